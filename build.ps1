@@ -11,9 +11,11 @@ Write-Host "Building Mandelbrot Computation Engine..." -ForegroundColor Cyan
 # Ensure lib directory exists
 New-Item -ItemType Directory -Force -Path "lib" | Out-Null
 
-# Compile with optimizations
+# Compile with optimizations. -ffp-contract=off keeps every multiply-add as
+# written (FMA only where the kernels ask for it), so results do not depend on
+# inlining or -march; deterministic rendering relies on this.
 $output = & gcc -shared -o lib/mandelbrot_compute.dll src/mandelbrot_compute.c `
-    -O3 -fopenmp -march=native -mavx2 -mfma -lquadmath 2>&1
+    -O3 -fopenmp -march=native -mavx2 -mfma -ffp-contract=off -lquadmath -pthread 2>&1
 
 if ($LASTEXITCODE -eq 0) {
     Write-Host "✓ Build successful!" -ForegroundColor Green
@@ -27,3 +29,29 @@ if ($LASTEXITCODE -eq 0) {
 # Check file size
 $dll = Get-Item "lib/mandelbrot_compute.dll"
 Write-Host "  Size: $([math]::Round($dll.Length / 1KB, 2)) KB" -ForegroundColor Gray
+
+# Native Python module (optional: needs the Python headers)
+$pyInclude = & python -c "import sysconfig; print(sysconfig.get_paths()['include'])" 2>$null
+$pySuffix = & python -c "import sysconfig; print(sysconfig.get_config_var('EXT_SUFFIX'))" 2>$null
+$pyLibDir = & python -c "import os, sys; print(os.path.join(sys.base_prefix, 'libs'))" 2>$null
+$pyLibName = & python -c "import sys; print('python%d%d' % sys.version_info[:2])" 2>$null
+
+if ($pyInclude -and (Test-Path (Join-Path $pyInclude "Python.h"))) {
+    Write-Host "Building native Python module..." -ForegroundColor Cyan
+    # Linked against the engine DLL rather than a copy of it, so the module
+    # and ctypes users in one process share its caches, tuning and metrics;
+    # Python finds the DLL next to the module
+    $output = & gcc -shared -o "lib/mandelbrot_native$pySuffix" src/mandelbrot_module.c lib/mandelbrot_compute.dll `
+        -I"$pyInclude" -L"$pyLibDir" -l"$pyLibName" -O3 -pthread 2>&1
+
+    if ($LASTEXITCODE -eq 0) {
+        Write-Host "✓ Build successful!" -ForegroundColor Green
+        Write-Host "  Output: lib/mandelbrot_native$pySuffix" -ForegroundColor Gray
+    } else {
+        Write-Host "✗ Build failed!" -ForegroundColor Red
+        Write-Host $output -ForegroundColor Red
+        exit 1
+    }
+} else {
+    Write-Host "  Skipping native Python module (Python.h not found)" -ForegroundColor Gray
+}
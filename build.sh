@@ -6,9 +6,11 @@ echo "Building Mandelbrot Computation Engine..."
 # Ensure lib directory exists
 mkdir -p lib
 
-# Compile with optimizations
+# Compile with optimizations. -ffp-contract=off keeps every multiply-add as
+# written (FMA only where the kernels ask for it), so results do not depend on
+# inlining or -march; deterministic rendering relies on this.
 gcc -shared -o lib/mandelbrot_compute.so src/mandelbrot_compute.c \
-    -O3 -fopenmp -march=native -mavx2 -mfma -lquadmath -fPIC
+    -O3 -fopenmp -march=native -mavx2 -mfma -ffp-contract=off -lquadmath -pthread -fPIC
 
 if [ $? -eq 0 ]; then
     echo "✓ Build successful!"
@@ -18,3 +20,26 @@ else
     echo "✗ Build failed!"
     exit 1
 fi
+
+# Native Python module (optional: needs the Python headers)
+PYTHON=${PYTHON:-python3}
+PY_INCLUDE=$($PYTHON -c "import sysconfig; print(sysconfig.get_paths()['include'])" 2>/dev/null)
+PY_SUFFIX=$($PYTHON -c "import sysconfig; print(sysconfig.get_config_var('EXT_SUFFIX'))" 2>/dev/null)
+
+if [ -n "$PY_INCLUDE" ] && [ -f "$PY_INCLUDE/Python.h" ]; then
+    echo "Building native Python module..."
+    # Linked against the engine above rather than a copy of it, so the module
+    # and ctypes users in one process share its caches, tuning and metrics
+    gcc -shared -o "lib/mandelbrot_native$PY_SUFFIX" src/mandelbrot_module.c \
+        -I"$PY_INCLUDE" -O3 -pthread -fPIC -Llib -l:mandelbrot_compute.so -Wl,-rpath,'$ORIGIN'
+
+    if [ $? -eq 0 ]; then
+        echo "✓ Build successful!"
+        echo "  Output: lib/mandelbrot_native$PY_SUFFIX"
+    else
+        echo "✗ Build failed!"
+        exit 1
+    fi
+else
+    echo "  Skipping native Python module (Python.h not found for $PYTHON)"
+fi
@@ -0,0 +1,182 @@
+"""
+Host Autotuner
+==============
+
+Benchmarks the engine's host-specific settings on a few representative views
+and writes the fastest to this host's tuning profile, which the engine loads
+whenever the library is loaded. The settings are the tile size, the number of
+render threads, how many groups of AVX2 lanes the double kernel interleaves
+and how often the perturbation loop tests for escapes. Each is searched in
+turn with the others held at their best so far. The per-iteration costs the
+STRATEGY_AUTO planner predicts frames with are measured last.
+
+Run it once per node: profiles are keyed by host name, so nodes sharing a home
+directory keep their own.
+
+Usage:
+    python src/autotune.py [--repeat 3] [--scale 1.0] [--out PATH] [--dry-run]
+"""
+
+import argparse
+import os
+import time
+
+import numpy as np
+
+from engine import Engine
+
+# (name, bounds, width, height, max_iter, precision mode)
+VIEWS = [
+    ("full set", ("-2.2", "1.2", "-1.3", "1.3"), 640, 480, 1000, 0),
+    ("seahorse valley", ("-0.75", "-0.74", "0.10", "0.11"), 480, 360, 2000, 0),
+    ("needle", ("-1.9999991175878805", "-1.9999991175868805",
+                "-0.000000000000375", "0.000000000000375"), 320, 240, 2000, 1),
+    ("deep spiral", ("-0.74364388703715920", "-0.74364388703714920",
+                     "0.13182590420530825", "0.13182590420531575"), 400, 300, 5000, 3),
+]
+
+TILE_SIZES = (16, 32, 64, 128, 256)
+
+
+def thread_candidates():
+    """0 (every core), then powers of two below the core count"""
+    cores = os.cpu_count() or 1
+    counts = [0]
+    n = cores // 2
+    while n >= 1:
+        counts.append(n)
+        n //= 2
+    return counts
+
+
+class Bench:
+    """Views prepared once, timed under whatever settings the engine has"""
+
+    def __init__(self, engine, repeat, scale):
+        self.engine = engine
+        self.repeat = repeat
+        self.views = []
+        for name, bounds, width, height, max_iter, mode in VIEWS:
+            width, height = max(16, int(width * scale)), max(16, int(height * scale))
+            view = engine.create_view(bounds, width, height, max_iter)
+            self.views.append((name, view, width, height, max_iter, mode))
+
+    def close(self):
+        for view in self.views:
+            self.engine.free_view(view[1])
+
+    def time_view(self, index):
+        """Best wall time of repeat renders, and the frame of the last"""
+        _, view, width, height, _, _ = self.views[index]
+        out = np.empty((height, width), dtype=np.float64)
+        best = float('inf')
+        for _ in range(self.repeat):
+            start = time.perf_counter()
+            self.engine.render_region(view, 0, 0, width, height, deterministic=False, out=out)
+            best = min(best, time.perf_counter() - start)
+        return best, out
+
+    def score(self, indices, baseline):
+        """Mean time relative to baseline over the given views"""
+        return sum(self.time_view(i)[0] / baseline[i] for i in indices) / len(indices)
+
+
+def search(engine, bench, profile, field, candidates, indices, baseline, log):
+    best_value, best_score = getattr(profile, field), None
+    for value in candidates:
+        setattr(profile, field, value)
+        engine.set_tuning(profile)
+        score = bench.score(indices, baseline)
+        log(f"  {field} = {value}: {score:.3f}")
+        if best_score is None or score < best_score:
+            best_value, best_score = value, score
+    setattr(profile, field, best_value)
+    engine.set_tuning(profile)
+    return best_value
+
+
+def reference_ns(engine, bounds, width, height, max_iter):
+    """Wall time per reference orbit iteration of a fresh perturbation view"""
+    def counters():
+        values = {}
+        for line in engine.metrics_text().splitlines():
+            if line and not line.startswith('#'):
+                name, value = line.rsplit(' ', 1)
+                values[name] = float(value)
+        return values
+    before = counters()
+    engine.free_view(engine.create_view(bounds, width, height, max_iter))
+    after = counters()
+    iterations = (after["mandelbrot_reference_iterations_total"] -
+                  before["mandelbrot_reference_iterations_total"])
+    seconds = (after["mandelbrot_orbit_build_duration_seconds_sum"] -
+               before["mandelbrot_orbit_build_duration_seconds_sum"])
+    return seconds * 1e9 / iterations if iterations > 0 else None
+
+
+def autotune(engine, repeat=3, scale=1.0, log=print):
+    """Search the settings and measure the cost model; returns the TuningProfile"""
+    engine.set_orbit_cache(None)  # Reference orbit timings must be real builds
+    profile = engine.tuning()
+    bench = Bench(engine, repeat, scale)
+    try:
+        baseline = [bench.time_view(i)[0] for i in range(len(bench.views))]
+        for (name, _, width, height, max_iter, mode), seconds in zip(bench.views, baseline):
+            log(f"{name}: {width}x{height}, {max_iter} iterations, mode {mode}, {seconds * 1000:.1f} ms")
+        every = list(range(len(bench.views)))
+        direct = [i for i, v in enumerate(bench.views) if v[5] == 0]
+        perturbation = [i for i, v in enumerate(bench.views) if v[5] == 3]
+
+        log("Double kernel interleave")
+        search(engine, bench, profile, "direct_groups", (2, 1), direct, baseline, log)
+        log("Perturbation escape interval")
+        search(engine, bench, profile, "escape_interval", (4, 8), perturbation, baseline, log)
+        log("Threads")
+        search(engine, bench, profile, "threads", thread_candidates(), every, baseline, log)
+        log("Tile size")
+        search(engine, bench, profile, "tile_size", TILE_SIZES, every, baseline, log)
+
+        # Cost model under the chosen settings: one thread's ns per iteration
+        threads = profile.threads or os.cpu_count() or 1
+        per_mode = {}
+        for i, (_, _, _, _, _, mode) in enumerate(bench.views):
+            seconds, frame = bench.time_view(i)
+            iterations = float(np.sum(np.abs(frame)))
+            per_mode.setdefault(mode, []).append(seconds * threads * 1e9 / iterations)
+        for mode, samples in per_mode.items():
+            profile.iteration_ns[mode] = float(np.median(samples))
+        _, _, width, height, max_iter, _ = bench.views[-1]
+        measured = reference_ns(engine, VIEWS[-1][1], width, height, max_iter)
+        if measured:
+            profile.reference_ns = measured
+        engine.set_tuning(profile)
+    finally:
+        bench.close()
+    return engine.tuning()
+
+
+def describe(profile):
+    return (f"tile_size={profile.tile_size} threads={profile.threads or 'all'} "
+            f"direct_groups={profile.direct_groups} escape_interval={profile.escape_interval} "
+            f"iteration_ns={[round(profile.iteration_ns[m], 3) for m in (0, 1, 3)]} "
+            f"reference_ns={profile.reference_ns:.0f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Tune the Mandelbrot engine for this host")
+    parser.add_argument('--repeat', type=int, default=3, help="renders per measurement (best counts)")
+    parser.add_argument('--scale', type=float, default=1.0, help="scale the benchmark frames")
+    parser.add_argument('--out', help="profile to write (default: this host's, see MANDELBROT_TUNING)")
+    parser.add_argument('--dry-run', action='store_true', help="report without writing a profile")
+    args = parser.parse_args()
+
+    engine = Engine()
+    start = time.perf_counter()
+    profile = autotune(engine, repeat=max(1, args.repeat), scale=args.scale)
+    print(f"Tuned in {time.perf_counter() - start:.1f}s: {describe(profile)}")
+    if not args.dry_run:
+        print(f"Wrote {engine.save_tuning(args.out)}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,342 @@
+"""
+Distributed Tile Rendering
+==========================
+
+A coordinator parses the view and builds the reference orbit and series
+approximation once, then ships them to worker processes, which render tiles
+of the frame through the same engine. Workers listen on TCP, so they can run
+on localhost for testing or on other nodes in production. Tiles held by a
+worker that dies are requeued on the survivors, and rendered locally if none
+is left.
+
+Tiles are rendered in deterministic mode by default, so the assembled frame is
+bitwise identical to a single-process deterministic render, without seams.
+
+Usage:
+    python src/distributed_render.py worker --port 5701 [--host 0.0.0.0]
+    python src/distributed_render.py render --workers node1:5701,node2:5701 \\
+        --view XMIN XMAX YMIN YMAX --size 16384 9216 --iter 20000 --out frame.npy
+    python src/distributed_render.py render --spawn 4 --view ... --out frame.npy
+
+Workers and coordinator must run the same engine build on the same
+architecture; workers reject views from incompatible builds.
+"""
+
+import argparse
+import collections
+import os
+import socket
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+import numpy as np
+
+from engine import FORMULA_BURNING_SHIP, FORMULA_MANDELBROT, FORMULA_MULTIBROT3, Engine
+
+# Message header: one type byte and the payload length
+HEADER = struct.Struct("<cQ")
+MSG_VIEW = b"V"    # Coordinator -> worker: exported view
+MSG_ACK = b"K"     # Worker -> coordinator: view accepted
+MSG_TILE = b"T"    # Coordinator -> worker: tile request
+MSG_RESULT = b"R"  # Worker -> coordinator: tile id and float64 pixels
+MSG_ERROR = b"E"   # Worker -> coordinator: UTF-8 message
+TILE = struct.Struct("<qiiii")  # id, x, y, width, height
+TILE_ID = struct.Struct("<q")
+
+
+def send_message(sock, kind, *parts):
+    payload = b"".join(parts)
+    sock.sendall(HEADER.pack(kind, len(payload)) + payload)
+
+
+def recv_exact(sock, size):
+    buf = bytearray(size)
+    view = memoryview(buf)
+    got = 0
+    while got < size:
+        n = sock.recv_into(view[got:])
+        if n == 0:
+            raise ConnectionError("peer closed the connection")
+        got += n
+    return buf
+
+
+def recv_message(sock):
+    kind, size = HEADER.unpack(recv_exact(sock, HEADER.size))
+    return kind, recv_exact(sock, size)
+
+
+# ---------------------------------------------------------------------------
+# Worker
+# ---------------------------------------------------------------------------
+
+class Worker:
+    """Serve tile requests; one view per connection, one render at a time"""
+
+    def __init__(self, host='127.0.0.1', port=0, max_tiles=0, engine=None):
+        self.engine = engine or Engine()
+        self.max_tiles = max_tiles  # Exit after this many tiles (0: never), for recycling
+        self.tiles_served = 0
+        self.render_lock = threading.Lock()  # The engine already uses every core
+        self.listener = socket.create_server((host, port))
+        self.address = self.listener.getsockname()[:2]
+
+    def serve_forever(self):
+        while True:
+            conn, _ = self.listener.accept()
+            conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            threading.Thread(target=self._serve_connection, args=(conn,), daemon=True).start()
+
+    def _serve_connection(self, conn):
+        view = None
+        try:
+            while True:
+                kind, payload = recv_message(conn)
+                if kind == MSG_VIEW:
+                    if view:
+                        self.engine.free_view(view)
+                        view = None
+                    try:
+                        view = self.engine.import_view(bytes(payload))
+                    except ValueError as e:
+                        send_message(conn, MSG_ERROR, str(e).encode('utf-8'))
+                        continue
+                    send_message(conn, MSG_ACK)
+                elif kind == MSG_TILE:
+                    if len(payload) != TILE.size:
+                        send_message(conn, MSG_ERROR, b"malformed tile request")
+                        continue
+                    tile_id, x, y, w, h = TILE.unpack(payload)
+                    if not view:
+                        send_message(conn, MSG_ERROR, b"tile requested before any view")
+                        continue
+                    width, height = self.engine.view_size(view)
+                    if w <= 0 or h <= 0 or x < 0 or y < 0 or x + w > width or y + h > height:
+                        send_message(conn, MSG_ERROR, b"tile outside the view")
+                        continue
+                    with self.render_lock:
+                        pixels = self.engine.render_region(view, x, y, w, h)
+                    send_message(conn, MSG_RESULT, TILE_ID.pack(tile_id), pixels.tobytes())
+                    self._count_tile()
+                else:
+                    send_message(conn, MSG_ERROR, b"unknown message type")
+        except (ConnectionError, OSError):
+            pass  # Coordinator went away
+        finally:
+            conn.close()
+            if view:
+                self.engine.free_view(view)
+
+    def _count_tile(self):
+        with self.render_lock:
+            self.tiles_served += 1
+            if self.max_tiles and self.tiles_served >= self.max_tiles:
+                # Like a crash, as far as coordinators can tell: no goodbye
+                os._exit(0)
+
+
+# ---------------------------------------------------------------------------
+# Coordinator
+# ---------------------------------------------------------------------------
+
+class WorkerLost(Exception):
+    pass
+
+
+class _TileQueue:
+    """Tiles still to render, shared by the links to every worker"""
+
+    def __init__(self, tiles):
+        self.pending = collections.deque(tiles)
+        self.remaining = len(self.pending)
+        self.cond = threading.Condition()
+
+    def take(self, block):
+        """Next tile, None when there is none to hand out (or all are done)"""
+        with self.cond:
+            while block and not self.pending and self.remaining > 0:
+                self.cond.wait()
+            return self.pending.popleft() if self.pending else None
+
+    def requeue(self, tiles):
+        with self.cond:
+            self.pending.extend(tiles)
+            self.cond.notify_all()
+
+    def finish(self):
+        with self.cond:
+            self.remaining -= 1
+            if self.remaining == 0:
+                self.cond.notify_all()
+
+
+def _run_link(address, blob, queue, output, depth, timeout, stats):
+    """Feed one worker until the frame is done or the worker is lost"""
+    in_flight = {}
+    try:
+        with socket.create_connection(address, timeout=timeout) as sock:
+            sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            send_message(sock, MSG_VIEW, blob)
+            kind, payload = recv_message(sock)
+            if kind != MSG_ACK:
+                raise WorkerLost(bytes(payload).decode('utf-8', 'replace'))
+
+            while True:
+                # Keep up to depth requests queued on the worker to hide latency
+                while len(in_flight) < depth:
+                    tile = queue.take(block=not in_flight)
+                    if tile is None:
+                        break
+                    in_flight[tile[0]] = tile
+                    send_message(sock, MSG_TILE, TILE.pack(*tile))
+                if not in_flight:
+                    return
+
+                # Anything but a result for a tile in flight, of the tile's size,
+                # means the worker cannot be trusted with the rest
+                kind, payload = recv_message(sock)
+                if kind != MSG_RESULT:
+                    raise WorkerLost(bytes(payload).decode('utf-8', 'replace'))
+                if len(payload) < TILE_ID.size:
+                    raise WorkerLost("truncated result")
+                (tile_id,) = TILE_ID.unpack_from(payload)
+                if tile_id not in in_flight:
+                    raise WorkerLost(f"result for tile {tile_id}, which it was not sent")
+                _, x, y, w, h = in_flight[tile_id]
+                if len(payload) != TILE_ID.size + w * h * 8:
+                    raise WorkerLost(f"result for tile {tile_id} has the wrong size")
+                del in_flight[tile_id]
+                pixels = np.frombuffer(payload, dtype=np.float64, offset=TILE_ID.size)
+                output[y:y + h, x:x + w] = pixels.reshape(h, w)
+                stats[address] = stats.get(address, 0) + 1
+                queue.finish()
+    except (OSError, ConnectionError, WorkerLost) as e:
+        print(f"[distributed] worker {address[0]}:{address[1]} lost ({e}); "
+              f"requeueing {len(in_flight)} tile(s)", file=sys.stderr)
+        queue.requeue(in_flight.values())
+
+
+def render_distributed(bounds, width, height, max_iter, workers, tile_size=256,
+                       deterministic=True, depth=2, timeout=300.0, engine=None,
+                       formula=FORMULA_MANDELBROT):
+    """Render a width x height frame of bounds (xmin, xmax, ymin, ymax) on workers.
+
+    workers is a list of (host, port). Returns the frame as a (height, width)
+    float64 array and the number of tiles each worker delivered.
+    """
+    if not deterministic:
+        raise ValueError("tiles from different processes only match in deterministic mode")
+    engine = engine or Engine()
+    view = engine.create_view(bounds, width, height, max_iter, formula)
+    try:
+        blob = engine.export_view(view)
+        output = np.full((height, width), np.nan)
+        tiles = []
+        for y in range(0, height, tile_size):
+            for x in range(0, width, tile_size):
+                tiles.append((len(tiles), x, y, min(tile_size, width - x), min(tile_size, height - y)))
+        queue = _TileQueue(tiles)
+        stats = {}
+
+        links = [threading.Thread(target=_run_link, daemon=True,
+                                  args=(tuple(addr), blob, queue, output, depth, timeout, stats))
+                 for addr in workers]
+        for link in links:
+            link.start()
+        for link in links:
+            link.join()
+
+        # Every worker is gone: finish here rather than fail the frame
+        leftover = 0
+        while True:
+            tile = queue.take(block=False)
+            if tile is None:
+                break
+            _, x, y, w, h = tile
+            engine.render_region(view, x, y, w, h, out=output[y:y + h, x:x + w])
+            queue.finish()
+            leftover += 1
+        if leftover:
+            stats['local'] = leftover
+        return output, stats
+    finally:
+        engine.free_view(view)
+
+
+def spawn_local_workers(count, max_tiles=0):
+    """Start count worker processes on free localhost ports; returns (processes, addresses)"""
+    procs, addresses = [], []
+    for _ in range(count):
+        cmd = [sys.executable, os.path.abspath(__file__), 'worker', '--port', '0']
+        if max_tiles:
+            cmd += ['--max-tiles', str(max_tiles)]
+        proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, text=True)
+        line = proc.stdout.readline().split()  # "listening HOST PORT"
+        if len(line) != 3 or line[0] != 'listening':
+            proc.kill()
+            raise RuntimeError("worker failed to start")
+        procs.append(proc)
+        addresses.append((line[1], int(line[2])))
+    return procs, addresses
+
+
+def parse_address(text):
+    host, _, port = text.rpartition(':')
+    return (host or '127.0.0.1', int(port))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Distributed Mandelbrot tile rendering")
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    w = sub.add_parser('worker', help="serve tiles")
+    w.add_argument('--host', default='127.0.0.1', help="interface to listen on (0.0.0.0 for all)")
+    w.add_argument('--port', type=int, default=5701, help="0 picks a free port")
+    w.add_argument('--max-tiles', type=int, default=0, help="exit after serving this many tiles")
+
+    r = sub.add_parser('render', help="coordinate a render")
+    r.add_argument('--workers', default='', help="comma-separated host:port list")
+    r.add_argument('--spawn', type=int, default=0, help="also start this many local workers")
+    r.add_argument('--view', nargs=4, required=True, metavar=('XMIN', 'XMAX', 'YMIN', 'YMAX'))
+    r.add_argument('--size', nargs=2, type=int, required=True, metavar=('WIDTH', 'HEIGHT'))
+    r.add_argument('--iter', type=int, default=1000)
+    r.add_argument('--formula', type=int, default=FORMULA_MANDELBROT,
+                   choices=(FORMULA_MANDELBROT, FORMULA_MULTIBROT3, FORMULA_BURNING_SHIP),
+                   help="0 z^2+c, 1 z^3+c, 2 Burning Ship")
+    r.add_argument('--tile-size', type=int, default=256)
+    r.add_argument('--out', required=True, help="output .npy file")
+    r.add_argument('--orbit-cache', help="directory to reuse reference orbits from")
+
+    args = parser.parse_args()
+    if args.command == 'worker':
+        worker = Worker(args.host, args.port, args.max_tiles)
+        print(f"listening {worker.address[0]} {worker.address[1]}", flush=True)
+        worker.serve_forever()
+        return
+
+    workers = [parse_address(a) for a in args.workers.split(',') if a]
+    procs = []
+    if args.spawn:
+        procs, spawned = spawn_local_workers(args.spawn)
+        workers += spawned
+    try:
+        engine = Engine()
+        if args.orbit_cache:
+            os.makedirs(args.orbit_cache, exist_ok=True)
+            engine.set_orbit_cache(args.orbit_cache)
+        start = time.perf_counter()
+        frame, stats = render_distributed(args.view, args.size[0], args.size[1], args.iter,
+                                          workers, tile_size=args.tile_size, engine=engine,
+                                          formula=args.formula)
+        print(f"Rendered {args.size[0]}x{args.size[1]} in {time.perf_counter() - start:.2f}s: {stats}")
+        np.save(args.out, frame)
+    finally:
+        for proc in procs:
+            proc.kill()
+
+
+if __name__ == '__main__':
+    main()
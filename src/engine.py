@@ -0,0 +1,261 @@
+"""
+Engine Bindings
+===============
+
+ctypes bindings for the view-handle API of the compiled engine
+(lib/mandelbrot_compute.so or .dll), shared by the distributed renderer, the
+tile server, the job spooler, the autotuner and the benchmarks. The structures
+mirror those of mandelbrot_compute.h field for field.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+# Iterations of RenderOptions.formula and Engine.create_view (FORMULA_* in mandelbrot_compute.h)
+FORMULA_MANDELBROT = 0
+FORMULA_MULTIBROT3 = 1
+FORMULA_BURNING_SHIP = 2
+
+# Subsystems of MemoryUsage (MEMORY_* in mandelbrot_compute.h)
+MEMORY_ORBIT = 0
+MEMORY_CACHE = 1
+MEMORY_SCRATCH = 2
+MEMORY_STAGING = 3
+
+
+class RenderOptions(ctypes.Structure):
+    _fields_ = [
+        ("focus_x", ctypes.c_int),
+        ("focus_y", ctypes.c_int),
+        ("tile_size", ctypes.c_int),
+        ("tile_done", ctypes.POINTER(ctypes.c_ubyte)),
+        ("progress", ctypes.c_void_p),
+        ("roi_x", ctypes.c_int),
+        ("roi_y", ctypes.c_int),
+        ("roi_width", ctypes.c_int),
+        ("roi_height", ctypes.c_int),
+        ("row_pitch", ctypes.c_longlong),
+        ("pixel_stride", ctypes.c_longlong),
+        ("deterministic", ctypes.c_int),
+        ("formula", ctypes.c_int),
+        ("aux", ctypes.POINTER(ctypes.c_double) * 4),
+        ("stripe_density", ctypes.c_int),
+        ("trace", ctypes.c_void_p),
+        ("strategy", ctypes.c_int),
+        ("plan", ctypes.c_void_p),
+    ]
+
+
+class TuningProfile(ctypes.Structure):
+    _fields_ = [
+        ("tile_size", ctypes.c_int),
+        ("threads", ctypes.c_int),
+        ("direct_groups", ctypes.c_int),
+        ("escape_interval", ctypes.c_int),
+        ("iteration_ns", ctypes.c_double * 4),
+        ("reference_ns", ctypes.c_double),
+    ]
+
+
+class MemoryUsage(ctypes.Structure):
+    _fields_ = [
+        ("bytes", ctypes.c_longlong * 4),
+        ("peak", ctypes.c_longlong * 4),
+        ("total", ctypes.c_longlong),
+        ("total_peak", ctypes.c_longlong),
+        ("budget", ctypes.c_longlong),
+        ("refused", ctypes.c_longlong),
+        ("evictions", ctypes.c_longlong),
+        ("streamed", ctypes.c_longlong),
+    ]
+
+
+class PrecisionChoice(ctypes.Structure):
+    _fields_ = [
+        ("mode", ctypes.c_int),
+        ("reason", ctypes.c_int),
+        ("magnitude", ctypes.c_double),
+        ("spacing", ctypes.c_double),
+        ("bits_needed", ctypes.c_double),
+    ]
+
+
+class Engine:
+    """ctypes bindings for the view-handle part of the engine"""
+
+    def __init__(self, lib_path=None):
+        if lib_path is None:
+            name = 'mandelbrot_compute.dll' if os.name == 'nt' else 'mandelbrot_compute.so'
+            script_dir = os.path.dirname(os.path.abspath(__file__))
+            lib_path = os.path.join(os.path.dirname(script_dir), 'lib', name)
+        lib = self.lib = ctypes.CDLL(lib_path)
+
+        lib.render_view_create.argtypes = [
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+            ctypes.c_longlong
+        ]
+        lib.render_view_create.restype = ctypes.c_void_p
+        lib.render_view_create_ex.argtypes = [
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+            ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+            ctypes.c_longlong
+        ]
+        lib.render_view_create_ex.restype = ctypes.c_void_p
+        lib.render_view_free.argtypes = [ctypes.c_void_p]
+        lib.render_view_free.restype = None
+        lib.render_view_size.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+        lib.render_view_size.restype = None
+        lib.render_view_precision.argtypes = [ctypes.c_void_p, ctypes.POINTER(PrecisionChoice)]
+        lib.render_view_precision.restype = None
+        lib.render_view_export.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_longlong]
+        lib.render_view_export.restype = ctypes.c_longlong
+        lib.render_view_import.argtypes = [ctypes.c_char_p, ctypes.c_longlong]
+        lib.render_view_import.restype = ctypes.c_void_p
+        lib.render_view_render.argtypes = [
+            ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.POINTER(RenderOptions)
+        ]
+        lib.render_view_render.restype = None
+        lib.render_view_save.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+        lib.render_view_save.restype = ctypes.c_int
+        lib.render_view_open.argtypes = [ctypes.c_char_p]
+        lib.render_view_open.restype = ctypes.c_void_p
+        lib.render_set_orbit_cache.argtypes = [ctypes.c_char_p]
+        lib.render_set_orbit_cache.restype = None
+        lib.render_metrics_format.argtypes = [ctypes.c_char_p, ctypes.c_longlong]
+        lib.render_metrics_format.restype = ctypes.c_longlong
+        lib.render_tuning_get.argtypes = [ctypes.POINTER(TuningProfile)]
+        lib.render_tuning_get.restype = None
+        lib.render_tuning_set.argtypes = [ctypes.POINTER(TuningProfile)]
+        lib.render_tuning_set.restype = ctypes.c_int
+        lib.render_tuning_default_path.argtypes = [ctypes.c_char_p, ctypes.c_longlong]
+        lib.render_tuning_default_path.restype = ctypes.c_longlong
+        lib.render_tuning_save.argtypes = [ctypes.c_char_p]
+        lib.render_tuning_save.restype = ctypes.c_int
+        lib.render_memory_usage.argtypes = [ctypes.POINTER(MemoryUsage)]
+        lib.render_memory_usage.restype = None
+        lib.render_memory_set_budget.argtypes = [ctypes.c_longlong]
+        lib.render_memory_set_budget.restype = None
+        lib.render_memory_reserve.argtypes = [ctypes.c_int, ctypes.c_longlong]
+        lib.render_memory_reserve.restype = ctypes.c_int
+        lib.render_memory_release.argtypes = [ctypes.c_int, ctypes.c_longlong]
+        lib.render_memory_release.restype = None
+
+    def create_view(self, bounds, width, height, max_iter, formula=FORMULA_MANDELBROT, julia=None):
+        """Parse a view; julia=(re, im) shows the Julia set of that c instead"""
+        xmin, xmax, ymin, ymax = (str(b).encode('utf-8') for b in bounds)
+        julia_r, julia_i = (str(j).encode('utf-8') for j in julia) if julia else (None, None)
+        view = self.lib.render_view_create_ex(xmin, xmax, width, ymin, ymax, height,
+                                              julia_r, julia_i, formula, max_iter)
+        if not view:
+            raise MemoryError("could not build the view")
+        return view
+
+    def free_view(self, view):
+        self.lib.render_view_free(view)
+
+    def view_size(self, view):
+        """(width, height) of view's frame in pixels"""
+        width, height = ctypes.c_int(), ctypes.c_int()
+        self.lib.render_view_size(view, ctypes.byref(width), ctypes.byref(height))
+        return width.value, height.value
+
+    def precision(self, view):
+        """PrecisionChoice of view: its mode and why it was chosen"""
+        choice = PrecisionChoice()
+        self.lib.render_view_precision(view, ctypes.byref(choice))
+        return choice
+
+    def export_view(self, view):
+        size = self.lib.render_view_export(view, None, 0)
+        blob = ctypes.create_string_buffer(size)
+        self.lib.render_view_export(view, blob, size)
+        return blob.raw
+
+    def import_view(self, blob):
+        view = self.lib.render_view_import(blob, len(blob))
+        if not view:
+            raise ValueError("view blob is corrupt or from an incompatible engine build")
+        return view
+
+    def save_view(self, view, path):
+        if not self.lib.render_view_save(view, os.fsencode(path)):
+            raise OSError(f"could not write {path}")
+
+    def open_view(self, path):
+        """Map a view file read-only; the orbit is used in place"""
+        view = self.lib.render_view_open(os.fsencode(path))
+        if not view:
+            raise ValueError(f"{path} is not a view file from a compatible engine build")
+        return view
+
+    def set_orbit_cache(self, directory):
+        """Reuse reference orbits stored in directory (None turns the cache off)"""
+        self.lib.render_set_orbit_cache(os.fsencode(directory) if directory else None)
+
+    def metrics_text(self):
+        """Process-wide engine counters in the Prometheus text format"""
+        size = self.lib.render_metrics_format(None, 0)
+        while True:
+            text = ctypes.create_string_buffer(size)
+            needed = self.lib.render_metrics_format(text, size)
+            if needed <= size:  # Counters may have grown a digit in between
+                return text.value.decode()
+            size = needed
+
+    def tuning(self):
+        """The engine's current TuningProfile"""
+        profile = TuningProfile()
+        self.lib.render_tuning_get(ctypes.byref(profile))
+        return profile
+
+    def set_tuning(self, profile):
+        """Use profile from now on; False when some fields were out of range and defaulted"""
+        return bool(self.lib.render_tuning_set(ctypes.byref(profile)))
+
+    def tuning_path(self):
+        """This host's profile file, which the engine loads at startup ('' for none)"""
+        size = self.lib.render_tuning_default_path(None, 0)
+        path = ctypes.create_string_buffer(size)
+        self.lib.render_tuning_default_path(path, size)
+        return os.fsdecode(path.value)
+
+    def save_tuning(self, path=None):
+        """Write the current settings as a profile, by default this host's"""
+        path = path or self.tuning_path()
+        if not path:
+            raise OSError("MANDELBROT_TUNING is empty: no profile path")
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        if not self.lib.render_tuning_save(os.fsencode(path)):
+            raise OSError(f"could not write {path}")
+        return path
+
+    def memory_usage(self):
+        """The engine's MemoryUsage: bytes held and peaks by MEMORY_* subsystem, and the budget"""
+        usage = MemoryUsage()
+        self.lib.render_memory_usage(ctypes.byref(usage))
+        return usage
+
+    def set_memory_budget(self, limit):
+        """Hard limit on engine memory in bytes (None or 0 for none)"""
+        self.lib.render_memory_set_budget(int(limit or 0))
+
+    def reserve_memory(self, subsystem, size):
+        """Charge size bytes the caller holds to subsystem; False when over the budget"""
+        return bool(self.lib.render_memory_reserve(subsystem, size))
+
+    def release_memory(self, subsystem, size):
+        self.lib.render_memory_release(subsystem, size)
+
+    def render_region(self, view, x, y, width, height, deterministic=True, out=None):
+        """Render pixels [x, x + width) x [y, y + height) of view into out (or a new array)"""
+        if out is None:
+            out = np.empty((height, width), dtype=np.float64)
+        options = RenderOptions(-1, -1, 0, None, None, x, y, width, height,
+                                out.strides[0] // 8, out.strides[1] // 8, int(deterministic))
+        self.lib.render_view_render(view, out.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                                    ctypes.byref(options))
+        return out
@@ -5,17 +5,55 @@
  * Uses double, long double (80-bit), or __float128 (128-bit) depending on zoom depth.
  */
 
+#include <float.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <quadmath.h>
 #include <immintrin.h>
+#include "mandelbrot_compute.h"
+#include <pthread.h>
+#include <time.h>
 
 #ifdef _WIN32
-    #define EXPORT __declspec(dllexport)
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
 #else
-    #define EXPORT
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/resource.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+#ifdef __linux__
+    #include <sys/syscall.h>
+#endif
+
+// USDT probes of provider "mandelbrot" for bpftrace, perf and SystemTap. Each
+// is a single nop until a tracer attaches; without <sys/sdt.h> they compile to
+// nothing. See README for the list.
+#if defined(__has_include)
+    #if __has_include(<sys/sdt.h>)
+        #include <sys/sdt.h>
+        #define HAVE_USDT 1
+    #endif
+#endif
+#ifdef HAVE_USDT
+    #define PROBE2(name, a, b) DTRACE_PROBE2(mandelbrot, name, a, b)
+    #define PROBE3(name, a, b, c) DTRACE_PROBE3(mandelbrot, name, a, b, c)
+    #define PROBE4(name, a, b, c, d) DTRACE_PROBE4(mandelbrot, name, a, b, c, d)
+#else
+    #define PROBE2(name, a, b) ((void)0)
+    #define PROBE3(name, a, b, c) ((void)0)
+    #define PROBE4(name, a, b, c, d) ((void)0)
+#endif
+
+#ifdef _OPENMP
+    #include <omp.h>
 #endif
 
 // Typedefs
@@ -26,139 +64,933 @@ typedef __float128 Real128;
 #define STRTOREAL80(s) strtold(s, NULL)
 #define STRTOREAL128(s) strtoflt128(s, NULL)
 
-static inline double mandelbrot_point_smooth_double(double cr, double ci, int max_iter) {
-    double zr = 0.0;
-    double zi = 0.0;
-    double zr2 = 0.0;
-    double zi2 = 0.0;
-    
+static inline double wall_time(void) {
+#ifdef _OPENMP
+    return omp_get_wtime();
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Monotonic nanoseconds for trace timestamps
+static inline long long monotonic_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER now, frequency;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&frequency);
+    return (long long)((double)now.QuadPart * 1.0e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// Uniform double in [0, 1), a pure function of (seed, sample, k), so every
+// thread, band and tile draws the same c for the same sample
+static inline double sample_random(unsigned long long seed, long long sample, int k) {
+    unsigned long long x = seed + ((unsigned long long)sample * 3 + k + 1) * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (double)(x >> 11) * 0x1.0p-53;
+}
+
+// Natural logarithm from basic IEEE operations only. libm's log may differ in
+// the last bit between library versions and CPU-specific variants, which
+// deterministic renders cannot allow.
+static inline double stable_log(double x) {
+    int e;
+    double m = frexp(x, &e); // Exact: x = m * 2^e, m in [0.5, 1)
+    if (m < 0.70710678118654752440) {
+        m *= 2.0;
+        e--;
+    }
+    // log(m) = 2 atanh(s) with |s| < 0.172, so 12 odd terms reach full precision
+    double s = (m - 1.0) / (m + 1.0);
+    double s2 = s * s;
+    double p = 1.0 / 23.0;
+    p = p * s2 + 1.0 / 21.0;
+    p = p * s2 + 1.0 / 19.0;
+    p = p * s2 + 1.0 / 17.0;
+    p = p * s2 + 1.0 / 15.0;
+    p = p * s2 + 1.0 / 13.0;
+    p = p * s2 + 1.0 / 11.0;
+    p = p * s2 + 1.0 / 9.0;
+    p = p * s2 + 1.0 / 7.0;
+    p = p * s2 + 1.0 / 5.0;
+    p = p * s2 + 1.0 / 3.0;
+    p = p * s2 + 1.0;
+    return e * 0.69314718055994530942 + 2.0 * s * p;
+}
+
+// ---------------------------------------------------------------------------
+// Formulas
+// ---------------------------------------------------------------------------
+//
+// Each formula is written once, in FORMULA_STEP, FORMULA_PERTURB and
+// FORMULA_DERIV, against an abstract arithmetic O providing O##_ADD, O##_SUB,
+// O##_MUL, O##_NEG, O##_ABS, O##_SET (a constant), O##_FMA (a * b + c),
+// O##_FNMA (c - a * b), O##_DIV, O##_SQRT and O##_SELECT (a where t >= 0,
+// else b). SCALAR works on double, long double and __float128 through the C
+// operators; AVX works on four doubles per __m256d.
+//
+// Kernels take the formula as an argument and are always inlined; the
+// dispatchers (render_span, evaluate_point_chunk) call them once per formula
+// with a constant, so every formula gets its own copy of the direct, SIMD and
+// perturbation loops with the case analysis folded away.
+
+#define KERNEL static inline __attribute__((always_inline))
+
+#define SCALAR_ADD(a, b) ((a) + (b))
+#define SCALAR_SUB(a, b) ((a) - (b))
+#define SCALAR_MUL(a, b) ((a) * (b))
+#define SCALAR_NEG(a) (-(a))
+#define SCALAR_ABS(a) ((a) < 0 ? -(a) : (a))
+#define SCALAR_SET(x) (x)
+#define SCALAR_FMA(a, b, c) fma(a, b, c)
+#define SCALAR_FNMA(a, b, c) fma(-(a), b, c)
+#define SCALAR_DIV(a, b) ((a) / (b))
+#define SCALAR_SQRT(a) sqrt(a)
+#define SCALAR_SELECT(t, a, b) ((t) >= 0 ? (a) : (b))
+
+#define AVX_ADD(a, b) _mm256_add_pd(a, b)
+#define AVX_SUB(a, b) _mm256_sub_pd(a, b)
+#define AVX_MUL(a, b) _mm256_mul_pd(a, b)
+#define AVX_NEG(a) _mm256_xor_pd(a, _mm256_set1_pd(-0.0))
+#define AVX_ABS(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), a)
+#define AVX_SET(x) _mm256_set1_pd(x)
+#define AVX_FMA(a, b, c) _mm256_fmadd_pd(a, b, c)
+#define AVX_FNMA(a, b, c) _mm256_fnmadd_pd(a, b, c)
+#define AVX_DIV(a, b) _mm256_div_pd(a, b)
+#define AVX_SQRT(a) _mm256_sqrt_pd(a)
+#define AVX_SELECT(t, a, b) _mm256_blendv_pd(b, a, _mm256_cmp_pd(t, _mm256_setzero_pd(), _CMP_GE_OQ))
+
+// (nr, ni) = f(z) + c. zr2 and zi2 hold zr^2 and zi^2, which every kernel
+// keeps for its escape test anyway.
+#define FORMULA_STEP(O, f, zr, zi, zr2, zi2, cr, ci, nr, ni) do { \
+    switch (f) { \
+    case FORMULA_MULTIBROT3: /* z^3 = x (x^2 - 3 y^2) + i y (3 x^2 - y^2) */ \
+        nr = O##_ADD(O##_MUL(zr, O##_SUB(zr2, O##_MUL(O##_SET(3.0), zi2))), cr); \
+        ni = O##_ADD(O##_MUL(zi, O##_SUB(O##_MUL(O##_SET(3.0), zr2), zi2)), ci); \
+        break; \
+    case FORMULA_BURNING_SHIP: /* (|x| + i |y|)^2 = x^2 - y^2 + 2 i |x y| */ \
+        nr = O##_ADD(O##_SUB(zr2, zi2), cr); \
+        ni = O##_ADD(O##_ABS(O##_MUL(O##_MUL(O##_SET(2.0), zr), zi)), ci); \
+        break; \
+    default: \
+        nr = O##_ADD(O##_SUB(zr2, zi2), cr); \
+        ni = O##_ADD(O##_MUL(O##_MUL(O##_SET(2.0), zr), zi), ci); \
+        break; \
+    } \
+} while (0)
+
+// (nr, ni) = f(Z + dz) - f(Z) + dc for the reference point Z = X + iY, in
+// terms of the small delta only so nothing cancels. dzr2 and dzi2 hold dzr^2
+// and dzi^2.
+#define FORMULA_PERTURB(O, f, X, Y, dzr, dzi, dzr2, dzi2, dcr, dci, nr, ni) do { \
+    switch (f) { \
+    case FORMULA_MULTIBROT3: { /* dz (3 Z^2 + dz (3 Z + dz)) + dc */ \
+        __typeof__(dzr) wr_ = O##_FMA(O##_SET(3.0), X, dzr); \
+        __typeof__(dzr) wi_ = O##_FMA(O##_SET(3.0), Y, dzi); \
+        __typeof__(dzr) qr_ = O##_FMA(O##_SET(3.0), O##_MUL(O##_SUB(X, Y), O##_ADD(X, Y)), \
+                                      O##_FNMA(dzi, wi_, O##_MUL(dzr, wr_))); \
+        __typeof__(dzr) qi_ = O##_FMA(O##_SET(6.0), O##_MUL(X, Y), \
+                                      O##_FMA(dzi, wr_, O##_MUL(dzr, wi_))); \
+        nr = O##_FMA(dzr, qr_, O##_FNMA(dzi, qi_, dcr)); \
+        ni = O##_FMA(dzr, qi_, O##_FMA(dzi, qr_, dci)); \
+        break; \
+    } \
+    case FORMULA_BURNING_SHIP: { \
+        /* Real part as for z^2; the imaginary part is 2 (|XY + d| - |XY|) + dci with \
+           d = X dzi + dzr (Y + dzi), split by the signs of XY and XY + d */ \
+        nr = O##_FMA(O##_MUL(O##_SET(2.0), X), dzr, \
+                     O##_FNMA(O##_MUL(O##_SET(2.0), Y), dzi, O##_ADD(O##_SUB(dzr2, dzi2), dcr))); \
+        __typeof__(dzr) xy_ = O##_MUL(X, Y); \
+        __typeof__(dzr) d_ = O##_FMA(X, dzi, O##_MUL(dzr, O##_ADD(Y, dzi))); \
+        __typeof__(dzr) s_ = O##_ADD(xy_, d_); \
+        __typeof__(dzr) t_ = O##_FMA(O##_SET(2.0), xy_, d_); \
+        __typeof__(dzr) da_ = O##_SELECT(xy_, O##_SELECT(s_, d_, O##_NEG(t_)), \
+                                              O##_SELECT(s_, t_, O##_NEG(d_))); \
+        ni = O##_FMA(O##_SET(2.0), da_, dci); \
+        break; \
+    } \
+    default: { /* 2 Z dz + dz^2 + dc */ \
+        __typeof__(dzr) two_x_ = O##_MUL(O##_SET(2.0), X); \
+        __typeof__(dzr) two_y_ = O##_MUL(O##_SET(2.0), Y); \
+        __typeof__(dzr) sq_r_ = O##_ADD(O##_SUB(dzr2, dzi2), dcr); \
+        __typeof__(dzr) sq_i_ = O##_ADD(O##_MUL(O##_SET(2.0), O##_MUL(dzr, dzi)), dci); \
+        nr = O##_FMA(two_x_, dzr, O##_FNMA(two_y_, dzi, sq_r_)); \
+        ni = O##_FMA(two_x_, dzi, O##_FMA(two_y_, dzr, sq_i_)); \
+        break; \
+    } \
+    } \
+} while (0)
+
+// (nr, ni) = f'(z) (dr + i di) + one: the derivative dz/dc carried one step,
+// or dz/dz0 for a Julia set with one = 0. The Burning Ship's fold is not
+// complex-differentiable; its Jacobian is applied to the derivative along the
+// real axis.
+#define FORMULA_DERIV(O, f, zr, zi, zr2, zi2, dr, di, one, nr, ni) do { \
+    switch (f) { \
+    case FORMULA_MULTIBROT3: { /* 3 z^2 */ \
+        __typeof__(dr) ar_ = O##_MUL(O##_SET(3.0), O##_SUB(zr2, zi2)); \
+        __typeof__(dr) ai_ = O##_MUL(O##_SET(6.0), O##_MUL(zr, zi)); \
+        nr = O##_ADD(O##_SUB(O##_MUL(ar_, dr), O##_MUL(ai_, di)), one); \
+        ni = O##_ADD(O##_MUL(ar_, di), O##_MUL(ai_, dr)); \
+        break; \
+    } \
+    case FORMULA_BURNING_SHIP: { /* rows (2x, -2y) and sign(xy) (2y, 2x) */ \
+        nr = O##_ADD(O##_MUL(O##_SET(2.0), O##_SUB(O##_MUL(zr, dr), O##_MUL(zi, di))), one); \
+        __typeof__(dr) t_ = O##_MUL(O##_SET(2.0), O##_ADD(O##_MUL(zi, dr), O##_MUL(zr, di))); \
+        ni = O##_SELECT(O##_MUL(zr, zi), t_, O##_NEG(t_)); \
+        break; \
+    } \
+    default: /* 2 z */ \
+        nr = O##_ADD(O##_MUL(O##_SET(2.0), O##_SUB(O##_MUL(zr, dr), O##_MUL(zi, di))), one); \
+        ni = O##_MUL(O##_SET(2.0), O##_ADD(O##_MUL(zr, di), O##_MUL(zi, dr))); \
+        break; \
+    } \
+} while (0)
+
+// ---------------------------------------------------------------------------
+// Auxiliary planes
+// ---------------------------------------------------------------------------
+//
+// With RenderOptions.aux set, the loops also track, per pixel, the least
+// |z|^2, the sum of stripe terms and the derivative, and keep z and the
+// derivative at escape. Kernels take the span's planes as aux, plane p of
+// pixel k at aux[p * AUX_PITCH + k], or NULL; the dispatchers pass a constant
+// NULL when no plane is wanted, so that specialisation of the loops is the
+// one without aux.
+
+// Pixels evaluated per span, and the distance between the planes of a span:
+// a padded SIMD group may write a few lanes past the end of a full span
+#define SPAN_CHUNK 256
+#define AUX_PITCH (SPAN_CHUNK + 8)
+
+#define DEFAULT_STRIPE_DENSITY 5
+
+// 1/2 + 1/2 sin(k arg z) for |z|^2 = modulus, as the imaginary part of
+// (z / |z|)^k, so the loops need no trigonometry. z = 0 gives 1/2.
+#define STRIPE_TERM(O, zr, zi, modulus, k, term) do { \
+    __typeof__(zr) inv_ = O##_DIV(O##_SET(1.0), O##_SQRT(O##_ADD(modulus, O##_SET(1e-300)))); \
+    __typeof__(zr) ur_ = O##_MUL(zr, inv_); \
+    __typeof__(zr) ui_ = O##_MUL(zi, inv_); \
+    __typeof__(zr) pr_ = ur_; \
+    __typeof__(zr) pi_ = ui_; \
+    for (int j_ = 1; j_ < (k); j_++) { \
+        __typeof__(zr) qr_ = O##_SUB(O##_MUL(pr_, ur_), O##_MUL(pi_, ui_)); \
+        pi_ = O##_ADD(O##_MUL(pr_, ui_), O##_MUL(pi_, ur_)); \
+        pr_ = qr_; \
+    } \
+    term = O##_ADD(O##_SET(0.5), O##_MUL(O##_SET(0.5), pi_)); \
+} while (0)
+
+// Write the planes of one pixel. stripe sums terms stripe terms, the latest
+// being last; an escaped pixel (smooth >= 0) blends the averages with and
+// without it by the fraction of its smooth count, so stripes do not band.
+static inline void finish_aux(
+    double* aux, double smooth, long long terms, double trap, double stripe, double last,
+    double zr, double zi, double dr, double di
+) {
+    double mean = terms > 0 ? stripe / terms : 0.5;
+    if (smooth >= 0.0 && terms > 1) {
+        double previous = (stripe - last) / (terms - 1);
+        mean = previous + (mean - previous) * (smooth - floor(smooth));
+    }
+    aux[AUX_ANGLE * AUX_PITCH] = atan2(zi, zr);
+    aux[AUX_STRIPE * AUX_PITCH] = mean;
+    aux[AUX_TRAP * AUX_PITCH] = sqrt(trap);
+    aux[AUX_DERIVATIVE * AUX_PITCH] = hypot(dr, di);
+}
+
+// Smooth iteration count of a point that escaped at iteration iter with
+// |z|^2 = modulus; the outer logarithm is to the base of the formula's degree.
+// Deterministic renders avoid libm.
+static inline double smooth_count(int formula, long long iter, double modulus, int deterministic) {
+    const double log_2 = 0.69314718055994530942;
+    const double log_degree = formula == FORMULA_MULTIBROT3 ? 1.09861228866810969140 : log_2;
+    if (deterministic) return iter + 1.0 - stable_log(stable_log(modulus) / log_2) / log_degree;
+    return iter + 1.0 - log(log(modulus) / log_2) / log_degree;
+}
+
+// |z|^2 past which the direct kernels and the perturbation kernels call a
+// point escaped; the smooth count depends on it
+#define DIRECT_BAILOUT 256.0
+#define PERTURBATION_BAILOUT 4.0
+
+// Iterate z -> f(z) + c from z until |z| > 16; the smooth escape count, or
+// -max_iter if z stays bounded. Mandelbrot pixels start at z = 0, Julia pixels
+// at their own position. One body for each precision of the direct modes.
+// aux, if not NULL, receives the pixel's auxiliary planes.
+#define DEFINE_ESCAPE_SMOOTH(name, Real) \
+KERNEL double name(int formula, Real zr, Real zi, Real cr, Real ci, long long max_iter, int deterministic, \
+                   double* aux, int julia, int stripe_density) { \
+    Real zr2 = zr * zr; \
+    Real zi2 = zi * zi; \
+    double dr = julia ? 1.0 : 0.0, di = 0.0, trap = INFINITY, stripe = 0.0, last = 0.0; \
+    for (long long i = 0; i < max_iter; i++) { \
+        if (aux && i > 0) { \
+            double zr_d = (double)zr, zi_d = (double)zi, modulus = (double)(zr2 + zi2); \
+            if (modulus < trap) trap = modulus; \
+            STRIPE_TERM(SCALAR, zr_d, zi_d, modulus, stripe_density, last); \
+            stripe += last; \
+        } \
+        if (zr2 + zi2 > DIRECT_BAILOUT) { \
+            double value = smooth_count(formula, i, (double)(zr2 + zi2), deterministic); \
+            if (aux) finish_aux(aux, value, i, trap, stripe, last, (double)zr, (double)zi, dr, di); \
+            return value; \
+        } \
+        if (aux) { \
+            double ndr, ndi; \
+            FORMULA_DERIV(SCALAR, formula, (double)zr, (double)zi, (double)zr2, (double)zi2, \
+                          dr, di, julia ? 0.0 : 1.0, ndr, ndi); \
+            dr = ndr; \
+            di = ndi; \
+        } \
+        Real nr, ni; \
+        FORMULA_STEP(SCALAR, formula, zr, zi, zr2, zi2, cr, ci, nr, ni); \
+        zr = nr; \
+        zi = ni; \
+        zr2 = zr * zr; \
+        zi2 = zi * zi; \
+    } \
+    if (aux) finish_aux(aux, -max_iter, max_iter - 1, trap, stripe, last, (double)zr, (double)zi, dr, di); \
+    return -max_iter; \
+}
+
+DEFINE_ESCAPE_SMOOTH(escape_smooth_double, double)
+DEFINE_ESCAPE_SMOOTH(escape_smooth_long, Real80)
+DEFINE_ESCAPE_SMOOTH(escape_smooth_quad, Real128) // Accuracy audits only: software arithmetic
+
+// Main cardioid of z^2 + c, where every point is bounded
+static inline int in_main_cardioid(double cr, double ci) {
     double q = (cr - 0.25) * (cr - 0.25) + ci * ci;
-    if (q * (q + (cr - 0.25)) < 0.25 * ci * ci) return -max_iter;
+    return q * (q + (cr - 0.25)) < 0.25 * ci * ci;
+}
+
+KERNEL double mandelbrot_point_smooth_double(int formula, double cr, double ci, long long max_iter, int deterministic) {
+    if (formula == FORMULA_MANDELBROT && in_main_cardioid(cr, ci)) return -max_iter;
     
-    int i = 0;
-    const double escape = 256.0;
-    const double log_2 = 0.6931471805599453;
+    return escape_smooth_double(formula, 0.0, 0.0, cr, ci, max_iter, deterministic, NULL, 0, 0);
+}
+
+KERNEL double mandelbrot_point_smooth_long(int formula, Real80 cr, Real80 ci, long long max_iter, int deterministic) {
+    if (formula == FORMULA_MANDELBROT && in_main_cardioid((double)cr, (double)ci)) return -max_iter;
     
-    for (; i < max_iter; i++) {
-        if (zr2 + zi2 > escape) {
-            double modulus = zr2 + zi2;
-            return i + 1.0 - log(log(modulus) / log_2) / log_2;
+    return escape_smooth_long(formula, 0.0, 0.0, cr, ci, max_iter, deterministic, NULL, 0, 0);
+}
+
+// 4 * groups escape_smooth_double() runs side by side: groups of four AVX2
+// lanes, interleaved so one group's multiplies fill the other's latency. Each
+// lane does the same operations in the same order as the scalar loop, escape
+// test every iteration included, so it returns the scalar result bit for bit
+// whatever the number of groups (1 or 2, a constant at each call site).
+// (re[k], im[k]) is c for the Mandelbrot set and z0 for a Julia set of c = (jr, ji).
+// With aux the cardioid shortcut is off, so bounded pixels get their planes.
+#define DIRECT_GROUPS 2 // Default of TuningProfile.direct_groups
+#define DIRECT_LANES 8  // Lanes of the widest block
+
+KERNEL void escape_block_double(
+    int formula, int groups, const double* re, const double* im, int julia, double jr, double ji,
+    long long max_iter, int deterministic, double* out, double* aux, int stripe_density
+) {
+    const int lanes = 4 * groups;
+    long long start[DIRECT_LANES];
+    for (int k = 0; k < lanes; k++) {
+        int interior = !aux && !julia && formula == FORMULA_MANDELBROT && in_main_cardioid(re[k], im[k]);
+        start[k] = interior ? 0 : -1;
+    }
+
+    const __m256d const_escape = _mm256_set1_pd(DIRECT_BAILOUT);
+    const __m256d vone = _mm256_set1_pd(julia ? 0.0 : 1.0);
+    __m256d vzr[2], vzi[2], vzr2[2], vzi2[2], vcr[2], vci[2], vmodulus[2];
+    __m256d vtrap[2], vstripe[2], vlast[2], vdr[2], vdi[2], vfzr[2], vfzi[2], vfdr[2], vfdi[2];
+    __m256i vmask[2], viter[2];
+    for (int g = 0; g < groups; g++) {
+        vmask[g] = _mm256_loadu_si256((const __m256i*)(start + 4 * g));
+        vzr[g] = julia ? _mm256_loadu_pd(re + 4 * g) : _mm256_setzero_pd();
+        vzi[g] = julia ? _mm256_loadu_pd(im + 4 * g) : _mm256_setzero_pd();
+        vcr[g] = julia ? _mm256_set1_pd(jr) : _mm256_loadu_pd(re + 4 * g);
+        vci[g] = julia ? _mm256_set1_pd(ji) : _mm256_loadu_pd(im + 4 * g);
+        vzr2[g] = _mm256_mul_pd(vzr[g], vzr[g]);
+        vzi2[g] = _mm256_mul_pd(vzi[g], vzi[g]);
+        viter[g] = _mm256_setzero_si256();
+        vmodulus[g] = _mm256_setzero_pd();
+        if (aux) {
+            vtrap[g] = _mm256_set1_pd(INFINITY);
+            vstripe[g] = vlast[g] = vdi[g] = _mm256_setzero_pd();
+            vdr[g] = _mm256_set1_pd(julia ? 1.0 : 0.0);
+            vfzr[g] = vfzi[g] = vfdr[g] = vfdi[g] = _mm256_setzero_pd();
+        }
+    }
+
+    for (long long i = 0; i < max_iter; i++) {
+        __m256i active = groups == 2 ? _mm256_or_si256(vmask[0], vmask[1]) : vmask[0];
+        if (_mm256_testz_si256(active, _mm256_set1_epi64x(-1))) break;
+        const __m256i vi = _mm256_set1_epi64x(i);
+        for (int g = 0; g < groups; g++) {
+            __m256d vmod = _mm256_add_pd(vzr2[g], vzi2[g]);
+            if (aux && i > 0) {
+                __m256d active = _mm256_castsi256_pd(vmask[g]);
+                __m256d term;
+                STRIPE_TERM(AVX, vzr[g], vzi[g], vmod, stripe_density, term);
+                vtrap[g] = _mm256_blendv_pd(vtrap[g], _mm256_min_pd(vtrap[g], vmod), active);
+                vstripe[g] = _mm256_add_pd(vstripe[g], _mm256_and_pd(active, term));
+                vlast[g] = _mm256_blendv_pd(vlast[g], term, active);
+            }
+            __m256i newly_escaped = _mm256_and_si256(vmask[g], _mm256_castpd_si256(_mm256_cmp_pd(vmod, const_escape, _CMP_GT_OQ)));
+            viter[g] = _mm256_blendv_epi8(viter[g], vi, newly_escaped);
+            vmodulus[g] = _mm256_blendv_pd(vmodulus[g], vmod, _mm256_castsi256_pd(newly_escaped));
+            vmask[g] = _mm256_andnot_si256(newly_escaped, vmask[g]);
+            if (aux) {
+                __m256d escaped = _mm256_castsi256_pd(newly_escaped);
+                vfzr[g] = _mm256_blendv_pd(vfzr[g], vzr[g], escaped);
+                vfzi[g] = _mm256_blendv_pd(vfzi[g], vzi[g], escaped);
+                vfdr[g] = _mm256_blendv_pd(vfdr[g], vdr[g], escaped);
+                vfdi[g] = _mm256_blendv_pd(vfdi[g], vdi[g], escaped);
+                __m256d ndr, ndi;
+                FORMULA_DERIV(AVX, formula, vzr[g], vzi[g], vzr2[g], vzi2[g], vdr[g], vdi[g], vone, ndr, ndi);
+                vdr[g] = ndr;
+                vdi[g] = ndi;
+            }
+
+            __m256d nr, ni;
+            FORMULA_STEP(AVX, formula, vzr[g], vzi[g], vzr2[g], vzi2[g], vcr[g], vci[g], nr, ni);
+            vzr[g] = nr;
+            vzi[g] = ni;
+            vzr2[g] = _mm256_mul_pd(vzr[g], vzr[g]);
+            vzi2[g] = _mm256_mul_pd(vzi[g], vzi[g]);
+        }
+    }
+
+    // Escaped lanes: active at the start, not any more
+    long long iters[DIRECT_LANES];
+    long long still[DIRECT_LANES];
+    double mods[DIRECT_LANES];
+    for (int g = 0; g < groups; g++) {
+        _mm256_storeu_si256((__m256i*)(iters + 4 * g), viter[g]);
+        _mm256_storeu_si256((__m256i*)(still + 4 * g), vmask[g]);
+        _mm256_storeu_pd(mods + 4 * g, vmodulus[g]);
+    }
+    for (int k = 0; k < lanes; k++) {
+        if (!start[k] || still[k]) {
+            out[k] = -max_iter;
+        } else {
+            out[k] = smooth_count(formula, iters[k], mods[k], deterministic);
+        }
+    }
+
+    if (aux) {
+        // Bounded lanes end where the loop left them
+        double trap[DIRECT_LANES], stripe[DIRECT_LANES], last[DIRECT_LANES];
+        double fzr[DIRECT_LANES], fzi[DIRECT_LANES], fdr[DIRECT_LANES], fdi[DIRECT_LANES];
+        for (int g = 0; g < groups; g++) {
+            __m256d bounded = _mm256_castsi256_pd(vmask[g]);
+            _mm256_storeu_pd(trap + 4 * g, vtrap[g]);
+            _mm256_storeu_pd(stripe + 4 * g, vstripe[g]);
+            _mm256_storeu_pd(last + 4 * g, vlast[g]);
+            _mm256_storeu_pd(fzr + 4 * g, _mm256_blendv_pd(vfzr[g], vzr[g], bounded));
+            _mm256_storeu_pd(fzi + 4 * g, _mm256_blendv_pd(vfzi[g], vzi[g], bounded));
+            _mm256_storeu_pd(fdr + 4 * g, _mm256_blendv_pd(vfdr[g], vdr[g], bounded));
+            _mm256_storeu_pd(fdi + 4 * g, _mm256_blendv_pd(vfdi[g], vdi[g], bounded));
+        }
+        for (int k = 0; k < lanes; k++) {
+            long long terms = still[k] ? max_iter - 1 : iters[k];
+            finish_aux(aux + k, out[k], terms, trap[k], stripe[k], last[k], fzr[k], fzi[k], fdr[k], fdi[k]);
         }
-        zi = 2.0 * zr * zi + ci;
-        zr = zr2 - zi2 + cr;
-        zr2 = zr * zr;
-        zi2 = zi * zi;
     }
-    return -max_iter;
 }
 
-static inline double mandelbrot_point_smooth_long(Real80 cr, Real80 ci, int max_iter) {
-    Real80 zr = 0.0;
-    Real80 zi = 0.0;
-    Real80 zr2 = 0.0;
-    Real80 zi2 = 0.0;
-    
-    double cr_d = (double)cr;
-    double ci_d = (double)ci;
-    double q = (cr_d - 0.25) * (cr_d - 0.25) + ci_d * ci_d;
-    if (q * (q + (cr_d - 0.25)) < 0.25 * ci_d * ci_d) return -max_iter;
-    
-    int i = 0;
-    const Real80 escape = 256.0;
-    const double log_2 = 0.6931471805599453;
-    
-    for (; i < max_iter; i++) {
-        if (zr2 + zi2 > escape) {
-            double modulus = (double)(zr2 + zi2);
-            return i + 1.0 - log(log(modulus) / log_2) / log_2;
+// Bits kept beyond those that tell neighbouring pixels apart: rounding errors
+// grow along the orbit, and the accuracy audit shows double glitching about
+// ten bits before the pixel spacing reaches its last place
+#define PRECISION_GUARD_BITS 10
+
+// Cheapest direct kernel whose mantissa resolves the pixel spacing relative to
+// the magnitude of the coordinates, perturbation beyond long double. Orbits of
+// z^2 + c near the origin stay near the origin, so the magnitude is that of the
+// view itself, or of c for a Julia set. A zero height considers x alone.
+static int pick_precision(
+    Real128 xmin, Real128 xmax, Real128 ymin, Real128 ymax, int width, int height,
+    const Real128* julia_c, PrecisionChoice* choice
+) {
+    double spacing = (double)((xmax - xmin) / width);
+    if (height > 0) spacing = fmin(spacing, (double)((ymax - ymin) / height));
+    double magnitude = hypot(fmax(fabs((double)xmin), fabs((double)xmax)),
+                             fmax(fabs((double)ymin), fabs((double)ymax)));
+    if (julia_c) magnitude = fmax(magnitude, hypot((double)julia_c[0], (double)julia_c[1]));
+
+    // Degenerate views keep the old answer for a zero width: perturbation
+    double bits = spacing > 0.0 ? log2(fmax(magnitude, spacing) / spacing) + PRECISION_GUARD_BITS : INFINITY;
+    PrecisionChoice c;
+    if (bits <= DBL_MANT_DIG) {
+        c.mode = 0;
+        c.reason = PRECISION_DOUBLE_FITS;
+    } else if (bits <= LDBL_MANT_DIG) {
+        c.mode = 1; // Never where long double is plain double
+        c.reason = PRECISION_DOUBLE_TOO_COARSE;
+    } else {
+        c.mode = 3;
+        c.reason = PRECISION_LONG_DOUBLE_TOO_COARSE;
+    }
+    c.magnitude = magnitude;
+    c.spacing = spacing;
+    c.bits_needed = bits;
+    if (choice) *choice = c;
+    return c.mode;
+}
+
+// Mode for a view of width pixels across [xmin, xmax], from the x range alone.
+// get_precision_mode_ex() also weighs the y range, as renders do.
+EXPORT int get_precision_mode(const char* xmin_str, const char* xmax_str, int width) {
+    return pick_precision(STRTOREAL128(xmin_str), STRTOREAL128(xmax_str), 0.0Q, 0.0Q, width, 0, NULL, NULL);
+}
+
+// Mode a Mandelbrot render of this view uses, and why; choice may be NULL
+EXPORT int get_precision_mode_ex(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    PrecisionChoice* choice
+) {
+    return pick_precision(STRTOREAL128(xmin_str), STRTOREAL128(xmax_str),
+                          STRTOREAL128(ymin_str), STRTOREAL128(ymax_str), width, height, NULL, choice);
+}
+
+static inline void set_progress_phase(RenderProgress* progress, int phase) {
+    if (progress) __atomic_store_n(&progress->phase, phase, __ATOMIC_RELAXED);
+}
+
+// ---------------------------------------------------------------------------
+// Render timelines
+// ---------------------------------------------------------------------------
+
+// Spans a RenderTrace records
+#define TRACE_RENDER 0
+#define TRACE_SETUP 1
+#define TRACE_ORBIT_LOAD 2
+#define TRACE_REFERENCE_ORBIT 3
+#define TRACE_SERIES_APPROX 4
+#define TRACE_AUX_SETUP 5
+#define TRACE_TILE 6
+#define TRACE_PLAN 7
+#define TRACE_SPAN_COUNT 8
+
+static const struct {
+    const char* name;
+    const char* args[4]; // Names of the span's arguments, NULL past the last
+} trace_spans[TRACE_SPAN_COUNT] = {
+    [TRACE_RENDER] = {"render", {"width", "height"}},
+    [TRACE_SETUP] = {"setup", {"mode"}},
+    [TRACE_ORBIT_LOAD] = {"orbit cache load", {"iterations"}},
+    [TRACE_REFERENCE_ORBIT] = {"reference orbit", {"iterations"}},
+    [TRACE_SERIES_APPROX] = {"series approximation", {"skip"}},
+    [TRACE_AUX_SETUP] = {"auxiliary planes setup", {NULL}},
+    [TRACE_TILE] = {"tile", {"x", "y", "width", "height"}},
+    [TRACE_PLAN] = {"frame plan", {"mode", "tile_size", "predicted_us", "alternative_us"}},
+};
+
+typedef struct {
+    long long start_ns, end_ns; // From the trace's creation
+    int span;                   // TRACE_*
+    long long args[4];
+} TraceEvent;
+
+// Events of one OS thread, which claims the track the first time it records
+// a span and is the only one to append to it. OpenMP thread numbers would not
+// do: a refine job's team and the caller's team both have a thread 0.
+typedef struct {
+    long long owner;   // OS thread id, 0 while the track is free
+    TraceEvent* events; // Allocated by the owner when it claims the track
+    long long count;   // Slots claimed, possibly past capacity
+} __attribute__((aligned(64))) TraceThread;
+
+struct RenderTrace {
+    long long capacity; // Events per thread
+    long long epoch_ns;
+    long long untracked; // Spans of threads that found no track or no memory for one
+    TraceThread threads[MAX_PROGRESS_THREADS];
+};
+
+// OS id of the calling thread, which keys and names its trace track
+static long long current_thread_id(void) {
+    static __thread long long id;
+    if (!id) {
+        #ifdef _WIN32
+        id = (long long)GetCurrentThreadId();
+        #elif defined(__linux__)
+        id = (long long)syscall(SYS_gettid);
+        #else
+        id = (long long)(uintptr_t)pthread_self();
+        #endif
+    }
+    return id;
+}
+
+static void* memory_alloc(int subsystem, size_t bytes);
+
+// The calling thread's track, claimed on first use; NULL when every track
+// belongs to another thread or the event buffer cannot be allocated. Tracks
+// are never released, so probing stops at the first free one. Event buffers
+// are charged to MEMORY_SCRATCH until the trace is freed.
+static TraceThread* trace_track(RenderTrace* trace) {
+    const long long self = current_thread_id();
+    const int first = (int)(((unsigned long long)self * 0x9E3779B97F4A7C15ULL) >> 56) % MAX_PROGRESS_THREADS;
+    for (int k = 0; k < MAX_PROGRESS_THREADS; k++) {
+        TraceThread* t = &trace->threads[(first + k) % MAX_PROGRESS_THREADS];
+        long long owner = __atomic_load_n(&t->owner, __ATOMIC_ACQUIRE);
+        if (owner == 0 &&
+            __atomic_compare_exchange_n(&t->owner, &owner, self, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            t->events = (TraceEvent*)memory_alloc(MEMORY_SCRATCH, sizeof(TraceEvent) * (size_t)trace->capacity);
+            return t->events ? t : NULL;
         }
-        zi = 2.0 * zr * zi + ci;
-        zr = zr2 - zi2 + cr;
-        zr2 = zr * zr;
-        zi2 = zi * zi;
+        if (owner == self) return t->events ? t : NULL; // Else taken, perhaps just now
     }
-    return -max_iter;
+    return NULL;
 }
 
-static inline double mandelbrot_point_smooth_quad(Real128 cr, Real128 ci, int max_iter) {
-    Real128 zr = 0.0Q;
-    Real128 zi = 0.0Q;
-    Real128 zr2 = 0.0Q;
-    Real128 zi2 = 0.0Q;
-    
-    double cr_d = (double)cr;
-    double ci_d = (double)ci;
-    double q = (cr_d - 0.25) * (cr_d - 0.25) + ci_d * ci_d;
-    if (q * (q + (cr_d - 0.25)) < 0.25 * ci_d * ci_d) return -max_iter;
-    
-    int i = 0;
-    const Real128 escape = 256.0Q;
-    const double log_2 = 0.6931471805599453;
-    
-    for (; i < max_iter; i++) {
-        if (zr2 + zi2 > escape) {
-            double modulus = (double)(zr2 + zi2);
-            return i + 1.0 - log(log(modulus) / log_2) / log_2;
+static inline long long trace_start(const RenderTrace* trace) {
+    return trace ? monotonic_ns() : 0;
+}
+
+// Close a span opened by trace_start() on the calling thread. Spans past the
+// thread's capacity, or of a thread without a track, are dropped and counted.
+static void trace_end(RenderTrace* trace, int span, long long start_ns,
+                      long long a0, long long a1, long long a2, long long a3) {
+    if (!trace) return;
+    long long end_ns = monotonic_ns();
+    TraceThread* t = trace_track(trace);
+    if (!t) {
+        __atomic_fetch_add(&trace->untracked, 1LL, __ATOMIC_RELAXED);
+        return;
+    }
+    long long i = __atomic_fetch_add(&t->count, 1LL, __ATOMIC_RELAXED);
+    if (i >= trace->capacity) return;
+
+    TraceEvent* e = &t->events[i];
+    e->start_ns = start_ns - trace->epoch_ns;
+    e->end_ns = end_ns - trace->epoch_ns;
+    e->span = span;
+    e->args[0] = a0;
+    e->args[1] = a1;
+    e->args[2] = a2;
+    e->args[3] = a3;
+}
+
+// ---------------------------------------------------------------------------
+// Process-wide metrics
+// ---------------------------------------------------------------------------
+
+// Upper bounds of the latency buckets in seconds, +Inf after the last
+static const double latency_bounds[METRICS_LATENCY_BUCKETS - 1] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+typedef struct {
+    long long count;
+    long long sum_ns;
+    long long buckets[METRICS_LATENCY_BUCKETS];
+} LatencyCounters;
+
+// Cumulative since the library was loaded, updated with relaxed atomics
+static struct {
+    long long renders[4];
+    long long pixels;
+    long long iterations;
+    long long reference_iterations;
+    long long series_skipped_iterations;
+    long long orbit_cache_hits;
+    long long orbit_cache_misses;
+    LatencyCounters render_seconds;
+    LatencyCounters orbit_build_seconds;
+} g_metrics;
+
+static void observe_latency(LatencyCounters* h, double seconds) {
+    int b = 0;
+    while (b < METRICS_LATENCY_BUCKETS - 1 && seconds > latency_bounds[b]) b++;
+    __atomic_fetch_add(&h->buckets[b], 1LL, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, (long long)(seconds * 1.0e9), __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1LL, __ATOMIC_RELAXED);
+}
+
+static inline void count_metric(long long* counter, long long amount) {
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+static void record_render(int mode, double seconds) {
+    count_metric(&g_metrics.renders[mode & 3], 1);
+    observe_latency(&g_metrics.render_seconds, seconds);
+}
+
+// ---------------------------------------------------------------------------
+// Host tuning
+// ---------------------------------------------------------------------------
+
+#define ESCAPE_INTERVAL 4 // Default of TuningProfile.escape_interval, and that of deterministic renders
+
+// Settings of this host (render_tuning_*), from its profile when the library
+// finds one. The cost model seeds are measurements on an AVX2 desktop; every
+// STRATEGY_AUTO render moves them a quarter of the way towards what it
+// measured, so predictions settle on the speed of this host either way.
+static TuningProfile g_tuning = {
+    DEFAULT_TILE_SIZE, 0, DIRECT_GROUPS, ESCAPE_INTERVAL, { 0.6, 6.0, 0.0, 2.5 }, 300.0
+};
+
+static inline int tuned_direct_groups(void) {
+    return __atomic_load_n(&g_tuning.direct_groups, __ATOMIC_RELAXED);
+}
+
+// OpenMP threads a render runs on
+static inline int render_threads(void) {
+    int threads = __atomic_load_n(&g_tuning.threads, __ATOMIC_RELAXED);
+    if (threads > 0) return threads;
+    #ifdef _OPENMP
+    return omp_get_max_threads();
+    #else
+    return 1;
+    #endif
+}
+
+// ---------------------------------------------------------------------------
+// Memory accounting
+// ---------------------------------------------------------------------------
+
+// Bytes held by subsystem, updated with relaxed atomics (render_memory_usage)
+static struct {
+    long long bytes[MEMORY_SUBSYSTEMS];
+    long long peak[MEMORY_SUBSYSTEMS];
+    long long total, total_peak;
+    long long budget; // 0 for none
+    long long refused, evictions, streamed;
+} g_memory;
+
+static long long evict_caches(void);
+
+static inline void raise_peak(long long* peak, long long value) {
+    long long seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (value > seen &&
+           !__atomic_compare_exchange_n(peak, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Account bytes to subsystem. Past the budget the caches are evicted first;
+// if that does not make room nothing is charged and 0 is returned. Callers
+// must not hold the cost history or sampling map locks, which eviction takes.
+static int memory_charge(int subsystem, long long bytes) {
+    for (int evicted = 0; ; evicted = 1) {
+        long long budget = __atomic_load_n(&g_memory.budget, __ATOMIC_RELAXED);
+        long long total = __atomic_add_fetch(&g_memory.total, bytes, __ATOMIC_RELAXED);
+        if (budget <= 0 || total <= budget || bytes <= 0) {
+            raise_peak(&g_memory.peak[subsystem],
+                       __atomic_add_fetch(&g_memory.bytes[subsystem], bytes, __ATOMIC_RELAXED));
+            raise_peak(&g_memory.total_peak, total);
+            return 1;
+        }
+        __atomic_sub_fetch(&g_memory.total, bytes, __ATOMIC_RELAXED);
+        if (evicted || evict_caches() == 0) {
+            count_metric(&g_memory.refused, 1);
+            return 0;
         }
-        zi = 2.0Q * zr * zi + ci;
-        zr = zr2 - zi2 + cr;
-        zr2 = zr * zr;
-        zi2 = zi * zi;
     }
-    return -max_iter;
 }
 
-EXPORT int get_precision_mode(const char* xmin_str, const char* xmax_str, int width) {
-    Real128 xmin = STRTOREAL128(xmin_str);
-    Real128 xmax = STRTOREAL128(xmax_str);
-    Real128 w = xmax - xmin;
-    
-    if (w > 1.0e-13Q) return 0; // double
-    if (w > 1.0e-18Q) return 1; // long double (extended range)
-    return 3; // Perturbation (Quad reference + Double delta)
+static inline void memory_uncharge(int subsystem, long long bytes) {
+    __atomic_sub_fetch(&g_memory.bytes[subsystem], bytes, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&g_memory.total, bytes, __ATOMIC_RELAXED);
+}
+
+// Blocks carry their size and subsystem in a header ahead of the 64-byte
+// aligned payload, so memory_free needs neither
+#define MEMORY_HEADER 64
+
+static void* memory_alloc(int subsystem, size_t bytes) {
+    size_t block_bytes = bytes + MEMORY_HEADER;
+    if (!memory_charge(subsystem, (long long)block_bytes)) return NULL;
+    char* block = (char*)_mm_malloc(block_bytes, 64);
+    if (!block) {
+        memory_uncharge(subsystem, (long long)block_bytes);
+        return NULL;
+    }
+    size_t* header = (size_t*)block;
+    header[0] = block_bytes;
+    header[1] = (size_t)subsystem;
+    return block + MEMORY_HEADER;
+}
+
+static void memory_free(void* p) {
+    if (!p) return;
+    char* block = (char*)p - MEMORY_HEADER;
+    const size_t* header = (const size_t*)block;
+    memory_uncharge((int)header[1], (long long)header[0]);
+    _mm_free(block);
+}
+
+// Reference orbit plus Series Approximation data shared by every pixel
+typedef struct {
+    double* refs_r_d; // Reference orbit rounded to double, ref_iter points or more
+    double* refs_i_d;
+    long long ref_iter;
+    long long skip_iter;
+    double Br;
+    double Bi;
+    Real128 center_r, center_i, dx_q, dy_q; // What the orbit was built for
+    int formula;
+    int julia;
+    Real128 julia_r, julia_i;
+    const void* mapping; // File the double orbit lives in, if mapped
+    size_t mapping_size;
+} ReferenceOrbit;
+
+// Everything a tile needs to evaluate its pixels, resolved once per render
+struct RenderView {
+    int mode; // Same codes as get_precision_mode()
+    int width;
+    int height;
+    long long max_iter;
+    int deterministic; // Same arithmetic for every pixel whatever its lane, tile or thread
+    int formula; // FORMULA_*, fixed when the view is set up
+    int julia; // Julia set of c = julia_r + i julia_i: pixels give z0 rather than c
+    double xmin_d, ymin_d, dx_d, dy_d;
+    Real80 xmin_l, ymin_l, dx_l, dy_l;
+    double julia_r_d, julia_i_d;
+    Real80 julia_r_l, julia_i_l;
+    ReferenceOrbit orbit;
+    double ref_shift_x, ref_shift_y; // Reference pixel minus (width / 2, height / 2); 0 but in coarse views
+    RenderProgress* progress; // NULL when nobody is watching
+    RenderTrace* trace;       // NULL when not tracing
+    int aux; // Also fill the auxiliary planes (set per render, see prepare_aux)
+    int stripe_density;
+    double aux_trap0, aux_stripe0; // Trap and stripe sum of the iterations the series approximation skips
+};
+
+// Deterministic renders keep the default, since the interval decides where
+// an escape is seen and every host must see it in the same place
+static inline int tuned_escape_interval(const RenderView* v) {
+    return v->deterministic ? ESCAPE_INTERVAL : __atomic_load_n(&g_tuning.escape_interval, __ATOMIC_RELAXED);
+}
+
+// A rectangle of pixels [x0, x1) x [y0, y1) dispatched as one unit of work
+typedef struct {
+    int x0, y0, x1, y1;
+    long long index; // Row-major position in the tile grid
+    double dist2; // Squared distance from the focus point
+} Tile;
+
+// Where pixels land in the caller's buffer: pixel (px, py) of the view goes to
+// base[(py - y0) * row_pitch + (px - x0) * stride], (x0, y0) being the top-left
+// corner of the region being rendered. Pitch and stride count doubles.
+// Auxiliary planes, where requested, share the layout.
+typedef struct {
+    double* base;
+    long long row_pitch;
+    long long stride;
+    int x0, y0;
+    double* aux[AUX_PLANES];
+} OutputLayout;
+
+static inline double* layout_pixel(const OutputLayout* out, int px, int py) {
+    return out->base + (py - out->y0) * out->row_pitch + (long long)(px - out->x0) * out->stride;
+}
+
+// Sub-rectangle [x0, x1) x [y0, y1) of the view requested by the caller
+typedef struct {
+    int x0, y0, x1, y1;
+} Region;
+
+// Tightly packed width-wide frame, the layout of the plain entry points
+static inline OutputLayout dense_layout(double* output, int width) {
+    OutputLayout out = { .base = output, .row_pitch = width, .stride = 1, .x0 = 0, .y0 = 0, .aux = { NULL } };
+    return out;
+}
+
+static void unmap_file(const void* data, size_t size);
+
+static void free_reference_orbit(ReferenceOrbit* orbit) {
+    if (orbit->mapping) {
+        unmap_file(orbit->mapping, orbit->mapping_size);
+        memory_uncharge(MEMORY_ORBIT, (long long)orbit->mapping_size);
+    } else {
+        memory_free(orbit->refs_r_d);
+        memory_free(orbit->refs_i_d);
+    }
+    memset(orbit, 0, sizeof(*orbit));
+}
+
+// Orbit points allocated at first when the whole orbit does not fit the memory budget
+#define ORBIT_CHUNK 65536
+
+// Move the orbit to arrays of capacity points, keeping its first count.
+// Returns 0, with the orbit untouched, when they cannot be allocated.
+static int resize_orbit(ReferenceOrbit* orbit, size_t capacity, size_t count) {
+    double* refs_r_d = (double*)memory_alloc(MEMORY_ORBIT, sizeof(double) * capacity);
+    double* refs_i_d = refs_r_d ? (double*)memory_alloc(MEMORY_ORBIT, sizeof(double) * capacity) : NULL;
+    if (!refs_i_d) {
+        memory_free(refs_r_d);
+        return 0;
+    }
+    if (count > 0) {
+        memcpy(refs_r_d, orbit->refs_r_d, sizeof(double) * count);
+        memcpy(refs_i_d, orbit->refs_i_d, sizeof(double) * count);
+    }
+    memory_free(orbit->refs_r_d);
+    memory_free(orbit->refs_i_d);
+    orbit->refs_r_d = refs_r_d;
+    orbit->refs_i_d = refs_i_d;
+    return 1;
 }
 
-// Perturbation theory implementation
-static void compute_mandelbrot_perturbation(
+// Perturbation theory: reference orbit and Series Approximation
+// For a Julia set the reference starts at the centre and adds the fixed c;
+// the approximation then tracks dz_n = A_n dz_0 with A_0 = 1, A_{n+1} = f'(Z_n) A_n.
+static int build_reference_orbit(
+    ReferenceOrbit* orbit,
     Real128 center_r, Real128 center_i,
     Real128 dx, Real128 dy,
-    int width, int height, int max_iter,
-    double* output
+    int formula, int julia, Real128 julia_r, Real128 julia_i,
+    int width, int height, long long max_iter,
+    RenderProgress* progress, RenderTrace* trace
 ) {
+    long long orbit_start = trace_start(trace);
+    double build_start = wall_time();
+
     // 1. Compute reference orbit
     // We allocate on heap to avoid stack overflow with large max_iter
-    // Using aligned memory for better cache performance
-    Real128* refs_r = (Real128*)_mm_malloc(sizeof(Real128) * (max_iter + 1), 64);
-    Real128* refs_i = (Real128*)_mm_malloc(sizeof(Real128) * (max_iter + 1), 64);
-    
-    if (!refs_r || !refs_i) {
-        if (refs_r) _mm_free(refs_r);
-        if (refs_i) _mm_free(refs_i);
-        return; // Allocation failed
-    }
-    
-    // Pre-allocate double arrays to avoid repeated casts in inner loop
-    double* refs_r_d = (double*)_mm_malloc(sizeof(double) * (max_iter + 1), 64);
-    double* refs_i_d = (double*)_mm_malloc(sizeof(double) * (max_iter + 1), 64);
-    
-    if (!refs_r_d || !refs_i_d) {
-        _mm_free(refs_r);
-        _mm_free(refs_i);
-        if (refs_r_d) _mm_free(refs_r_d);
-        if (refs_i_d) _mm_free(refs_i_d);
-        return; // Allocation failed
+    // Using aligned memory for better cache performance. Only the double
+    // rounding is kept: the kernels and the series approximation read nothing else.
+    // When the memory budget refuses the whole orbit up front, the arrays
+    // start at ORBIT_CHUNK points and double as the orbit proceeds.
+    memset(orbit, 0, sizeof(*orbit));
+    size_t orbit_len = (size_t)max_iter + 1;
+    size_t capacity = orbit_len;
+    if (!resize_orbit(orbit, capacity, 0)) {
+        capacity = orbit_len < ORBIT_CHUNK ? orbit_len : ORBIT_CHUNK;
+        if (!resize_orbit(orbit, capacity, 0)) return 0; // Allocation failed
+        count_metric(&g_memory.streamed, 1);
     }
+    double* refs_r_d = orbit->refs_r_d;
+    double* refs_i_d = orbit->refs_i_d;
 
-    Real128 zr = 0.0Q;
-    Real128 zi = 0.0Q;
-    Real128 zr2 = 0.0Q;
-    Real128 zi2 = 0.0Q;
+    Real128 zr = julia ? center_r : 0.0Q;
+    Real128 zi = julia ? center_i : 0.0Q;
+    Real128 zr2 = zr * zr;
+    Real128 zi2 = zi * zi;
+    Real128 cr = julia ? julia_r : center_r;
+    Real128 ci = julia ? julia_i : center_i;
     
-    int ref_iter = max_iter;
+    long long ref_iter = max_iter;
     
-    for (int i = 0; i < max_iter; i++) {
-        refs_r[i] = zr;
-        refs_i[i] = zi;
+    for (long long i = 0; i < max_iter; i++) {
+        if ((size_t)i == capacity) {
+            size_t grown = 2 * capacity < orbit_len ? 2 * capacity : orbit_len;
+            if (!resize_orbit(orbit, grown, capacity)) {
+                free_reference_orbit(orbit);
+                return 0; // Allocation failed
+            }
+            capacity = grown;
+            refs_r_d = orbit->refs_r_d;
+            refs_i_d = orbit->refs_i_d;
+        }
         // Pre-cast to double to avoid repeated conversions in inner loop
         refs_r_d[i] = (double)zr;
         refs_i_d[i] = (double)zi;
@@ -168,18 +1000,34 @@ static void compute_mandelbrot_perturbation(
             break;
         }
         
-        zi = 2.0Q * zr * zi + center_i;
-        zr = zr2 - zi2 + center_r;
+        Real128 nr, ni;
+        FORMULA_STEP(SCALAR, formula, zr, zi, zr2, zi2, cr, ci, nr, ni);
+        zr = nr;
+        zi = ni;
         zr2 = zr * zr;
         zi2 = zi * zi;
+
+        if (progress && (i & 1023) == 1023) {
+            __atomic_store_n(&progress->orbit_iterations, i + 1, __ATOMIC_RELAXED);
+        }
     }
+    if (progress) __atomic_store_n(&progress->orbit_iterations, ref_iter, __ATOMIC_RELAXED);
+    // An early escape leaves most of the arrays unused: give that back
+    if ((size_t)ref_iter + 1 < capacity / 2) resize_orbit(orbit, (size_t)ref_iter + 1, (size_t)ref_iter + 1);
+    refs_r_d = orbit->refs_r_d;
+    refs_i_d = orbit->refs_i_d;
+    trace_end(trace, TRACE_REFERENCE_ORBIT, orbit_start, ref_iter, 0, 0, 0);
+    PROBE2(orbit__done, ref_iter, 0);
+    set_progress_phase(progress, PHASE_SERIES_APPROX);
+    long long series_start = trace_start(trace);
 
     // 1.5 Compute Linear Approximation (Series Approximation) skipping
     // We want to find how many iterations we can skip using dz_n = B_n * dc
-    // B_{n+1} = 2*Z_n*B_n + 1, B_0 = 0
+    // B_{n+1} = f'(Z_n)*B_n + 1, B_0 = 0
+    // Burning Ship's abs() has no derivative across the axes, so it skips nothing
     
-    int skip_iter = 0;
-    double Br = 0.0;
+    long long skip_iter = 0;
+    double Br = julia ? 1.0 : 0.0;
     double Bi = 0.0;
     
     // Calculate max_dc (radius of view)
@@ -192,7 +1040,9 @@ static void compute_mandelbrot_perturbation(
     // Use very conservative threshold to preserve detail at deep zooms
     const double approx_threshold = 1.0e-12; 
     
-    for (int i = 0; i < ref_iter; i++) {
+    double skip_Br = Br;
+    double skip_Bi = Bi;
+    for (long long i = 0; i < ref_iter; i++) {
         // Check magnitude
         double B_mag = sqrt(Br*Br + Bi*Bi);
         if (B_mag * max_dc > approx_threshold) {
@@ -200,15 +1050,23 @@ static void compute_mandelbrot_perturbation(
         }
         
         skip_iter = i;
+        skip_Br = Br;
+        skip_Bi = Bi;
+        if (formula == FORMULA_BURNING_SHIP) break;
         
-        // Update B_{n+1} = 2*Z_n*B_n + 1
-        double Zr = (double)refs_r[i];
-        double Zi = (double)refs_i[i];
+        // Update B_{n+1} = f'(Z_n)*B_n + 1
+        double Zr = refs_r_d[i];
+        double Zi = refs_i_d[i];
         
-        // 2*(Zr + iZi)*(Br + iBi) + 1
-        // 2*(ZrBr - ZiBi + i(ZrBi + ZiBr)) + 1
-        double next_Br = 2.0 * (Zr * Br - Zi * Bi) + 1.0;
-        double next_Bi = 2.0 * (Zr * Bi + Zi * Br);
+        // f'(Z) = Dr + iDi: 2Z for z^2, 3Z^2 for z^3
+        double Dr = 2.0 * Zr;
+        double Di = 2.0 * Zi;
+        if (formula == FORMULA_MULTIBROT3) {
+            Dr = 3.0 * (Zr * Zr - Zi * Zi);
+            Di = 6.0 * Zr * Zi;
+        }
+        double next_Br = (Dr * Br - Di * Bi) + (julia ? 0.0 : 1.0);
+        double next_Bi = Dr * Bi + Di * Br;
         
         Br = next_Br;
         Bi = next_Bi;
@@ -216,416 +1074,3184 @@ static void compute_mandelbrot_perturbation(
     
     // Don't skip too much if it's short
     if (skip_iter > ref_iter) skip_iter = ref_iter;
+
+    orbit->ref_iter = ref_iter;
+    orbit->skip_iter = skip_iter;
+    orbit->Br = skip_Br;
+    orbit->Bi = skip_Bi;
+    orbit->center_r = center_r;
+    orbit->center_i = center_i;
+    orbit->dx_q = dx;
+    orbit->dy_q = dy;
+    orbit->formula = formula;
+    orbit->julia = julia;
+    orbit->julia_r = julia_r;
+    orbit->julia_i = julia_i;
+    trace_end(trace, TRACE_SERIES_APPROX, series_start, skip_iter, 0, 0, 0);
+    PROBE2(series__skip, skip_iter, ref_iter);
+    observe_latency(&g_metrics.orbit_build_seconds, wall_time() - build_start);
+    count_metric(&g_metrics.reference_iterations, ref_iter);
+    count_metric(&g_metrics.series_skipped_iterations, skip_iter);
+    return 1;
     
-    // 2. Parallel perturbation loop
-    double dx_d = (double)dx;
-    double dy_d = (double)dy;
-    
+}
+
+// Auxiliary accumulators of four perturbation lanes
+typedef struct {
+    __m256d trap, stripe, last; // Least |z|^2, stripe sum and latest stripe term
+    __m256d zr, zi;             // Full z = Z + dz of the current iteration
+    __m256d dr, di;             // Derivative at the current iteration
+    __m256d fzr, fzi, fdr, fdi; // z and derivative where each lane escaped
+} AuxLanes;
+
+// Add the stripe term and trap of the current z of the lanes in active
+static inline void aux_lanes_accumulate(AuxLanes* a, __m256d active, int stripe_density) {
+    __m256d vmod = _mm256_add_pd(_mm256_mul_pd(a->zr, a->zr), _mm256_mul_pd(a->zi, a->zi));
+    __m256d term;
+    STRIPE_TERM(AVX, a->zr, a->zi, vmod, stripe_density, term);
+    a->trap = _mm256_blendv_pd(a->trap, _mm256_min_pd(a->trap, vmod), active);
+    a->stripe = _mm256_add_pd(a->stripe, _mm256_and_pd(active, term));
+    a->last = _mm256_blendv_pd(a->last, term, active);
+}
+
+// Carry the derivative over one step from the current z
+KERNEL void aux_lanes_derive(AuxLanes* a, int formula, __m256d vone) {
+    __m256d ndr, ndi;
+    FORMULA_DERIV(AVX, formula, a->zr, a->zi, _mm256_mul_pd(a->zr, a->zr), _mm256_mul_pd(a->zi, a->zi),
+                  a->dr, a->di, vone, ndr, ndi);
+    a->dr = ndr;
+    a->di = ndi;
+}
+
+// Keep z and the derivative of the lanes in escaped
+static inline void aux_lanes_capture(AuxLanes* a, __m256d escaped) {
+    a->fzr = _mm256_blendv_pd(a->fzr, a->zr, escaped);
+    a->fzi = _mm256_blendv_pd(a->fzi, a->zi, escaped);
+    a->fdr = _mm256_blendv_pd(a->fdr, a->dr, escaped);
+    a->fdi = _mm256_blendv_pd(a->fdi, a->di, escaped);
+}
+
+// Perturbation loop for 4 pixels at once, one per AVX2 lane. (vdcr, vdci) is
+// each pixel's offset from the reference: dc for the Mandelbrot set, dz0 for a
+// Julia set, whose iterations add nothing more since c is the reference's.
+// aux, if not NULL, receives the auxiliary planes of the 4 pixels; the terms
+// of the iterations the series approximation skips come from the reference.
+// Escapes are tested every interval iterations (a constant at each call site).
+KERNEL void perturbation_block4(const RenderView* v, int formula, int interval,
+                                __m256d vdcr, __m256d vdci, double* out, double* aux) {
+    const long long max_iter = v->max_iter;
+    const double* refs_r_d = v->orbit.refs_r_d;
+    const double* refs_i_d = v->orbit.refs_i_d;
+    const long long ref_iter = v->orbit.ref_iter;
+    const long long skip_iter = v->orbit.skip_iter;
+    const double Br = v->orbit.Br;
+    const double Bi = v->orbit.Bi;
+
     // Hoist SIMD constants outside loop to avoid recomputation
-    const __m256d const_two = _mm256_set1_pd(2.0);
-    const __m256d const_four = _mm256_set1_pd(4.0);
-    const __m256i const_one_i = _mm256_set1_epi64x(1);
-    const __m256i const_four_i = _mm256_set1_epi64x(4);
+    const __m256d const_four = _mm256_set1_pd(PERTURBATION_BAILOUT);
+
+    // Initialize dz using Linear Approximation
+    // dz = B * dc
+    // dzr = Br*dcr - Bi*dci
+    // dzi = Br*dci + Bi*dcr
+    __m256d vBr = _mm256_set1_pd(Br);
+    __m256d vBi = _mm256_set1_pd(Bi);
     
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule(guided)
-    #endif
-    for (int py = 0; py < height; py++) {
-        // Process 4 pixels at a time using AVX2
-        int px = 0;
-        for (; px <= width - 4; px += 4) {
-            // Delta c for 4 pixels
-            double dcr0 = (px + 0 - width / 2.0) * dx_d;
-            double dcr1 = (px + 1 - width / 2.0) * dx_d;
-            double dcr2 = (px + 2 - width / 2.0) * dx_d;
-            double dcr3 = (px + 3 - width / 2.0) * dx_d;
-            
-            double dci_val = (py - height / 2.0) * dy_d;
-            
-            __m256d vdcr = _mm256_set_pd(dcr3, dcr2, dcr1, dcr0);
-            __m256d vdci = _mm256_set1_pd(dci_val);
-            
-            // Initialize dz using Linear Approximation
-            // dz = B * dc
-            // dzr = Br*dcr - Bi*dci
-            // dzi = Br*dci + Bi*dcr
-            __m256d vBr = _mm256_set1_pd(Br);
-            __m256d vBi = _mm256_set1_pd(Bi);
+    __m256d vdzr, vdzi;
+    const __m256d vaddr = v->julia ? _mm256_setzero_pd() : vdcr;
+    const __m256d vaddi = v->julia ? _mm256_setzero_pd() : vdci;
+    
+    if (skip_iter > 0 || v->julia) {
+        vdzr = _mm256_sub_pd(
+            _mm256_mul_pd(vBr, vdcr),
+            _mm256_mul_pd(vBi, vdci)
+        );
+        vdzi = _mm256_add_pd(
+            _mm256_mul_pd(vBr, vdci),
+            _mm256_mul_pd(vBi, vdcr)
+        );
+    } else {
+        vdzr = _mm256_setzero_pd();
+        vdzi = _mm256_setzero_pd();
+    }
+    
+    __m256d vdzr2 = _mm256_mul_pd(vdzr, vdzr);
+    __m256d vdzi2 = _mm256_mul_pd(vdzi, vdzi);
+    
+    // Mask for active pixels (all start active)
+    __m256i vmask = _mm256_set1_epi64x(-1);
+    
+    // Store iteration counts (start at skip_iter)
+    __m256i viter = _mm256_set1_epi64x(skip_iter);
+    
+    // Store final modulus for smoothing
+    __m256d vmodulus = _mm256_setzero_pd();
+    
+    long long limit = ref_iter;
+    int all_escaped = 0;
+
+    // The derivative of dz = B dc is B; terms are added for z_1 onwards
+    AuxLanes a;
+    const __m256d vone = _mm256_set1_pd(v->julia ? 0.0 : 1.0);
+    if (aux) {
+        memset(&a, 0, sizeof(a));
+        a.trap = _mm256_set1_pd(v->aux_trap0);
+        a.stripe = _mm256_set1_pd(v->aux_stripe0);
+        if (skip_iter > 0 || v->julia) {
+            a.dr = vBr;
+            a.di = vBi;
+        }
+        if (skip_iter < limit) {
+            a.zr = _mm256_add_pd(_mm256_set1_pd(refs_r_d[skip_iter]), vdzr);
+            a.zi = _mm256_add_pd(_mm256_set1_pd(refs_i_d[skip_iter]), vdzi);
+            if (skip_iter > 0) aux_lanes_accumulate(&a, _mm256_castsi256_pd(vmask), v->stripe_density);
+        }
+    }
+    
+    // Main loop - interval iterations per escape check
+    long long i = skip_iter;
+    for (; i < limit; i += interval) {
+        // Check if we can do a full block followed by its escape check,
+        // which needs the reference at i+interval
+        if (i + interval >= limit) {
+            // Handle remaining iterations one by one
+            break;
+        }
+
+        // Fully unrolled by the compiler
+        for (int u = 0; u < interval; u++) {
+            __m256d vX = _mm256_set1_pd(refs_r_d[i + u]);
+            __m256d vY = _mm256_set1_pd(refs_i_d[i + u]);
             
-            __m256d vdzr, vdzi;
+            __m256d next_dzr, next_dzi;
+            FORMULA_PERTURB(AVX, formula, vX, vY, vdzr, vdzi, vdzr2, vdzi2, vaddr, vaddi, next_dzr, next_dzi);
             
-            if (skip_iter > 0) {
-                vdzr = _mm256_sub_pd(
-                    _mm256_mul_pd(vBr, vdcr),
-                    _mm256_mul_pd(vBi, vdci)
-                );
-                vdzi = _mm256_add_pd(
-                    _mm256_mul_pd(vBr, vdci),
-                    _mm256_mul_pd(vBi, vdcr)
-                );
-            } else {
-                vdzr = _mm256_setzero_pd();
-                vdzi = _mm256_setzero_pd();
+            vdzr = next_dzr;
+            vdzi = next_dzi;
+            vdzr2 = _mm256_mul_pd(vdzr, vdzr);
+            vdzi2 = _mm256_mul_pd(vdzi, vdzi);
+
+            if (aux) {
+                aux_lanes_derive(&a, formula, vone);
+                a.zr = _mm256_add_pd(_mm256_set1_pd(refs_r_d[i + u + 1]), vdzr);
+                a.zi = _mm256_add_pd(_mm256_set1_pd(refs_i_d[i + u + 1]), vdzi);
+                aux_lanes_accumulate(&a, _mm256_castsi256_pd(vmask), v->stripe_density);
             }
+        }
+        
+        // --- Check Escape (Once every interval iterations) ---
+        // After the block we're at iteration i+interval, so check against that reference
+        double X = refs_r_d[i + interval];
+        double Y = refs_i_d[i + interval];
+        __m256d vX = _mm256_set1_pd(X);
+        __m256d vY = _mm256_set1_pd(Y);
+        
+        __m256d vZ_plus_dz_r = _mm256_add_pd(vX, vdzr);
+        __m256d vZ_plus_dz_i = _mm256_add_pd(vY, vdzi);
+        
+        __m256d vmod = _mm256_add_pd(
+            _mm256_mul_pd(vZ_plus_dz_r, vZ_plus_dz_r),
+            _mm256_mul_pd(vZ_plus_dz_i, vZ_plus_dz_i)
+        );
+        __m256d vcmp = _mm256_cmp_pd(vmod, const_four, _CMP_GT_OQ);
+        __m256i vcmp_i = _mm256_castpd_si256(vcmp);
+        
+        // For pixels that just escaped, store their iteration count and modulus
+        // vcmp_i has -1 for escaped pixels
+        // We want to update viter and vmodulus ONLY for newly escaped pixels
+        // Newly escaped = (vmask is active) AND (vcmp_i shows escaped)
+        __m256i newly_escaped = _mm256_and_si256(vmask, vcmp_i);
+        
+        // For newly escaped pixels, set iteration to i+interval
+        __m256i viter_escaped = _mm256_set1_epi64x(i + interval);
+        // Update viter: if newly escaped, use i+interval, else keep old value
+        viter = _mm256_blendv_epi8(viter, viter_escaped, newly_escaped);
+        
+        // Store modulus for newly escaped pixels
+        vmodulus = _mm256_blendv_pd(vmodulus, vmod, _mm256_castsi256_pd(newly_escaped));
+        if (aux) aux_lanes_capture(&a, _mm256_castsi256_pd(newly_escaped));
+        
+        // Update mask: pixels that haven't escaped yet remain active
+        // vmask = vmask & ~vcmp_i
+        vmask = _mm256_andnot_si256(vcmp_i, vmask);
+        
+        if (_mm256_testz_si256(vmask, vmask)) {
+            all_escaped = 1;
+            break;
+        }
+        
+        // Zero out inactive pixels to prevent explosion
+        vdzr = _mm256_and_pd(_mm256_castsi256_pd(vmask), vdzr);
+        vdzi = _mm256_and_pd(_mm256_castsi256_pd(vmask), vdzi);
+        vdzr2 = _mm256_mul_pd(vdzr, vdzr);
+        vdzi2 = _mm256_mul_pd(vdzi, vdzi);
+        if (aux) {
+            a.dr = _mm256_and_pd(_mm256_castsi256_pd(vmask), a.dr);
+            a.di = _mm256_and_pd(_mm256_castsi256_pd(vmask), a.di);
+        }
+    }
+    
+    // Finish remaining iterations (if any, or if we broke early but not all escaped?)
+    // If we broke because all_escaped, we are done.
+    // If we finished loop, we might have up to interval iters left.
+    if (!all_escaped) {
+        for (; i < limit; i++) {
+            double X = refs_r_d[i];
+            double Y = refs_i_d[i];
+            __m256d vX = _mm256_set1_pd(X);
+            __m256d vY = _mm256_set1_pd(Y);
             
-            __m256d vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-            __m256d vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-            
-            // Mask for active pixels (all start active)
-            __m256i vmask = _mm256_set1_epi64x(-1);
+            __m256d vZ_plus_dz_r = _mm256_add_pd(vX, vdzr);
+            __m256d vZ_plus_dz_i = _mm256_add_pd(vY, vdzi);
             
-            // Store iteration counts (start at skip_iter)
-            __m256i viter = _mm256_set1_epi64x(skip_iter);
+            __m256d vmod = _mm256_add_pd(
+                _mm256_mul_pd(vZ_plus_dz_r, vZ_plus_dz_r),
+                _mm256_mul_pd(vZ_plus_dz_i, vZ_plus_dz_i)
+            );
             
-            // Store final modulus for smoothing
-            __m256d vmodulus = _mm256_setzero_pd();
+            __m256d vcmp = _mm256_cmp_pd(vmod, const_four, _CMP_GT_OQ);
+            __m256i vcmp_i = _mm256_castpd_si256(vcmp);
             
-            int limit = ref_iter;
-            int all_escaped = 0;
+            // For newly escaped pixels, record iteration and modulus
+            __m256i newly_escaped = _mm256_and_si256(vmask, vcmp_i);
+            __m256i viter_escaped = _mm256_set1_epi64x(i);
+            viter = _mm256_blendv_epi8(viter, viter_escaped, newly_escaped);
+            vmodulus = _mm256_blendv_pd(vmodulus, vmod, _mm256_castsi256_pd(newly_escaped));
+            if (aux) aux_lanes_capture(&a, _mm256_castsi256_pd(newly_escaped));
             
-            // Main loop - Unrolled by 4
-            int i = skip_iter;
-            for (; i < limit; i+=4) {
-                // Check if we can do a full block of 4
-                if (i + 4 > limit) {
-                    // Handle remaining iterations one by one
-                    break;
-                }
-
-                // --- Iteration 0 ---
-                {
-                    double X = refs_r_d[i];
-                    double Y = refs_i_d[i];
-                    __m256d vX = _mm256_set1_pd(X);
-                    __m256d vY = _mm256_set1_pd(Y);
-                    
-                    // Perturbation: dz = 2*Z*dz + dz^2 + dc
-                    // Use FMA: 2*X*dzr - 2*Y*dzi + (dzr^2 - dzi^2 + dcr)
-                    
-                    __m256d vtwoX = _mm256_mul_pd(const_two, vX);
-                    __m256d vtwoY = _mm256_mul_pd(const_two, vY);
-                    
-                    __m256d term_sq_r = _mm256_add_pd(_mm256_sub_pd(vdzr2, vdzi2), vdcr);
-                    __m256d term_sq_i = _mm256_add_pd(_mm256_mul_pd(const_two, _mm256_mul_pd(vdzr, vdzi)), vdci);
-                    
-                    // next_dzr = 2*X*dzr - 2*Y*dzi + term_sq_r
-                    // = fma(2*X, dzr, term_sq_r - 2*Y*dzi)
-                    __m256d next_dzr = _mm256_fmadd_pd(vtwoX, vdzr, _mm256_fnmadd_pd(vtwoY, vdzi, term_sq_r));
-                    
-                    // next_dzi = 2*X*dzi + 2*Y*dzr + term_sq_i
-                    __m256d next_dzi = _mm256_fmadd_pd(vtwoX, vdzi, _mm256_fmadd_pd(vtwoY, vdzr, term_sq_i));
-                    
-                    vdzr = next_dzr;
-                    vdzi = next_dzi;
-                    vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-                    vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-                }
-                
-                // --- Iteration 1 ---
-                {
-                    double X = refs_r_d[i+1];
-                    double Y = refs_i_d[i+1];
-                    __m256d vX = _mm256_set1_pd(X);
-                    __m256d vY = _mm256_set1_pd(Y);
-                    
-                    __m256d vtwoX = _mm256_mul_pd(const_two, vX);
-                    __m256d vtwoY = _mm256_mul_pd(const_two, vY);
-                    
-                    __m256d term_sq_r = _mm256_add_pd(_mm256_sub_pd(vdzr2, vdzi2), vdcr);
-                    __m256d term_sq_i = _mm256_add_pd(_mm256_mul_pd(const_two, _mm256_mul_pd(vdzr, vdzi)), vdci);
-                    
-                    __m256d next_dzr = _mm256_fmadd_pd(vtwoX, vdzr, _mm256_fnmadd_pd(vtwoY, vdzi, term_sq_r));
-                    __m256d next_dzi = _mm256_fmadd_pd(vtwoX, vdzi, _mm256_fmadd_pd(vtwoY, vdzr, term_sq_i));
-                    
-                    vdzr = next_dzr;
-                    vdzi = next_dzi;
-                    vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-                    vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-                }
-
-                // --- Iteration 2 ---
-                {
-                    double X = refs_r_d[i+2];
-                    double Y = refs_i_d[i+2];
-                    __m256d vX = _mm256_set1_pd(X);
-                    __m256d vY = _mm256_set1_pd(Y);
-                    
-                    __m256d vtwoX = _mm256_mul_pd(const_two, vX);
-                    __m256d vtwoY = _mm256_mul_pd(const_two, vY);
-                    
-                    __m256d term_sq_r = _mm256_add_pd(_mm256_sub_pd(vdzr2, vdzi2), vdcr);
-                    __m256d term_sq_i = _mm256_add_pd(_mm256_mul_pd(const_two, _mm256_mul_pd(vdzr, vdzi)), vdci);
-                    
-                    __m256d next_dzr = _mm256_fmadd_pd(vtwoX, vdzr, _mm256_fnmadd_pd(vtwoY, vdzi, term_sq_r));
-                    __m256d next_dzi = _mm256_fmadd_pd(vtwoX, vdzi, _mm256_fmadd_pd(vtwoY, vdzr, term_sq_i));
-                    
-                    vdzr = next_dzr;
-                    vdzi = next_dzi;
-                    vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-                    vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-                }
-
-                // --- Iteration 3 ---
-                {
-                    double X = refs_r_d[i+3];
-                    double Y = refs_i_d[i+3];
-                    __m256d vX = _mm256_set1_pd(X);
-                    __m256d vY = _mm256_set1_pd(Y);
-                    
-                    __m256d vtwoX = _mm256_mul_pd(const_two, vX);
-                    __m256d vtwoY = _mm256_mul_pd(const_two, vY);
-                    
-                    __m256d term_sq_r = _mm256_add_pd(_mm256_sub_pd(vdzr2, vdzi2), vdcr);
-                    __m256d term_sq_i = _mm256_add_pd(_mm256_mul_pd(const_two, _mm256_mul_pd(vdzr, vdzi)), vdci);
-                    
-                    __m256d next_dzr = _mm256_fmadd_pd(vtwoX, vdzr, _mm256_fnmadd_pd(vtwoY, vdzi, term_sq_r));
-                    __m256d next_dzi = _mm256_fmadd_pd(vtwoX, vdzi, _mm256_fmadd_pd(vtwoY, vdzr, term_sq_i));
-                    
-                    vdzr = next_dzr;
-                    vdzi = next_dzi;
-                    vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-                    vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-                }
-                
-                // --- Check Escape (Once every 4 iterations) ---
-                // After 4 iterations, we're now at iteration i+4, so check against that reference
-                // But clamp to avoid accessing beyond ref_iter
-                int check_idx = (i + 4 < ref_iter) ? i + 4 : ref_iter - 1;
-                double X = refs_r_d[check_idx];
-                double Y = refs_i_d[check_idx];
-                __m256d vX = _mm256_set1_pd(X);
-                __m256d vY = _mm256_set1_pd(Y);
-                
-                __m256d vZ_plus_dz_r = _mm256_add_pd(vX, vdzr);
-                __m256d vZ_plus_dz_i = _mm256_add_pd(vY, vdzi);
-                
-                __m256d vmod = _mm256_add_pd(
-                    _mm256_mul_pd(vZ_plus_dz_r, vZ_plus_dz_r),
-                    _mm256_mul_pd(vZ_plus_dz_i, vZ_plus_dz_i)
-                );
-                __m256d vcmp = _mm256_cmp_pd(vmod, const_four, _CMP_GT_OQ);
-                __m256i vcmp_i = _mm256_castpd_si256(vcmp);
-                
-                // For pixels that just escaped, store their iteration count and modulus
-                // vcmp_i has -1 for escaped pixels
-                // We want to update viter and vmodulus ONLY for newly escaped pixels
-                // Newly escaped = (vmask is active) AND (vcmp_i shows escaped)
-                __m256i newly_escaped = _mm256_and_si256(vmask, vcmp_i);
-                
-                // For newly escaped pixels, set iteration to i+4
-                __m256i viter_escaped = _mm256_set1_epi64x(i + 4);
-                // Update viter: if newly escaped, use i+4, else keep old value
-                viter = _mm256_blendv_epi8(viter, viter_escaped, newly_escaped);
-                
-                // Store modulus for newly escaped pixels
-                vmodulus = _mm256_blendv_pd(vmodulus, vmod, _mm256_castsi256_pd(newly_escaped));
-                
-                // Update mask: pixels that haven't escaped yet remain active
-                // vmask = vmask & ~vcmp_i
-                vmask = _mm256_andnot_si256(vcmp_i, vmask);
-                
-                if (_mm256_testz_si256(vmask, vmask)) {
-                    all_escaped = 1;
-                    break;
-                }
-                
-                // Zero out inactive pixels to prevent explosion
-                vdzr = _mm256_and_pd(_mm256_castsi256_pd(vmask), vdzr);
-                vdzi = _mm256_and_pd(_mm256_castsi256_pd(vmask), vdzi);
-                vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-                vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-            }
+            // Update mask
+            vmask = _mm256_andnot_si256(vcmp_i, vmask);
             
-            // Finish remaining iterations (if any, or if we broke early but not all escaped?)
-            // If we broke because all_escaped, we are done.
-            // If we finished loop, we might have 1-3 iters left.
-            if (!all_escaped) {
-                for (; i < limit; i++) {
-                    double X = refs_r_d[i];
-                    double Y = refs_i_d[i];
-                    __m256d vX = _mm256_set1_pd(X);
-                    __m256d vY = _mm256_set1_pd(Y);
-                    
-                    __m256d vZ_plus_dz_r = _mm256_add_pd(vX, vdzr);
-                    __m256d vZ_plus_dz_i = _mm256_add_pd(vY, vdzi);
-                    
-                    __m256d vmod = _mm256_add_pd(
-                        _mm256_mul_pd(vZ_plus_dz_r, vZ_plus_dz_r),
-                        _mm256_mul_pd(vZ_plus_dz_i, vZ_plus_dz_i)
-                    );
-                    
-                    __m256d vcmp = _mm256_cmp_pd(vmod, const_four, _CMP_GT_OQ);
-                    __m256i vcmp_i = _mm256_castpd_si256(vcmp);
-                    
-                    // For newly escaped pixels, record iteration and modulus
-                    __m256i newly_escaped = _mm256_and_si256(vmask, vcmp_i);
-                    __m256i viter_escaped = _mm256_set1_epi64x(i);
-                    viter = _mm256_blendv_epi8(viter, viter_escaped, newly_escaped);
-                    vmodulus = _mm256_blendv_pd(vmodulus, vmod, _mm256_castsi256_pd(newly_escaped));
-                    
-                    // Update mask
-                    vmask = _mm256_andnot_si256(vcmp_i, vmask);
-                    
-                    if (_mm256_testz_si256(vmask, vmask)) break;
-                    
-                    // Perturbation
-                    __m256d vtwoX = _mm256_mul_pd(const_two, vX);
-                    __m256d vtwoY = _mm256_mul_pd(const_two, vY);
-                    
-                    __m256d term_sq_r = _mm256_add_pd(_mm256_sub_pd(vdzr2, vdzi2), vdcr);
-                    __m256d term_sq_i = _mm256_add_pd(_mm256_mul_pd(const_two, _mm256_mul_pd(vdzr, vdzi)), vdci);
-                    
-                    __m256d next_dzr = _mm256_fmadd_pd(vtwoX, vdzr, _mm256_fnmadd_pd(vtwoY, vdzi, term_sq_r));
-                    __m256d next_dzi = _mm256_fmadd_pd(vtwoX, vdzi, _mm256_fmadd_pd(vtwoY, vdzr, term_sq_i));
-                    
-                    vdzr = _mm256_and_pd(_mm256_castsi256_pd(vmask), next_dzr);
-                    vdzi = _mm256_and_pd(_mm256_castsi256_pd(vmask), next_dzi);
-                    vdzr2 = _mm256_mul_pd(vdzr, vdzr);
-                    vdzi2 = _mm256_mul_pd(vdzi, vdzi);
-                }
-            }
+            if (_mm256_testz_si256(vmask, vmask)) break;
             
-            // Extract results
-            long long iters[4];
-            double mods[4];
-            _mm256_storeu_si256((__m256i*)iters, viter);
-            _mm256_storeu_pd(mods, vmodulus);
+            // Perturbation
+            __m256d next_dzr, next_dzi;
+            FORMULA_PERTURB(AVX, formula, vX, vY, vdzr, vdzi, vdzr2, vdzi2, vaddr, vaddi, next_dzr, next_dzi);
             
-            for (int k = 0; k < 4; k++) {
-                if (iters[k] < limit) {
-                    // Escaped
-                    double modulus = mods[k];
-                    output[py * width + (px + k)] = iters[k] + 1.0 - log(log(modulus) / 0.69314718056) / 0.69314718056;
-                } else {
-                    // Did not escape
-                    output[py * width + (px + k)] = -max_iter;
-                }
+            vdzr = _mm256_and_pd(_mm256_castsi256_pd(vmask), next_dzr);
+            vdzi = _mm256_and_pd(_mm256_castsi256_pd(vmask), next_dzi);
+            vdzr2 = _mm256_mul_pd(vdzr, vdzr);
+            vdzi2 = _mm256_mul_pd(vdzi, vdzi);
+
+            if (aux && i + 1 < limit) {
+                aux_lanes_derive(&a, formula, vone);
+                a.zr = _mm256_add_pd(_mm256_set1_pd(refs_r_d[i + 1]), vdzr);
+                a.zi = _mm256_add_pd(_mm256_set1_pd(refs_i_d[i + 1]), vdzi);
+                aux_lanes_accumulate(&a, _mm256_castsi256_pd(vmask), v->stripe_density);
             }
         }
-        
-        // Handle remaining pixels
-        for (; px < width; px++) {
-            // Delta c
-            double dcr = (px - width / 2.0) * dx_d;
-            double dci = (py - height / 2.0) * dy_d;
-            
-            double dzr, dzi;
-            
-            // Init with BLA
-            if (skip_iter > 0) {
-                dzr = Br * dcr - Bi * dci;
-                dzi = Br * dci + Bi * dcr;
-            } else {
-                dzr = 0.0;
-                dzi = 0.0;
-            }
-            
-            double dzr2 = dzr * dzr;
-            double dzi2 = dzi * dzi;
-            
-            int escaped = 0;
-            int limit = ref_iter;
-            
-            for (int i = skip_iter; i < limit; i++) {
-                double X = refs_r_d[i];
-                double Y = refs_i_d[i];
-                
-                double Z_plus_dz_r = X + dzr;
-                double Z_plus_dz_i = Y + dzi;
-                double modulus = Z_plus_dz_r*Z_plus_dz_r + Z_plus_dz_i*Z_plus_dz_i;
-                
-                if (modulus > 4.0) {
-                    output[py * width + px] = i + 1.0 - log(log(modulus) / 0.69314718056) / 0.69314718056;
-                    escaped = 1;
-                    break;
-                }
-                
-                double two_X = 2.0 * X;
-                double two_Y = 2.0 * Y;
-                
-                double next_dzr = (two_X * dzr - two_Y * dzi) + dzr2 - dzi2 + dcr;
-                double next_dzi = (two_X * dzi + two_Y * dzr) + 2.0 * dzr * dzi + dci;
-                
-                dzr = next_dzr;
-                dzi = next_dzi;
-                dzr2 = dzr * dzr;
-                dzi2 = dzi * dzi;
-            }
-            
-            if (!escaped) {
-                output[py * width + px] = -max_iter;
+    }
+    
+    // Extract results
+    long long iters[4];
+    long long active[4];
+    double mods[4];
+    _mm256_storeu_si256((__m256i*)iters, viter);
+    _mm256_storeu_si256((__m256i*)active, vmask);
+    _mm256_storeu_pd(mods, vmodulus);
+    
+    for (int k = 0; k < 4; k++) {
+        // Lanes still active never escaped; their iteration count stayed at skip_iter
+        if (!active[k]) {
+            // Escaped
+            out[k] = smooth_count(formula, iters[k], mods[k], v->deterministic);
+        } else {
+            // Did not escape
+            out[k] = -max_iter;
+        }
+    }
+
+    if (aux) {
+        aux_lanes_capture(&a, _mm256_castsi256_pd(vmask)); // Bounded lanes end where the loop left them
+        double trap[4], stripe[4], last[4], fzr[4], fzi[4], fdr[4], fdi[4];
+        _mm256_storeu_pd(trap, a.trap);
+        _mm256_storeu_pd(stripe, a.stripe);
+        _mm256_storeu_pd(last, a.last);
+        _mm256_storeu_pd(fzr, a.fzr);
+        _mm256_storeu_pd(fzi, a.fzi);
+        _mm256_storeu_pd(fdr, a.fdr);
+        _mm256_storeu_pd(fdi, a.fdi);
+        for (int k = 0; k < 4; k++) {
+            long long terms = active[k] ? (limit > 0 ? limit - 1 : 0) : iters[k];
+            finish_aux(aux + k, out[k], terms, trap[k], stripe[k], last[k], fzr[k], fzi[k], fdr[k], fdi[k]);
+        }
+    }
+}
+
+// Scalar perturbation loop for a single pixel
+KERNEL double perturbation_point(const RenderView* v, int formula, double dcr, double dci, double* aux) {
+    const long long max_iter = v->max_iter;
+    const double* refs_r_d = v->orbit.refs_r_d;
+    const double* refs_i_d = v->orbit.refs_i_d;
+    const long long ref_iter = v->orbit.ref_iter;
+    const long long skip_iter = v->orbit.skip_iter;
+    const double Br = v->orbit.Br;
+    const double Bi = v->orbit.Bi;
+
+    double dzr, dzi;
+    const double addr = v->julia ? 0.0 : dcr;
+    const double addi = v->julia ? 0.0 : dci;
+    
+    // Init with BLA
+    if (skip_iter > 0 || v->julia) {
+        dzr = Br * dcr - Bi * dci;
+        dzi = Br * dci + Bi * dcr;
+    } else {
+        dzr = 0.0;
+        dzi = 0.0;
+    }
+    
+    double dzr2 = dzr * dzr;
+    double dzi2 = dzi * dzi;
+    
+    long long limit = ref_iter;
+
+    // As perturbation_block4(), with the terms of each z added before its escape test
+    double dr = (skip_iter > 0 || v->julia) ? Br : 0.0, di = (skip_iter > 0 || v->julia) ? Bi : 0.0;
+    double trap = v->aux_trap0, stripe = v->aux_stripe0, last = 0.0, zr = 0.0, zi = 0.0;
+    
+    for (long long i = skip_iter; i < limit; i++) {
+        double X = refs_r_d[i];
+        double Y = refs_i_d[i];
+        
+        double Z_plus_dz_r = X + dzr;
+        double Z_plus_dz_i = Y + dzi;
+        double modulus = Z_plus_dz_r*Z_plus_dz_r + Z_plus_dz_i*Z_plus_dz_i;
+
+        if (aux) {
+            zr = Z_plus_dz_r;
+            zi = Z_plus_dz_i;
+            if (i > 0) {
+                if (modulus < trap) trap = modulus;
+                STRIPE_TERM(SCALAR, zr, zi, modulus, v->stripe_density, last);
+                stripe += last;
             }
         }
+        
+        if (modulus > PERTURBATION_BAILOUT) {
+            double value = smooth_count(formula, i, modulus, v->deterministic);
+            if (aux) finish_aux(aux, value, i, trap, stripe, last, zr, zi, dr, di);
+            return value;
+        }
+
+        if (aux) {
+            double ndr, ndi;
+            FORMULA_DERIV(SCALAR, formula, zr, zi, zr * zr, zi * zi, dr, di, v->julia ? 0.0 : 1.0, ndr, ndi);
+            dr = ndr;
+            di = ndi;
+        }
+        
+        double next_dzr, next_dzi;
+        FORMULA_PERTURB(SCALAR, formula, X, Y, dzr, dzi, dzr2, dzi2, addr, addi, next_dzr, next_dzi);
+        
+        dzr = next_dzr;
+        dzi = next_dzi;
+        dzr2 = dzr * dzr;
+        dzi2 = dzi * dzi;
     }
     
-    _mm_free(refs_r);
-    _mm_free(refs_i);
-    _mm_free(refs_r_d);
-    _mm_free(refs_i_d);
+    if (aux) finish_aux(aux, -max_iter, limit > 0 ? limit - 1 : 0, trap, stripe, last, zr, zi, dr, di);
+    return -max_iter;
 }
 
-EXPORT void compute_mandelbrot_str(
+// Perturbation loop for pixels [px0, px1) of row py; pixel px goes to dst[px - px0]
+// and its auxiliary planes, if aux is not NULL, to aux + (px - px0)
+KERNEL void perturbation_row(const RenderView* v, int formula, int interval,
+                             int py, int px0, int px1, double* dst, double* aux) {
+    const double ref_x = v->width / 2.0 + v->ref_shift_x;
+    const double ref_y = v->height / 2.0 + v->ref_shift_y;
+    const double dx_d = v->dx_d;
+    const double dy_d = v->dy_d;
+
+    // Process 4 pixels at a time using AVX2
+    int px = px0;
+    for (; px <= px1 - 4; px += 4) {
+        // Delta c for 4 pixels
+        double dcr0 = (px + 0 - ref_x) * dx_d;
+        double dcr1 = (px + 1 - ref_x) * dx_d;
+        double dcr2 = (px + 2 - ref_x) * dx_d;
+        double dcr3 = (px + 3 - ref_x) * dx_d;
+        
+        double dci_val = (py - ref_y) * dy_d;
+        
+        __m256d vdcr = _mm256_set_pd(dcr3, dcr2, dcr1, dcr0);
+        __m256d vdci = _mm256_set1_pd(dci_val);
+
+        perturbation_block4(v, formula, interval, vdcr, vdci, dst + (px - px0), aux ? aux + (px - px0) : NULL);
+    }
+    
+    if (v->deterministic && px < px1) {
+        // Pad the last group instead of taking the scalar path, whose escape
+        // test runs every iteration rather than every interval. Padding lanes'
+        // planes land in the slack past the span (see AUX_PITCH).
+        double dcr[4], out[4];
+        for (int k = 0; k < 4; k++) {
+            int x = (px + k < px1) ? px + k : px1 - 1;
+            dcr[k] = (x - ref_x) * dx_d;
+        }
+        __m256d vdci = _mm256_set1_pd((py - ref_y) * dy_d);
+        perturbation_block4(v, formula, interval, _mm256_loadu_pd(dcr), vdci, out, aux ? aux + (px - px0) : NULL);
+        for (int k = 0; px < px1; k++, px++) dst[px - px0] = out[k];
+    }
+
+    // Handle remaining pixels
+    for (; px < px1; px++) {
+        // Delta c
+        double dcr = (px - ref_x) * dx_d;
+        double dci = (py - ref_y) * dy_d;
+
+        dst[px - px0] = perturbation_point(v, formula, dcr, dci, aux ? aux + (px - px0) : NULL);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Serialised views and the orbit cache
+// ---------------------------------------------------------------------------
+
+// Flat form of a RenderView for other processes on the same architecture:
+// this header, then ref_iter real parts and ref_iter imaginary parts of the
+// orbit. Only the double copy of the orbit is kept: the quad orbit is needed
+// to build the series approximation, not to render pixels. The header size is
+// a multiple of 16, so a mapped file can be used in place.
+#define VIEW_BLOB_MAGIC 0x574d424dU // "MBMW"
+#define VIEW_BLOB_VERSION 4
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int header_size;
+    int mode;
+    int width;
+    int height;
+    long long max_iter;
+    double xmin_d, ymin_d, dx_d, dy_d;
+    Real80 xmin_l, ymin_l, dx_l, dy_l;
+    Real128 center_r, center_i, dx_q, dy_q; // Orbit cache key, mode 3 only
+    Real128 julia_r, julia_i;
+    int julia;
+    int formula;
+    long long ref_iter;
+    long long skip_iter;
+    double Br, Bi;
+} ViewBlobHeader;
+
+static char g_orbit_cache[1024]; // Directory of cached orbits, "" when off
+
+static long long view_blob_size(const RenderView* v) {
+    long long orbit_len = v->mode == 3 ? v->orbit.ref_iter : 0;
+    return (long long)sizeof(ViewBlobHeader) + 2 * orbit_len * (long long)sizeof(double);
+}
+
+// An x87 long double has 10 significant bytes in a 16-byte slot, and a store
+// may leave anything in the rest. Zero it so equal views give equal blobs.
+static void clear_real80_padding(Real80* value) {
+    #if LDBL_MANT_DIG == 64
+    memset((char*)value + 10, 0, sizeof(Real80) - 10);
+    #else
+    (void)value;
+    #endif
+}
+
+static void write_view_blob(const RenderView* v, void* buffer) {
+    ViewBlobHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = VIEW_BLOB_MAGIC;
+    h.version = VIEW_BLOB_VERSION;
+    h.header_size = sizeof(ViewBlobHeader);
+    h.mode = v->mode;
+    h.width = v->width;
+    h.height = v->height;
+    h.max_iter = v->max_iter;
+    h.formula = v->formula;
+    h.xmin_d = v->xmin_d;
+    h.ymin_d = v->ymin_d;
+    h.dx_d = v->dx_d;
+    h.dy_d = v->dy_d;
+    h.xmin_l = v->xmin_l;
+    h.ymin_l = v->ymin_l;
+    h.dx_l = v->dx_l;
+    h.dy_l = v->dy_l;
+    h.julia = v->julia;
+    if (v->julia) {
+        // The orbit keeps c exactly; direct modes only have the rounded copies
+        h.julia_r = v->mode == 3 ? v->orbit.julia_r : (Real128)v->julia_r_l;
+        h.julia_i = v->mode == 3 ? v->orbit.julia_i : (Real128)v->julia_i_l;
+    }
+    if (v->mode == 3) {
+        h.center_r = v->orbit.center_r;
+        h.center_i = v->orbit.center_i;
+        h.dx_q = v->orbit.dx_q;
+        h.dy_q = v->orbit.dy_q;
+        h.ref_iter = v->orbit.ref_iter;
+        h.skip_iter = v->orbit.skip_iter;
+        h.Br = v->orbit.Br;
+        h.Bi = v->orbit.Bi;
+    }
+    clear_real80_padding(&h.xmin_l);
+    clear_real80_padding(&h.ymin_l);
+    clear_real80_padding(&h.dx_l);
+    clear_real80_padding(&h.dy_l);
+
+    char* dst = (char*)buffer;
+    memcpy(dst, &h, sizeof(h));
+    dst += sizeof(h);
+    if (h.ref_iter > 0) {
+        memcpy(dst, v->orbit.refs_r_d, sizeof(double) * (size_t)h.ref_iter);
+        dst += sizeof(double) * (size_t)h.ref_iter;
+        memcpy(dst, v->orbit.refs_i_d, sizeof(double) * (size_t)h.ref_iter);
+    }
+}
+
+// Fill v (zeroed) from a blob. With borrow set the orbit arrays point into
+// buffer, which must outlive the view; otherwise they are copied.
+// Returns 0 for a truncated, inconsistent or incompatible blob, or on
+// allocation failure. Blobs come from other processes and over the network,
+// so every field the kernels index with is checked.
+static int read_view_blob(RenderView* v, const void* buffer, long long size, int borrow) {
+    ViewBlobHeader h;
+    if (!buffer || size < (long long)sizeof(h)) return 0;
+    memcpy(&h, buffer, sizeof(h));
+    if (h.magic != VIEW_BLOB_MAGIC || h.version != VIEW_BLOB_VERSION || h.header_size != sizeof(h)) return 0;
+    if (h.mode != 0 && h.mode != 1 && h.mode != 3) return 0;
+    if (h.width <= 0 || h.height <= 0 || h.max_iter <= 0) return 0;
+    if (h.ref_iter < 0 || h.ref_iter > h.max_iter || h.skip_iter < 0 || h.skip_iter > h.ref_iter) return 0;
+    // Only perturbation views carry an orbit, empty only for a Julia set whose
+    // reference z0 escapes at once
+    if (h.mode != 3 ? h.ref_iter != 0 : h.ref_iter == 0 && !h.julia) return 0;
+    if (h.formula < 0 || h.formula >= FORMULA_COUNT) return 0;
+    // ref_iter doubles twice over, compared without the multiplication overflowing
+    if (h.ref_iter > (size - (long long)sizeof(h)) / (2 * (long long)sizeof(double))) return 0;
+
+    v->mode = h.mode;
+    v->width = h.width;
+    v->height = h.height;
+    v->max_iter = h.max_iter;
+    v->formula = h.formula;
+    v->xmin_d = h.xmin_d;
+    v->ymin_d = h.ymin_d;
+    v->dx_d = h.dx_d;
+    v->dy_d = h.dy_d;
+    v->xmin_l = h.xmin_l;
+    v->ymin_l = h.ymin_l;
+    v->dx_l = h.dx_l;
+    v->dy_l = h.dy_l;
+    v->julia = h.julia;
+    v->julia_r_d = (double)h.julia_r;
+    v->julia_i_d = (double)h.julia_i;
+    v->julia_r_l = (Real80)h.julia_r;
+    v->julia_i_l = (Real80)h.julia_i;
+    if (h.mode != 3) return 1;
+
+    ReferenceOrbit* orbit = &v->orbit;
+    const char* src = (const char*)buffer + sizeof(h);
+    size_t bytes = sizeof(double) * (size_t)h.ref_iter;
+    if (borrow) {
+        orbit->refs_r_d = (double*)src;
+        orbit->refs_i_d = (double*)(src + bytes);
+    } else {
+        orbit->refs_r_d = (double*)memory_alloc(MEMORY_ORBIT, bytes);
+        orbit->refs_i_d = (double*)memory_alloc(MEMORY_ORBIT, bytes);
+        if (!orbit->refs_r_d || !orbit->refs_i_d) {
+            free_reference_orbit(orbit);
+            return 0; // Allocation failed
+        }
+        memcpy(orbit->refs_r_d, src, bytes);
+        memcpy(orbit->refs_i_d, src + bytes, bytes);
+    }
+    orbit->center_r = h.center_r;
+    orbit->center_i = h.center_i;
+    orbit->dx_q = h.dx_q;
+    orbit->dy_q = h.dy_q;
+    orbit->formula = h.formula;
+    orbit->julia = h.julia;
+    orbit->julia_r = h.julia_r;
+    orbit->julia_i = h.julia_i;
+    orbit->ref_iter = h.ref_iter;
+    orbit->skip_iter = h.skip_iter;
+    orbit->Br = h.Br;
+    orbit->Bi = h.Bi;
+    return 1;
+}
+
+static const void* map_file(const char* path, size_t* size) {
+    const void* data = NULL;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+    LARGE_INTEGER length;
+    if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // The view keeps the mapping alive
+            *size = (size_t)length.QuadPart;
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            data = p;
+            *size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+#endif
+    return data;
+}
+
+static void unmap_file(const void* data, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+static int open_view_file(RenderView* v, const char* path) {
+    size_t size = 0;
+    const void* data = map_file(path, &size);
+    if (!data) return 0;
+    memset(v, 0, sizeof(*v));
+    if (!memory_charge(MEMORY_ORBIT, (long long)size)) {
+        unmap_file(data, size);
+        return 0;
+    }
+    if (!read_view_blob(v, data, (long long)size, 1)) {
+        unmap_file(data, size);
+        memory_uncharge(MEMORY_ORBIT, (long long)size);
+        return 0;
+    }
+    v->orbit.mapping = data;
+    v->orbit.mapping_size = size;
+    return 1;
+}
+
+// Write to a temporary file and rename it over path, so readers never map a
+// partial file. Returns 1 on success.
+static int save_view_file(const RenderView* v, const char* path) {
+    long long size = view_blob_size(v);
+    char* blob = (char*)memory_alloc(MEMORY_STAGING, (size_t)size);
+    if (!blob) return 0;
+    write_view_blob(v, blob);
+
+    char tmp[1100];
+#ifdef _WIN32
+    unsigned long pid = GetCurrentProcessId();
+#else
+    unsigned long pid = (unsigned long)getpid();
+#endif
+    snprintf(tmp, sizeof(tmp), "%s.%lu.tmp", path, pid);
+    FILE* f = fopen(tmp, "wb");
+    int ok = f && fwrite(blob, 1, (size_t)size, f) == (size_t)size;
+    if (f && fclose(f) != 0) ok = 0;
+    memory_free(blob);
+#ifdef _WIN32
+    ok = ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename(tmp, path) == 0;
+#endif
+    if (!ok) remove(tmp);
+    return ok;
+}
+
+// Cache file of an orbit: FNV-1a of everything the orbit and approximation depend on
+static void orbit_cache_path(
+    char* path, size_t capacity,
+    Real128 center_r, Real128 center_i, Real128 dx, Real128 dy,
+    int formula, int julia, Real128 julia_r, Real128 julia_i,
+    int width, int height, long long max_iter
+) {
+    unsigned char key[6 * sizeof(Real128) + 4 * sizeof(int) + sizeof(long long)];
+    unsigned char* k = key;
+    memcpy(k, &center_r, sizeof(Real128)); k += sizeof(Real128);
+    memcpy(k, &center_i, sizeof(Real128)); k += sizeof(Real128);
+    memcpy(k, &dx, sizeof(Real128)); k += sizeof(Real128);
+    memcpy(k, &dy, sizeof(Real128)); k += sizeof(Real128);
+    memcpy(k, &julia_r, sizeof(Real128)); k += sizeof(Real128);
+    memcpy(k, &julia_i, sizeof(Real128)); k += sizeof(Real128);
+    memcpy(k, &formula, sizeof(int)); k += sizeof(int);
+    memcpy(k, &julia, sizeof(int)); k += sizeof(int);
+    memcpy(k, &width, sizeof(int)); k += sizeof(int);
+    memcpy(k, &height, sizeof(int)); k += sizeof(int);
+    memcpy(k, &max_iter, sizeof(long long));
+
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < sizeof(key); i++) {
+        hash ^= key[i];
+        hash *= 1099511628211ULL;
+    }
+    snprintf(path, capacity, "%s/orbit-%016llx-v%d.mbv", g_orbit_cache, hash, VIEW_BLOB_VERSION);
+}
+
+// Map a cached orbit for this location, if one exists and really matches
+static int load_cached_orbit(
+    RenderView* v, const char* path,
+    Real128 center_r, Real128 center_i, Real128 dx, Real128 dy,
+    Real128 julia_r, Real128 julia_i
+) {
+    RenderView cached;
+    if (!open_view_file(&cached, path)) return 0;
+    const ReferenceOrbit* o = &cached.orbit;
+    if (cached.mode != 3 || cached.width != v->width || cached.height != v->height ||
+        cached.max_iter != v->max_iter || o->center_r != center_r || o->center_i != center_i ||
+        o->dx_q != dx || o->dy_q != dy || o->formula != v->formula ||
+        o->julia != v->julia || o->julia_r != julia_r || o->julia_i != julia_i) {
+        free_reference_orbit(&cached.orbit); // Hash collision or stale file
+        return 0;
+    }
+    v->orbit = cached.orbit;
+    return 1;
+}
+
+// Switch v to perturbation: a reference orbit through the centre of the view,
+// loaded from the orbit cache when there is one, and per-pixel deltas in double
+static int setup_perturbation(
+    RenderView* v, Real128 xmin_q, Real128 xmax_q, Real128 ymin_q, Real128 ymax_q,
+    Real128 julia_r, Real128 julia_i, RenderProgress* progress, RenderTrace* trace
+) {
+    v->mode = 3;
+    Real128 center_r = (xmin_q + xmax_q) / 2.0Q;
+    Real128 center_i = (ymin_q + ymax_q) / 2.0Q;
+    Real128 dx_q = (xmax_q - xmin_q) / v->width;
+    Real128 dy_q = (ymax_q - ymin_q) / v->height;
+    v->dx_d = (double)dx_q;
+    v->dy_d = (double)dy_q;
+
+    char cache_path[1100];
+    if (g_orbit_cache[0]) {
+        orbit_cache_path(cache_path, sizeof(cache_path), center_r, center_i, dx_q, dy_q,
+                         v->formula, v->julia, julia_r, julia_i, v->width, v->height, v->max_iter);
+        long long load_start = trace_start(trace);
+        if (load_cached_orbit(v, cache_path, center_r, center_i, dx_q, dy_q, julia_r, julia_i)) {
+            if (progress) __atomic_store_n(&progress->orbit_iterations, v->orbit.ref_iter, __ATOMIC_RELAXED);
+            trace_end(trace, TRACE_ORBIT_LOAD, load_start, v->orbit.ref_iter, 0, 0, 0);
+            PROBE2(orbit__done, v->orbit.ref_iter, 1);
+            PROBE2(series__skip, v->orbit.skip_iter, v->orbit.ref_iter);
+            count_metric(&g_metrics.orbit_cache_hits, 1);
+            count_metric(&g_metrics.reference_iterations, v->orbit.ref_iter);
+            count_metric(&g_metrics.series_skipped_iterations, v->orbit.skip_iter);
+            return 1;
+        }
+        count_metric(&g_metrics.orbit_cache_misses, 1);
+    }
+
+    set_progress_phase(progress, PHASE_REFERENCE_ORBIT);
+    if (!build_reference_orbit(&v->orbit, center_r, center_i, dx_q, dy_q,
+                               v->formula, v->julia, julia_r, julia_i, v->width, v->height, v->max_iter,
+                               progress, trace)) {
+        return 0;
+    }
+    if (g_orbit_cache[0]) save_view_file(v, cache_path); // Best effort
+    return 1;
+}
+
+// Parse the view and pick a precision mode; builds the reference orbit when needed.
+// With julia_r_str and julia_i_str set the view shows that Julia set instead
+// of the Mandelbrot set. Unknown formulas fall back to z^2 + c.
+static int setup_view(
+    RenderView* v,
     const char* xmin_str, const char* xmax_str, int width,
     const char* ymin_str, const char* ymax_str, int height,
-    int max_iter,
-    double* output
+    const char* julia_r_str, const char* julia_i_str, int formula,
+    long long max_iter,
+    RenderProgress* progress, RenderTrace* trace
 ) {
     // Parse as 128-bit first to check width
     Real128 xmin_q = STRTOREAL128(xmin_str);
     Real128 xmax_q = STRTOREAL128(xmax_str);
     Real128 ymin_q = STRTOREAL128(ymin_str);
     Real128 ymax_q = STRTOREAL128(ymax_str);
-    
-    Real128 w_real = xmax_q - xmin_q;
-    
-    // Thresholds:
-    // double: > 1e-13
-    // long double: > 1e-17 (Extended range for 80-bit)
-    // Perturbation: <= 1e-17
-    
-    if (w_real > 1.0e-13Q) {
+
+    memset(v, 0, sizeof(*v));
+    v->width = width;
+    v->height = height;
+    v->max_iter = max_iter;
+    v->formula = (formula > 0 && formula < FORMULA_COUNT) ? formula : FORMULA_MANDELBROT;
+    v->progress = progress;
+    v->trace = trace;
+
+    Real128 julia_r = 0.0Q, julia_i = 0.0Q;
+    if (julia_r_str && julia_i_str) {
+        v->julia = 1;
+        julia_r = STRTOREAL128(julia_r_str);
+        julia_i = STRTOREAL128(julia_i_str);
+        v->julia_r_d = (double)julia_r;
+        v->julia_i_d = (double)julia_i;
+        v->julia_r_l = (Real80)julia_r;
+        v->julia_i_l = (Real80)julia_i;
+    }
+
+    Real128 julia_c[2] = {julia_r, julia_i};
+    PrecisionChoice choice;
+    int mode = pick_precision(xmin_q, xmax_q, ymin_q, ymax_q, width, height, v->julia ? julia_c : NULL, &choice);
+    PROBE3(precision__mode, mode, choice.reason, (int)ceil(choice.bits_needed));
+
+    if (mode == 0) {
         // Double precision
-        double xmin_d = (double)xmin_q;
-        double ymin_d = (double)ymin_q;
-        double dx_d = (double)((xmax_q - xmin_q) / width);
-        double dy_d = (double)((ymax_q - ymin_q) / height);
-        
-        #ifdef _OPENMP
-        #pragma omp parallel for schedule(guided) collapse(2)
-        #endif
-        for (int py = 0; py < height; py++) {
-            for (int px = 0; px < width; px++) {
-                double cr = xmin_d + dx_d * px;
-                double ci = ymin_d + dy_d * py;
-                output[py * width + px] = mandelbrot_point_smooth_double(cr, ci, max_iter);
-            }
-        }
-    } else if (w_real > 1.0e-17Q) {
+        v->mode = 0;
+        v->xmin_d = (double)xmin_q;
+        v->ymin_d = (double)ymin_q;
+        v->dx_d = (double)((xmax_q - xmin_q) / width);
+        v->dy_d = (double)((ymax_q - ymin_q) / height);
+    } else if (mode == 1) {
         // Long double precision (80-bit)
-        Real80 xmin_l = (Real80)xmin_q;
-        Real80 ymin_l = (Real80)ymin_q;
-        Real80 dx_l = (Real80)((xmax_q - xmin_q) / width);
-        Real80 dy_l = (Real80)((ymax_q - ymin_q) / height);
+        v->mode = 1;
+        v->xmin_l = (Real80)xmin_q;
+        v->ymin_l = (Real80)ymin_q;
+        v->dx_l = (Real80)((xmax_q - xmin_q) / width);
+        v->dy_l = (Real80)((ymax_q - ymin_q) / height);
+    } else if (!setup_perturbation(v, xmin_q, xmax_q, ymin_q, ymax_q, julia_r, julia_i, progress, trace)) {
+        return 0;
+    }
+    return 1;
+}
 
-        #ifdef _OPENMP
-        #pragma omp parallel for schedule(guided) collapse(2)
-        #endif
-        for (int py = 0; py < height; py++) {
-            for (int px = 0; px < width; px++) {
-                Real80 cr = xmin_l + dx_l * px;
-                Real80 ci = ymin_l + dy_l * py;
-                output[py * width + px] = mandelbrot_point_smooth_long(cr, ci, max_iter);
+// Pixel (px, py) of v in quad, from the coordinates its own mode computes with
+static void pixel_quad(const RenderView* v, int px, int py, Real128* re, Real128* im) {
+    if (v->mode == 3) {
+        *re = v->orbit.center_r + (px - v->width / 2.0Q - v->ref_shift_x) * v->orbit.dx_q;
+        *im = v->orbit.center_i + (py - v->height / 2.0Q - v->ref_shift_y) * v->orbit.dy_q;
+    } else if (v->mode == 1) {
+        *re = (Real128)v->xmin_l + (Real128)v->dx_l * px;
+        *im = (Real128)v->ymin_l + (Real128)v->dy_l * py;
+    } else {
+        *re = (Real128)v->xmin_d + (Real128)v->dx_d * px;
+        *im = (Real128)v->ymin_d + (Real128)v->dy_d * py;
+    }
+}
+
+static void release_view(RenderView* v) {
+    free_reference_orbit(&v->orbit);
+}
+
+// Iterations the kernels ran for pixels [px0, px0 + count) of row py, read
+// back from their smooth values so the kernels themselves stay untouched:
+// the escape count, less the iterations the series approximation skipped.
+// Interior pixels ran to max_iter, or to the end of the reference orbit in
+// perturbation views, except those the cardioid test settled without
+// iterating (mandelbrot_point_smooth_double()).
+static long long span_iterations(const RenderView* v, int py, int px0, const double* row, int count) {
+    const long long skipped = v->mode == 3 ? v->orbit.skip_iter : 0;
+    const long long bounded = v->mode == 3 ? v->orbit.ref_iter - skipped : v->max_iter;
+    const int shortcut = v->mode != 3 && !v->julia && !v->aux && v->formula == FORMULA_MANDELBROT;
+    const double im = v->mode == 1 ? (double)(v->ymin_l + v->dy_l * py) : v->ymin_d + v->dy_d * py;
+    long long iterations = 0;
+    for (int i = 0; i < count; i++) {
+        double value = row[i];
+        if (value >= 0.0) {
+            long long escaped = value < 9.0e18 ? (long long)value - skipped : 0;
+            if (escaped > 0) iterations += escaped;
+        } else if (value < 0.0) { // Neither for NaN
+            if (shortcut) {
+                double re = v->mode == 1 ? (double)(v->xmin_l + v->dx_l * (px0 + i)) : v->xmin_d + v->dx_d * (px0 + i);
+                if (in_main_cardioid(re, im)) continue;
             }
+            iterations += bounded;
+        }
+    }
+    return iterations;
+}
+
+// Credit a finished row to the calling thread
+static void report_row_progress(RenderProgress* progress, int count, long long iterations) {
+    int slot = 0;
+    #ifdef _OPENMP
+    slot = omp_get_thread_num() % MAX_PROGRESS_THREADS;
+    #endif
+    ThreadProgress* p = &progress->slots[slot];
+    __atomic_store_n(&p->phase, PHASE_PIXELS, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->pixels_done, (long long)count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&p->iterations_done, iterations, __ATOMIC_RELAXED);
+}
+
+// Direct evaluation of the point (re, im): c for the Mandelbrot set, z0 for a Julia set
+KERNEL double direct_point_double(const RenderView* v, int formula, double re, double im, double* aux) {
+    if (v->julia) {
+        return escape_smooth_double(formula, re, im, v->julia_r_d, v->julia_i_d, v->max_iter, v->deterministic,
+                                    aux, 1, v->stripe_density);
+    }
+    if (aux) return escape_smooth_double(formula, 0.0, 0.0, re, im, v->max_iter, v->deterministic, aux, 0, v->stripe_density);
+    return mandelbrot_point_smooth_double(formula, re, im, v->max_iter, v->deterministic);
+}
+
+KERNEL double direct_point_long(const RenderView* v, int formula, Real80 re, Real80 im, double* aux) {
+    if (v->julia) {
+        return escape_smooth_long(formula, re, im, v->julia_r_l, v->julia_i_l, v->max_iter, v->deterministic,
+                                  aux, 1, v->stripe_density);
+    }
+    if (aux) return escape_smooth_long(formula, 0.0, 0.0, re, im, v->max_iter, v->deterministic, aux, 0, v->stripe_density);
+    return mandelbrot_point_smooth_long(formula, re, im, v->max_iter, v->deterministic);
+}
+
+// Call kernel(v, formula, ...) with v's formula as a constant, so the compiler
+// specialises the inlined kernels for each one
+#define DISPATCH_FORMULA(kernel, v, ...) do { \
+    switch ((v)->formula) { \
+    case FORMULA_MULTIBROT3: kernel(v, FORMULA_MULTIBROT3, __VA_ARGS__); break; \
+    case FORMULA_BURNING_SHIP: kernel(v, FORMULA_BURNING_SHIP, __VA_ARGS__); break; \
+    default: kernel(v, FORMULA_MANDELBROT, __VA_ARGS__); break; \
+    } \
+} while (0)
+
+// Double precision pixels [px0, px1) of row py, groups * 4 at a time
+KERNEL void direct_row_double(const RenderView* v, int formula, int groups,
+                              int py, int px0, int px1, double* dst, double* aux) {
+    const int lanes = 4 * groups;
+    double im = v->ymin_d + v->dy_d * py;
+    double re8[DIRECT_LANES], im8[DIRECT_LANES];
+    for (int k = 0; k < lanes; k++) im8[k] = im;
+    int px = px0;
+    for (; px <= px1 - lanes; px += lanes) {
+        for (int k = 0; k < lanes; k++) re8[k] = v->xmin_d + v->dx_d * (px + k);
+        escape_block_double(formula, groups, re8, im8, v->julia, v->julia_r_d, v->julia_i_d,
+                             v->max_iter, v->deterministic, dst + (px - px0),
+                             aux ? aux + (px - px0) : NULL, v->stripe_density);
+    }
+    for (; px < px1; px++) {
+        dst[px - px0] = direct_point_double(v, formula, v->xmin_d + v->dx_d * px, im,
+                                            aux ? aux + (px - px0) : NULL);
+    }
+}
+
+// Evaluate pixels [px0, px1) of row py into dst[0 .. px1 - px0), and their
+// auxiliary planes into aux unless it is NULL, with the kernel variants the
+// tuning profile selects
+KERNEL void render_span_formula(const RenderView* v, int formula, int py, int px0, int px1, double* dst, double* aux) {
+    if (v->mode == 0) {
+        if (tuned_direct_groups() == 1) {
+            direct_row_double(v, formula, 1, py, px0, px1, dst, aux);
+        } else {
+            direct_row_double(v, formula, 2, py, px0, px1, dst, aux);
         }
+    } else if (v->mode == 1) {
+        Real80 im = v->ymin_l + v->dy_l * py;
+        for (int px = px0; px < px1; px++) {
+            dst[px - px0] = direct_point_long(v, formula, v->xmin_l + v->dx_l * px, im,
+                                              aux ? aux + (px - px0) : NULL);
+        }
+    } else if (tuned_escape_interval(v) == 8) {
+        perturbation_row(v, formula, 8, py, px0, px1, dst, aux);
     } else {
-        // Perturbation Theory (Hybrid Quad/Double)
-        Real128 center_r = (xmin_q + xmax_q) / 2.0Q;
-        Real128 center_i = (ymin_q + ymax_q) / 2.0Q;
-        Real128 dx_q = (xmax_q - xmin_q) / width;
-        Real128 dy_q = (ymax_q - ymin_q) / height;
-        
-        compute_mandelbrot_perturbation(center_r, center_i, dx_q, dy_q, width, height, max_iter, output);
+        perturbation_row(v, formula, 4, py, px0, px1, dst, aux);
+    }
+}
+
+// aux is the span's planes (AUX_PITCH apart) or NULL
+static void render_span(const RenderView* v, int py, int px0, int px1, double* dst, double* aux) {
+    if (aux) {
+        DISPATCH_FORMULA(render_span_formula, v, py, px0, px1, dst, aux);
+    } else {
+        DISPATCH_FORMULA(render_span_formula, v, py, px0, px1, dst, NULL);
+    }
+}
+
+// Returns the iterations spent, as span_iterations() counts them
+static long long render_tile(const RenderView* v, const Tile* t, const OutputLayout* out) {
+    long long total = 0;
+    for (int py = t->y0; py < t->y1; py++) {
+        if (out->stride == 1 && !v->aux) {
+            double* dst = layout_pixel(out, t->x0, py);
+            render_span(v, py, t->x0, t->x1, dst, NULL);
+            long long iterations = span_iterations(v, py, t->x0, dst, t->x1 - t->x0);
+            if (v->progress) report_row_progress(v->progress, t->x1 - t->x0, iterations);
+            total += iterations;
+            continue;
+        }
+
+        // Interleaved output or auxiliary planes: compute contiguous runs, then scatter them
+        double span[SPAN_CHUNK];
+        double planes[v->aux ? AUX_PLANES * AUX_PITCH : 1];
+        for (int px0 = t->x0; px0 < t->x1; px0 += SPAN_CHUNK) {
+            int px1 = (px0 + SPAN_CHUNK < t->x1) ? px0 + SPAN_CHUNK : t->x1;
+            render_span(v, py, px0, px1, span, v->aux ? planes : NULL);
+            long long offset = layout_pixel(out, px0, py) - out->base;
+            for (int i = 0; i < px1 - px0; i++) out->base[offset + i * out->stride] = span[i];
+            for (int p = 0; v->aux && p < AUX_PLANES; p++) {
+                if (!out->aux[p]) continue;
+                for (int i = 0; i < px1 - px0; i++) out->aux[p][offset + i * out->stride] = planes[p * AUX_PITCH + i];
+            }
+            long long iterations = span_iterations(v, py, px0, span, px1 - px0);
+            if (v->progress) report_row_progress(v->progress, px1 - px0, iterations);
+            total += iterations;
+        }
+    }
+    return total;
+}
+
+// Evaluate count points given in (possibly fractional) pixel coordinates.
+// Consecutive points share AVX2 lanes whatever their position in the frame;
+// a partial last group is padded by repeating its final point, so every point
+// takes the same 4-wide path, at the same tuned escape interval, as in a
+// dense render.
+KERNEL void evaluate_point_chunk_formula(
+    const RenderView* v, int formula, const double* xs, const double* ys, int count, double* values
+) {
+    if (v->mode == 0) {
+        int i = 0;
+        for (; i <= count - DIRECT_LANES; i += DIRECT_LANES) {
+            double re8[DIRECT_LANES], im8[DIRECT_LANES];
+            for (int k = 0; k < DIRECT_LANES; k++) {
+                re8[k] = v->xmin_d + v->dx_d * xs[i + k];
+                im8[k] = v->ymin_d + v->dy_d * ys[i + k];
+            }
+            escape_block_double(formula, DIRECT_GROUPS, re8, im8, v->julia, v->julia_r_d, v->julia_i_d,
+                                 v->max_iter, v->deterministic, values + i, NULL, 0);
+        }
+        for (; i < count; i++) {
+            values[i] = direct_point_double(v, formula, v->xmin_d + v->dx_d * xs[i], v->ymin_d + v->dy_d * ys[i], NULL);
+        }
+        return;
+    }
+    if (v->mode == 1) {
+        for (int i = 0; i < count; i++) {
+            values[i] = direct_point_long(v, formula, v->xmin_l + v->dx_l * xs[i], v->ymin_l + v->dy_l * ys[i], NULL);
+        }
+        return;
+    }
+
+    const double ref_x = v->width / 2.0 + v->ref_shift_x;
+    const double ref_y = v->height / 2.0 + v->ref_shift_y;
+    const int interval = tuned_escape_interval(v);
+    for (int i = 0; i < count; i += 4) {
+        double dcr[4], dci[4], out[4];
+        for (int k = 0; k < 4; k++) {
+            int j = (i + k < count) ? i + k : count - 1;
+            dcr[k] = (xs[j] - ref_x) * v->dx_d;
+            dci[k] = (ys[j] - ref_y) * v->dy_d;
+        }
+        if (interval == 8) {
+            perturbation_block4(v, formula, 8, _mm256_loadu_pd(dcr), _mm256_loadu_pd(dci), out, NULL);
+        } else {
+            perturbation_block4(v, formula, 4, _mm256_loadu_pd(dcr), _mm256_loadu_pd(dci), out, NULL);
+        }
+        for (int k = 0; k < 4 && i + k < count; k++) values[i + k] = out[k];
+    }
+}
+
+static void evaluate_point_chunk(const RenderView* v, const double* xs, const double* ys, int count, double* values) {
+    DISPATCH_FORMULA(evaluate_point_chunk_formula, v, xs, ys, count, values);
+}
+
+#define POINT_CHUNK 256
+
+static void evaluate_points(const RenderView* v, const double* xs, const double* ys, long long count, double* values) {
+    long long chunks = (count + POINT_CHUNK - 1) / POINT_CHUNK;
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(render_threads())
+    #endif
+    for (long long c = 0; c < chunks; c++) {
+        long long i0 = c * POINT_CHUNK;
+        int n = (count - i0 < POINT_CHUNK) ? (int)(count - i0) : POINT_CHUNK;
+        evaluate_point_chunk(v, xs + i0, ys + i0, n, values + i0);
+    }
+}
+
+// Evaluate the pixels of roi whose mask byte is non-zero, writing them in place
+// through out. mask covers roi row-major. Selected pixels of a row are packed
+// together before evaluation.
+static long long evaluate_mask(const RenderView* v, const Region* roi, const unsigned char* mask, const OutputLayout* out) {
+    const int roi_width = roi->x1 - roi->x0;
+    long long selected = 0;
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 4) reduction(+:selected) num_threads(render_threads())
+    #endif
+    for (int py = roi->y0; py < roi->y1; py++) {
+        const unsigned char* mask_row = mask + (size_t)(py - roi->y0) * roi_width;
+        double xs[POINT_CHUNK], ys[POINT_CHUNK], values[POINT_CHUNK];
+        int n = 0;
+
+        for (int px = roi->x0; px <= roi->x1; px++) {
+            if (px < roi->x1 && mask_row[px - roi->x0]) {
+                xs[n] = px;
+                ys[n] = py;
+                n++;
+            }
+            if (n == POINT_CHUNK || (px == roi->x1 && n > 0)) {
+                evaluate_point_chunk(v, xs, ys, n, values);
+                for (int i = 0; i < n; i++) *layout_pixel(out, (int)xs[i], py) = values[i];
+                selected += n;
+                n = 0;
+            }
+        }
+    }
+
+    return selected;
+}
+
+static int compare_tiles(const void* a, const void* b) {
+    const Tile* ta = (const Tile*)a;
+    const Tile* tb = (const Tile*)b;
+    if (ta->dist2 < tb->dist2) return -1;
+    if (ta->dist2 > tb->dist2) return 1;
+    return (ta->index > tb->index) - (ta->index < tb->index);
+}
+
+static int normalize_tile_size(int tile_size) {
+    if (tile_size <= 0) tile_size = __atomic_load_n(&g_tuning.tile_size, __ATOMIC_RELAXED);
+    // Tiles a multiple of 4 wide keep every pixel on the AVX2 path
+    return (tile_size + 3) & ~3;
+}
+
+// Split roi into tiles sorted by distance from (focus_x, focus_y). The grid
+// starts at the region's corner, so its index matches a tile_done array sized
+// with render_tile_count(region width, region height, tile_size).
+// Tile index of a grid tiles_x tiles wide over roi
+static void grid_tile(const Region* roi, int tile_size, long long tiles_x, long long index,
+                      int focus_x, int focus_y, Tile* t) {
+    t->x0 = roi->x0 + (int)(index % tiles_x) * tile_size;
+    t->y0 = roi->y0 + (int)(index / tiles_x) * tile_size;
+    t->x1 = (t->x0 + tile_size < roi->x1) ? t->x0 + tile_size : roi->x1;
+    t->y1 = (t->y0 + tile_size < roi->y1) ? t->y0 + tile_size : roi->y1;
+    t->index = index;
+
+    double cx = 0.5 * (t->x0 + t->x1) - focus_x;
+    double cy = 0.5 * (t->y0 + t->y1) - focus_y;
+    t->dist2 = cx * cx + cy * cy;
+}
+
+static Tile* build_tile_order(const Region* roi, int tile_size, int focus_x, int focus_y, long long* count) {
+    long long tiles_x = (roi->x1 - roi->x0 + tile_size - 1) / tile_size;
+    long long tiles_y = (roi->y1 - roi->y0 + tile_size - 1) / tile_size;
+    Tile* tiles = (Tile*)memory_alloc(MEMORY_SCRATCH, sizeof(Tile) * (size_t)(tiles_x * tiles_y));
+    if (!tiles) return NULL;
+
+    for (long long i = 0; i < tiles_x * tiles_y; i++) {
+        grid_tile(roi, tile_size, tiles_x, i, focus_x, focus_y, &tiles[i]);
+    }
+
+    qsort(tiles, (size_t)(tiles_x * tiles_y), sizeof(Tile), compare_tiles);
+    *count = tiles_x * tiles_y;
+    return tiles;
+}
+
+// Tiles a render without room for its tile list hands out at a time
+#define TILE_BATCH 256
+
+// Number of flags a tile_done array needs for a frame (or region of interest)
+// of this size
+EXPORT long long render_tile_count(int width, int height, int tile_size) {
+    tile_size = normalize_tile_size(tile_size);
+    return (long long)((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+}
+
+// Render every tile not yet flagged in tile_done, nearest-first.
+// A tile is not started once deadline (wall_time() seconds, 0 for none) would be
+// overrun by its estimated cost, or once *cancel is set. When tile_cost is not
+// NULL it receives the measured seconds of each rendered tile, by grid index.
+// Returns the number of tiles rendered.
+static long long render_tiles_until(
+    const RenderView* v, const Tile* tiles, long long count,
+    const OutputLayout* out, unsigned char* tile_done,
+    double deadline, const volatile int* cancel,
+    const double* tile_estimate, double* tile_cost
+) {
+    long long rendered = 0;
+
+    // Tiles nearest the focus are handed out first
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) reduction(+:rendered) num_threads(render_threads())
+    #endif
+    for (long long t = 0; t < count; t++) {
+        long long index = tiles[t].index;
+        if (tile_done && __atomic_load_n(&tile_done[index], __ATOMIC_ACQUIRE)) continue;
+        if (cancel && *cancel) continue;
+
+        double start = wall_time();
+        if (deadline > 0.0) {
+            double estimate = tile_estimate ? tile_estimate[index] : 0.0;
+            if (start + estimate > deadline) continue;
+        }
+
+        long long trace_from = trace_start(v->trace);
+        long long iterations = render_tile(v, &tiles[t], out);
+        count_metric(&g_metrics.pixels, (long long)(tiles[t].x1 - tiles[t].x0) * (tiles[t].y1 - tiles[t].y0));
+        count_metric(&g_metrics.iterations, iterations);
+        trace_end(v->trace, TRACE_TILE, trace_from, tiles[t].x0, tiles[t].y0,
+                  tiles[t].x1 - tiles[t].x0, tiles[t].y1 - tiles[t].y0);
+        PROBE4(tile__done, tiles[t].x0, tiles[t].y0, tiles[t].x1 - tiles[t].x0, tiles[t].y1 - tiles[t].y0);
+        if (tile_cost) tile_cost[index] = wall_time() - start;
+        rendered++;
+
+        if (tile_done) {
+            // Publish the tile only once its pixels are visible to other threads
+            __atomic_store_n(&tile_done[index], 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    return rendered;
+}
+
+static void render_view_tiles(
+    const RenderView* v, const Region* roi,
+    int focus_x, int focus_y, int tile_size,
+    const OutputLayout* out, unsigned char* tile_done
+) {
+    long long count = 0;
+    tile_size = normalize_tile_size(tile_size);
+    Tile* tiles = build_tile_order(roi, tile_size, focus_x, focus_y, &count);
+    if (!tiles) {
+        // The memory budget refused the tile list: render the grid row by row
+        // in batches on the stack, giving up the nearest-first order
+        long long tiles_x = (roi->x1 - roi->x0 + tile_size - 1) / tile_size;
+        count = tiles_x * ((roi->y1 - roi->y0 + tile_size - 1) / tile_size);
+        if (tile_done) memset(tile_done, 0, (size_t)count);
+        count_metric(&g_memory.streamed, 1);
+        Tile batch[TILE_BATCH];
+        for (long long first = 0; first < count; first += TILE_BATCH) {
+            int n = count - first < TILE_BATCH ? (int)(count - first) : TILE_BATCH;
+            for (int i = 0; i < n; i++) grid_tile(roi, tile_size, tiles_x, first + i, focus_x, focus_y, &batch[i]);
+            render_tiles_until(v, batch, n, out, tile_done, 0.0, NULL, NULL, NULL);
+        }
+        return;
+    }
+
+    if (tile_done) memset(tile_done, 0, (size_t)count);
+    render_tiles_until(v, tiles, count, out, tile_done, 0.0, NULL, NULL, NULL);
+
+    memory_free(tiles);
+}
+
+// Same view sampled every scale pixels, with at most iter_cap iterations:
+// coarse pixel (px, py) is pixel (px * scale, py * scale) of v, in every mode.
+// Shares the reference orbit of v, so it must not outlive it.
+static RenderView coarse_view(const RenderView* v, int scale, long long iter_cap) {
+    RenderView c = *v;
+    c.width = (v->width + scale - 1) / scale;
+    c.height = (v->height + scale - 1) / scale;
+    // Perturbation offsets count from the reference pixel, which would move
+    // with the rounded-up size; keep it where it is in v
+    c.ref_shift_x = (v->width / 2.0 + v->ref_shift_x) / scale - c.width / 2.0;
+    c.ref_shift_y = (v->height / 2.0 + v->ref_shift_y) / scale - c.height / 2.0;
+    c.dx_d *= scale;
+    c.dy_d *= scale;
+    c.dx_l *= scale;
+    c.dy_l *= scale;
+    if (iter_cap < c.max_iter) {
+        c.max_iter = iter_cap;
+        if (c.orbit.ref_iter > iter_cap) c.orbit.ref_iter = iter_cap;
+        if (c.orbit.skip_iter > c.orbit.ref_iter) c.orbit.skip_iter = c.orbit.ref_iter;
+    }
+    return c;
+}
+
+EXPORT void compute_mandelbrot_str(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    double* output
+) {
+    PROBE3(render__start, width, height, max_iter);
+    double start = wall_time();
+    RenderView view;
+    if (!setup_view(&view, xmin_str, xmax_str, width, ymin_str, ymax_str, height, NULL, NULL, FORMULA_MANDELBROT, max_iter, NULL, NULL)) {
+        return; // Allocation failed
     }
+    Region frame = { 0, 0, width, height };
+    OutputLayout out = dense_layout(output, width);
+    render_view_tiles(&view, &frame, width / 2, height / 2, 0, &out, NULL);
+    release_view(&view);
+    PROBE3(render__done, width, height, view.mode);
+    record_render(view.mode, wall_time() - start);
+}
+
+// Allocate a progress block to pass in RenderOptions
+EXPORT RenderProgress* render_progress_create(void) {
+    RenderProgress* progress = (RenderProgress*)_mm_malloc(sizeof(RenderProgress), 64);
+    if (progress) memset(progress, 0, sizeof(*progress));
+    return progress;
+}
+
+EXPORT void render_progress_free(RenderProgress* progress) {
+    if (progress) _mm_free(progress);
+}
+
+// Read a progress block while its render runs on other threads.
+// thread_pixels and thread_iterations, if not NULL, receive up to max_threads
+// per-thread counters. Returns the current phase.
+EXPORT int render_progress_snapshot(
+    const RenderProgress* progress, ProgressSnapshot* out,
+    long long* thread_pixels, long long* thread_iterations, int max_threads
+) {
+    ProgressSnapshot snap;
+    memset(&snap, 0, sizeof(snap));
+    snap.pixels_total = __atomic_load_n(&progress->pixels_total, __ATOMIC_RELAXED);
+    snap.orbit_iterations = __atomic_load_n(&progress->orbit_iterations, __ATOMIC_RELAXED);
+    snap.phase = __atomic_load_n(&progress->phase, __ATOMIC_RELAXED);
+    snap.threads = __atomic_load_n(&progress->threads, __ATOMIC_RELAXED);
+
+    for (int t = 0; t < snap.threads; t++) {
+        long long pixels = __atomic_load_n(&progress->slots[t].pixels_done, __ATOMIC_RELAXED);
+        long long iterations = __atomic_load_n(&progress->slots[t].iterations_done, __ATOMIC_RELAXED);
+        snap.pixels_done += pixels;
+        snap.iterations_done += iterations;
+        if (t < max_threads) {
+            if (thread_pixels) thread_pixels[t] = pixels;
+            if (thread_iterations) thread_iterations[t] = iterations;
+        }
+    }
+
+    if (out) *out = snap;
+    return snap.phase;
+}
+
+// Allocate a timeline to pass in RenderOptions.trace, with room for
+// events_per_thread spans (0 for 65536) on each of up to MAX_PROGRESS_THREADS
+// OS threads, allocated when a thread records its first span. Renders append
+// to it; render_trace_write() saves what they recorded.
+EXPORT RenderTrace* render_trace_create(long long events_per_thread) {
+    RenderTrace* trace = (RenderTrace*)_mm_malloc(sizeof(RenderTrace), 64);
+    if (!trace) return NULL;
+    memset(trace, 0, sizeof(*trace));
+    trace->capacity = events_per_thread > 0 ? events_per_thread : 65536;
+    trace->epoch_ns = monotonic_ns();
+    return trace;
+}
+
+EXPORT void render_trace_free(RenderTrace* trace) {
+    if (!trace) return;
+    for (int t = 0; t < MAX_PROGRESS_THREADS; t++) memory_free(trace->threads[t].events);
+    _mm_free(trace);
+}
+
+// Forget the recorded spans; not while a traced render runs
+EXPORT void render_trace_clear(RenderTrace* trace) {
+    for (int t = 0; t < MAX_PROGRESS_THREADS; t++) trace->threads[t].count = 0;
+    trace->untracked = 0;
+    trace->epoch_ns = monotonic_ns();
+}
+
+// Spans dropped because a thread's buffer was full, or it had none
+EXPORT long long render_trace_dropped(const RenderTrace* trace) {
+    long long dropped = __atomic_load_n(&trace->untracked, __ATOMIC_RELAXED);
+    for (int t = 0; t < MAX_PROGRESS_THREADS; t++) {
+        long long count = __atomic_load_n(&trace->threads[t].count, __ATOMIC_RELAXED);
+        if (count > trace->capacity) dropped += count - trace->capacity;
+    }
+    return dropped;
+}
+
+// Write the recorded spans to path as Chrome trace-event JSON, one track per
+// OS thread, for chrome://tracing or Perfetto. Call it once the traced
+// renders have returned. Returns the number of spans written, -1 if the file
+// could not be written.
+EXPORT long long render_trace_write(const RenderTrace* trace, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) return -1;
+
+    long long written = 0;
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    for (int t = 0; t < MAX_PROGRESS_THREADS; t++) {
+        const TraceThread* thread = &trace->threads[t];
+        long long count = __atomic_load_n(&thread->count, __ATOMIC_ACQUIRE);
+        if (count > trace->capacity) count = trace->capacity;
+        if (count == 0 || !thread->events) continue;
+
+        fprintf(f, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %lld, "
+                   "\"args\": {\"name\": \"render thread %lld\"}}",
+                written ? ",\n" : "", thread->owner, thread->owner);
+        for (long long i = 0; i < count; i++) {
+            const TraceEvent* e = &thread->events[i];
+            fprintf(f, ",\n{\"ph\": \"X\", \"name\": \"%s\", \"pid\": 1, \"tid\": %lld, "
+                       "\"ts\": %lld.%03lld, \"dur\": %lld.%03lld, \"args\": {",
+                    trace_spans[e->span].name, thread->owner,
+                    e->start_ns / 1000, e->start_ns % 1000,
+                    (e->end_ns - e->start_ns) / 1000, (e->end_ns - e->start_ns) % 1000);
+            for (int a = 0; a < 4 && trace_spans[e->span].args[a]; a++) {
+                fprintf(f, "%s\"%s\": %lld", a ? ", " : "", trace_spans[e->span].args[a], e->args[a]);
+            }
+            fprintf(f, "}}");
+            written++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) return -1;
+    return written;
+}
+
+static void snapshot_latency(const LatencyCounters* h, LatencyHistogram* out) {
+    out->count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    out->sum_seconds = __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1.0e9;
+    for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+        out->buckets[b] = __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+    }
+}
+
+// Read the process-wide counters; any thread, any time. Counters are read one
+// by one, so a snapshot taken mid-render may be a few tiles out of step.
+EXPORT void render_metrics_snapshot(EngineMetrics* out) {
+    memset(out, 0, sizeof(*out));
+    for (int m = 0; m < 4; m++) out->renders[m] = __atomic_load_n(&g_metrics.renders[m], __ATOMIC_RELAXED);
+    out->pixels = __atomic_load_n(&g_metrics.pixels, __ATOMIC_RELAXED);
+    out->iterations = __atomic_load_n(&g_metrics.iterations, __ATOMIC_RELAXED);
+    out->reference_iterations = __atomic_load_n(&g_metrics.reference_iterations, __ATOMIC_RELAXED);
+    out->series_skipped_iterations = __atomic_load_n(&g_metrics.series_skipped_iterations, __ATOMIC_RELAXED);
+    out->orbit_cache_hits = __atomic_load_n(&g_metrics.orbit_cache_hits, __ATOMIC_RELAXED);
+    out->orbit_cache_misses = __atomic_load_n(&g_metrics.orbit_cache_misses, __ATOMIC_RELAXED);
+    snapshot_latency(&g_metrics.render_seconds, &out->render_seconds);
+    snapshot_latency(&g_metrics.orbit_build_seconds, &out->orbit_build_seconds);
+}
+
+// Text written so far, or only measured once the buffer is too small
+typedef struct {
+    char* buffer;
+    long long capacity;
+    long long length;
+} TextOut;
+
+static void text_printf(TextOut* t, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    long long room = t->length < t->capacity ? t->capacity - t->length : 0;
+    int n = vsnprintf(room ? t->buffer + t->length : NULL, (size_t)room, format, args);
+    va_end(args);
+    if (n > 0) t->length += n;
+}
+
+static void text_counter(TextOut* t, const char* name, const char* help, long long value) {
+    text_printf(t, "# HELP %s %s\n# TYPE %s counter\n%s %lld\n", name, help, name, name, value);
+}
+
+static void text_histogram(TextOut* t, const char* name, const char* help, const LatencyHistogram* h) {
+    text_printf(t, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    long long cumulative = 0;
+    for (int b = 0; b < METRICS_LATENCY_BUCKETS; b++) {
+        cumulative += h->buckets[b];
+        if (b < METRICS_LATENCY_BUCKETS - 1) {
+            text_printf(t, "%s_bucket{le=\"%g\"} %lld\n", name, latency_bounds[b], cumulative);
+        } else {
+            text_printf(t, "%s_bucket{le=\"+Inf\"} %lld\n", name, cumulative);
+        }
+    }
+    text_printf(t, "%s_sum %.9g\n%s_count %lld\n", name, h->sum_seconds, name, h->count);
+}
+
+// Write the metrics in the Prometheus text exposition format (version 0.0.4)
+// to buffer. Returns the size the text needs, NUL included; the buffer holds
+// the whole text only when capacity is at least that.
+EXPORT long long render_metrics_format(char* buffer, long long capacity) {
+    static const char* mode_names[4] = {"double", "long_double", "quad", "perturbation"};
+    EngineMetrics m;
+    render_metrics_snapshot(&m);
+    TextOut t = {buffer, capacity, 0};
+
+    text_printf(&t, "# HELP mandelbrot_renders_total Dense renders finished, by precision mode.\n"
+                    "# TYPE mandelbrot_renders_total counter\n");
+    for (int mode = 0; mode < 4; mode++) {
+        if (mode == 2) continue; // No renderer uses it
+        text_printf(&t, "mandelbrot_renders_total{mode=\"%s\"} %lld\n", mode_names[mode], m.renders[mode]);
+    }
+    text_counter(&t, "mandelbrot_pixels_total", "Pixels rendered by tiles.", m.pixels);
+    text_counter(&t, "mandelbrot_iterations_total",
+                 "Iterations the kernels ran for rendered pixels.", m.iterations);
+    text_counter(&t, "mandelbrot_reference_iterations_total",
+                 "Reference orbit iterations of perturbation views.", m.reference_iterations);
+    text_counter(&t, "mandelbrot_series_skipped_iterations_total",
+                 "Reference iterations every pixel skips by series approximation.", m.series_skipped_iterations);
+    text_printf(&t, "# HELP mandelbrot_orbit_cache_requests_total Orbit file cache lookups.\n"
+                    "# TYPE mandelbrot_orbit_cache_requests_total counter\n"
+                    "mandelbrot_orbit_cache_requests_total{result=\"hit\"} %lld\n"
+                    "mandelbrot_orbit_cache_requests_total{result=\"miss\"} %lld\n",
+                m.orbit_cache_hits, m.orbit_cache_misses);
+    text_histogram(&t, "mandelbrot_render_duration_seconds", "Wall time of dense renders.", &m.render_seconds);
+    text_histogram(&t, "mandelbrot_orbit_build_duration_seconds",
+                   "Wall time of reference orbit and series approximation builds.", &m.orbit_build_seconds);
+
+    static const char* memory_names[MEMORY_SUBSYSTEMS] = {"orbit", "cache", "scratch", "staging"};
+    MemoryUsage u;
+    render_memory_usage(&u);
+    text_printf(&t, "# HELP mandelbrot_memory_bytes Engine memory held, by subsystem.\n"
+                    "# TYPE mandelbrot_memory_bytes gauge\n");
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        text_printf(&t, "mandelbrot_memory_bytes{subsystem=\"%s\"} %lld\n", memory_names[s], u.bytes[s]);
+    }
+    text_printf(&t, "# HELP mandelbrot_memory_peak_bytes Most engine memory held at once, by subsystem.\n"
+                    "# TYPE mandelbrot_memory_peak_bytes gauge\n");
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        text_printf(&t, "mandelbrot_memory_peak_bytes{subsystem=\"%s\"} %lld\n", memory_names[s], u.peak[s]);
+    }
+    text_printf(&t, "# HELP mandelbrot_memory_budget_bytes Engine memory budget, 0 for none.\n"
+                    "# TYPE mandelbrot_memory_budget_bytes gauge\n"
+                    "mandelbrot_memory_budget_bytes %lld\n", u.budget);
+    text_counter(&t, "mandelbrot_memory_refused_total", "Allocations refused by the memory budget.", u.refused);
+    text_counter(&t, "mandelbrot_memory_streamed_total",
+                 "Renders that took a smaller working set to fit the memory budget.", u.streamed);
+
+    if (capacity > 0 && t.length >= capacity) buffer[capacity - 1] = '\0';
+    return t.length + 1;
+}
+
+// ---------------------------------------------------------------------------
+// Tuning profiles
+// ---------------------------------------------------------------------------
+
+// Keys of a profile file, one "key = value" per line; '#' starts a comment
+static const struct {
+    const char* key;
+    size_t offset; // Of the field in TuningProfile
+    int integer;
+} tuning_keys[] = {
+    {"tile_size", offsetof(TuningProfile, tile_size), 1},
+    {"threads", offsetof(TuningProfile, threads), 1},
+    {"direct_groups", offsetof(TuningProfile, direct_groups), 1},
+    {"escape_interval", offsetof(TuningProfile, escape_interval), 1},
+    {"iteration_ns_double", offsetof(TuningProfile, iteration_ns[0]), 0},
+    {"iteration_ns_long_double", offsetof(TuningProfile, iteration_ns[1]), 0},
+    {"iteration_ns_perturbation", offsetof(TuningProfile, iteration_ns[3]), 0},
+    {"reference_ns", offsetof(TuningProfile, reference_ns), 0},
+};
+#define TUNING_KEY_COUNT (int)(sizeof(tuning_keys) / sizeof(tuning_keys[0]))
+
+// Replace out-of-range fields of t by the defaults; returns 0 if any was
+static int sanitize_tuning(TuningProfile* t) {
+    static const TuningProfile defaults = {
+        DEFAULT_TILE_SIZE, 0, DIRECT_GROUPS, ESCAPE_INTERVAL, { 0.6, 6.0, 0.0, 2.5 }, 300.0
+    };
+    int valid = 1;
+    if (t->tile_size < 16 || t->tile_size > 1024) {
+        t->tile_size = defaults.tile_size;
+        valid = 0;
+    }
+    t->tile_size = normalize_tile_size(t->tile_size);
+    if (t->threads < 0 || t->threads > 4096) {
+        t->threads = defaults.threads;
+        valid = 0;
+    }
+    if (t->direct_groups != 1 && t->direct_groups != 2) {
+        t->direct_groups = defaults.direct_groups;
+        valid = 0;
+    }
+    if (t->escape_interval != 4 && t->escape_interval != 8) {
+        t->escape_interval = defaults.escape_interval;
+        valid = 0;
+    }
+    for (int m = 0; m < 4; m++) {
+        if (m == 2) continue; // No mode 2
+        if (!(t->iteration_ns[m] > 0.0 && t->iteration_ns[m] < 1.0e6)) {
+            t->iteration_ns[m] = defaults.iteration_ns[m];
+            valid = 0;
+        }
+    }
+    t->iteration_ns[2] = 0.0;
+    if (!(t->reference_ns > 0.0 && t->reference_ns < 1.0e9)) {
+        t->reference_ns = defaults.reference_ns;
+        valid = 0;
+    }
+    return valid;
+}
+
+// Current settings, the cost model included as refined so far
+EXPORT void render_tuning_get(TuningProfile* out) {
+    #ifdef _OPENMP
+    #pragma omp critical(tuning)
+    #endif
+    {
+        *out = g_tuning;
+    }
+}
+
+// Use t from now on. Out-of-range fields take their defaults; returns 0 when
+// any did. Renders already running keep the settings they started with,
+// except that dense rows pick up the kernel variants row by row.
+EXPORT int render_tuning_set(const TuningProfile* t) {
+    TuningProfile clean = *t;
+    int valid = sanitize_tuning(&clean);
+    #ifdef _OPENMP
+    #pragma omp critical(tuning)
+    #endif
+    {
+        __atomic_store_n(&g_tuning.tile_size, clean.tile_size, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_tuning.threads, clean.threads, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_tuning.direct_groups, clean.direct_groups, __ATOMIC_RELAXED);
+        __atomic_store_n(&g_tuning.escape_interval, clean.escape_interval, __ATOMIC_RELAXED);
+        memcpy(g_tuning.iteration_ns, clean.iteration_ns, sizeof(clean.iteration_ns));
+        g_tuning.reference_ns = clean.reference_ns;
+    }
+    return valid;
+}
+
+// Where this host's profile lives: $MANDELBROT_TUNING when set (empty for no
+// profile), otherwise tuning-<host name>.conf in the mandelbrot_fast directory
+// of the user's configuration directory. Hosts sharing a home directory keep
+// separate profiles. Returns the size the path needs, NUL included, as
+// render_metrics_format() does; 1 means there is no profile.
+EXPORT long long render_tuning_default_path(char* buffer, long long capacity) {
+    TextOut t = { buffer, capacity, 0 };
+    const char* override = getenv("MANDELBROT_TUNING");
+    if (override) {
+        text_printf(&t, "%s", override);
+    } else {
+        char host[256] = "localhost";
+        #ifdef _WIN32
+        const char* base = getenv("APPDATA");
+        const char* name = getenv("COMPUTERNAME");
+        if (name) snprintf(host, sizeof(host), "%s", name);
+        if (base) text_printf(&t, "%s\\mandelbrot_fast\\tuning-%s.conf", base, host);
+        #else
+        gethostname(host, sizeof(host) - 1);
+        host[sizeof(host) - 1] = '\0';
+        const char* config = getenv("XDG_CONFIG_HOME");
+        const char* home = getenv("HOME");
+        if (config && config[0]) {
+            text_printf(&t, "%s/mandelbrot_fast/tuning-%s.conf", config, host);
+        } else if (home) {
+            text_printf(&t, "%s/.config/mandelbrot_fast/tuning-%s.conf", home, host);
+        }
+        #endif
+    }
+    if (capacity > 0 && t.length >= capacity) buffer[capacity - 1] = '\0';
+    return t.length + 1;
+}
+
+// Read a profile (NULL for the default path) and use it. Keys it does not
+// give take their defaults, unknown keys are ignored. Returns 1 when the
+// file was read, 0 when there was none (settings unchanged).
+EXPORT int render_tuning_load(const char* path) {
+    char fallback[1100];
+    if (!path) {
+        if (render_tuning_default_path(fallback, sizeof(fallback)) > (long long)sizeof(fallback)) return 0;
+        path = fallback;
+    }
+    if (!path[0]) return 0;
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+
+    TuningProfile t;
+    memset(&t, 0, sizeof(t));
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char key[64];
+        double value;
+        if (line[0] == '#' || sscanf(line, " %63[a-z_] = %lf", key, &value) != 2) continue;
+        for (int k = 0; k < TUNING_KEY_COUNT; k++) {
+            if (strcmp(key, tuning_keys[k].key) != 0) continue;
+            char* field = (char*)&t + tuning_keys[k].offset;
+            if (tuning_keys[k].integer) {
+                *(int*)field = (int)value;
+            } else {
+                *(double*)field = value;
+            }
+        }
+    }
+    fclose(f);
+    render_tuning_set(&t);
+    return 1;
+}
+
+// Write the current settings as a profile (NULL for the default path, whose
+// directory must exist). Returns 1 on success.
+EXPORT int render_tuning_save(const char* path) {
+    char fallback[1100];
+    if (!path) {
+        if (render_tuning_default_path(fallback, sizeof(fallback)) > (long long)sizeof(fallback)) return 0;
+        path = fallback;
+    }
+    if (!path[0]) return 0;
+    TuningProfile t;
+    render_tuning_get(&t);
+    FILE* f = fopen(path, "w");
+    if (!f) return 0;
+    fprintf(f, "# mandelbrot_fast tuning profile (src/autotune.py)\n");
+    for (int k = 0; k < TUNING_KEY_COUNT; k++) {
+        const char* field = (const char*)&t + tuning_keys[k].offset;
+        if (tuning_keys[k].integer) {
+            fprintf(f, "%s = %d\n", tuning_keys[k].key, *(const int*)field);
+        } else {
+            fprintf(f, "%s = %.6g\n", tuning_keys[k].key, *(const double*)field);
+        }
+    }
+    return fclose(f) == 0;
+}
+
+// Each process picks up its host's profile as the library loads
+__attribute__((constructor)) static void load_host_tuning(void) {
+    render_tuning_load(NULL);
+}
+
+static void reset_progress(RenderProgress* progress, int width, int height) {
+    int threads = render_threads();
+    if (threads > MAX_PROGRESS_THREADS) threads = MAX_PROGRESS_THREADS;
+
+    for (int t = 0; t < MAX_PROGRESS_THREADS; t++) {
+        __atomic_store_n(&progress->slots[t].pixels_done, 0LL, __ATOMIC_RELAXED);
+        __atomic_store_n(&progress->slots[t].iterations_done, 0LL, __ATOMIC_RELAXED);
+        __atomic_store_n(&progress->slots[t].phase, PHASE_IDLE, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&progress->orbit_iterations, 0LL, __ATOMIC_RELAXED);
+    __atomic_store_n(&progress->pixels_total, (long long)width * height, __ATOMIC_RELAXED);
+    __atomic_store_n(&progress->threads, threads, __ATOMIC_RELAXED);
+    __atomic_store_n(&progress->phase, PHASE_IDLE, __ATOMIC_RELAXED);
+}
+
+static void finish_progress(RenderProgress* progress) {
+    if (!progress) return;
+    for (int t = 0; t < progress->threads; t++) {
+        __atomic_store_n(&progress->slots[t].phase, PHASE_DONE, __ATOMIC_RELAXED);
+    }
+    set_progress_phase(progress, PHASE_DONE);
+}
+
+// Fill in the defaults of options (which may be NULL) and derive the region to
+// render and where its pixels go. Returns 0 when the region is empty.
+static int resolve_options(
+    const RenderOptions* options, int width, int height, double* output,
+    RenderOptions* opts, Region* roi, OutputLayout* out
+) {
+    memset(opts, 0, sizeof(*opts));
+    opts->focus_x = opts->focus_y = -1;
+    if (options) *opts = *options;
+
+    roi->x0 = opts->roi_x > 0 ? opts->roi_x : 0;
+    roi->y0 = opts->roi_y > 0 ? opts->roi_y : 0;
+    roi->x1 = (opts->roi_width > 0 && roi->x0 + opts->roi_width < width) ? roi->x0 + opts->roi_width : width;
+    roi->y1 = (opts->roi_height > 0 && roi->y0 + opts->roi_height < height) ? roi->y0 + opts->roi_height : height;
+    if (roi->x1 <= roi->x0 || roi->y1 <= roi->y0) return 0;
+
+    if (opts->focus_x < 0 || opts->focus_y < 0) {
+        opts->focus_x = (roi->x0 + roi->x1) / 2;
+        opts->focus_y = (roi->y0 + roi->y1) / 2;
+    }
+
+    out->base = output;
+    out->stride = opts->pixel_stride > 0 ? opts->pixel_stride : 1;
+    out->row_pitch = opts->row_pitch > 0 ? opts->row_pitch : (long long)(roi->x1 - roi->x0) * out->stride;
+    out->x0 = roi->x0;
+    out->y0 = roi->y0;
+    memcpy(out->aux, opts->aux, sizeof(out->aux));
+    return 1;
+}
+
+// Turn on the auxiliary planes of opts for one render of v. The iterations the
+// series approximation skips follow the reference closely, so their trap and
+// stripe terms are taken from it, once for all pixels.
+static void prepare_aux(RenderView* v, const RenderOptions* opts) {
+    v->aux = 0;
+    for (int p = 0; p < AUX_PLANES; p++) {
+        if (opts->aux[p]) v->aux = 1;
+    }
+    v->stripe_density = opts->stripe_density > 0 ? opts->stripe_density : DEFAULT_STRIPE_DENSITY;
+    v->aux_trap0 = INFINITY;
+    v->aux_stripe0 = 0.0;
+    if (!v->aux || v->mode != 3) return;
+
+    long long start = trace_start(v->trace);
+    for (long long n = 1; n < v->orbit.skip_iter; n++) {
+        double zr = v->orbit.refs_r_d[n], zi = v->orbit.refs_i_d[n];
+        double modulus = zr * zr + zi * zi;
+        double term;
+        STRIPE_TERM(SCALAR, zr, zi, modulus, v->stripe_density, term);
+        if (modulus < v->aux_trap0) v->aux_trap0 = modulus;
+        v->aux_stripe0 += term;
+    }
+    trace_end(v->trace, TRACE_AUX_SETUP, start, 0, 0, 0, 0);
+}
+
+// ---------------------------------------------------------------------------
+// Per-frame planning
+// ---------------------------------------------------------------------------
+
+#define COST_MODEL_WEIGHT 0.25
+#define COST_MODEL_MIN_ITERATIONS 1000000 // Smaller renders are too noisy to learn from
+#define PROBE_MIN_SCALE 8                 // The probe renders at most 1/64 of the pixels
+#define PROBE_MAX_SAMPLES 4096
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Render roi of v every plan->probe_scale pixels, at full max_iter, and
+// summarise the samples into plan. Returns 0 when the probe could not be
+// allocated.
+static int probe_frame(const RenderView* v, const Region* roi, FramePlan* plan) {
+    double start = wall_time();
+    double pixels = (double)(roi->x1 - roi->x0) * (roi->y1 - roi->y0);
+    int scale = (int)ceil(sqrt(pixels / PROBE_MAX_SAMPLES));
+    if (scale < PROBE_MIN_SCALE) scale = PROBE_MIN_SCALE;
+
+    RenderView c = coarse_view(v, scale, v->max_iter);
+    c.progress = NULL; // The probe is not part of the frame's progress or timeline
+    c.trace = NULL;
+    c.aux = 0;
+    Region coarse_roi = { roi->x0 / scale, roi->y0 / scale,
+                          (roi->x1 + scale - 1) / scale, (roi->y1 + scale - 1) / scale };
+    int coarse_width = coarse_roi.x1 - coarse_roi.x0;
+    long long samples = (long long)coarse_width * (coarse_roi.y1 - coarse_roi.y0);
+    double* values = (double*)memory_alloc(MEMORY_SCRATCH, sizeof(double) * (size_t)samples);
+    if (!values) return 0;
+
+    OutputLayout out = {
+        .base = values, .row_pitch = coarse_width, .stride = 1,
+        .x0 = coarse_roi.x0, .y0 = coarse_roi.y0, .aux = { NULL }
+    };
+    render_view_tiles(&c, &coarse_roi, (coarse_roi.x0 + coarse_roi.x1) / 2, (coarse_roi.y0 + coarse_roi.y1) / 2,
+                      0, &out, NULL);
+
+    // Escaped values are packed to the front of values for the quantiles
+    long long interior = 0, escaped = 0;
+    double sum = 0.0, sum2 = 0.0;
+    for (long long i = 0; i < samples; i++) {
+        double iterations;
+        if (values[i] < 0.0) {
+            iterations = (double)v->max_iter;
+            interior++;
+        } else if (values[i] >= 0.0) {
+            iterations = values[i];
+            values[escaped++] = values[i];
+        } else {
+            continue; // NaN
+        }
+        sum += iterations;
+        sum2 += iterations * iterations;
+    }
+    long long counted = interior + escaped;
+    double mean = counted > 0 ? sum / counted : 0.0;
+    double variance = counted > 0 ? fmax(sum2 / counted - mean * mean, 0.0) : 0.0;
+    qsort(values, (size_t)escaped, sizeof(double), compare_doubles);
+
+    plan->probe_scale = scale;
+    plan->probe_samples = samples;
+    plan->interior_fraction = counted > 0 ? (double)interior / counted : 0.0;
+    plan->mean_iterations = mean;
+    plan->iteration_cv = mean > 0.0 ? sqrt(variance) / mean : 0.0;
+    plan->escape_p50 = escaped > 0 ? values[escaped / 2] : 0.0;
+    plan->escape_p90 = escaped > 0 ? values[escaped * 9 / 10] : 0.0;
+    memory_free(values);
+    plan->probe_ms = (wall_time() - start) * 1000.0;
+    return 1;
+}
+
+// Tile edge giving the scheduler enough tiles per thread to even out the
+// load: uniform frames balance with a few large tiles, frames mixing interior
+// and fast-escaping pixels need many small ones. Multiples of 16 keep tiles
+// on the AVX2 path.
+static int plan_tile_size(const Region* roi, double iteration_cv, int threads) {
+    int per_thread = iteration_cv < 0.5 ? 4 : (iteration_cv < 1.0 ? 8 : 16);
+    double pixels = (double)(roi->x1 - roi->x0) * (roi->y1 - roi->y0);
+    int size = (int)sqrt(pixels / ((double)per_thread * threads)) & ~15;
+    if (size < 16) size = 16;
+    if (size > 256) size = 256;
+    return size;
+}
+
+static double model_ms(int mode, double pixel_iterations, double reference_iterations, int threads) {
+    double iteration_ns, reference_ns;
+    #ifdef _OPENMP
+    #pragma omp critical(tuning)
+    #endif
+    {
+        iteration_ns = g_tuning.iteration_ns[mode & 3];
+        reference_ns = g_tuning.reference_ns;
+    }
+    return (pixel_iterations * iteration_ns / threads + reference_iterations * reference_ns) * 1.0e-6;
+}
+
+// Probe v over roi and fill in plan. A long double view may move to
+// perturbation (plan->mode 3) when the model finds that cheaper and the
+// centre of the view, where the reference orbit starts, stays bounded: a
+// reference escaping early would cut short every pixel orbiting longer.
+// Deterministic renders keep their mode, as every tile must take the same
+// path. Returns 0 when the probe could not be allocated.
+static int plan_frame(const RenderView* v, const Region* roi, const RenderOptions* opts, FramePlan* plan) {
+    long long trace_from = trace_start(opts->trace);
+    memset(plan, 0, sizeof(*plan));
+    plan->mode = plan->fixed_mode = v->mode;
+    if (!probe_frame(v, roi, plan)) return 0;
+
+    int threads = render_threads();
+    double pixel_iterations = (double)(roi->x1 - roi->x0) * (roi->y1 - roi->y0) * plan->mean_iterations;
+    plan->predicted_ms = model_ms(v->mode, pixel_iterations, 0.0, threads);
+
+    if (v->mode == 1 && !opts->deterministic) {
+        double x = v->width / 2.0, y = v->height / 2.0, centre;
+        evaluate_points(v, &x, &y, 1, &centre);
+        if (centre < 0.0) {
+            double perturbation = model_ms(3, pixel_iterations, (double)v->max_iter, threads);
+            if (perturbation < plan->predicted_ms) {
+                plan->mode = 3;
+                plan->alternative_ms = plan->predicted_ms;
+                plan->predicted_ms = perturbation;
+            } else {
+                plan->alternative_ms = perturbation;
+            }
+        }
+    }
+
+    plan->tile_size = (opts->tile_size > 0 || opts->tile_done)
+                    ? normalize_tile_size(opts->tile_size) // The caller sized tile_done for its grid
+                    : plan_tile_size(roi, plan->iteration_cv, threads);
+    trace_end(opts->trace, TRACE_PLAN, trace_from, plan->mode, plan->tile_size,
+              (long long)(plan->predicted_ms * 1000.0), (long long)(plan->alternative_ms * 1000.0));
+    return 1;
+}
+
+// Record what a planned render cost and learn from it. reference_seconds is
+// the time spent building a reference orbit after the probe, 0 when none was.
+static void finish_plan(FramePlan* plan, const RenderView* v, const Region* roi,
+                        double reference_seconds, double pixel_seconds) {
+    plan->actual_ms = (reference_seconds + pixel_seconds) * 1000.0;
+    PROBE4(frame__plan, plan->mode, plan->tile_size,
+           (long long)(plan->predicted_ms * 1000.0), (long long)(plan->actual_ms * 1000.0));
+
+    int threads = render_threads();
+    double pixel_iterations = (double)(roi->x1 - roi->x0) * (roi->y1 - roi->y0) * plan->mean_iterations;
+    #ifdef _OPENMP
+    #pragma omp critical(tuning)
+    #endif
+    {
+        if (pixel_iterations >= COST_MODEL_MIN_ITERATIONS) {
+            double* ns = &g_tuning.iteration_ns[v->mode & 3];
+            *ns += COST_MODEL_WEIGHT * (pixel_seconds * threads * 1.0e9 / pixel_iterations - *ns);
+        }
+        // Orbits from the orbit cache say nothing about building one
+        if (reference_seconds > 0.0 && v->orbit.ref_iter > 0 && !g_orbit_cache[0]) {
+            double* ns = &g_tuning.reference_ns;
+            *ns += COST_MODEL_WEIGHT * (reference_seconds * 1.0e9 / v->orbit.ref_iter - *ns);
+        }
+    }
+}
+
+static void render_view_strings(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str,
+    long long max_iter,
+    double* output, const RenderOptions* options
+) {
+    RenderOptions opts;
+    Region roi;
+    OutputLayout out;
+    if (!resolve_options(options, width, height, output, &opts, &roi, &out)) return;
+
+    if (opts.progress) reset_progress(opts.progress, roi.x1 - roi.x0, roi.y1 - roi.y0);
+    long long render_start = trace_start(opts.trace);
+    PROBE3(render__start, roi.x1 - roi.x0, roi.y1 - roi.y0, max_iter);
+    double start = wall_time();
+
+    RenderView view;
+    long long setup_start = trace_start(opts.trace);
+    if (!setup_view(&view, xmin_str, xmax_str, width, ymin_str, ymax_str, height,
+                    julia_r_str, julia_i_str, opts.formula, max_iter, opts.progress, opts.trace)) {
+        return; // Allocation failed
+    }
+    trace_end(opts.trace, TRACE_SETUP, setup_start, view.mode, 0, 0, 0);
+    view.deterministic = opts.deterministic;
+
+    FramePlan plan;
+    int tile_size = opts.tile_size;
+    double reference_seconds = 0.0;
+    if (opts.strategy == STRATEGY_AUTO) {
+        if (!plan_frame(&view, &roi, &opts, &plan)) {
+            release_view(&view);
+            return; // Allocation failed
+        }
+        if (plan.mode == 3 && view.mode != 3) {
+            double reference_start = wall_time();
+            Real128 julia_r = julia_r_str ? STRTOREAL128(julia_r_str) : 0.0Q;
+            Real128 julia_i = julia_i_str ? STRTOREAL128(julia_i_str) : 0.0Q;
+            if (!setup_perturbation(&view, STRTOREAL128(xmin_str), STRTOREAL128(xmax_str),
+                                    STRTOREAL128(ymin_str), STRTOREAL128(ymax_str),
+                                    julia_r, julia_i, opts.progress, opts.trace)) {
+                release_view(&view);
+                return; // Allocation failed
+            }
+            reference_seconds = wall_time() - reference_start;
+        }
+        tile_size = plan.tile_size;
+    }
+
+    prepare_aux(&view, &opts);
+    set_progress_phase(opts.progress, PHASE_PIXELS);
+    double pixels_start = wall_time();
+    render_view_tiles(&view, &roi, opts.focus_x, opts.focus_y, tile_size, &out, opts.tile_done);
+    if (opts.strategy == STRATEGY_AUTO) {
+        finish_plan(&plan, &view, &roi, reference_seconds, wall_time() - pixels_start);
+        if (opts.plan) *opts.plan = plan;
+    }
+    release_view(&view);
+    finish_progress(opts.progress);
+    trace_end(opts.trace, TRACE_RENDER, render_start, roi.x1 - roi.x0, roi.y1 - roi.y0, 0, 0);
+    PROBE3(render__done, roi.x1 - roi.x0, roi.y1 - roi.y0, view.mode);
+    record_render(view.mode, wall_time() - start);
+}
+
+// Render with optional settings; options may be NULL for the defaults
+EXPORT void compute_mandelbrot_str_ex(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    double* output, const RenderOptions* options
+) {
+    render_view_strings(xmin_str, xmax_str, width, ymin_str, ymax_str, height, NULL, NULL,
+                        max_iter, output, options);
+}
+
+// Render the Julia set of c = julia_r + i julia_i over the view, with the
+// same kernels, precision modes and options as compute_mandelbrot_str_ex
+EXPORT void compute_julia_str(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str,
+    long long max_iter,
+    double* output, const RenderOptions* options
+) {
+    render_view_strings(xmin_str, xmax_str, width, ymin_str, ymax_str, height, julia_r_str, julia_i_str,
+                        max_iter, output, options);
+}
+
+// Progressive variant: tiles are dispatched nearest-first from the focus pixel
+// (focus_y counts rows from ymin, like output). tile_done, if not NULL, holds
+// one byte per tile of the row-major grid; the engine clears it and sets each
+// byte to 1 once that tile's pixels are written, so another thread can upload
+// finished tiles while the render is still running.
+EXPORT void compute_mandelbrot_str_focus(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    int focus_x, int focus_y, int tile_size,
+    double* output, unsigned char* tile_done
+) {
+    RenderOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.focus_x = focus_x;
+    opts.focus_y = focus_y;
+    opts.tile_size = tile_size;
+    opts.tile_done = tile_done;
+    compute_mandelbrot_str_ex(xmin_str, xmax_str, width, ymin_str, ymax_str, height, max_iter, output, &opts);
+}
+
+// ---------------------------------------------------------------------------
+// Reusable views and sparse evaluation
+// ---------------------------------------------------------------------------
+
+// Parse a view and build its reference orbit once, for repeated sparse queries
+EXPORT RenderView* render_view_create(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter
+) {
+    RenderView* view = (RenderView*)malloc(sizeof(RenderView));
+    if (!view) return NULL;
+    if (!setup_view(view, xmin_str, xmax_str, width, ymin_str, ymax_str, height, NULL, NULL, FORMULA_MANDELBROT, max_iter, NULL, NULL)) {
+        free(view);
+        return NULL; // Allocation failed
+    }
+    return view;
+}
+
+// render_view_create for the Julia set of c = julia_r + i julia_i
+EXPORT RenderView* render_view_create_julia(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str,
+    long long max_iter
+) {
+    return render_view_create_ex(xmin_str, xmax_str, width, ymin_str, ymax_str, height,
+                                 julia_r_str, julia_i_str, FORMULA_MANDELBROT, max_iter);
+}
+
+// render_view_create for any formula, as a Julia set when julia_r and julia_i are set
+EXPORT RenderView* render_view_create_ex(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str, int formula,
+    long long max_iter
+) {
+    RenderView* view = (RenderView*)malloc(sizeof(RenderView));
+    if (!view) return NULL;
+    if (!setup_view(view, xmin_str, xmax_str, width, ymin_str, ymax_str, height,
+                    julia_r_str, julia_i_str, formula, max_iter, NULL, NULL)) {
+        free(view);
+        return NULL; // Allocation failed
+    }
+    return view;
+}
+
+// Precision mode of view and the reason it was chosen; a view read from a
+// file keeps the mode it was saved with
+EXPORT void render_view_precision(const RenderView* view, PrecisionChoice* choice) {
+    Real128 xmin, ymin, xmax, ymax;
+    pixel_quad(view, 0, 0, &xmin, &ymin);
+    pixel_quad(view, view->width, view->height, &xmax, &ymax);
+    Real128 julia_c[2] = {
+        view->mode == 3 ? view->orbit.julia_r : (Real128)view->julia_r_l,
+        view->mode == 3 ? view->orbit.julia_i : (Real128)view->julia_i_l
+    };
+    pick_precision(xmin, xmax, ymin, ymax, view->width, view->height, view->julia ? julia_c : NULL, choice);
+    choice->mode = view->mode;
+}
+
+// Frame size of view in pixels, which bounds the regions it can render
+EXPORT void render_view_size(const RenderView* view, int* width, int* height) {
+    *width = view->width;
+    *height = view->height;
+}
+
+EXPORT void render_view_free(RenderView* view) {
+    if (!view) return;
+    release_view(view);
+    free(view);
+}
+
+// Evaluate count points at pixel coordinates (xs[i], ys[i]) of the view; rows
+// count from ymin as in output, and fractional coordinates give sub-pixel
+// samples. Points should lie within the view, which sized the approximation.
+// Only the deterministic field of options (may be NULL) applies.
+EXPORT void render_view_points(
+    const RenderView* view, const double* xs, const double* ys, long long count, double* values,
+    const RenderOptions* options
+) {
+    RenderView v = *view; // Shares the reference orbit
+    v.deterministic = options ? options->deterministic : 0;
+    evaluate_points(&v, xs, ys, count, values);
+}
+
+// Evaluate only the pixels with a non-zero byte in mask, leaving the rest of
+// output untouched. options (may be NULL) gives the region and output layout as
+// for compute_mandelbrot_str_ex; mask holds one byte per pixel of the region.
+// Returns the number evaluated.
+EXPORT long long render_view_masked(
+    const RenderView* view, const unsigned char* mask, double* output, const RenderOptions* options
+) {
+    RenderOptions opts;
+    Region roi;
+    OutputLayout out;
+    if (!resolve_options(options, view->width, view->height, output, &opts, &roi, &out)) return 0;
+    RenderView v = *view; // Shares the reference orbit
+    v.deterministic = opts.deterministic;
+    return evaluate_mask(&v, &roi, mask, &out);
+}
+
+// Render the region and layout given by options (may be NULL) from a prepared
+// view, as compute_mandelbrot_str_ex does, without parsing the view again or
+// rebuilding its reference orbit.
+EXPORT void render_view_render(const RenderView* view, double* output, const RenderOptions* options) {
+    RenderOptions opts;
+    Region roi;
+    OutputLayout out;
+    if (!resolve_options(options, view->width, view->height, output, &opts, &roi, &out)) return;
+
+    if (opts.progress) reset_progress(opts.progress, roi.x1 - roi.x0, roi.y1 - roi.y0);
+    long long render_start = trace_start(opts.trace);
+    PROBE3(render__start, roi.x1 - roi.x0, roi.y1 - roi.y0, view->max_iter);
+    double start = wall_time();
+    RenderView v = *view; // Shares the reference orbit
+    v.deterministic = opts.deterministic;
+    v.progress = opts.progress;
+    v.trace = opts.trace;
+    prepare_aux(&v, &opts);
+    set_progress_phase(opts.progress, PHASE_PIXELS);
+    render_view_tiles(&v, &roi, opts.focus_x, opts.focus_y, opts.tile_size, &out, opts.tile_done);
+    finish_progress(opts.progress);
+    trace_end(opts.trace, TRACE_RENDER, render_start, roi.x1 - roi.x0, roi.y1 - roi.y0, 0, 0);
+    PROBE3(render__done, roi.x1 - roi.x0, roi.y1 - roi.y0, v.mode);
+    record_render(v.mode, wall_time() - start);
+}
+
+// Serialise a view into buffer (see ViewBlobHeader). Returns the size the
+// blob needs; the buffer is written only when capacity is at least that.
+EXPORT long long render_view_export(const RenderView* view, void* buffer, long long capacity) {
+    long long size = view_blob_size(view);
+    if (buffer && capacity >= size) write_view_blob(view, buffer);
+    return size;
+}
+
+// Rebuild a view from render_view_export() output, copying the orbit. Returns
+// NULL when the blob is truncated, comes from an incompatible build, or
+// allocation fails.
+EXPORT RenderView* render_view_import(const void* buffer, long long size) {
+    RenderView* view = (RenderView*)calloc(1, sizeof(RenderView));
+    if (!view) return NULL;
+    if (!read_view_blob(view, buffer, size, 0)) {
+        free(view);
+        return NULL;
+    }
+    return view;
+}
+
+// Write a view to path as a memory-mappable file, replacing it atomically.
+// Returns 1 on success.
+EXPORT int render_view_save(const RenderView* view, const char* path) {
+    return save_view_file(view, path);
+}
+
+// Map a file written by render_view_save() (or the orbit cache) read-only.
+// The orbit is used in place, so the view is ready without reading the file
+// up front; pages load as pixels first touch them. Returns NULL on failure.
+EXPORT RenderView* render_view_open(const char* path) {
+    RenderView* view = (RenderView*)calloc(1, sizeof(RenderView));
+    if (!view) return NULL;
+    if (!open_view_file(view, path)) {
+        free(view);
+        return NULL;
+    }
+    return view;
+}
+
+// Keep reference orbits of perturbation views in directory, keyed by location,
+// size and max_iter: a render whose file exists maps it instead of computing
+// the orbit, and new orbits are written there. NULL or "" turns the cache off.
+// Call while no render is running.
+EXPORT void render_set_orbit_cache(const char* directory) {
+    if (!directory || strlen(directory) >= sizeof(g_orbit_cache)) {
+        g_orbit_cache[0] = '\0';
+        return;
+    }
+    strcpy(g_orbit_cache, directory);
+}
+
+// ---------------------------------------------------------------------------
+// Deadline-bounded rendering
+// ---------------------------------------------------------------------------
+
+// Per-tile cost of the last frame rendered with the same grid
+static struct {
+    int width, height, tile_size, mode, formula;
+    long long max_iter;
+    Region roi;
+    long long count;
+    double* tile_cost; // Seconds of one thread, by grid index
+} g_cost_history;
+
+// Fill estimates from the previous frame; returns 0 when there is no usable history
+static int load_cost_history(const RenderView* v, const Region* roi, int tile_size, long long count, double* estimate) {
+    int found = 0;
+    #ifdef _OPENMP
+    #pragma omp critical(cost_history)
+    #endif
+    {
+        if (g_cost_history.tile_cost && g_cost_history.count == count &&
+            g_cost_history.width == v->width && g_cost_history.height == v->height &&
+            g_cost_history.tile_size == tile_size && g_cost_history.mode == v->mode &&
+            g_cost_history.formula == v->formula &&
+            memcmp(&g_cost_history.roi, roi, sizeof(Region)) == 0) {
+            // Interior pixels dominate, and they cost max_iter each
+            double iter_ratio = (double)v->max_iter / g_cost_history.max_iter;
+            for (long long i = 0; i < count; i++) estimate[i] = g_cost_history.tile_cost[i] * iter_ratio;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// The copy is made outside the lock, since a refused allocation evicts the history
+static void store_cost_history(const RenderView* v, const Region* roi, int tile_size, long long count, const double* tile_cost) {
+    double* copy = (double*)memory_alloc(MEMORY_CACHE, sizeof(double) * (size_t)count);
+    if (copy) memcpy(copy, tile_cost, sizeof(double) * (size_t)count);
+    double* old;
+    #ifdef _OPENMP
+    #pragma omp critical(cost_history)
+    #endif
+    {
+        old = g_cost_history.tile_cost;
+        g_cost_history.tile_cost = copy;
+        if (copy) {
+            g_cost_history.count = count;
+            g_cost_history.width = v->width;
+            g_cost_history.height = v->height;
+            g_cost_history.roi = *roi;
+            g_cost_history.tile_size = tile_size;
+            g_cost_history.mode = v->mode;
+            g_cost_history.formula = v->formula;
+            g_cost_history.max_iter = v->max_iter;
+        } else {
+            g_cost_history.count = 0;
+        }
+    }
+    memory_free(old);
+}
+
+// Render a coarse version of roi and stretch it over every tile not yet at
+// full quality. Returns the wall time it took, or a negative value on failure.
+static double render_preview(
+    const RenderView* v, int scale, long long iter_cap, const Region* roi,
+    const Tile* tiles, long long count,
+    const OutputLayout* out, const unsigned char* tile_done
+) {
+    double start = wall_time();
+    RenderView c = coarse_view(v, scale, iter_cap);
+    Region coarse_roi = { roi->x0 / scale, roi->y0 / scale,
+                          (roi->x1 + scale - 1) / scale, (roi->y1 + scale - 1) / scale };
+    int coarse_width = coarse_roi.x1 - coarse_roi.x0;
+    int coarse_height = coarse_roi.y1 - coarse_roi.y0;
+    double* coarse = (double*)memory_alloc(MEMORY_STAGING, sizeof(double) * (size_t)coarse_width * coarse_height);
+    if (!coarse) return -1.0;
+
+    OutputLayout coarse_out = {
+        .base = coarse, .row_pitch = coarse_width, .stride = 1,
+        .x0 = coarse_roi.x0, .y0 = coarse_roi.y0, .aux = { NULL }
+    };
+    render_view_tiles(&c, &coarse_roi, (coarse_roi.x0 + coarse_roi.x1) / 2, (coarse_roi.y0 + coarse_roi.y1) / 2,
+                      0, &coarse_out, NULL);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(render_threads())
+    #endif
+    for (long long t = 0; t < count; t++) {
+        const Tile* tile = &tiles[t];
+        if (tile_done[tile->index]) continue;
+        for (int py = tile->y0; py < tile->y1; py++) {
+            const double* src = coarse + (size_t)(py / scale - coarse_roi.y0) * coarse_width;
+            double* dst = layout_pixel(out, tile->x0, py);
+            for (int px = tile->x0; px < tile->x1; px++) {
+                dst[(px - tile->x0) * out->stride] = src[px / scale - coarse_roi.x0];
+            }
+        }
+    }
+
+    memory_free(coarse);
+    return wall_time() - start;
+}
+
+// Background refinement left over from a budgeted render
+typedef struct {
+    RenderView view;
+    Tile* tiles;
+    long long count;
+    int tile_size;
+    Region roi;
+    OutputLayout out;
+    unsigned char* tile_done;
+    unsigned char* own_tile_done; // Allocated by the engine when the caller passed none
+    double* tile_cost;
+    volatile int cancel;
+    volatile int finished;
+    pthread_t thread;
+} RefineJob;
+
+static void free_refine_job(RefineJob* job) {
+    release_view(&job->view);
+    memory_free(job->tiles);
+    memory_free(job->own_tile_done);
+    memory_free(job->tile_cost);
+    free(job);
+}
+
+static void* refine_thread_main(void* arg) {
+    RefineJob* job = (RefineJob*)arg;
+    render_tiles_until(&job->view, job->tiles, job->count, &job->out, job->tile_done,
+                       0.0, &job->cancel, NULL, job->tile_cost);
+    if (!job->cancel) store_cost_history(&job->view, &job->roi, job->tile_size, job->count, job->tile_cost);
+    __atomic_store_n(&job->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Render within budget_ms of wall time, degrading quality rather than latency.
+// A coarse preview (larger pixels, and a lower iteration cap if even that is too
+// slow) is sized from the previous frame's per-tile costs, then full-quality
+// tiles overwrite it nearest-first from the focus pixel until the deadline.
+// options (may be NULL) is as for compute_mandelbrot_str_ex, except that
+// progress is not reported; its tile_done marks the full-quality tiles.
+// quality, if not NULL, describes what was delivered.
+// With refine != 0 and the frame incomplete, the remaining tiles keep rendering
+// in the background and a job handle is returned: output and tile_done must stay
+// valid until render_job_wait() or render_job_cancel() is called on it.
+// Returns NULL otherwise.
+EXPORT void* compute_mandelbrot_str_budget(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    double budget_ms, int refine,
+    double* output, const RenderOptions* options,
+    RenderQuality* quality
+) {
+    double start = wall_time();
+    double deadline = start + budget_ms / 1000.0;
+    RenderQuality q;
+    memset(&q, 0, sizeof(q));
+    q.preview_scale = 1;
+    q.preview_max_iter = max_iter;
+    if (quality) *quality = q;
+
+    RenderOptions opts;
+    RefineJob* job = (RefineJob*)calloc(1, sizeof(RefineJob));
+    if (!job) return NULL;
+    if (!resolve_options(options, width, height, output, &opts, &job->roi, &job->out)) {
+        free(job);
+        return NULL; // Empty region
+    }
+    if (!setup_view(&job->view, xmin_str, xmax_str, width, ymin_str, ymax_str, height,
+                    NULL, NULL, opts.formula, max_iter, NULL, opts.trace)) {
+        free(job);
+        return NULL; // Allocation failed
+    }
+    job->view.deterministic = opts.deterministic;
+
+    const RenderView* v = &job->view;
+    const Region* roi = &job->roi;
+    const OutputLayout* out = &job->out;
+    job->tile_size = normalize_tile_size(opts.tile_size);
+    job->tiles = build_tile_order(roi, job->tile_size, opts.focus_x, opts.focus_y, &job->count);
+    long long count = job->count;
+    unsigned char* tile_done = opts.tile_done;
+    if (!tile_done) tile_done = job->own_tile_done = (unsigned char*)memory_alloc(MEMORY_SCRATCH, (size_t)count);
+    job->tile_done = tile_done;
+    job->tile_cost = (double*)memory_alloc(MEMORY_SCRATCH, sizeof(double) * (size_t)count);
+    double* estimate = (double*)memory_alloc(MEMORY_SCRATCH, sizeof(double) * (size_t)count);
+    if (!job->tiles || !tile_done || !job->tile_cost || !estimate) {
+        memory_free(estimate);
+        free_refine_job(job);
+        return NULL; // Allocation failed
+    }
+    memset(tile_done, 0, (size_t)count);
+
+    int threads = render_threads();
+
+    // Predict the full-quality frame, probing with a coarse preview when this
+    // grid has no history yet
+    double predicted = -1.0;
+    if (load_cost_history(v, roi, job->tile_size, count, estimate)) {
+        predicted = 0.0;
+        for (long long i = 0; i < count; i++) predicted += estimate[i];
+        predicted /= threads;
+    }
+
+    const int max_scale = 16;
+    int preview_scale = 1;
+    long long preview_iter = max_iter;
+    double remaining = deadline - wall_time();
+
+    if (predicted < 0.0) {
+        double probe = render_preview(v, max_scale, max_iter, roi, job->tiles, count, out, tile_done);
+        if (probe >= 0.0) {
+            preview_scale = max_scale;
+            predicted = probe * max_scale * max_scale;
+        } else {
+            predicted = 0.0;
+        }
+        // Spread the prediction over tiles by pixel count
+        for (long long t = 0; t < count; t++) {
+            const Tile* tile = &job->tiles[t];
+            double share = (double)(tile->x1 - tile->x0) * (tile->y1 - tile->y0) /
+                           ((double)(roi->x1 - roi->x0) * (roi->y1 - roi->y0));
+            estimate[tile->index] = predicted * threads * share;
+        }
+        remaining = deadline - wall_time();
+    }
+
+    if (predicted > 0.6 * remaining) {
+        // The full frame will not make it: pick the finest preview costing at
+        // most a quarter of what is left, capping iterations if needed
+        int scale = 2;
+        while (scale < max_scale && predicted / ((double)scale * scale) > 0.25 * remaining) scale *= 2;
+        double preview_cost = predicted / ((double)scale * scale);
+        long long iter_cap = max_iter;
+        if (preview_cost > 0.25 * remaining) {
+            double ratio = remaining > 0.0 ? 0.25 * remaining / preview_cost : 0.0;
+            iter_cap = (long long)(max_iter * ratio);
+            if (iter_cap < 64) iter_cap = (max_iter < 64) ? max_iter : 64;
+        }
+        // A probe already on screen at this scale has the full iteration count
+        if (preview_scale == 1 || scale < preview_scale) {
+            if (render_preview(v, scale, iter_cap, roi, job->tiles, count, out, tile_done) >= 0.0) {
+                preview_scale = scale;
+                preview_iter = iter_cap;
+            }
+        }
+    }
+
+    // Full-quality tiles, nearest the focus first, until the deadline
+    for (long long i = 0; i < count; i++) job->tile_cost[i] = estimate[i];
+    long long tiles_full = render_tiles_until(v, job->tiles, count, out, tile_done,
+                                        deadline, NULL, estimate, job->tile_cost);
+    memory_free(estimate);
+
+    if (tiles_full < count && preview_scale == 1) {
+        // Estimates were too optimistic: cover what is missing as cheaply as possible
+        if (render_preview(v, max_scale, max_iter, roi, job->tiles, count, out, tile_done) >= 0.0) {
+            preview_scale = max_scale;
+        }
+    }
+
+    q.elapsed_ms = (wall_time() - start) * 1000.0;
+    q.predicted_ms = predicted * 1000.0;
+    q.preview_scale = preview_scale;
+    q.preview_max_iter = preview_iter;
+    q.tiles_total = count;
+    q.tiles_full = tiles_full;
+    q.complete = (tiles_full == count);
+    if (quality) *quality = q;
+
+    if (q.complete || !refine) {
+        store_cost_history(v, roi, job->tile_size, count, job->tile_cost);
+        free_refine_job(job);
+        return NULL;
+    }
+
+    if (pthread_create(&job->thread, NULL, refine_thread_main, job) != 0) {
+        store_cost_history(v, roi, job->tile_size, count, job->tile_cost);
+        free_refine_job(job);
+        return NULL;
+    }
+    return job;
+}
+
+// 1 once a background refinement has rendered every tile (or was cancelled)
+EXPORT int render_job_done(void* handle) {
+    RefineJob* job = (RefineJob*)handle;
+    return __atomic_load_n(&job->finished, __ATOMIC_ACQUIRE);
+}
+
+// Block until the refinement finishes and release it
+EXPORT void render_job_wait(void* handle) {
+    RefineJob* job = (RefineJob*)handle;
+    pthread_join(job->thread, NULL);
+    free_refine_job(job);
+}
+
+// Stop the refinement after the tiles in flight and release it
+EXPORT void render_job_cancel(void* handle) {
+    RefineJob* job = (RefineJob*)handle;
+    job->cancel = 1;
+    pthread_join(job->thread, NULL);
+    free_refine_job(job);
+}
+
+// ---------------------------------------------------------------------------
+// Accuracy audits
+// ---------------------------------------------------------------------------
+
+#define AUDIT_DEFAULT_SAMPLES 256
+
+// Background audit of a view against brute-force __float128 iteration
+typedef struct {
+    RenderView view; // Shallow copy: the caller's view must outlive the audit
+    long long samples;
+    double deadline; // wall_time() at which no new pixel is started, 0 for none
+    unsigned long long seed;
+    AuditReport* report;
+    volatile int cancel;
+    volatile int finished;
+    pthread_t thread;
+} AuditJob;
+
+// Let the render threads have the cores: the audit only uses idle time
+static void lower_thread_priority(void) {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#elif defined(__linux__)
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19); // Niceness is per thread on Linux
+#endif
+}
+
+// Brute-force value of a perturbation pixel from z = (zr, zi) and c = (cr, ci):
+// z is iterated in quad, but tested for escape only where perturbation_block4()
+// tests it, every interval iterations from the series skip, then every
+// iteration once fewer than interval reference iterations remain. Where the
+// escape is seen moves the smooth count, so this leaves the arithmetic alone
+// to compare. interval 1 is the scalar path's schedule.
+static double perturbation_reference_quad(const RenderView* v, Real128 zr, Real128 zi, Real128 cr, Real128 ci,
+                                          int interval) {
+    const long long skip = v->orbit.skip_iter;
+    long long every = skip; // First iteration of the per-iteration tail
+    while (every + interval < v->orbit.ref_iter) every += interval;
+
+    Real128 zr2 = zr * zr, zi2 = zi * zi;
+    for (long long i = 0; i < v->max_iter; i++) {
+        int tested = i >= every || (i > skip && (i - skip) % interval == 0);
+        if (tested && zr2 + zi2 > PERTURBATION_BAILOUT) {
+            return smooth_count(v->formula, i, (double)(zr2 + zi2), v->deterministic);
+        }
+        Real128 nr, ni;
+        FORMULA_STEP(SCALAR, v->formula, zr, zi, zr2, zi2, cr, ci, nr, ni);
+        zr = nr;
+        zi = ni;
+        zr2 = zr * zr;
+        zi2 = zi * zi;
+    }
+    return -v->max_iter;
+}
+
+static void* audit_thread_main(void* arg) {
+    AuditJob* job = (AuditJob*)arg;
+    const RenderView* v = &job->view;
+    AuditReport* r = job->report;
+    lower_thread_priority();
+
+    Real128 julia_r = v->mode == 3 ? v->orbit.julia_r : (Real128)v->julia_r_l;
+    Real128 julia_i = v->mode == 3 ? v->orbit.julia_i : (Real128)v->julia_i_l;
+    double start = wall_time();
+    double error_sum = 0.0, max_error = 0.0;
+    long long checked = 0, mismatches = 0, escaped_both = 0;
+
+    for (long long s = 0; s < job->samples && !job->cancel; s++) {
+        if (job->deadline > 0.0 && wall_time() > job->deadline) break;
+        double x = (double)(int)(sample_random(job->seed, s, 0) * v->width);
+        double y = (double)(int)(sample_random(job->seed, s, 1) * v->height);
+
+        // The value a render of the view gives: the pixel's lane group, as in a
+        // tile, so it takes the same kernel at the same escape interval
+        double span[DIRECT_LANES];
+        int px0 = (int)x - (int)x % DIRECT_LANES;
+        int px1 = px0 + DIRECT_LANES < v->width ? px0 + DIRECT_LANES : v->width;
+        render_span(v, (int)y, px0, px1, span, NULL);
+        double value = span[(int)x - px0];
+
+        // Then the brute-force one, seeing the escape at the same bailout and iteration
+        Real128 re, im;
+        pixel_quad(v, (int)x, (int)y, &re, &im);
+        double exact;
+        if (v->mode == 3) {
+            int scalar = !v->deterministic && (int)x >= px0 + (px1 - px0) / 4 * 4; // perturbation_row()'s tail
+            int interval = scalar ? 1 : tuned_escape_interval(v);
+            exact = v->julia ? perturbation_reference_quad(v, re, im, julia_r, julia_i, interval)
+                             : perturbation_reference_quad(v, 0.0Q, 0.0Q, re, im, interval);
+        } else {
+            exact = v->julia
+                ? escape_smooth_quad(v->formula, re, im, julia_r, julia_i, v->max_iter, v->deterministic, NULL, 1, 0)
+                : escape_smooth_quad(v->formula, 0.0Q, 0.0Q, re, im, v->max_iter, v->deterministic, NULL, 0, 0);
+        }
+
+        checked++;
+        if ((value >= 0.0) != (exact >= 0.0)) {
+            mismatches++;
+            __atomic_store_n(&r->class_mismatches, mismatches, __ATOMIC_RELAXED);
+        } else if (value >= 0.0) {
+            double error = fabs(value - exact);
+            escaped_both++;
+            error_sum += error;
+            if (error > max_error) {
+                max_error = error;
+                __atomic_store_n(&r->worst_x, (int)x, __ATOMIC_RELAXED);
+                __atomic_store_n(&r->worst_y, (int)y, __ATOMIC_RELAXED);
+                __atomic_store(&r->max_error, &max_error, __ATOMIC_RELAXED);
+            }
+            double mean = error_sum / escaped_both;
+            __atomic_store_n(&r->escaped_both, escaped_both, __ATOMIC_RELAXED);
+            __atomic_store(&r->mean_error, &mean, __ATOMIC_RELAXED);
+        }
+        double elapsed = (wall_time() - start) * 1000.0;
+        __atomic_store(&r->elapsed_ms, &elapsed, __ATOMIC_RELAXED);
+        __atomic_store_n(&r->pixels_checked, checked, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&r->done, 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&job->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Check up to samples random pixels of view (0 for 256), as a render with the
+// view's own settings gives them, against brute-force __float128 iteration
+// from the same coordinates, escape test included, on a low-priority thread,
+// and report how often the two disagree on escaping and by how much the smooth
+// values of pixels both call escaped differ. No pixel is started after
+// budget_ms (0 for no limit); a single quad pixel costs about a microsecond per
+// iteration. report is cleared, then updated as pixels are checked, and may be
+// read at any time; view and report must stay valid until render_audit_wait()
+// or render_audit_cancel() is called on the returned handle.
+// Returns NULL if the thread could not be started.
+EXPORT void* render_audit_start(
+    const RenderView* view, long long samples, double budget_ms, unsigned long long seed, AuditReport* report
+) {
+    memset(report, 0, sizeof(*report));
+    AuditJob* job = (AuditJob*)calloc(1, sizeof(AuditJob));
+    if (!job) return NULL;
+    job->view = *view;
+    job->view.progress = NULL;
+    job->view.trace = NULL;
+    job->view.aux = 0;
+    job->samples = samples > 0 ? samples : AUDIT_DEFAULT_SAMPLES;
+    job->deadline = budget_ms > 0.0 ? wall_time() + budget_ms / 1000.0 : 0.0;
+    job->seed = seed;
+    job->report = report;
+    if (pthread_create(&job->thread, NULL, audit_thread_main, job) != 0) {
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+// 1 once the audit has checked every sample, run out of budget or been cancelled
+EXPORT int render_audit_done(void* handle) {
+    AuditJob* job = (AuditJob*)handle;
+    return __atomic_load_n(&job->finished, __ATOMIC_ACQUIRE);
+}
+
+// Block until the audit finishes and release it
+EXPORT void render_audit_wait(void* handle) {
+    AuditJob* job = (AuditJob*)handle;
+    pthread_join(job->thread, NULL);
+    free(job);
+}
+
+// Stop the audit after the pixel in progress and release it
+EXPORT void render_audit_cancel(void* handle) {
+    AuditJob* job = (AuditJob*)handle;
+    job->cancel = 1;
+    pthread_join(job->thread, NULL);
+    free(job);
+}
+
+// ---------------------------------------------------------------------------
+// Orbit density (Buddhabrot)
+// ---------------------------------------------------------------------------
+
+// Samples c come from [-2, 2]^2, which holds every formula's set
+#define BUDDHA_EXTENT 2.0
+#define BUDDHA_DEFAULT_MAP 512
+#define BUDDHA_DEFAULT_SAMPLES_PER_PIXEL 16
+// Share of samples drawn uniformly, so that cells the grid wrongly shows as
+// barren keep a nonzero probability and the density stays unbiased
+#define BUDDHA_UNIFORM_SHARE 0.0625
+// Private histograms of all threads together stay below this; taller regions
+// are accumulated in bands of rows, every band retracing every sample
+#define BUDDHA_HISTOGRAM_BYTES (256LL << 20)
+// Samples traced per trace_samples call
+#define BUDDHA_CHUNK 64
+// The samples are split into this many blocks of consecutive chunks, each
+// traced by one thread into its histogram and added to the image in block
+// order, so the sums do not depend on the thread count or the schedule
+#define BUDDHA_BLOCKS 128
+
+// Distribution of samples over the cells of a size x size grid on [-2, 2]^2,
+// shared by every render with the same settings
+typedef struct {
+    int formula, size;
+    long long max_iter, min_iter;
+    int refs; // Renders using the map, plus one while it is the cached map
+    double* cdf;    // cdf[k] = P(cell < k), size^2 + 1 entries
+    double* weight; // (1 / cells) / P(cell k): what a sample from cell k counts for
+} SamplingMap;
+
+static SamplingMap* g_sampling_map; // Last map built, reused by later tiles of an image
+static pthread_mutex_t g_sampling_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void release_sampling_map(SamplingMap* map) {
+    pthread_mutex_lock(&g_sampling_lock);
+    int last = --map->refs == 0;
+    pthread_mutex_unlock(&g_sampling_lock);
+    if (!last) return;
+    memory_free(map->cdf);
+    memory_free(map->weight);
+    free(map);
+}
+
+// Render the escape-time grid and turn it into a sampling distribution. An
+// orbit escaping after n >= min_iter iterations adds n points to the density,
+// so a cell is worth its escape count; interior cells and early escapes are
+// worth nothing. The weights are dilated by one cell, since a cell's corner
+// value says little about the rest of a cell on the boundary.
+static SamplingMap* build_sampling_map(int formula, int size, long long max_iter, long long min_iter) {
+    long long cells = (long long)size * size;
+    SamplingMap* map = (SamplingMap*)calloc(1, sizeof(SamplingMap));
+    double* escape = (double*)memory_alloc(MEMORY_SCRATCH, cells * sizeof(double));
+    double* worth = (double*)memory_alloc(MEMORY_SCRATCH, cells * sizeof(double));
+    if (map) {
+        map->cdf = (double*)memory_alloc(MEMORY_CACHE, (cells + 1) * sizeof(double));
+        map->weight = (double*)memory_alloc(MEMORY_CACHE, cells * sizeof(double));
+    }
+    RenderView view;
+    int ok = map && escape && worth && map->cdf && map->weight &&
+             setup_view(&view, "-2", "2", size, "-2", "2", size, NULL, NULL, formula, max_iter, NULL, NULL);
+    if (!ok) {
+        if (map) {
+            memory_free(map->cdf);
+            memory_free(map->weight);
+        }
+        free(map);
+        memory_free(escape);
+        memory_free(worth);
+        return NULL;
+    }
+    Region frame = { 0, 0, size, size };
+    OutputLayout out = dense_layout(escape, size);
+    render_view_tiles(&view, &frame, size / 2, size / 2, 0, &out, NULL);
+    release_view(&view);
+
+    double total = 0.0;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            double best = 0.0;
+            for (int ny = y - 1; ny <= y + 1; ny++) {
+                for (int nx = x - 1; nx <= x + 1; nx++) {
+                    if (nx < 0 || ny < 0 || nx >= size || ny >= size) continue;
+                    double n = escape[(long long)ny * size + nx];
+                    if (n > 0.0 && n >= (double)min_iter && n > best) best = n;
+                }
+            }
+            worth[(long long)y * size + x] = best;
+            total += best;
+        }
+    }
+
+    double sum = 0.0;
+    for (long long k = 0; k < cells; k++) {
+        double p = total > 0.0
+            ? (1.0 - BUDDHA_UNIFORM_SHARE) * worth[k] / total + BUDDHA_UNIFORM_SHARE / cells
+            : 1.0 / cells;
+        map->cdf[k] = sum;
+        map->weight[k] = 1.0 / (cells * p);
+        sum += p;
+    }
+    map->cdf[cells] = sum;
+    map->formula = formula;
+    map->size = size;
+    map->max_iter = max_iter;
+    map->min_iter = min_iter;
+    map->refs = 1;
+    memory_free(escape);
+    memory_free(worth);
+    return map;
+}
+
+// The cached map for these settings, built if needed; release it when done
+static SamplingMap* acquire_sampling_map(int formula, int size, long long max_iter, long long min_iter) {
+    pthread_mutex_lock(&g_sampling_lock);
+    SamplingMap* map = g_sampling_map;
+    if (map && map->formula == formula && map->size == size &&
+        map->max_iter == max_iter && map->min_iter == min_iter) {
+        map->refs++;
+        pthread_mutex_unlock(&g_sampling_lock);
+        return map;
+    }
+    pthread_mutex_unlock(&g_sampling_lock);
+
+    map = build_sampling_map(formula, size, max_iter, min_iter);
+    if (!map) return NULL;
+    map->refs = 2; // The caller's reference and the cache's
+    pthread_mutex_lock(&g_sampling_lock);
+    SamplingMap* old = g_sampling_map;
+    g_sampling_map = map;
+    pthread_mutex_unlock(&g_sampling_lock);
+    if (old) release_sampling_map(old);
+    return map;
+}
+
+// Cell holding the cumulative probability u
+static inline long long pick_cell(const SamplingMap* map, double u) {
+    long long lo = 0, hi = (long long)map->size * map->size - 1;
+    while (lo < hi) {
+        long long mid = (lo + hi + 1) / 2;
+        if (map->cdf[mid] <= u) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+// Period-2 bulb of z^2 + c, where every point is bounded
+static inline int in_period2_bulb(double cr, double ci) {
+    return (cr + 1.0) * (cr + 1.0) + ci * ci < 0.0625;
+}
+
+// One render's worth of orbit tracing, split into bands of histogram rows
+typedef struct {
+    int formula;
+    long long max_iter, min_iter;
+    unsigned long long seed;
+    const SamplingMap* map; // NULL for uniform sampling
+    double xmin, ymin, inv_dx, inv_dy;
+    Region band; // Pixels accumulated by this pass
+    RenderProgress* progress;
+} OrbitDensity;
+
+// Trace samples [s0, s1) and add every orbit that escapes after at least
+// min_iter iterations to hist, the band's pixels row by row. orbit has room
+// for max_iter points, or is NULL to trace escaping orbits a second time
+// instead of keeping them; the points are the same either way.
+// *recorded counts the orbits added.
+KERNEL void trace_samples_formula(
+    const OrbitDensity* d, int formula, long long s0, long long s1,
+    double* orbit, double* hist, long long* recorded
+) {
+    const SamplingMap* map = d->map;
+    const double cell = map ? 2.0 * BUDDHA_EXTENT / map->size : 2.0 * BUDDHA_EXTENT;
+    const int band_width = d->band.x1 - d->band.x0;
+    long long iterations = 0;
+
+    for (long long s = s0; s < s1; s++) {
+        double cr, ci, weight = 1.0;
+        long long k = 0;
+        if (map) {
+            k = pick_cell(map, sample_random(d->seed, s, 0) * map->cdf[(long long)map->size * map->size]);
+            weight = map->weight[k];
+        }
+        cr = -BUDDHA_EXTENT + ((map ? k % map->size : 0) + sample_random(d->seed, s, 1)) * cell;
+        ci = -BUDDHA_EXTENT + ((map ? k / map->size : 0) + sample_random(d->seed, s, 2)) * cell;
+        if (formula == FORMULA_MANDELBROT && (in_main_cardioid(cr, ci) || in_period2_bulb(cr, ci))) continue;
+
+        double zr = 0.0, zi = 0.0, zr2 = 0.0, zi2 = 0.0;
+        long long n = 0;
+        while (n < d->max_iter && zr2 + zi2 <= 4.0) {
+            double nr, ni;
+            FORMULA_STEP(SCALAR, formula, zr, zi, zr2, zi2, cr, ci, nr, ni);
+            zr = nr;
+            zi = ni;
+            zr2 = zr * zr;
+            zi2 = zi * zi;
+            if (orbit) {
+                orbit[2 * n] = zr;
+                orbit[2 * n + 1] = zi;
+            }
+            n++;
+        }
+        iterations += n;
+        if (zr2 + zi2 <= 4.0 || n < d->min_iter) continue;
+
+        (*recorded)++;
+        zr = zi = zr2 = zi2 = 0.0;
+        for (long long j = 0; j < n; j++) {
+            if (orbit) {
+                zr = orbit[2 * j];
+                zi = orbit[2 * j + 1];
+            } else {
+                double nr, ni;
+                FORMULA_STEP(SCALAR, formula, zr, zi, zr2, zi2, cr, ci, nr, ni);
+                zr = nr;
+                zi = ni;
+                zr2 = zr * zr;
+                zi2 = zi * zi;
+            }
+            double fx = (zr - d->xmin) * d->inv_dx;
+            double fy = (zi - d->ymin) * d->inv_dy;
+            if (fx >= d->band.x0 && fx < d->band.x1 && fy >= d->band.y0 && fy < d->band.y1) {
+                hist[(long long)((int)fy - d->band.y0) * band_width + ((int)fx - d->band.x0)] += weight;
+            }
+        }
+    }
+
+    if (d->progress) {
+        int slot = 0;
+        #ifdef _OPENMP
+        slot = omp_get_thread_num() % MAX_PROGRESS_THREADS;
+        #endif
+        ThreadProgress* p = &d->progress->slots[slot];
+        __atomic_store_n(&p->phase, PHASE_PIXELS, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&p->pixels_done, s1 - s0, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&p->iterations_done, iterations, __ATOMIC_RELAXED);
+    }
+}
+
+static void trace_samples(
+    const OrbitDensity* d, long long s0, long long s1, double* orbit, double* hist, long long* recorded
+) {
+    DISPATCH_FORMULA(trace_samples_formula, d, s0, s1, orbit, hist, recorded);
+}
+
+// Orbit density ("Buddhabrot") of the view: how many points of the orbits of
+// escaping c land in each pixel, for settings->samples values of c spread over
+// [-2, 2]^2. c is drawn from the escape-time grid of the formula, which puts
+// samples where long escaping orbits are, and each orbit counts for the
+// inverse of its likelihood, so the result estimates the density of the same
+// number of uniform samples (which settings->uniform draws instead).
+//
+// The samples are traced in BUDDHA_BLOCKS blocks, one per thread at a time,
+// each into a private histogram of the region; after every round of blocks
+// the histograms are added to the image in block order, so the same seed
+// gives the same image bit for bit on any thread count. Where the memory
+// budget does not leave room for them, the histograms cover fewer rows per
+// band and escaping orbits are traced again instead of being kept. The region, pitch, stride, formula and progress of
+// options apply as for compute_mandelbrot_str_ex; progress counts samples as
+// pixels. Samples depend on the seed only, so regions rendered separately add
+// up to the whole frame, and tiles of a large image share one sampling grid.
+// Returns the number of orbits recorded, or -1 if memory ran out.
+EXPORT long long compute_buddhabrot_str(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter, const BuddhabrotOptions* settings,
+    double* output, const RenderOptions* options
+) {
+    RenderOptions opts;
+    Region roi;
+    OutputLayout out;
+    if (!resolve_options(options, width, height, output, &opts, &roi, &out) || max_iter <= 0) return 0;
+
+    BuddhabrotOptions b;
+    memset(&b, 0, sizeof(b));
+    if (settings) b = *settings;
+    if (b.samples <= 0) b.samples = (long long)width * height * BUDDHA_DEFAULT_SAMPLES_PER_PIXEL;
+    if (b.map_size <= 0) b.map_size = BUDDHA_DEFAULT_MAP;
+
+    OrbitDensity d;
+    memset(&d, 0, sizeof(d));
+    d.formula = (opts.formula > 0 && opts.formula < FORMULA_COUNT) ? opts.formula : FORMULA_MANDELBROT;
+    d.max_iter = max_iter;
+    d.min_iter = b.min_iter;
+    d.seed = b.seed;
+    d.xmin = strtod(xmin_str, NULL);
+    d.ymin = strtod(ymin_str, NULL);
+    d.inv_dx = width / (strtod(xmax_str, NULL) - d.xmin);
+    d.inv_dy = height / (strtod(ymax_str, NULL) - d.ymin);
+    d.progress = opts.progress;
+
+    int threads = render_threads();
+    int band_width = roi.x1 - roi.x0;
+    long long band_rows = BUDDHA_HISTOGRAM_BYTES / ((long long)threads * band_width * sizeof(double));
+    if (band_rows < 1) band_rows = 1;
+    if (band_rows > roi.y1 - roi.y0) band_rows = roi.y1 - roi.y0;
+
+    SamplingMap* map = NULL;
+    if (!b.uniform) {
+        map = acquire_sampling_map(d.formula, b.map_size, max_iter, b.min_iter);
+        if (!map) return -1;
+    }
+    d.map = map;
+    // Halve the band until the histograms fit the memory budget
+    double* hist;
+    int streamed = 0;
+    while (!(hist = (double*)memory_alloc(MEMORY_STAGING, (size_t)(threads * band_rows * band_width) * sizeof(double))) &&
+           band_rows > 1) {
+        band_rows = (band_rows + 1) / 2;
+        streamed = 1;
+    }
+    long long hist_size = band_rows * band_width;
+    double* orbits = hist ? (double*)memory_alloc(MEMORY_SCRATCH, (size_t)(threads * 2 * max_iter) * sizeof(double)) : NULL;
+    if (hist && !orbits) streamed = 1; // Retrace instead
+    if (!hist) {
+        if (map) release_sampling_map(map);
+        return -1;
+    }
+    if (streamed) count_metric(&g_memory.streamed, 1);
+
+    long long bands = (roi.y1 - roi.y0 + band_rows - 1) / band_rows;
+    long long chunks = (b.samples + BUDDHA_CHUNK - 1) / BUDDHA_CHUNK;
+    long long blocks = chunks < BUDDHA_BLOCKS ? chunks : BUDDHA_BLOCKS;
+    if (opts.progress) {
+        reset_progress(opts.progress, 0, 0);
+        __atomic_store_n(&opts.progress->pixels_total, b.samples * bands, __ATOMIC_RELAXED);
+        set_progress_phase(opts.progress, PHASE_PIXELS);
+    }
+
+    long long recorded = 0;
+    for (int y = roi.y0; y < roi.y1; y += (int)band_rows) {
+        d.band.x0 = roi.x0;
+        d.band.x1 = roi.x1;
+        d.band.y0 = y;
+        d.band.y1 = y + band_rows < roi.y1 ? y + (int)band_rows : roi.y1;
+        int first_band = y == roi.y0;
+
+        #ifdef _OPENMP
+        #pragma omp parallel num_threads(threads)
+        #endif
+        {
+            int thread = 0, team = 1;
+            #ifdef _OPENMP
+            thread = omp_get_thread_num();
+            team = omp_get_num_threads();
+            #endif
+            double* mine = hist + thread * hist_size;
+            double* orbit = orbits ? orbits + thread * 2 * max_iter : NULL;
+
+            for (long long wave = 0; wave < blocks; wave += team) {
+                // Private histograms: no atomics and no shared cache lines while tracing
+                long long block = wave + thread;
+                if (block < blocks) {
+                    memset(mine, 0, (size_t)((d.band.y1 - d.band.y0) * band_width) * sizeof(double));
+                    long long added = 0;
+                    for (long long c = block * chunks / blocks; c < (block + 1) * chunks / blocks; c++) {
+                        long long s1 = (c + 1) * BUDDHA_CHUNK < b.samples ? (c + 1) * BUDDHA_CHUNK : b.samples;
+                        trace_samples(&d, c * BUDDHA_CHUNK, s1, orbit, mine, &added);
+                    }
+                    if (first_band) __atomic_fetch_add(&recorded, added, __ATOMIC_RELAXED);
+                }
+                #ifdef _OPENMP
+                #pragma omp barrier
+                #endif
+
+                // Merge: each thread adds its share of rows of the wave's
+                // histograms to the image, in block order
+                int merged = blocks - wave < team ? (int)(blocks - wave) : team;
+                #ifdef _OPENMP
+                #pragma omp for schedule(static)
+                #endif
+                for (int py = d.band.y0; py < d.band.y1; py++) {
+                    long long row = (long long)(py - d.band.y0) * band_width;
+                    for (int px = roi.x0; px < roi.x1; px++) {
+                        double* pixel = layout_pixel(&out, px, py);
+                        double sum = wave ? *pixel : 0.0;
+                        for (int t = 0; t < merged; t++) sum += hist[t * hist_size + row + (px - roi.x0)];
+                        *pixel = sum;
+                    }
+                }
+            }
+        }
+    }
+
+    if (map) release_sampling_map(map);
+    memory_free(hist);
+    memory_free(orbits);
+    finish_progress(opts.progress);
+    return recorded;
+}
+
+// ---------------------------------------------------------------------------
+// Memory budget
+// ---------------------------------------------------------------------------
+
+// Drop the tile cost history and the cached sampling map (renders using the
+// map keep it until they finish). Returns the bytes released.
+static long long evict_caches(void) {
+    long long before = __atomic_load_n(&g_memory.bytes[MEMORY_CACHE], __ATOMIC_RELAXED);
+    double* history;
+    #ifdef _OPENMP
+    #pragma omp critical(cost_history)
+    #endif
+    {
+        history = g_cost_history.tile_cost;
+        g_cost_history.tile_cost = NULL;
+        g_cost_history.count = 0;
+    }
+    pthread_mutex_lock(&g_sampling_lock);
+    SamplingMap* map = g_sampling_map;
+    g_sampling_map = NULL;
+    pthread_mutex_unlock(&g_sampling_lock);
+
+    if (!history && !map) return 0;
+    memory_free(history);
+    if (map) release_sampling_map(map);
+    count_metric(&g_memory.evictions, 1);
+    long long released = before - __atomic_load_n(&g_memory.bytes[MEMORY_CACHE], __ATOMIC_RELAXED);
+    return released > 0 ? released : 0;
+}
+
+EXPORT void render_memory_usage(MemoryUsage* out) {
+    if (!out) return;
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        out->bytes[s] = __atomic_load_n(&g_memory.bytes[s], __ATOMIC_RELAXED);
+        out->peak[s] = __atomic_load_n(&g_memory.peak[s], __ATOMIC_RELAXED);
+    }
+    out->total = __atomic_load_n(&g_memory.total, __ATOMIC_RELAXED);
+    out->total_peak = __atomic_load_n(&g_memory.total_peak, __ATOMIC_RELAXED);
+    out->budget = __atomic_load_n(&g_memory.budget, __ATOMIC_RELAXED);
+    out->refused = __atomic_load_n(&g_memory.refused, __ATOMIC_RELAXED);
+    out->evictions = __atomic_load_n(&g_memory.evictions, __ATOMIC_RELAXED);
+    out->streamed = __atomic_load_n(&g_memory.streamed, __ATOMIC_RELAXED);
+}
+
+// Limit the engine to bytes (0 or less for no limit). Memory already held is
+// not taken back, except that the caches are dropped when over the new budget.
+EXPORT void render_memory_set_budget(long long bytes) {
+    if (bytes < 0) bytes = 0;
+    __atomic_store_n(&g_memory.budget, bytes, __ATOMIC_RELAXED);
+    if (bytes > 0 && __atomic_load_n(&g_memory.total, __ATOMIC_RELAXED) > bytes) evict_caches();
+}
+
+// Start the peaks over from what is held now
+EXPORT void render_memory_reset_peak(void) {
+    for (int s = 0; s < MEMORY_SUBSYSTEMS; s++) {
+        __atomic_store_n(&g_memory.peak[s], __atomic_load_n(&g_memory.bytes[s], __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&g_memory.total_peak, __atomic_load_n(&g_memory.total, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+// Account memory the caller holds on the engine's behalf (a tile cache, say)
+// under the same budget. Returns 0, charging nothing, when it does not fit
+// even after the engine's caches are dropped.
+EXPORT int render_memory_reserve(int subsystem, long long bytes) {
+    if (subsystem < 0 || subsystem >= MEMORY_SUBSYSTEMS || bytes < 0) return 0;
+    return memory_charge(subsystem, bytes);
+}
+
+EXPORT void render_memory_release(int subsystem, long long bytes) {
+    if (subsystem < 0 || subsystem >= MEMORY_SUBSYSTEMS || bytes < 0) return;
+    memory_uncharge(subsystem, bytes);
 }
 
 // Keep the old function for backward compatibility
@@ -639,13 +4265,13 @@ EXPORT void compute_mandelbrot(
     double dy = (ymax - ymin) / height;
 
     #ifdef _OPENMP
-    #pragma omp parallel for schedule(guided) collapse(2)
+    #pragma omp parallel for schedule(guided) collapse(2) num_threads(render_threads())
     #endif
     for (int py = 0; py < height; py++) {
         for (int px = 0; px < width; px++) {
             double cr = xmin + dx * px;
             double ci = ymin + dy * py;
-            output[py * width + px] = mandelbrot_point_smooth_double(cr, ci, max_iter);
+            output[(size_t)py * width + px] = mandelbrot_point_smooth_double(FORMULA_MANDELBROT, cr, ci, max_iter, 0);
         }
     }
 }
@@ -0,0 +1,368 @@
+/*
+ * Mandelbrot Computation Engine - Public API
+ * ==========================================
+ *
+ * Types and entry points shared by mandelbrot_compute.c and native bindings.
+ * ctypes users mirror the structs below field for field.
+ */
+
+#ifndef MANDELBROT_COMPUTE_H
+#define MANDELBROT_COMPUTE_H
+
+#ifdef _WIN32
+    #define EXPORT __declspec(dllexport)
+#else
+    #define EXPORT
+#endif
+
+// Edge length of the square tiles handed to worker threads
+#define DEFAULT_TILE_SIZE 64
+
+// Parsed view with its reference orbit (opaque)
+typedef struct RenderView RenderView;
+
+// Iterations z -> f(z) + c selectable through RenderOptions.formula
+#define FORMULA_MANDELBROT 0   // z^2 + c
+#define FORMULA_MULTIBROT3 1   // z^3 + c
+#define FORMULA_BURNING_SHIP 2 // (|Re z| + i |Im z|)^2 + c
+#define FORMULA_COUNT 3
+
+// Planes a render can fill besides the smooth escape value (RenderOptions.aux),
+// so that one render feeds several colourings
+#define AUX_ANGLE 0      // arg z at escape, or after max_iter for bounded points
+#define AUX_STRIPE 1     // Stripe average: mean of 1/2 + 1/2 sin(k arg z_n) over n >= 1
+#define AUX_TRAP 2       // Least |z_n| over n >= 1
+#define AUX_DERIVATIVE 3 // |dz/dc| at escape (|dz/dz0| for a Julia set)
+#define AUX_PLANES 4
+
+// Render phases reported through RenderProgress
+#define PHASE_IDLE 0
+#define PHASE_REFERENCE_ORBIT 1
+#define PHASE_SERIES_APPROX 2
+#define PHASE_PIXELS 3
+#define PHASE_DONE 4
+
+#define MAX_PROGRESS_THREADS 256
+
+// Counters owned by one worker thread, padded to a cache line so that
+// threads never write to the same line
+typedef struct {
+    long long pixels_done;
+    long long iterations_done;
+    int phase;
+} __attribute__((aligned(64))) ThreadProgress;
+
+// Progress of one render. Every field is written with relaxed atomics, one
+// writer per field, so any thread may read it at any time without locking.
+typedef struct {
+    long long pixels_total;
+    long long orbit_iterations; // Reference orbit iterations computed so far
+    int phase;
+    int threads; // Worker slots in use
+    ThreadProgress slots[MAX_PROGRESS_THREADS];
+} RenderProgress;
+
+// Timeline of the setup, reference orbit, series approximation and tile spans
+// of renders, per OpenMP thread (render_trace_create)
+typedef struct RenderTrace RenderTrace;
+
+// Totals of a RenderProgress at one instant
+typedef struct {
+    long long pixels_total;
+    long long pixels_done;
+    long long iterations_done;
+    long long orbit_iterations;
+    int phase;
+    int threads;
+} ProgressSnapshot;
+
+// Strategies of RenderOptions.strategy
+#define STRATEGY_FIXED 0 // Precision mode from the pixel spacing, the caller's tile size
+#define STRATEGY_AUTO 1  // Probe the frame at low resolution and let a cost model choose
+                         // between long double and perturbation, and the tile size
+                         // unless tile_size or tile_done fixes the grid
+
+// Optional settings of compute_mandelbrot_str_ex. Zero-initialised fields
+// select the defaults: the whole frame, densely packed.
+//
+// The region of interest [roi_x, roi_x + roi_width) x [roi_y, roi_y + roi_height)
+// of the width x height view is rendered, and output points at its top-left
+// pixel: pixel (px, py) lands at
+//     output[(py - roi_y) * row_pitch + (px - roi_x) * pixel_stride]
+// so results can go straight into a larger mosaic or an interleaved texture.
+// tile_done then covers the region's tile grid (see render_tile_count).
+typedef struct {
+    int focus_x, focus_y; // Pixel whose tile renders first; negative for the region centre
+    int tile_size;        // 0 for the tuned size (DEFAULT_TILE_SIZE without a profile)
+    unsigned char* tile_done; // Optional per-tile completion flags
+    RenderProgress* progress; // Optional progress counters, reset by the render
+    int roi_x, roi_y;         // Top-left pixel of the region
+    int roi_width, roi_height; // 0 for the rest of the frame
+    long long row_pitch;      // Doubles between rows; 0 for roi_width * pixel_stride
+    long long pixel_stride;   // Doubles between pixels of a row; 0 for 1
+    int deterministic;        // 1: bitwise-identical pixels whatever the region, tiling,
+                              // thread count or sparse/dense path (see README)
+    int formula;              // FORMULA_*; ignored by render_view_*, whose view fixes it
+    double* aux[AUX_PLANES];  // Optional AUX_* planes, laid out like output; NULL to skip.
+                              // Filled by the dense renders only (not budgeted, sparse or masked)
+    int stripe_density;       // k of AUX_STRIPE; 0 for 5
+    RenderTrace* trace;       // Optional timeline the render appends its spans to; a budgeted
+                              // render's refine job keeps appending until it finishes
+    int strategy;             // STRATEGY_*; honoured by compute_mandelbrot_str_ex and compute_julia_str
+    struct FramePlan* plan;   // Optional: receives the decisions of a STRATEGY_AUTO render
+} RenderOptions;
+
+// What a STRATEGY_AUTO render decided, the probe figures it decided from,
+// and the cost model's prediction next to the measured cost. The costs cover
+// the render after the probe: reference orbit (when still to build) and pixels.
+typedef struct FramePlan {
+    int mode;                  // Precision mode rendered with
+    int fixed_mode;            // Mode STRATEGY_FIXED would have used
+    int tile_size;
+    int probe_scale;           // Probe samples are this many pixels apart along each axis
+    long long probe_samples;
+    double interior_fraction;  // Probe samples still bounded after max_iter
+    double mean_iterations;    // Per probe sample, max_iter for interior ones
+    double iteration_cv;       // Standard deviation / mean of those iterations
+    double escape_p50, escape_p90; // Escape-count quantiles of the escaped samples
+    double probe_ms;
+    double predicted_ms;       // Model cost of the chosen mode
+    double alternative_ms;     // Model cost of the mode passed over; 0 when there was no choice
+    double actual_ms;
+} FramePlan;
+
+// What a budgeted render actually delivered
+typedef struct {
+    double elapsed_ms;    // Wall time spent before returning
+    double predicted_ms;  // Expected wall time of the full-quality frame
+    long long preview_max_iter; // Iteration cap of the preview layer
+    long long tiles_total;
+    long long tiles_full; // Tiles at full resolution and max_iter
+    int preview_scale;    // Block size of the preview layer, 1 when none was needed
+    int complete;         // 1 when every tile is at full quality
+} RenderQuality;
+
+// Findings of an accuracy audit (render_audit_start). Written with relaxed
+// atomics while the audit runs, so any thread may read them at any time.
+typedef struct {
+    long long pixels_checked;
+    long long class_mismatches; // Escaped by one evaluation, bounded by the other
+    long long escaped_both;     // Pixels behind the error figures
+    double mean_error;          // |smooth value - brute-force value| over escaped_both
+    double max_error;
+    int worst_x, worst_y;       // Pixel of max_error
+    double elapsed_ms;
+    int done;                   // 1 once the audit stopped
+} AuditReport;
+
+// Buckets of a LatencyHistogram: upper bounds of 1, 2.5, 5, 10, 25, 50, 100,
+// 250 and 500 ms, 1, 2.5, 5 and 10 s, then +Inf
+#define METRICS_LATENCY_BUCKETS 14
+
+typedef struct {
+    long long count;
+    double sum_seconds;
+    long long buckets[METRICS_LATENCY_BUCKETS]; // Observations per bucket, not cumulative
+} LatencyHistogram;
+
+// Process-wide counters, cumulative since the library was loaded
+// (render_metrics_snapshot, or render_metrics_format for Prometheus)
+typedef struct {
+    long long renders[4];          // Dense renders finished, by precision mode
+    long long pixels;              // Pixels rendered by tiles, budgeted renders included
+    long long iterations;          // Pixel iterations run; none for the series approximation's or cardioid pixels
+    long long reference_iterations;      // Reference orbit lengths of perturbation views
+    long long series_skipped_iterations; // Of those, iterations skipped by every pixel
+    long long orbit_cache_hits;    // Orbit file cache lookups (render_set_orbit_cache)
+    long long orbit_cache_misses;
+    LatencyHistogram render_seconds;
+    LatencyHistogram orbit_build_seconds; // Reference orbit and series approximation
+} EngineMetrics;
+
+// Host-specific settings (render_tuning_*). The library loads its host's
+// profile when it is loaded; src/autotune.py benchmarks candidates and writes it.
+typedef struct {
+    int tile_size;          // Tile edge when RenderOptions.tile_size is 0
+    int threads;            // OpenMP threads per render; 0 for every core
+    int direct_groups;      // Groups of 4 AVX2 lanes the double kernel interleaves: 1 or 2
+    int escape_interval;    // Perturbation iterations between escape tests: 4 or 8.
+                            // Deterministic renders always use 4
+    double iteration_ns[4]; // STRATEGY_AUTO cost model: ns per pixel iteration and thread,
+                            // by precision mode
+    double reference_ns;    // and per reference orbit iteration
+} TuningProfile;
+
+// Subsystems the engine's memory is accounted to (render_memory_usage)
+#define MEMORY_ORBIT 0      // Reference orbits of views, built or mapped from orbit files
+#define MEMORY_CACHE 1      // Kept for later renders: Buddhabrot sampling maps, tile cost history
+#define MEMORY_SCRATCH 2    // Working arrays: tile lists, probes, Buddhabrot orbits, trace event buffers
+#define MEMORY_STAGING 3    // Images before they reach the output: previews, density histograms
+#define MEMORY_SUBSYSTEMS 4
+
+// Engine memory (render_memory_usage). With a budget set, an allocation that
+// would exceed it first evicts the caches, then is refused, and renders that
+// can work in smaller pieces do so instead of failing.
+typedef struct {
+    long long bytes[MEMORY_SUBSYSTEMS]; // Held now, by MEMORY_*
+    long long peak[MEMORY_SUBSYSTEMS];  // Most held at once since load or render_memory_reset_peak
+    long long total;
+    long long total_peak;
+    long long budget;     // Hard limit on total; 0 for none
+    long long refused;    // Allocations refused by the budget
+    long long evictions;  // Times the caches were dropped to make room
+    long long streamed;   // Renders that fell back to a smaller working set to fit the budget
+} MemoryUsage;
+
+// Settings of compute_buddhabrot_str. Zero-initialised fields select the defaults.
+typedef struct {
+    long long samples;     // Orbits to trace; 0 for 16 per pixel of the view
+    long long min_iter;    // Orbits escaping in fewer iterations are not recorded
+    unsigned long long seed;
+    int map_size;          // Edge of the escape-time grid samples are drawn from; 0 for 512
+    int uniform;           // 1: draw c uniformly instead of from the escape-time grid
+} BuddhabrotOptions;
+
+// Why a precision mode was chosen (PrecisionChoice.reason)
+#define PRECISION_DOUBLE_FITS 0            // double resolves the pixel spacing
+#define PRECISION_DOUBLE_TOO_COARSE 1      // long double needed for its extra mantissa bits
+#define PRECISION_LONG_DOUBLE_TOO_COARSE 2 // Beyond long double: perturbation
+
+typedef struct {
+    int mode;           // Same codes as get_precision_mode()
+    int reason;         // PRECISION_*
+    double magnitude;   // Largest |coordinate| the kernels add the pixel spacing to
+    double spacing;     // Smaller of the x and y pixel spacings
+    double bits_needed; // log2(magnitude / spacing) plus guard bits for orbit rounding
+} PrecisionChoice;
+
+EXPORT int get_precision_mode(const char* xmin_str, const char* xmax_str, int width);
+EXPORT int get_precision_mode_ex(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    PrecisionChoice* choice
+);
+
+EXPORT void compute_mandelbrot_str(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    double* output
+);
+
+EXPORT void compute_mandelbrot_str_ex(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    double* output, const RenderOptions* options
+);
+
+EXPORT void compute_julia_str(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str,
+    long long max_iter,
+    double* output, const RenderOptions* options
+);
+
+EXPORT long long compute_buddhabrot_str(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter, const BuddhabrotOptions* settings,
+    double* output, const RenderOptions* options
+);
+
+EXPORT void compute_mandelbrot_str_focus(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    int focus_x, int focus_y, int tile_size,
+    double* output, unsigned char* tile_done
+);
+
+EXPORT long long render_tile_count(int width, int height, int tile_size);
+
+EXPORT RenderView* render_view_create(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter
+);
+EXPORT RenderView* render_view_create_julia(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str,
+    long long max_iter
+);
+EXPORT RenderView* render_view_create_ex(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    const char* julia_r_str, const char* julia_i_str, int formula,
+    long long max_iter
+);
+EXPORT void render_view_precision(const RenderView* view, PrecisionChoice* choice);
+EXPORT void render_view_size(const RenderView* view, int* width, int* height);
+EXPORT void render_view_free(RenderView* view);
+EXPORT void render_view_points(
+    const RenderView* view, const double* xs, const double* ys, long long count, double* values,
+    const RenderOptions* options
+);
+EXPORT long long render_view_masked(
+    const RenderView* view, const unsigned char* mask, double* output, const RenderOptions* options
+);
+EXPORT void render_view_render(const RenderView* view, double* output, const RenderOptions* options);
+EXPORT long long render_view_export(const RenderView* view, void* buffer, long long capacity);
+EXPORT RenderView* render_view_import(const void* buffer, long long size);
+EXPORT int render_view_save(const RenderView* view, const char* path);
+EXPORT RenderView* render_view_open(const char* path);
+EXPORT void render_set_orbit_cache(const char* directory);
+
+EXPORT void* render_audit_start(
+    const RenderView* view, long long samples, double budget_ms, unsigned long long seed, AuditReport* report
+);
+EXPORT int render_audit_done(void* handle);
+EXPORT void render_audit_wait(void* handle);
+EXPORT void render_audit_cancel(void* handle);
+
+EXPORT RenderProgress* render_progress_create(void);
+EXPORT void render_progress_free(RenderProgress* progress);
+EXPORT RenderTrace* render_trace_create(long long events_per_thread);
+EXPORT void render_trace_free(RenderTrace* trace);
+EXPORT void render_trace_clear(RenderTrace* trace);
+EXPORT long long render_trace_dropped(const RenderTrace* trace);
+EXPORT long long render_trace_write(const RenderTrace* trace, const char* path);
+EXPORT void render_metrics_snapshot(EngineMetrics* out);
+EXPORT long long render_metrics_format(char* buffer, long long capacity);
+EXPORT void render_tuning_get(TuningProfile* out);
+EXPORT int render_tuning_set(const TuningProfile* tuning);
+EXPORT long long render_tuning_default_path(char* buffer, long long capacity);
+EXPORT int render_tuning_load(const char* path);
+EXPORT int render_tuning_save(const char* path);
+EXPORT void render_memory_usage(MemoryUsage* out);
+EXPORT void render_memory_set_budget(long long bytes);
+EXPORT void render_memory_reset_peak(void);
+EXPORT int render_memory_reserve(int subsystem, long long bytes);
+EXPORT void render_memory_release(int subsystem, long long bytes);
+EXPORT int render_progress_snapshot(
+    const RenderProgress* progress, ProgressSnapshot* out,
+    long long* thread_pixels, long long* thread_iterations, int max_threads
+);
+
+EXPORT void* compute_mandelbrot_str_budget(
+    const char* xmin_str, const char* xmax_str, int width,
+    const char* ymin_str, const char* ymax_str, int height,
+    long long max_iter,
+    double budget_ms, int refine,
+    double* output, const RenderOptions* options,
+    RenderQuality* quality
+);
+EXPORT int render_job_done(void* handle);
+EXPORT void render_job_wait(void* handle);
+EXPORT void render_job_cancel(void* handle);
+
+EXPORT void compute_mandelbrot(
+    double xmin, double xmax, int width,
+    double ymin, double ymax, int height,
+    int max_iter,
+    double* output
+);
+
+#endif // MANDELBROT_COMPUTE_H
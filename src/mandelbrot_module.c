@@ -0,0 +1,431 @@
+/*
+ * Mandelbrot Computation Engine - Native Python Module
+ * ====================================================
+ *
+ * Exposes the engine as `mandelbrot_native.Renderer`, which renders straight
+ * into any writable float64 buffer (numpy arrays and their strided slices,
+ * memoryview, mmap) with the GIL released. render_async() returns a
+ * concurrent.futures.Future.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pthread.h>
+#include <string.h>
+#include "mandelbrot_compute.h"
+
+// concurrent.futures.Future, imported once at module init
+static PyObject* future_type = NULL;
+
+typedef struct {
+    PyObject_HEAD
+    RenderProgress* progress; // Reset by every render of this renderer
+    int tile_size;
+    pthread_mutex_t lock;     // Renders of one renderer run one after another
+} RendererObject;
+
+// Everything one render needs once the GIL is released
+typedef struct {
+    RendererObject* renderer;
+    Py_buffer out;
+    Py_buffer tile_done;
+    int has_tile_done;
+    char* bounds[4]; // xmin, xmax, ymin, ymax as decimal strings
+    int width, height;
+    long long max_iter;
+    int focus_x, focus_y;
+    int roi[4];                      // x, y, width, height of the rendered region
+    long long row_pitch, pixel_stride; // Layout of out, in doubles
+    int deterministic;
+    PyObject* future;
+} RenderJob;
+
+static void release_job(RenderJob* job) {
+    PyBuffer_Release(&job->out);
+    if (job->has_tile_done) PyBuffer_Release(&job->tile_done);
+    for (int i = 0; i < 4; i++) free(job->bounds[i]);
+    Py_XDECREF(job->future);
+    Py_XDECREF((PyObject*)job->renderer);
+    free(job);
+}
+
+// Bounds keep full precision as text: str(Decimal) and str(float) both parse
+static char* bound_to_string(PyObject* value) {
+    PyObject* text = PyObject_Str(value);
+    if (!text) return NULL;
+    const char* utf8 = PyUnicode_AsUTF8(text);
+    char* copy = utf8 ? strdup(utf8) : NULL;
+    if (utf8 && !copy) PyErr_NoMemory();
+    Py_DECREF(text);
+    return copy;
+}
+
+static int is_float64_format(const char* format) {
+    if (!format) return 0;
+    if (*format == '@' || *format == '=' || *format == '<') format++;
+    return strcmp(format, "d") == 0;
+}
+
+static RenderJob* parse_render_args(RendererObject* self, PyObject* args, PyObject* kwargs) {
+    static char* keywords[] = {
+        "out", "xmin", "xmax", "ymin", "ymax", "max_iter",
+        "width", "height", "focus", "tile_done", "roi", "deterministic", NULL
+    };
+    PyObject* out;
+    PyObject* bounds[4];
+    long long max_iter;
+    int width = -1;
+    int height = -1;
+    PyObject* focus = Py_None;
+    PyObject* tile_done = Py_None;
+    PyObject* roi = Py_None;
+    int deterministic = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OOOOOL|$iiOOOp", keywords,
+                                     &out, &bounds[0], &bounds[1], &bounds[2], &bounds[3], &max_iter,
+                                     &width, &height, &focus, &tile_done, &roi, &deterministic)) {
+        return NULL;
+    }
+    if (max_iter <= 0) {
+        PyErr_SetString(PyExc_ValueError, "max_iter must be positive");
+        return NULL;
+    }
+
+    RenderJob* job = (RenderJob*)calloc(1, sizeof(RenderJob));
+    if (!job) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    Py_INCREF(self);
+    job->renderer = self;
+
+    if (PyObject_GetBuffer(out, &job->out, PyBUF_RECORDS) < 0) {
+        goto fail;
+    }
+    if (job->out.itemsize != 8 || !is_float64_format(job->out.format)) {
+        PyErr_SetString(PyExc_TypeError, "out must be a float64 buffer");
+        goto fail;
+    }
+    if (job->out.ndim < 1 || job->out.ndim > 2) {
+        PyErr_SetString(PyExc_ValueError, "out must be 1-D or 2-D");
+        goto fail;
+    }
+    for (int d = 0; d < job->out.ndim; d++) {
+        if (job->out.strides[d] <= 0 || job->out.strides[d] % 8 != 0) {
+            PyErr_SetString(PyExc_ValueError, "out strides must be positive multiples of 8 bytes");
+            goto fail;
+        }
+    }
+
+    // A 2-D buffer carries its own shape; flat buffers need width and height
+    if (roi == Py_None && width < 0 && height < 0 && job->out.ndim == 2) {
+        height = (int)job->out.shape[0];
+        width = (int)job->out.shape[1];
+    }
+    if (width <= 0 || height <= 0) {
+        PyErr_SetString(PyExc_ValueError, "width and height are required unless out is 2-D and roi is None");
+        goto fail;
+    }
+
+    // out covers the region of interest only, the whole frame by default
+    job->roi[0] = 0;
+    job->roi[1] = 0;
+    job->roi[2] = width;
+    job->roi[3] = height;
+    if (roi != Py_None) {
+        if (!PyArg_ParseTuple(roi, "iiii", &job->roi[0], &job->roi[1], &job->roi[2], &job->roi[3])) {
+            goto fail;
+        }
+        if (job->roi[0] < 0 || job->roi[1] < 0 || job->roi[2] <= 0 || job->roi[3] <= 0 ||
+            job->roi[0] + job->roi[2] > width || job->roi[1] + job->roi[3] > height) {
+            PyErr_SetString(PyExc_ValueError, "roi must be a non-empty (x, y, width, height) inside the frame");
+            goto fail;
+        }
+    }
+    int roi_width = job->roi[2];
+    int roi_height = job->roi[3];
+
+    if (job->out.ndim == 2) {
+        if (job->out.shape[0] < roi_height || job->out.shape[1] < roi_width) {
+            PyErr_Format(PyExc_ValueError, "out is %zd x %zd, %d x %d needed",
+                         job->out.shape[0], job->out.shape[1], roi_height, roi_width);
+            goto fail;
+        }
+        job->row_pitch = job->out.strides[0] / 8;
+        job->pixel_stride = job->out.strides[1] / 8;
+    } else {
+        if (job->out.shape[0] < (Py_ssize_t)roi_width * roi_height) {
+            PyErr_Format(PyExc_ValueError, "out holds %zd values, %d x %d needed",
+                         job->out.shape[0], roi_width, roi_height);
+            goto fail;
+        }
+        job->pixel_stride = job->out.strides[0] / 8;
+        job->row_pitch = (long long)roi_width * job->pixel_stride;
+    }
+    job->width = width;
+    job->height = height;
+    job->deterministic = deterministic;
+    job->max_iter = max_iter;
+
+    job->focus_x = -1;
+    job->focus_y = -1;
+    if (focus != Py_None && !PyArg_ParseTuple(focus, "ii", &job->focus_x, &job->focus_y)) {
+        goto fail;
+    }
+
+    if (tile_done != Py_None) {
+        if (PyObject_GetBuffer(tile_done, &job->tile_done, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0) {
+            goto fail;
+        }
+        job->has_tile_done = 1;
+        long long tiles = render_tile_count(roi_width, roi_height, self->tile_size);
+        if (job->tile_done.len < tiles) {
+            PyErr_Format(PyExc_ValueError, "tile_done holds %zd flags, %lld needed",
+                         job->tile_done.len, tiles);
+            goto fail;
+        }
+    }
+
+    for (int i = 0; i < 4; i++) {
+        job->bounds[i] = bound_to_string(bounds[i]);
+        if (!job->bounds[i]) goto fail;
+    }
+    return job;
+
+fail:
+    release_job(job); // Buffers never acquired have obj == NULL and are skipped
+    return NULL;
+}
+
+// Runs without the GIL
+static void run_job(RenderJob* job) {
+    RendererObject* r = job->renderer;
+    RenderOptions opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.focus_x = job->focus_x;
+    opts.focus_y = job->focus_y;
+    opts.tile_size = r->tile_size;
+    opts.tile_done = job->has_tile_done ? (unsigned char*)job->tile_done.buf : NULL;
+    opts.progress = r->progress;
+    opts.roi_x = job->roi[0];
+    opts.roi_y = job->roi[1];
+    opts.roi_width = job->roi[2];
+    opts.roi_height = job->roi[3];
+    opts.row_pitch = job->row_pitch;
+    opts.pixel_stride = job->pixel_stride;
+    opts.deterministic = job->deterministic;
+
+    pthread_mutex_lock(&r->lock);
+    compute_mandelbrot_str_ex(
+        job->bounds[0], job->bounds[1], job->width,
+        job->bounds[2], job->bounds[3], job->height,
+        job->max_iter, (double*)job->out.buf, &opts
+    );
+    pthread_mutex_unlock(&r->lock);
+}
+
+static PyObject* Renderer_render(RendererObject* self, PyObject* args, PyObject* kwargs) {
+    RenderJob* job = parse_render_args(self, args, kwargs);
+    if (!job) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    run_job(job);
+    Py_END_ALLOW_THREADS
+
+    PyObject* result = job->out.obj;
+    Py_INCREF(result);
+    release_job(job);
+    return result;
+}
+
+static void* async_thread_main(void* arg) {
+    RenderJob* job = (RenderJob*)arg;
+    PyGILState_STATE gil = PyGILState_Ensure();
+
+    // False when the future was cancelled before the render started
+    PyObject* started = PyObject_CallMethod(job->future, "set_running_or_notify_cancel", NULL);
+    int run = started && PyObject_IsTrue(started);
+    if (!started) PyErr_WriteUnraisable(job->future);
+    Py_XDECREF(started);
+
+    if (run) {
+        Py_BEGIN_ALLOW_THREADS
+        run_job(job);
+        Py_END_ALLOW_THREADS
+
+        PyObject* done = PyObject_CallMethod(job->future, "set_result", "O", job->out.obj);
+        if (!done) PyErr_WriteUnraisable(job->future);
+        Py_XDECREF(done);
+    }
+
+    release_job(job);
+    PyGILState_Release(gil);
+    return NULL;
+}
+
+static PyObject* Renderer_render_async(RendererObject* self, PyObject* args, PyObject* kwargs) {
+    RenderJob* job = parse_render_args(self, args, kwargs);
+    if (!job) return NULL;
+
+    job->future = PyObject_CallNoArgs(future_type);
+    if (!job->future) {
+        release_job(job);
+        return NULL;
+    }
+    PyObject* future = job->future;
+    Py_INCREF(future);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&thread, &attr, async_thread_main, job);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        release_job(job);
+        Py_DECREF(future);
+        PyErr_SetString(PyExc_RuntimeError, "could not start render thread");
+        return NULL;
+    }
+    return future;
+}
+
+static PyObject* Renderer_progress(RendererObject* self, PyObject* Py_UNUSED(ignored)) {
+    ProgressSnapshot snap;
+    render_progress_snapshot(self->progress, &snap, NULL, NULL, 0);
+    return Py_BuildValue(
+        "{s:i,s:i,s:L,s:L,s:L,s:L}",
+        "phase", snap.phase,
+        "threads", snap.threads,
+        "pixels_total", snap.pixels_total,
+        "pixels_done", snap.pixels_done,
+        "iterations_done", snap.iterations_done,
+        "orbit_iterations", snap.orbit_iterations
+    );
+}
+
+static PyObject* Renderer_precision_mode(RendererObject* self, PyObject* args) {
+    PyObject* bounds[4] = {NULL, NULL, NULL, NULL};
+    int width, height = 0;
+    if (!PyArg_ParseTuple(args, "OOi|OOi", &bounds[0], &bounds[1], &width, &bounds[2], &bounds[3], &height)) {
+        return NULL;
+    }
+    int with_y = bounds[2] && bounds[3];
+
+    char* strs[4] = {NULL, NULL, NULL, NULL};
+    int ok = 1;
+    for (int i = 0; i < (with_y ? 4 : 2) && ok; i++) {
+        strs[i] = bound_to_string(bounds[i]);
+        ok = strs[i] != NULL;
+    }
+    PyObject* result = NULL;
+    if (ok) {
+        int mode = with_y ? get_precision_mode_ex(strs[0], strs[1], width, strs[2], strs[3], height, NULL)
+                          : get_precision_mode(strs[0], strs[1], width);
+        result = PyLong_FromLong(mode);
+    }
+    for (int i = 0; i < 4; i++) free(strs[i]);
+    return result;
+}
+
+static PyObject* Renderer_tile_count(RendererObject* self, PyObject* args) {
+    int width, height;
+    if (!PyArg_ParseTuple(args, "ii", &width, &height)) return NULL;
+    return PyLong_FromLongLong(render_tile_count(width, height, self->tile_size));
+}
+
+static int Renderer_init(RendererObject* self, PyObject* args, PyObject* kwargs) {
+    static char* keywords[] = {"tile_size", NULL};
+    int tile_size = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|i", keywords, &tile_size)) return -1;
+    self->tile_size = tile_size;
+    return 0;
+}
+
+static PyObject* Renderer_new(PyTypeObject* type, PyObject* args, PyObject* kwargs) {
+    RendererObject* self = (RendererObject*)type->tp_alloc(type, 0);
+    if (!self) return NULL;
+    self->progress = render_progress_create();
+    if (!self->progress) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    pthread_mutex_init(&self->lock, NULL);
+    return (PyObject*)self;
+}
+
+static void Renderer_dealloc(RendererObject* self) {
+    // Async jobs hold a reference, so no render is running here
+    if (self->progress) {
+        render_progress_free(self->progress);
+        pthread_mutex_destroy(&self->lock);
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static PyMethodDef Renderer_methods[] = {
+    {"render", (PyCFunction)(void (*)(void))Renderer_render, METH_VARARGS | METH_KEYWORDS,
+     "render(out, xmin, xmax, ymin, ymax, max_iter, *, width=-1, height=-1, focus=None, tile_done=None,\n"
+     "       roi=None, deterministic=False)\n"
+     "--\n\n"
+     "Render into the writable float64 buffer out and return it. Bounds may be\n"
+     "str, Decimal or float. width and height default to the shape of a 2-D out.\n"
+     "roi=(x, y, w, h) renders only that part of the frame, whose pixels fill\n"
+     "out from its first element. A strided 2-D out, such as a slice of a larger\n"
+     "mosaic or one channel of an interleaved image, is written in place.\n"
+     "deterministic=True gives bitwise-identical pixels whatever the roi or tiling."},
+    {"render_async", (PyCFunction)(void (*)(void))Renderer_render_async, METH_VARARGS | METH_KEYWORDS,
+     "render_async(out, xmin, xmax, ymin, ymax, max_iter, *, width=-1, height=-1, focus=None, tile_done=None,\n"
+     "             roi=None, deterministic=False)\n"
+     "--\n\n"
+     "Like render(), on a background thread. Returns a concurrent.futures.Future\n"
+     "whose result is out. Keep out alive and untouched until it resolves."},
+    {"progress", (PyCFunction)Renderer_progress, METH_NOARGS,
+     "Progress counters of the current or last render, safe to poll from any thread."},
+    {"precision_mode", (PyCFunction)Renderer_precision_mode, METH_VARARGS,
+     "precision_mode(xmin, xmax, width, ymin=None, ymax=None, height=0) -> same codes as\n"
+     "get_precision_mode(); with the y range, the mode a render of the view uses"},
+    {"tile_count", (PyCFunction)Renderer_tile_count, METH_VARARGS,
+     "tile_count(width, height) -> length a tile_done buffer needs"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyTypeObject RendererType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mandelbrot_native.Renderer",
+    .tp_doc = "Renderer(tile_size=0)\n--\n\nMandelbrot engine rendering into caller-provided buffers.",
+    .tp_basicsize = sizeof(RendererObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = Renderer_new,
+    .tp_init = (initproc)Renderer_init,
+    .tp_dealloc = (destructor)Renderer_dealloc,
+    .tp_methods = Renderer_methods,
+};
+
+static struct PyModuleDef mandelbrot_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "mandelbrot_native",
+    .m_doc = "Native bindings for the Mandelbrot computation engine.",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_mandelbrot_native(void) {
+    PyObject* futures = PyImport_ImportModule("concurrent.futures");
+    if (!futures) return NULL;
+    future_type = PyObject_GetAttrString(futures, "Future");
+    Py_DECREF(futures);
+    if (!future_type) return NULL;
+
+    if (PyType_Ready(&RendererType) < 0) return NULL;
+
+    PyObject* module = PyModule_Create(&mandelbrot_module);
+    if (!module) return NULL;
+
+    Py_INCREF(&RendererType);
+    if (PyModule_AddObject(module, "Renderer", (PyObject*)&RendererType) < 0) {
+        Py_DECREF(&RendererType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -0,0 +1,403 @@
+"""
+Render Job Spooler
+==================
+
+Runs long poster and video-frame jobs from a spool directory, highest
+priority first, and checkpoints them so a preempted or crashed spooler picks
+up where it stopped instead of starting over.
+
+Layout of a spool directory:
+    incoming/NAME.json   job descriptors, as written by `submit`
+    state/NAME/          checkpoint of a started job:
+        job.json         the descriptor the checkpoint belongs to
+        view.mbv         the view with its reference orbit (render_view_save)
+        frame.npy        the frame so far, written in place
+        tiles.log        indices of finished tiles, appended after each tile
+    done/NAME.json       descriptors of finished jobs
+    failed/NAME.json     rejected jobs, with the reason in NAME.error
+
+Tiles are scheduled one at a time across the worker pool, always from the
+highest-priority job (then the oldest), so a new urgent job takes over at the
+next tile boundary. A tile is logged only after its pixels are flushed, and
+tiles render in deterministic mode, so a resumed frame is bitwise identical
+to an uninterrupted one. Resuming maps the saved orbit instead of rebuilding
+it.
+
+The pool is made of local slots, each rendering a tile with every core, and
+optionally of remote workers from distributed_render.py.
+
+Usage:
+    python src/render_spool.py submit SPOOL NAME --view XMIN XMAX YMIN YMAX \\
+        --size 16384 9216 --iter 20000 [--priority 5] [--out poster.npy]
+    python src/render_spool.py serve SPOOL [--slots 1] [--workers node1:5701]
+    python src/render_spool.py status SPOOL
+"""
+
+import argparse
+import collections
+import json
+import os
+import shutil
+import signal
+import socket
+import struct
+import sys
+import threading
+import time
+
+import numpy as np
+
+from distributed_render import (MSG_ACK, MSG_RESULT, MSG_TILE, MSG_VIEW, TILE, TILE_ID, parse_address,
+                                recv_message, send_message)
+from engine import Engine
+
+TILE_RECORD = struct.Struct("<q")  # tiles.log entry
+
+
+def log(message):
+    print(f"[spool] {message}", file=sys.stderr, flush=True)
+
+
+def read_descriptor(path):
+    """Load and validate a job descriptor; raises ValueError when it is unusable"""
+    try:
+        with open(path) as f:
+            desc = json.load(f)
+        job = {
+            'view': [str(b) for b in desc['view']],
+            'width': int(desc['width']),
+            'height': int(desc['height']),
+            'max_iter': int(desc['max_iter']),
+            'priority': int(desc.get('priority', 0)),
+            'tile_size': int(desc.get('tile_size', 256)),
+            'output': desc.get('output'),
+        }
+    except (OSError, ValueError, KeyError, TypeError) as e:
+        raise ValueError(f"bad descriptor: {e}")
+    if len(job['view']) != 4 or min(job['width'], job['height'], job['max_iter'], job['tile_size']) <= 0:
+        raise ValueError("bad descriptor: view needs 4 bounds and sizes must be positive")
+    return job
+
+
+class Job:
+    """A started job: its view, checkpointed frame and the tiles still to render"""
+
+    def __init__(self, spool, name, desc, submitted):
+        self.name = name
+        self.desc = desc
+        self.priority = desc['priority']
+        self.submitted = submitted
+        self.engine = spool.engine
+        self.state_dir = os.path.join(spool.root, 'state', name)
+        self.blob = None  # Exported view, made on first use by a remote worker
+
+        # A checkpoint from an edited descriptor is useless
+        desc_path = os.path.join(self.state_dir, 'job.json')
+        if os.path.exists(desc_path):
+            with open(desc_path) as f:
+                if json.load(f) != desc:
+                    log(f"{name}: descriptor changed, discarding checkpoint")
+                    shutil.rmtree(self.state_dir)
+        os.makedirs(self.state_dir, exist_ok=True)
+
+        w, h, size = desc['width'], desc['height'], desc['tile_size']
+        self.tiles = [(x, y, min(size, w - x), min(size, h - y))
+                      for y in range(0, h, size) for x in range(0, w, size)]
+
+        view_path = os.path.join(self.state_dir, 'view.mbv')
+        frame_path = os.path.join(self.state_dir, 'frame.npy')
+        log_path = os.path.join(self.state_dir, 'tiles.log')
+        finished, logged = set(), 0
+        if os.path.exists(view_path) and os.path.exists(frame_path):
+            self.view = self.engine.open_view(view_path)
+            self.frame = np.lib.format.open_memmap(frame_path, mode='r+')
+            if os.path.exists(log_path):
+                with open(log_path, 'rb') as f:
+                    data = f.read()
+                # A torn final record is a tile that was never logged
+                logged = len(data) - len(data) % TILE_RECORD.size
+                finished = {i for (i,) in TILE_RECORD.iter_unpack(data[:logged])}
+        else:
+            with open(desc_path, 'w') as f:
+                json.dump(desc, f)
+            self.view = self.engine.create_view(desc['view'], w, h, desc['max_iter'])
+            self.engine.save_view(self.view, view_path)
+            self.frame = np.lib.format.open_memmap(frame_path, mode='w+', dtype=np.float64, shape=(h, w))
+        self.frame_path = frame_path
+        self.log_file = open(log_path, 'ab')
+        self.log_file.truncate(logged)  # Drop whatever followed the last whole record
+
+        self.pending = collections.deque(i for i in range(len(self.tiles)) if i not in finished)
+        self.remaining = len(self.pending)
+        self.resumed = len(finished)
+
+    def export(self):
+        if self.blob is None:
+            self.blob = self.engine.export_view(self.view)
+        return self.blob
+
+    def record(self, index):
+        """Make tile index durable: pixels first, then the log entry"""
+        self.frame.flush()
+        self.log_file.write(TILE_RECORD.pack(index))
+        self.log_file.flush()
+        os.fsync(self.log_file.fileno())
+
+    def close(self):
+        self.log_file.close()
+        self.frame.flush()
+        del self.frame
+        self.engine.free_view(self.view)
+
+
+class LocalSlot:
+    """Render tiles in this process"""
+
+    name = 'local'
+
+    def render(self, job, tile):
+        x, y, w, h = tile
+        job.engine.render_region(job.view, x, y, w, h, out=job.frame[y:y + h, x:x + w])
+
+
+class RemoteSlot:
+    """Render tiles on a distributed_render.py worker"""
+
+    def __init__(self, address, timeout=300.0):
+        self.address = address
+        self.name = f"{address[0]}:{address[1]}"
+        self.timeout = timeout
+        self.sock = None
+        self.job = None  # Job whose view the worker holds
+
+    def render(self, job, tile):
+        if self.sock is None:
+            self.sock = socket.create_connection(self.address, timeout=self.timeout)
+            self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        if self.job is not job:
+            send_message(self.sock, MSG_VIEW, job.export())
+            kind, payload = recv_message(self.sock)
+            if kind != MSG_ACK:
+                raise ConnectionError(bytes(payload).decode('utf-8', 'replace'))
+            self.job = job
+        x, y, w, h = tile
+        send_message(self.sock, MSG_TILE, TILE.pack(0, x, y, w, h))
+        kind, payload = recv_message(self.sock)
+        if kind != MSG_RESULT:
+            raise ConnectionError(bytes(payload).decode('utf-8', 'replace'))
+        pixels = np.frombuffer(payload, dtype=np.float64, offset=TILE_ID.size)
+        job.frame[y:y + h, x:x + w] = pixels.reshape(h, w)
+
+
+class Spooler:
+    def __init__(self, root, slots=1, workers=(), engine=None, poll=2.0):
+        self.root = root
+        self.engine = engine or Engine()
+        self.poll = poll
+        for sub in ('incoming', 'state', 'done', 'failed'):
+            os.makedirs(os.path.join(root, sub), exist_ok=True)
+        self.slots = [LocalSlot() for _ in range(slots)] + [RemoteSlot(a) for a in workers]
+        self.jobs = {}
+        self.lock = threading.Condition()
+        self.stopping = False
+        self.tile_budget = 0  # Tiles left before preempting ourselves (0: no limit)
+        self.tiles_rendered = 0
+
+    def stop(self):
+        """Finish the tiles being rendered, then return from run()"""
+        with self.lock:
+            self.stopping = True
+            self.lock.notify_all()
+
+    def scan(self):
+        """Start jobs that appeared in incoming/"""
+        incoming = os.path.join(self.root, 'incoming')
+        started = []
+        for entry in sorted(os.listdir(incoming)):
+            name, ext = os.path.splitext(entry)
+            if ext != '.json' or name in self.jobs or name.startswith('.'):
+                continue
+            path = os.path.join(incoming, entry)
+            try:
+                desc = read_descriptor(path)
+                job = Job(self, name, desc, os.path.getmtime(path))
+            except (ValueError, OSError, MemoryError) as e:
+                self._move(name, 'failed', str(e))
+                continue
+            if job.resumed:
+                log(f"{name}: resuming with {job.resumed}/{len(job.tiles)} tiles done")
+            started.append(job)
+
+        # All at once, so priorities hold among jobs found in the same scan
+        with self.lock:
+            self.jobs.update((job.name, job) for job in started)
+            self.lock.notify_all()
+        for job in started:
+            if job.remaining == 0:
+                self._finish(job)
+
+    def _move(self, name, where, error=None):
+        src = os.path.join(self.root, 'incoming', name + '.json')
+        os.replace(src, os.path.join(self.root, where, name + '.json'))
+        if error:
+            log(f"{name}: {error}")
+            with open(os.path.join(self.root, where, name + '.error'), 'w') as f:
+                f.write(error + '\n')
+
+    def _take(self):
+        """Next (job, tile index) by priority, None once stopping"""
+        with self.lock:
+            while True:
+                if self.stopping:
+                    return None
+                ready = [j for j in self.jobs.values() if j.pending]
+                if ready:
+                    job = max(ready, key=lambda j: (j.priority, -j.submitted))
+                    return job, job.pending.popleft()
+                self.lock.wait()
+
+    def _run_slot(self, slot):
+        while True:
+            item = self._take()
+            if item is None:
+                return
+            job, index = item
+            try:
+                slot.render(job, job.tiles[index])
+            except (OSError, ConnectionError) as e:
+                with self.lock:
+                    job.pending.appendleft(index)
+                    self.lock.notify_all()
+                log(f"worker {slot.name} lost ({e}); leaving the pool")
+                return
+            with self.lock:
+                job.record(index)
+                job.remaining -= 1
+                self.tiles_rendered += 1
+                if self.tile_budget and self.tiles_rendered >= self.tile_budget:
+                    self.stopping = True
+                    self.lock.notify_all()
+                done = job.remaining == 0
+            if done:
+                self._finish(job)
+
+    def _finish(self, job):
+        job.close()
+        output = job.desc['output'] or os.path.join(self.root, 'done', job.name + '.npy')
+        shutil.move(job.frame_path, output)
+        self._move(job.name, 'done')
+        shutil.rmtree(job.state_dir)
+        with self.lock:
+            del self.jobs[job.name]  # Only now, or scan() would start it again
+            self.lock.notify_all()
+        log(f"{job.name}: finished -> {output}")
+
+    def idle(self):
+        with self.lock:
+            return not self.jobs
+
+    def run(self, until_idle=False, max_tiles=0):
+        """Serve the spool until stop() (or, with until_idle, until no job is left).
+
+        max_tiles stops after that many tiles, as a preemption would. Returns
+        the number of tiles rendered.
+        """
+        self.stopping = False
+        self.tile_budget = self.tiles_rendered + max_tiles if max_tiles else 0
+        threads = [threading.Thread(target=self._run_slot, args=(s,), daemon=True) for s in self.slots]
+        for t in threads:
+            t.start()
+        start = self.tiles_rendered
+        try:
+            while True:
+                self.scan()
+                with self.lock:
+                    if until_idle and not self.jobs:
+                        self.stopping = True
+                        self.lock.notify_all()
+                    if self.stopping or not any(t.is_alive() for t in threads):
+                        break
+                    self.lock.wait(self.poll)
+        finally:
+            self.stop()
+            for t in threads:
+                t.join()
+        return self.tiles_rendered - start
+
+    def close(self):
+        """Release open jobs; their checkpoints stay on disk"""
+        with self.lock:
+            jobs, self.jobs = list(self.jobs.values()), {}
+        for job in jobs:
+            job.close()
+
+
+def status(root):
+    def names(where):
+        path = os.path.join(root, where)
+        entries = os.listdir(path) if os.path.isdir(path) else []
+        return sorted(e[:-5] for e in entries if e.endswith('.json') and not e.startswith('.'))
+
+    lines = []
+    for name in names('incoming'):
+        log_path = os.path.join(root, 'state', name, 'tiles.log')
+        done = os.path.getsize(log_path) // TILE_RECORD.size if os.path.exists(log_path) else 0
+        lines.append(f"{name}: {done} tiles done")
+    for where in ('done', 'failed'):
+        lines += [f"{name}: {where}" for name in names(where)]
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Prioritised, checkpointed render jobs")
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    s = sub.add_parser('submit', help="queue a job")
+    s.add_argument('spool')
+    s.add_argument('name')
+    s.add_argument('--view', nargs=4, required=True, metavar=('XMIN', 'XMAX', 'YMIN', 'YMAX'))
+    s.add_argument('--size', nargs=2, type=int, required=True, metavar=('WIDTH', 'HEIGHT'))
+    s.add_argument('--iter', type=int, default=1000)
+    s.add_argument('--priority', type=int, default=0, help="higher runs first")
+    s.add_argument('--tile-size', type=int, default=256)
+    s.add_argument('--out', help="output .npy file (default SPOOL/done/NAME.npy)")
+
+    v = sub.add_parser('serve', help="run jobs")
+    v.add_argument('spool')
+    v.add_argument('--slots', type=int, default=1, help="local tiles rendered at once")
+    v.add_argument('--workers', default='', help="comma-separated distributed_render.py workers")
+    v.add_argument('--poll', type=float, default=2.0, help="seconds between spool scans")
+    v.add_argument('--until-idle', action='store_true', help="exit when the spool is empty")
+
+    t = sub.add_parser('status', help="list jobs")
+    t.add_argument('spool')
+
+    args = parser.parse_args()
+    if args.command == 'status':
+        print('\n'.join(status(args.spool)))
+        return
+    if args.command == 'submit':
+        desc = {'view': args.view, 'width': args.size[0], 'height': args.size[1],
+                'max_iter': args.iter, 'priority': args.priority, 'tile_size': args.tile_size,
+                'output': os.path.abspath(args.out) if args.out else None}
+        incoming = os.path.join(args.spool, 'incoming')
+        os.makedirs(incoming, exist_ok=True)
+        tmp = os.path.join(incoming, f".{args.name}.{os.getpid()}")
+        with open(tmp, 'w') as f:
+            json.dump(desc, f)
+        os.replace(tmp, os.path.join(incoming, args.name + '.json'))  # Never seen half-written
+        return
+
+    workers = [parse_address(a) for a in args.workers.split(',') if a]
+    spooler = Spooler(args.spool, args.slots, workers, poll=args.poll)
+    # SIGTERM from a scheduler is a preemption: finish current tiles and exit
+    signal.signal(signal.SIGTERM, lambda *_: spooler.stop())
+    signal.signal(signal.SIGINT, lambda *_: spooler.stop())
+    start = time.perf_counter()
+    tiles = spooler.run(until_idle=args.until_idle)
+    spooler.close()
+    log(f"{tiles} tiles in {time.perf_counter() - start:.1f}s")
+
+
+if __name__ == '__main__':
+    main()
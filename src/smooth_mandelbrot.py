@@ -8,10 +8,13 @@ Combines:
 - Exact color palette matching the matplotlib version
 - Dynamic histogram normalization for perfect contrast
 - Infinite smooth zooming
+- Progressive rendering: tiles under the cursor resolve first
+- Live Julia set preview of the point under the cursor
 
 Controls:
 - Mouse Scroll: Zoom in/out at cursor position
 - Left Click: Center view at cursor
+- J: Toggle the Julia preview
 - ESC: Exit
 
 Author: GitHub Copilot (based on work by Aashish Panta)
@@ -37,18 +40,30 @@ getcontext().prec = 50
 # Window dimensions - High Resolution
 WIDTH, HEIGHT = 1920, 1440
 
+# Edge length of the tiles the engine renders and the viewer uploads progressively
+TILE_SIZE = 64
+
+# Julia preview inset: edge in pixels, iteration budget and half-width of the plane shown
+JULIA_SIZE = 512
+JULIA_ITER = 256
+JULIA_EXTENT = "1.6"
+
 # Shader sources
 VERTEX_SHADER = """
 #version 330 core
 layout (location = 0) in vec2 position;
 out vec2 TexCoord;
+out vec2 ProgressCoord;
 
 uniform vec2 relative_offset;
 uniform vec2 relative_scale;
+uniform vec2 progress_offset;
+uniform vec2 progress_scale;
 
 void main() {
     vec2 view_center_uv = vec2(0.5) + relative_offset;
     TexCoord = view_center_uv + (position * 0.5) * relative_scale;
+    ProgressCoord = vec2(0.5) + progress_offset + (position * 0.5) * progress_scale;
     gl_Position = vec4(position, 0.0, 1.0);
 }
 """
@@ -56,16 +71,24 @@ void main() {
 FRAGMENT_SHADER = """
 #version 330 core
 in vec2 TexCoord;
+in vec2 ProgressCoord;
 out vec4 FragColor;
 
 uniform sampler2D mandelbrotTexture;
 uniform sampler2D paletteTexture; // Changed to 2D for better compatibility
+uniform sampler2D progressTexture; // Tiles of the render in flight, NaN where not done yet
+uniform bool progress_active;
 uniform float min_val;
 uniform float max_val;
 
 void main() {
     float iter = texture(mandelbrotTexture, TexCoord).r;
 
+    if (progress_active) {
+        float fresh = texture(progressTexture, ProgressCoord).r;
+        if (!isnan(fresh)) iter = fresh;
+    }
+
     if (iter < 0.0) {
         // Inside set - black
         FragColor = vec4(0.0, 0.0, 0.0, 1.0);
@@ -101,10 +124,24 @@ class AppState:
         self.tex_width = WIDTH
         self.tex_height = HEIGHT
 
+        # Pixel the user is looking at (rows counted from ymin); tiles around it render first
+        self.focus_x = WIDTH // 2
+        self.focus_y = HEIGHT // 2
+
+        # Render in flight: (output, tile_done, (cx, cy, zoom)) while tiles are still arriving
+        self.progress = None
+
         # Visualization parameters
         self.min_val = 0.0
         self.max_val = 1.0
 
+        # Julia preview: c under the cursor, and the latest rendered preview
+        self.julia_enabled = False
+        self.julia_c = None
+        self.julia_needs_compute = False
+        self.new_julia = None  # (data, min_val, max_val) waiting for upload
+        self.julia_range = (0.0, 1.0)
+
         # Flags
         self.needs_compute = True
         self.computing = False
@@ -119,10 +156,21 @@ state = AppState()
 # C computation engine
 class FastMandelbrotCompute:
     def __init__(self):
-        dll_name = 'mandelbrot_compute.dll'
+        dll_name = 'mandelbrot_compute.dll' if os.name == 'nt' else 'mandelbrot_compute.so'
         script_dir = os.path.dirname(os.path.abspath(__file__))
         # Look in lib directory
-        dll_path = os.path.join(os.path.dirname(script_dir), 'lib', dll_name)
+        lib_dir = os.path.join(os.path.dirname(script_dir), 'lib')
+        dll_path = os.path.join(lib_dir, dll_name)
+
+        # Prefer the native module: renders in place with no per-call ctypes marshaling
+        self.renderer = None
+        sys.path.insert(0, lib_dir)
+        try:
+            import mandelbrot_native
+            self.renderer = mandelbrot_native.Renderer(tile_size=TILE_SIZE)
+            print("[OK] Native module loaded")
+        except ImportError:
+            pass
 
         try:
             self.lib = ctypes.CDLL(dll_path)
@@ -131,24 +179,48 @@ class FastMandelbrotCompute:
             self.lib.compute_mandelbrot_str.argtypes = [
                 ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
                 ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
-                ctypes.c_int,
+                ctypes.c_longlong,
                 ctypes.POINTER(ctypes.c_double)
             ]
             self.lib.compute_mandelbrot_str.restype = None
 
+            # Progressive variant: nearest-first tiles around a focus pixel
+            self.lib.compute_mandelbrot_str_focus.argtypes = [
+                ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                ctypes.c_longlong,
+                ctypes.c_int, ctypes.c_int, ctypes.c_int,
+                ctypes.POINTER(ctypes.c_double),
+                ctypes.POINTER(ctypes.c_ubyte)
+            ]
+            self.lib.compute_mandelbrot_str_focus.restype = None
+
+            # Julia set of a fixed c, with the same options block as compute_mandelbrot_str_ex
+            self.lib.compute_julia_str.argtypes = [
+                ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                ctypes.c_char_p, ctypes.c_char_p,
+                ctypes.c_longlong,
+                ctypes.POINTER(ctypes.c_double), ctypes.c_void_p
+            ]
+            self.lib.compute_julia_str.restype = None
+
             # Helper to check precision mode
-            self.lib.get_precision_mode.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]
-            self.lib.get_precision_mode.restype = ctypes.c_int
+            self.lib.get_precision_mode_ex.argtypes = [
+                ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+                ctypes.c_void_p
+            ]
+            self.lib.get_precision_mode_ex.restype = ctypes.c_int
 
             print("[OK] C acceleration library loaded successfully!")
         except Exception as e:
             print(f"[ERROR] Failed to load C library: {e}")
             sys.exit(1)
 
-    def get_mode(self, xmin, xmax, width):
-        xmin_str = str(xmin).encode('utf-8')
-        xmax_str = str(xmax).encode('utf-8')
-        return self.lib.get_precision_mode(xmin_str, xmax_str, width)
+    def get_mode(self, xmin, xmax, width, ymin, ymax, height):
+        bounds = [str(v).encode('utf-8') for v in (xmin, xmax, ymin, ymax)]
+        return self.lib.get_precision_mode_ex(bounds[0], bounds[1], width, bounds[2], bounds[3], height, None)
 
     def compute(self, xmin, xmax, width, ymin, ymax, height, max_iter):
         output = np.zeros(height * width, dtype=np.float64)
@@ -167,6 +239,35 @@ class FastMandelbrotCompute:
         )
         return output.reshape(height, width)
 
+    def compute_focus(self, xmin, xmax, width, ymin, ymax, height, max_iter, focus, output, tile_done):
+        """Render into output, setting tile_done[i] as each tile finishes (nearest to focus first)"""
+        if self.renderer is not None:
+            self.renderer.render(output, xmin, xmax, ymin, ymax, max_iter,
+                                 width=width, height=height, focus=focus, tile_done=tile_done)
+            return output.reshape(height, width)
+
+        self.lib.compute_mandelbrot_str_focus(
+            str(xmin).encode('utf-8'), str(xmax).encode('utf-8'), width,
+            str(ymin).encode('utf-8'), str(ymax).encode('utf-8'), height,
+            max_iter,
+            focus[0], focus[1], TILE_SIZE,
+            output.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+            tile_done.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte))
+        )
+        return output.reshape(height, width)
+
+    def compute_julia(self, c, extent, size, max_iter):
+        """Julia set of c = (re, im) over [-extent, extent]^2, rows counted from the bottom"""
+        output = np.zeros(size * size, dtype=np.float64)
+        lo, hi = f"-{extent}".encode('utf-8'), str(extent).encode('utf-8')
+        self.lib.compute_julia_str(
+            lo, hi, size, lo, hi, size,
+            str(c[0]).encode('utf-8'), str(c[1]).encode('utf-8'),
+            max_iter,
+            output.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), None
+        )
+        return output.reshape(size, size)
+
 compute_engine = FastMandelbrotCompute()
 
 def create_palette_texture():
@@ -194,6 +295,50 @@ def create_palette_texture():
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 2048, 1, 0, GL_RGBA, GL_FLOAT, data)
     return texture
 
+def value_range(data):
+    """Dynamic normalization stats: range of the log-log smoothed escape counts"""
+    valid_mask = data > 0
+    if not np.any(valid_mask):
+        return 0.0, 1.0
+    subset = data[valid_mask]
+    if subset.size > 100000:
+        subset = np.random.choice(subset, 100000)
+
+    log_vals = np.log(np.log(subset + 2) + 1)
+    min_v = np.min(log_vals)
+    max_v = np.percentile(log_vals, 99.7)
+
+    if max_v <= min_v:
+        max_v = min_v + 1.0
+    return min_v, max_v
+
+def cursor_world(window):
+    """Point of the plane under the cursor, in Decimal (call with state.lock held)"""
+    window_x, window_y = glfw.get_cursor_pos(window)
+    ndc_x = Decimal(window_x / WIDTH) * 2 - 1
+    ndc_y = -(Decimal(window_y / HEIGHT) * 2 - 1)
+
+    aspect = Decimal(WIDTH) / Decimal(HEIGHT)
+    view_w = aspect / state.zoom
+    view_h = Decimal("1.0") / state.zoom
+    return state.center_x + ndc_x * (view_w / 2), state.center_y + ndc_y * (view_h / 2)
+
+def julia_thread_func():
+    """Background thread rendering the Julia preview for the latest cursor position"""
+    while True:
+        with state.lock:
+            c = state.julia_c if state.julia_needs_compute else None
+            state.julia_needs_compute = False
+
+        if c is None:
+            time.sleep(0.005)
+            continue
+
+        data = compute_engine.compute_julia(c, JULIA_EXTENT, JULIA_SIZE, JULIA_ITER)
+        min_v, max_v = value_range(data)
+        with state.lock:
+            state.new_julia = (data.astype(np.float32), min_v, max_v)
+
 def compute_thread_func():
     """Background thread for C computation"""
     while True:
@@ -208,6 +353,7 @@ def compute_thread_func():
                 zoom = state.zoom
                 max_iter = state.max_iter
                 width, height = WIDTH, HEIGHT
+                focus = (state.focus_x, state.focus_y)
 
         if not should_compute:
             time.sleep(0.01)
@@ -226,32 +372,28 @@ def compute_thread_func():
         start_t = time.time()
 
         # Check precision mode
-        mode = compute_engine.get_mode(xmin, xmax, width)
+        mode = compute_engine.get_mode(xmin, xmax, width, ymin, ymax, height)
         mode_str = ["Double (64-bit)", "Long Double (80-bit)", "Quad (128-bit)", "Perturbation (Hybrid)"][mode]
 
-        data = compute_engine.compute(xmin, xmax, width, ymin, ymax, height, max_iter)
-        dt = time.time() - start_t
-
-        # Calculate dynamic normalization stats
-        valid_mask = data > 0
-        if np.any(valid_mask):
-            subset = data[valid_mask]
-            if subset.size > 100000:
-                subset = np.random.choice(subset, 100000)
+        # Shared with the main loop, which uploads tiles as soon as they are flagged done
+        output = np.full(height * width, np.nan, dtype=np.float64)
+        tiles_x = (width + TILE_SIZE - 1) // TILE_SIZE
+        tiles_y = (height + TILE_SIZE - 1) // TILE_SIZE
+        tile_done = np.zeros(tiles_x * tiles_y, dtype=np.uint8)
+        with state.lock:
+            state.progress = (output, tile_done, (cx, cy, zoom))
 
-            log_vals = np.log(np.log(subset + 2) + 1)
-            min_v = np.min(log_vals)
-            max_v = np.percentile(log_vals, 99.7)
+        data = compute_engine.compute_focus(xmin, xmax, width, ymin, ymax, height, max_iter,
+                                            focus, output, tile_done)
+        dt = time.time() - start_t
 
-            if max_v <= min_v:
-                max_v = min_v + 1.0
-        else:
-            min_v, max_v = 0.0, 1.0
+        min_v, max_v = value_range(data)
 
         with state.lock:
             state.new_data = data.astype(np.float32)
             state.new_data_params = (cx, cy, zoom, width, height, min_v, max_v)
             state.new_data_available = True
+            state.progress = None
             state.computing = False
 
             if state.center_x != cx or state.center_y != cy or state.zoom != zoom:
@@ -281,6 +423,10 @@ def scroll_callback(window, xoffset, yoffset):
         state.center_x = cursor_world_x - ndc_x * (new_view_w / 2)
         state.center_y = cursor_world_y - ndc_y * (new_view_h / 2)
 
+        # The cursor keeps its screen position across the zoom, so it marks the same pixel
+        state.focus_x = min(max(int(window_x), 0), WIDTH - 1)
+        state.focus_y = min(max(HEIGHT - 1 - int(window_y), 0), HEIGHT - 1)
+
         # Adaptive iterations
         zoom_float = float(state.zoom)
         if zoom_float < 10: state.max_iter = 512
@@ -299,6 +445,20 @@ def scroll_callback(window, xoffset, yoffset):
 
         state.needs_compute = True
 
+def cursor_pos_callback(window, xpos, ypos):
+    with state.lock:
+        if state.julia_enabled:
+            state.julia_c = cursor_world(window)
+            state.julia_needs_compute = True
+
+def key_callback(window, key, scancode, action, mods):
+    if key == glfw.KEY_J and action == glfw.PRESS:
+        with state.lock:
+            state.julia_enabled = not state.julia_enabled
+            if state.julia_enabled:
+                state.julia_c = cursor_world(window)
+                state.julia_needs_compute = True
+
 def mouse_button_callback(window, button, action, mods):
     if button == glfw.MOUSE_BUTTON_LEFT and action == glfw.PRESS:
         with state.lock:
@@ -312,6 +472,8 @@ def mouse_button_callback(window, button, action, mods):
 
             state.center_x += ndc_x * (view_w / 2)
             state.center_y += ndc_y * (view_h / 2)
+            state.focus_x = WIDTH // 2
+            state.focus_y = HEIGHT // 2
             state.needs_compute = True
 
 def main():
@@ -330,6 +492,8 @@ def main():
     glfw.make_context_current(window)
     glfw.set_scroll_callback(window, scroll_callback)
     glfw.set_mouse_button_callback(window, mouse_button_callback)
+    glfw.set_cursor_pos_callback(window, cursor_pos_callback)
+    glfw.set_key_callback(window, key_callback)
     glfw.swap_interval(1)
 
     try:
@@ -361,9 +525,33 @@ def main():
 
     palette_texture = create_palette_texture()
 
+    julia_texture = glGenTextures(1)
+    glBindTexture(GL_TEXTURE_2D, julia_texture)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE)
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, JULIA_SIZE, JULIA_SIZE, 0, GL_RED, GL_FLOAT, None)
+    julia_ready = False
+
+    # Receives tiles of the render in flight; cleared to NaN ("not done") for each new render
+    progress_texture = glGenTextures(1)
+    glBindTexture(GL_TEXTURE_2D, progress_texture)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE)
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, WIDTH, HEIGHT, 0, GL_RED, GL_FLOAT, None)
+    nan_frame = np.full((HEIGHT, WIDTH), np.nan, dtype=np.float32)
+    tiles_x = (WIDTH + TILE_SIZE - 1) // TILE_SIZE
+    progress_owner = None  # tile_done array of the render the progress texture belongs to
+    uploaded = None
+    progress_params = None
+
     # Start compute thread
     t = Thread(target=compute_thread_func, daemon=True)
     t.start()
+    Thread(target=julia_thread_func, daemon=True).start()
 
     # Uniform locations
     loc_rel_offset = glGetUniformLocation(program, "relative_offset")
@@ -372,14 +560,20 @@ def main():
     loc_palette_tex = glGetUniformLocation(program, "paletteTexture")
     loc_min_val = glGetUniformLocation(program, "min_val")
     loc_max_val = glGetUniformLocation(program, "max_val")
+    loc_progress_tex = glGetUniformLocation(program, "progressTexture")
+    loc_progress_active = glGetUniformLocation(program, "progress_active")
+    loc_progress_offset = glGetUniformLocation(program, "progress_offset")
+    loc_progress_scale = glGetUniformLocation(program, "progress_scale")
 
     glUseProgram(program)
     glUniform1i(loc_mandel_tex, 0)
     glUniform1i(loc_palette_tex, 1)
+    glUniform1i(loc_progress_tex, 2)
 
     print("Controls:")
     print("  Scroll: Zoom")
     print("  Click: Center")
+    print("  J: Julia preview")
 
     try:
         while not glfw.window_should_close(window):
@@ -392,6 +586,37 @@ def main():
                     state.tex_center_x, state.tex_center_y, state.tex_zoom, _, _, state.min_val, state.max_val = state.new_data_params
                     state.new_data_available = False
 
+                if state.new_julia is not None:
+                    julia_data, j_min, j_max = state.new_julia
+                    state.new_julia = None
+                    glActiveTexture(GL_TEXTURE0)
+                    glBindTexture(GL_TEXTURE_2D, julia_texture)
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, JULIA_SIZE, JULIA_SIZE, GL_RED, GL_FLOAT, julia_data)
+                    state.julia_range = (j_min, j_max)
+                    julia_ready = True
+                show_julia = state.julia_enabled and julia_ready
+                julia_min, julia_max = state.julia_range
+
+                # Upload tiles of the render in flight as the engine flags them done
+                progress = state.progress
+                if progress is None:
+                    progress_owner = None
+                else:
+                    output, tile_done, progress_params = progress
+                    glActiveTexture(GL_TEXTURE2)
+                    glBindTexture(GL_TEXTURE_2D, progress_texture)
+                    if progress_owner is not tile_done:
+                        progress_owner = tile_done
+                        uploaded = np.zeros_like(tile_done)
+                        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHT, GL_RED, GL_FLOAT, nan_frame)
+                    frame = output.reshape(HEIGHT, WIDTH)
+                    for t in np.flatnonzero(tile_done & ~uploaded):
+                        x0 = (t % tiles_x) * TILE_SIZE
+                        y0 = (t // tiles_x) * TILE_SIZE
+                        tile = np.ascontiguousarray(frame[y0:y0 + TILE_SIZE, x0:x0 + TILE_SIZE], dtype=np.float32)
+                        glTexSubImage2D(GL_TEXTURE_2D, 0, x0, y0, tile.shape[1], tile.shape[0], GL_RED, GL_FLOAT, tile)
+                        uploaded[t] = 1
+
                 # Calculate relative offset/scale using Decimal for precision, then convert to float for shader
                 # Shader only needs relative values which are small, so float is fine here
                 rel_scale = float(state.tex_zoom / state.zoom)
@@ -406,6 +631,13 @@ def main():
                 current_min = state.min_val
                 current_max = state.max_val
 
+                progress_active = progress_owner is not None
+                if progress_active:
+                    p_cx, p_cy, p_zoom = progress_params
+                    prog_scale = float(p_zoom / state.zoom)
+                    prog_off_x = float((state.center_x - p_cx) / (aspect / p_zoom))
+                    prog_off_y = float((state.center_y - p_cy) / (Decimal("1.0") / p_zoom))
+
             glClear(GL_COLOR_BUFFER_BIT)
             glUseProgram(program)
 
@@ -413,15 +645,36 @@ def main():
             glUniform2f(loc_rel_scale, rel_scale, rel_scale)
             glUniform1f(loc_min_val, current_min)
             glUniform1f(loc_max_val, current_max)
+            glUniform1i(loc_progress_active, 1 if progress_active else 0)
+            if progress_active:
+                glUniform2f(loc_progress_offset, prog_off_x, prog_off_y)
+                glUniform2f(loc_progress_scale, prog_scale, prog_scale)
 
             glActiveTexture(GL_TEXTURE0)
             glBindTexture(GL_TEXTURE_2D, mandel_texture)
             glActiveTexture(GL_TEXTURE1)
             glBindTexture(GL_TEXTURE_2D, palette_texture)
+            glActiveTexture(GL_TEXTURE2)
+            glBindTexture(GL_TEXTURE_2D, progress_texture)
 
             glBindVertexArray(vao)
             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4)
 
+            if show_julia:
+                # Inset in the top-right corner, same shader with the Julia texture
+                fb_w, fb_h = glfw.get_framebuffer_size(window)
+                inset = fb_h * JULIA_SIZE // HEIGHT
+                glViewport(fb_w - inset, fb_h - inset, inset, inset)
+                glUniform2f(loc_rel_offset, 0.0, 0.0)
+                glUniform2f(loc_rel_scale, 1.0, 1.0)
+                glUniform1f(loc_min_val, julia_min)
+                glUniform1f(loc_max_val, julia_max)
+                glUniform1i(loc_progress_active, 0)
+                glActiveTexture(GL_TEXTURE0)
+                glBindTexture(GL_TEXTURE_2D, julia_texture)
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4)
+                glViewport(0, 0, fb_w, fb_h)
+
             glfw.swap_buffers(window)
             glfw.poll_events()
 
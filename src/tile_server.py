@@ -0,0 +1,415 @@
+"""
+Mandelbrot Tile Server
+======================
+
+Serves the set as XYZ map tiles over HTTP, for web map viewers:
+
+    GET /Z/X/Y.png     256x256 coloured tile (row 0 at the top)
+    GET /Z/X/Y.npy     the raw smooth iteration counts, for client colouring
+    GET /stats         counters as JSON
+    GET /metrics       server and engine counters for Prometheus
+
+Level 0 is one tile covering re [-2.5, 1.5] x im [-2, 2]; every level doubles
+the tiles per axis. Append ?iter=N to override the iteration budget, up to
+the server's --max-iter; N must be positive.
+
+Popular locations draw many clients at once, so the server:
+  - coalesces identical requests: one render, however many are waiting,
+    plus a small cache of finished tiles;
+  - shares reference orbits: tiles are rendered as regions of one view per
+    block of BLOCK_TILES x BLOCK_TILES tiles, so neighbours reuse its orbit
+    and series approximation instead of building their own;
+  - admits at most max_queue distinct renders waiting for a render slot and
+    sheds the rest with 503 + Retry-After, and drops queued renders that
+    waited longer than max_wait, whose clients have most likely moved on.
+    Overload then costs clients a retry rather than every core thrashing
+    on stale work;
+  - charges cached tiles to the engine's memory budget, and drops cached
+    tiles and idle views when a tile or a new view does not fit it.
+
+Usage:
+    python src/tile_server.py [--port 8080] [--iter 1000] [--max-iter 100000] [--workers 1] \\
+        [--max-queue 32] [--max-wait 10] [--orbit-cache DIR] [--memory-budget MB]
+"""
+
+import argparse
+import collections
+import io
+import json
+import re
+import struct
+import sys
+import threading
+import time
+import zlib
+from decimal import Decimal, localcontext
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+import numpy as np
+
+from engine import MEMORY_CACHE, Engine
+
+TILE_SIZE = 256
+BLOCK_TILES = 8      # Tiles per block side sharing one view and reference orbit
+MAX_ZOOM = 90        # Pixels shrink below quad precision beyond this level
+PLANE = (Decimal(-2.5), Decimal(2))  # Top-left corner of level 0
+PLANE_SIZE = Decimal(4)
+
+# Same stops as the explorer's palette
+PALETTE_STOPS = [
+    '#000428', '#000764', '#0A1E5C', '#0C2C8A', '#1852B1', '#2B6FCC', '#397DD1', '#5092DD',
+    '#6AA7E5', '#83B9E9', '#9BCBEB', '#B0D7EC', '#C4E1ED', '#D5EAF0', '#E3F0F3', '#F0F9FF',
+    '#FFF8DC', '#FFEED5', '#FFE4B5', '#FFDAA0', '#FFD18A', '#FFC570', '#FFB347', '#FFA520',
+    '#FF9000', '#FF7D00', '#FF6B00', '#FF5800', '#FF4500', '#FF3200', '#FF2400', '#F51C00',
+    '#E60000', '#D80000', '#CC0000', '#B30000', '#990000', '#800020', '#660033', '#570040',
+    '#4B0082', '#3D0066', '#2F004F', '#240040', '#1A0033', '#120022', '#0D001A', '#050008',
+    '#000000'
+]
+
+
+class Overloaded(Exception):
+    """The request was shed; the client should retry later"""
+
+
+def _palette(n=2048):
+    stops = np.array([[int(c[i:i + 2], 16) for i in (1, 3, 5)] for c in PALETTE_STOPS], dtype=np.float64)
+    at = np.linspace(0, 1, len(stops))
+    t = np.linspace(0, 1, n)
+    return np.stack([np.interp(t, at, stops[:, k]) for k in range(3)], axis=1).astype(np.uint8)
+
+
+PALETTE = _palette()
+
+
+def colorize(tile, max_iter):
+    """RGB image of a tile; normalised per iteration budget so tiles join without seams"""
+    rgb = np.zeros(tile.shape + (3,), dtype=np.uint8)
+    outside = tile >= 0
+    val = np.log(np.log(tile[outside] + 2) + 1)
+    t = np.clip(val / np.log(np.log(max_iter + 2) + 1), 0, 1) ** 0.8
+    rgb[outside] = PALETTE[(t * (len(PALETTE) - 1)).astype(np.intp)]
+    return rgb
+
+
+def encode_png(rgb):
+    def chunk(kind, data):
+        return struct.pack(">I", len(data)) + kind + data + struct.pack(">I", zlib.crc32(kind + data))
+
+    h, w, _ = rgb.shape
+    rows = np.concatenate([np.zeros((h, 1), dtype=np.uint8), rgb.reshape(h, w * 3)], axis=1)
+    return (b"\x89PNG\r\n\x1a\n"
+            + chunk(b"IHDR", struct.pack(">IIBBBBB", w, h, 8, 2, 0, 0, 0))
+            + chunk(b"IDAT", zlib.compress(rows.tobytes(), 6))
+            + chunk(b"IEND", b""))
+
+
+def block_bounds(z, bx, by, block):
+    """(xmin, xmax, ymin, ymax) strings of a block of block x block tiles, exactly"""
+    with localcontext() as ctx:
+        ctx.prec = 40 + z  # Enough for every binary fraction down to MAX_ZOOM
+        span = PLANE_SIZE / (2 ** z) * block
+        xmin = PLANE[0] + bx * span
+        ymax = PLANE[1] - by * span
+        return tuple(str(v) for v in (xmin, xmin + span, ymax - span, ymax))
+
+
+class _Pending:
+    """A render that requests for the same tile wait on together"""
+
+    def __init__(self, key):
+        self.key = key
+        self.queued = time.monotonic()
+        self.done = threading.Event()
+        self.result = None
+        self.error = None
+
+
+class TileService:
+    def __init__(self, engine=None, max_iter=1000, workers=1, max_queue=32, max_wait=10.0,
+                 block_tiles=BLOCK_TILES, view_cache=16, tile_cache=128, iter_limit=100000):
+        self.engine = engine or Engine()
+        self.max_iter = max_iter
+        self.iter_limit = iter_limit  # Ceiling for budgets clients ask for
+        self.max_queue = max_queue
+        self.max_wait = max_wait
+        self.block_tiles = block_tiles
+        self.view_cache = view_cache
+        self.tile_cache = tile_cache
+        self.lock = threading.Condition()
+        self.inflight = {}                       # Tile key -> _Pending
+        self.queue = collections.deque()         # _Pending not started yet
+        self.tiles = collections.OrderedDict()   # Tile key -> array, LRU
+        self.views = collections.OrderedDict()   # Block key -> [view, users], LRU
+        self.building = set()                    # Block keys whose orbit is being built
+        self.stats = collections.Counter()
+        self.closed = False
+        self.workers = [threading.Thread(target=self._work, daemon=True) for _ in range(workers)]
+        for t in self.workers:
+            t.start()
+
+    def close(self):
+        with self.lock:
+            self.closed = True
+            self.lock.notify_all()
+        for t in self.workers:
+            t.join()
+        for view, _ in self.views.values():
+            self.engine.free_view(view)
+        self.views.clear()
+        while self.tiles:
+            self._drop_tile()
+
+    def metrics_text(self):
+        """Prometheus exposition of the server's counters followed by the engine's"""
+        with self.lock:
+            stats = dict(self.stats, queued=len(self.queue))
+        lines = []
+        for name in ('requests', 'cache_hits', 'coalesced', 'rendered', 'shed', 'views_built', 'memory_evictions'):
+            metric = f"mandelbrot_tile_{name}_total"
+            lines += [f"# TYPE {metric} counter", f"{metric} {stats.get(name, 0)}"]
+        lines += ["# TYPE mandelbrot_tile_queued gauge", f"mandelbrot_tile_queued {stats['queued']}"]
+        return "\n".join(lines) + "\n" + self.engine.metrics_text()
+
+    def tile(self, z, x, y, max_iter=None, timeout=None):
+        """Smooth values of tile (z, x, y), row 0 at the top; raises Overloaded when shed"""
+        if not (0 <= z <= MAX_ZOOM and 0 <= x < 2 ** z and 0 <= y < 2 ** z):
+            raise KeyError("no such tile")
+        key = (z, x, y, max_iter or self.max_iter)
+        with self.lock:
+            self.stats['requests'] += 1
+            if key in self.tiles:
+                self.tiles.move_to_end(key)
+                self.stats['cache_hits'] += 1
+                return self.tiles[key]
+            pending = self.inflight.get(key)
+            if pending:
+                self.stats['coalesced'] += 1
+            else:
+                if len(self.queue) >= self.max_queue:
+                    self.stats['shed'] += 1
+                    raise Overloaded("render queue full")
+                pending = self.inflight[key] = _Pending(key)
+                self.queue.append(pending)
+                self.lock.notify_all()
+        if not pending.done.wait(timeout):
+            raise Overloaded("timed out waiting for the render")
+        if pending.error:
+            raise pending.error
+        return pending.result
+
+    def _work(self):
+        while True:
+            with self.lock:
+                while not self.queue and not self.closed:
+                    self.lock.wait()
+                if self.closed:
+                    return
+                pending = self.queue.popleft()
+                stale = time.monotonic() - pending.queued > self.max_wait
+                if stale:
+                    self.stats['shed'] += 1
+            if stale:
+                self._complete(pending, error=Overloaded("queued too long"))
+                continue
+            try:
+                self._complete(pending, result=self._render(*pending.key))
+            except Exception as e:  # Waiters get the error instead of hanging
+                self._complete(pending, error=e)
+
+    def _complete(self, pending, result=None, error=None):
+        with self.lock:
+            del self.inflight[pending.key]
+            if result is not None:
+                self.stats['rendered'] += 1
+                self._cache_tile(pending.key, result)
+        pending.result, pending.error = result, error
+        pending.done.set()
+
+    def _render(self, z, x, y, max_iter):
+        block = min(self.block_tiles, 2 ** z)
+        bx, by = x // block, y // block
+        view = self._acquire_view((z, bx, by, max_iter), block)
+        try:
+            # Engine rows run bottom to top, tile rows top to bottom
+            px = (x - bx * block) * TILE_SIZE
+            py = (block - 1 - (y - by * block)) * TILE_SIZE
+            tile = self.engine.render_region(view, px, py, TILE_SIZE, TILE_SIZE)
+        finally:
+            self._release_view((z, bx, by, max_iter))
+        return np.ascontiguousarray(tile[::-1])
+
+    def _acquire_view(self, key, block):
+        with self.lock:
+            while key in self.building:
+                self.lock.wait()
+            entry = self.views.get(key)
+            if entry:
+                self.views.move_to_end(key)
+                entry[1] += 1
+                return entry[0]
+            self.building.add(key)
+        try:
+            z, bx, by, max_iter = key
+            size = block * TILE_SIZE
+            bounds = block_bounds(z, bx, by, block)
+            try:
+                view = self.engine.create_view(bounds, size, size, max_iter)
+            except MemoryError:
+                # Over the memory budget: give up what the caches hold and retry once
+                with self.lock:
+                    while self._make_room():
+                        pass
+                view = self.engine.create_view(bounds, size, size, max_iter)
+        finally:
+            with self.lock:
+                self.building.discard(key)
+                self.lock.notify_all()
+        with self.lock:
+            self.stats['views_built'] += 1
+            self.views[key] = [view, 1]
+            self._evict_views()
+        return view
+
+    def _release_view(self, key):
+        with self.lock:
+            self.views[key][1] -= 1
+            self._evict_views()
+
+    def _cache_tile(self, key, tile):
+        # Cached tiles count against the engine's memory budget; a tile that
+        # does not fit even with the caches emptied is not kept
+        while not self.engine.reserve_memory(MEMORY_CACHE, tile.nbytes):
+            if not self._make_room():
+                return
+        self.tiles[key] = tile
+        while len(self.tiles) > self.tile_cache:
+            self._drop_tile()
+
+    def _drop_tile(self):
+        _, tile = self.tiles.popitem(last=False)
+        self.engine.release_memory(MEMORY_CACHE, tile.nbytes)
+
+    def _make_room(self):
+        # Drop the least recently used cached tile, or else idle view; False when neither is left
+        if self.tiles:
+            self._drop_tile()
+            self.stats['memory_evictions'] += 1
+            return True
+        for key, (view, users) in self.views.items():
+            if users == 0:
+                del self.views[key]
+                self.engine.free_view(view)
+                self.stats['memory_evictions'] += 1
+                return True
+        return False
+
+    def _evict_views(self):
+        # Least recently used first, skipping views a render still holds
+        for key in list(self.views):
+            if len(self.views) <= self.view_cache:
+                break
+            view, users = self.views[key]
+            if users == 0:
+                del self.views[key]
+                self.engine.free_view(view)
+
+
+TILE_PATH = re.compile(r"^/(\d+)/(\d+)/(\d+)\.(png|npy)$")
+
+
+class TileHandler(BaseHTTPRequestHandler):
+    service = None  # Set by make_server
+    retry_after = 2
+
+    def do_GET(self):
+        url = urlsplit(self.path)
+        if url.path == '/stats':
+            with self.service.lock:
+                body = json.dumps(dict(self.service.stats, queued=len(self.service.queue)))
+            return self._reply(200, 'application/json', body.encode())
+        if url.path == '/metrics':
+            return self._reply(200, 'text/plain; version=0.0.4', self.service.metrics_text().encode())
+        match = TILE_PATH.match(url.path)
+        if not match:
+            return self._reply(404, 'text/plain', b"not found\n")
+        z, x, y = (int(g) for g in match.groups()[:3])
+        max_iter = None
+        query = parse_qs(url.query)
+        if 'iter' in query:
+            try:
+                max_iter = int(query['iter'][0])
+            except ValueError:
+                max_iter = 0
+            if max_iter <= 0:
+                return self._reply(400, 'text/plain', b"bad iter\n")
+            max_iter = min(max_iter, self.service.iter_limit)
+        try:
+            tile = self.service.tile(z, x, y, max_iter, timeout=self.service.max_wait * 2)
+        except KeyError:
+            return self._reply(404, 'text/plain', b"no such tile\n")
+        except Overloaded as e:
+            return self._reply(503, 'text/plain', f"{e}\n".encode(),
+                               {'Retry-After': str(self.retry_after)})
+        if match.group(4) == 'png':
+            body = encode_png(colorize(tile, max_iter or self.service.max_iter))
+            return self._reply(200, 'image/png', body)
+        buf = io.BytesIO()
+        np.save(buf, tile)
+        return self._reply(200, 'application/octet-stream', buf.getvalue())
+
+    def _reply(self, status, content_type, body, headers=None):
+        self.send_response(status)
+        self.send_header('Content-Type', content_type)
+        self.send_header('Content-Length', str(len(body)))
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, fmt, *args):
+        pass  # One line per tile is too much
+
+
+def make_server(service, host='127.0.0.1', port=8080):
+    handler = type('BoundTileHandler', (TileHandler,), {'service': service})
+    server = ThreadingHTTPServer((host, port), handler)
+    server.daemon_threads = True
+    return server
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Serve Mandelbrot XYZ tiles over HTTP")
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=8080)
+    parser.add_argument('--iter', type=int, default=1000, help="default iteration budget")
+    parser.add_argument('--max-iter', type=int, default=100000, help="largest budget ?iter= may ask for")
+    parser.add_argument('--workers', type=int, default=1, help="tiles rendered at once")
+    parser.add_argument('--max-queue', type=int, default=32, help="distinct renders allowed to wait")
+    parser.add_argument('--max-wait', type=float, default=10.0, help="seconds before a queued render is shed")
+    parser.add_argument('--orbit-cache', help="directory to keep reference orbits in")
+    parser.add_argument('--memory-budget', type=float, help="MB the engine and tile cache may hold")
+    args = parser.parse_args()
+    if not 0 < args.iter <= args.max_iter:
+        parser.error("--iter must be positive and at most --max-iter")
+
+    engine = Engine()
+    if args.orbit_cache:
+        engine.set_orbit_cache(args.orbit_cache)
+    if args.memory_budget:
+        engine.set_memory_budget(int(args.memory_budget * (1 << 20)))
+    service = TileService(engine, args.iter, args.workers, args.max_queue, args.max_wait,
+                          iter_limit=args.max_iter)
+    server = make_server(service, args.host, args.port)
+    print(f"Serving tiles on http://{args.host}:{server.server_address[1]}/Z/X/Y.png", file=sys.stderr)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+        service.close()
+
+
+if __name__ == '__main__':
+    main()
@@ -9,14 +9,15 @@ import os
 
 # Load library
 script_dir = os.path.dirname(os.path.abspath(__file__))
-lib_path = os.path.join(os.path.dirname(script_dir), 'lib', 'mandelbrot_compute.dll')
+lib_name = 'mandelbrot_compute.dll' if os.name == 'nt' else 'mandelbrot_compute.so'
+lib_path = os.path.join(os.path.dirname(script_dir), 'lib', lib_name)
 lib = ctypes.CDLL(lib_path)
 
 # Setup function signatures
 lib.compute_mandelbrot_str.argtypes = [
     ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
     ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
-    ctypes.c_int,
+    ctypes.c_longlong,
     ctypes.POINTER(ctypes.c_double)
 ]
 lib.compute_mandelbrot_str.restype = None
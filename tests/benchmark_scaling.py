@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+"""
+Thread and resolution scaling benchmark
+
+Renders each view at each resolution with 1..N render threads and reports the
+speedup and parallel efficiency of whole frames. A frame is the view setup
+(parsing, reference orbit, series approximation), which runs on one thread,
+plus the tiled render, which runs on all of them. The setup's share of the
+one-thread frame is the serial fraction s, and Amdahl's law bounds the speedup
+by 1 / s. The report shows that bound next to the measured speedups, together
+with the Karp-Flatt serial fraction. When that fraction grows with the thread
+count, the loss comes from imbalance or memory bandwidth, not the orbit.
+
+Usage:
+    python tests/benchmark_scaling.py [--threads 1,2,4,...] [--sizes 256,1024,4096,8k]
+                                      [--views double,long_double,deep,deeper]
+                                      [--repeat 3] [--csv scaling.csv]
+
+The thread counts default to powers of two up to the core count, and the sizes
+default to 256^2 .. 2048^2. Pass '--sizes all' for the sweep up to 8k (7680x4320),
+which takes a long time at one thread.
+"""
+import argparse
+import csv
+import os
+import sys
+import time
+
+import numpy as np
+
+script_dir = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(os.path.dirname(script_dir), 'src'))
+from engine import Engine
+
+
+MODE_NAMES = {0: "double", 1: "long double", 3: "perturbation"}
+
+# name -> (bounds, max_iter), from shallow to the deepest perturbation view
+VIEWS = {
+    "double": (("-0.75", "-0.74", "0.10", "0.11"), 2000),
+    "long_double": (("-1.9999991175878805", "-1.9999991175868805",
+                     "-0.000000000000375", "0.000000000000375"), 2000),
+    "deep": (("-0.74364388703715920", "-0.74364388703714920",
+              "0.13182590420530825", "0.13182590420531575"), 5000),
+    "deeper": (("-0.743643887037158704752191506114774", "-0.743643887037158704752191506114764",
+                "0.131825904205311970493132056385139", "0.131825904205311970493132056385149"), 20000),
+}
+
+SIZES = {"256": (256, 256), "512": (512, 512), "1024": (1024, 1024), "2048": (2048, 2048),
+         "4096": (4096, 4096), "8k": (7680, 4320)}
+DEFAULT_SIZES = "256,512,1024,2048"
+
+
+def default_threads():
+    cores = os.cpu_count() or 1
+    counts = [1]
+    while counts[-1] * 2 <= cores:
+        counts.append(counts[-1] * 2)
+    if counts[-1] != cores:
+        counts.append(cores)
+    return counts
+
+
+def parse_size(text):
+    if text in SIZES:
+        return SIZES[text]
+    width, _, height = text.partition('x')
+    return int(width), int(height or width)
+
+
+def measure_frame(engine, bounds, width, height, max_iter, out, repeat):
+    """Best setup and render wall times of repeat frames, and the view's precision mode"""
+    best_setup = best_render = float('inf')
+    mode = None
+    for _ in range(repeat):
+        start = time.perf_counter()
+        view = engine.create_view(bounds, width, height, max_iter)
+        built = time.perf_counter()
+        try:
+            engine.render_region(view, 0, 0, width, height, deterministic=False, out=out)
+            best_render = min(best_render, time.perf_counter() - built)
+            mode = engine.precision(view).mode
+        finally:
+            engine.free_view(view)
+        best_setup = min(best_setup, built - start)
+    return best_setup, best_render, mode
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Thread and resolution scaling of the Mandelbrot engine")
+    parser.add_argument('--threads', help="comma-separated render thread counts (default: 1, 2, 4, .., cores)")
+    parser.add_argument('--sizes', default=DEFAULT_SIZES,
+                        help=f"comma-separated sizes: {', '.join(SIZES)}, WxH, or 'all' (default: {DEFAULT_SIZES})")
+    parser.add_argument('--views', default=",".join(VIEWS), help=f"comma-separated views: {', '.join(VIEWS)}")
+    parser.add_argument('--repeat', type=int, default=3, help="frames per measurement (best counts)")
+    parser.add_argument('--csv', help="also write every measurement to this CSV file")
+    args = parser.parse_args()
+
+    threads = sorted({int(t) for t in args.threads.split(',')}) if args.threads else default_threads()
+    if threads[0] != 1:
+        threads.insert(0, 1)  # Speedups are relative to one thread
+    sizes = [parse_size(s) for s in (",".join(SIZES) if args.sizes == 'all' else args.sizes).split(',')]
+    views = args.views.split(',')
+    unknown = [v for v in views if v not in VIEWS]
+    if unknown:
+        parser.error(f"unknown views: {', '.join(unknown)}")
+
+    engine = Engine()
+    engine.set_orbit_cache(None)  # Every frame must build its own orbit
+    host_tuning = engine.tuning()
+    rows = []
+
+    print("=" * 78)
+    print(f"Scaling Benchmark - {os.cpu_count()} cores, threads {threads}")
+    print("=" * 78)
+    try:
+        for name in views:
+            bounds, max_iter = VIEWS[name]
+            for width, height in sizes:
+                out = np.empty((height, width), dtype=np.float64)
+                results = []
+                for count in threads:
+                    profile = engine.tuning()
+                    profile.threads = count
+                    engine.set_tuning(profile)
+                    results.append((count,) + measure_frame(engine, bounds, width, height, max_iter,
+                                                            out, max(1, args.repeat)))
+
+                _, setup_1, render_1, mode = results[0]
+                frame_1 = setup_1 + render_1
+                serial = setup_1 / frame_1
+                print(f"\n{name} ({MODE_NAMES.get(mode, mode)}), {width}x{height}, {max_iter} iterations")
+                print(f"  Serial setup {setup_1 * 1000:.1f} ms of {frame_1 * 1000:.1f} ms: "
+                      f"s = {serial:.4f}, Amdahl limit {1 / serial if serial > 0 else float('inf'):.1f}x")
+                print(f"  {'threads':>7} {'frame ms':>10} {'speedup':>8} {'efficiency':>10} "
+                      f"{'Amdahl':>7} {'Karp-Flatt':>10}")
+                for count, setup, render, _ in results:
+                    frame = setup + render
+                    speedup = frame_1 / frame
+                    efficiency = speedup / count
+                    amdahl = 1 / (serial + (1 - serial) / count)
+                    karp_flatt = (1 / speedup - 1 / count) / (1 - 1 / count) if count > 1 else serial
+                    print(f"  {count:>7} {frame * 1000:>10.1f} {speedup:>7.2f}x {efficiency:>10.1%} "
+                          f"{amdahl:>6.2f}x {karp_flatt:>10.4f}")
+                    rows.append({"view": name, "mode": mode, "width": width, "height": height,
+                                 "max_iter": max_iter, "threads": count, "setup_ms": setup * 1000,
+                                 "render_ms": render * 1000, "frame_ms": frame * 1000,
+                                 "speedup": speedup, "efficiency": efficiency,
+                                 "amdahl_speedup": amdahl, "karp_flatt": karp_flatt})
+    finally:
+        engine.set_tuning(host_tuning)
+
+    if args.csv:
+        with open(args.csv, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+            writer.writeheader()
+            writer.writerows(rows)
+        print(f"\nWrote {len(rows)} measurements to {args.csv}")
+    print("=" * 78)
+
+
+if __name__ == '__main__':
+    main()
@@ -2,20 +2,31 @@
 """
 Quick test to verify optimizations don't break functionality
 """
+import collections
+import concurrent.futures
 import ctypes
 import numpy as np
+import socket
+import struct
 import sys
+import tempfile
+import threading
+import time
 
 # Load library
 try:
     import os
     script_dir = os.path.dirname(os.path.abspath(__file__))
-    lib_path = os.path.join(os.path.dirname(script_dir), 'lib', 'mandelbrot_compute.dll')
+    lib_name = 'mandelbrot_compute.dll' if os.name == 'nt' else 'mandelbrot_compute.so'
+    lib_path = os.path.join(os.path.dirname(script_dir), 'lib', lib_name)
     lib = ctypes.CDLL(lib_path)
 except OSError as e:
-    print(f"Error: Cannot load mandelbrot_compute.dll: {e}")
+    print(f"Error: Cannot load {lib_name}: {e}")
     sys.exit(1)
 
+sys.path.insert(0, os.path.join(os.path.dirname(script_dir), 'src'))
+from engine import Engine, PrecisionChoice, RenderOptions
+
 # Setup function signatures
 lib.compute_mandelbrot.argtypes = [
     ctypes.c_double, ctypes.c_double, ctypes.c_int,
@@ -28,11 +39,213 @@ lib.compute_mandelbrot.restype = None
 lib.compute_mandelbrot_str.argtypes = [
     ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
     ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
-    ctypes.c_int,
+    ctypes.c_longlong,
     ctypes.POINTER(ctypes.c_double)
 ]
 lib.compute_mandelbrot_str.restype = None
 
+lib.compute_mandelbrot_str_focus.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_longlong,
+    ctypes.c_int, ctypes.c_int, ctypes.c_int,
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(ctypes.c_ubyte)
+]
+lib.compute_mandelbrot_str_focus.restype = None
+
+class RenderQuality(ctypes.Structure):
+    _fields_ = [
+        ("elapsed_ms", ctypes.c_double),
+        ("predicted_ms", ctypes.c_double),
+        ("preview_max_iter", ctypes.c_longlong),
+        ("tiles_total", ctypes.c_longlong),
+        ("tiles_full", ctypes.c_longlong),
+        ("preview_scale", ctypes.c_int),
+        ("complete", ctypes.c_int),
+    ]
+
+lib.compute_mandelbrot_str_budget.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_longlong,
+    ctypes.c_double, ctypes.c_int,
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(RenderOptions),
+    ctypes.POINTER(RenderQuality)
+]
+lib.compute_mandelbrot_str_budget.restype = ctypes.c_void_p
+lib.render_job_wait.argtypes = [ctypes.c_void_p]
+lib.render_job_wait.restype = None
+
+class ProgressSnapshot(ctypes.Structure):
+    _fields_ = [
+        ("pixels_total", ctypes.c_longlong),
+        ("pixels_done", ctypes.c_longlong),
+        ("iterations_done", ctypes.c_longlong),
+        ("orbit_iterations", ctypes.c_longlong),
+        ("phase", ctypes.c_int),
+        ("threads", ctypes.c_int),
+    ]
+
+lib.compute_mandelbrot_str_ex.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_longlong,
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(RenderOptions)
+]
+lib.compute_mandelbrot_str_ex.restype = None
+lib.render_progress_create.restype = ctypes.c_void_p
+lib.render_progress_free.argtypes = [ctypes.c_void_p]
+lib.render_progress_snapshot.argtypes = [
+    ctypes.c_void_p, ctypes.POINTER(ProgressSnapshot),
+    ctypes.POINTER(ctypes.c_longlong), ctypes.POINTER(ctypes.c_longlong), ctypes.c_int
+]
+lib.render_progress_snapshot.restype = ctypes.c_int
+
+lib.render_view_create.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_longlong
+]
+lib.render_view_create.restype = ctypes.c_void_p
+lib.render_view_free.argtypes = [ctypes.c_void_p]
+lib.render_view_free.restype = None
+lib.render_view_points.argtypes = [
+    ctypes.c_void_p,
+    ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double),
+    ctypes.c_longlong,
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(RenderOptions)
+]
+lib.render_view_points.restype = None
+lib.render_view_masked.argtypes = [
+    ctypes.c_void_p, ctypes.POINTER(ctypes.c_ubyte), ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(RenderOptions)
+]
+lib.render_view_masked.restype = ctypes.c_longlong
+lib.compute_julia_str.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p,
+    ctypes.c_longlong,
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(RenderOptions)
+]
+lib.compute_julia_str.restype = None
+
+class BuddhabrotOptions(ctypes.Structure):
+    _fields_ = [
+        ("samples", ctypes.c_longlong),
+        ("min_iter", ctypes.c_longlong),
+        ("seed", ctypes.c_ulonglong),
+        ("map_size", ctypes.c_int),
+        ("uniform", ctypes.c_int),
+    ]
+
+lib.compute_buddhabrot_str.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_longlong, ctypes.POINTER(BuddhabrotOptions),
+    ctypes.POINTER(ctypes.c_double),
+    ctypes.POINTER(RenderOptions)
+]
+lib.compute_buddhabrot_str.restype = ctypes.c_longlong
+
+class AuditReport(ctypes.Structure):
+    _fields_ = [
+        ("pixels_checked", ctypes.c_longlong),
+        ("class_mismatches", ctypes.c_longlong),
+        ("escaped_both", ctypes.c_longlong),
+        ("mean_error", ctypes.c_double),
+        ("max_error", ctypes.c_double),
+        ("worst_x", ctypes.c_int),
+        ("worst_y", ctypes.c_int),
+        ("elapsed_ms", ctypes.c_double),
+        ("done", ctypes.c_int),
+    ]
+
+lib.render_audit_start.argtypes = [
+    ctypes.c_void_p, ctypes.c_longlong, ctypes.c_double, ctypes.c_ulonglong, ctypes.POINTER(AuditReport)
+]
+lib.render_audit_start.restype = ctypes.c_void_p
+lib.render_audit_done.argtypes = [ctypes.c_void_p]
+lib.render_audit_done.restype = ctypes.c_int
+lib.render_audit_wait.argtypes = [ctypes.c_void_p]
+lib.render_audit_wait.restype = None
+lib.render_audit_cancel.argtypes = [ctypes.c_void_p]
+lib.render_audit_cancel.restype = None
+
+lib.get_precision_mode_ex.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.POINTER(PrecisionChoice)
+]
+lib.get_precision_mode_ex.restype = ctypes.c_int
+lib.render_view_create_julia.argtypes = [
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int,
+    ctypes.c_char_p, ctypes.c_char_p,
+    ctypes.c_longlong
+]
+lib.render_view_create_julia.restype = ctypes.c_void_p
+lib.render_view_precision.argtypes = [ctypes.c_void_p, ctypes.POINTER(PrecisionChoice)]
+lib.render_view_precision.restype = None
+lib.render_trace_create.argtypes = [ctypes.c_longlong]
+lib.render_trace_create.restype = ctypes.c_void_p
+lib.render_trace_free.argtypes = [ctypes.c_void_p]
+lib.render_trace_free.restype = None
+lib.render_trace_dropped.argtypes = [ctypes.c_void_p]
+lib.render_trace_dropped.restype = ctypes.c_longlong
+lib.render_trace_write.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+lib.render_trace_write.restype = ctypes.c_longlong
+
+class LatencyHistogram(ctypes.Structure):
+    _fields_ = [
+        ("count", ctypes.c_longlong),
+        ("sum_seconds", ctypes.c_double),
+        ("buckets", ctypes.c_longlong * 14),
+    ]
+
+class EngineMetrics(ctypes.Structure):
+    _fields_ = [
+        ("renders", ctypes.c_longlong * 4),
+        ("pixels", ctypes.c_longlong),
+        ("iterations", ctypes.c_longlong),
+        ("reference_iterations", ctypes.c_longlong),
+        ("series_skipped_iterations", ctypes.c_longlong),
+        ("orbit_cache_hits", ctypes.c_longlong),
+        ("orbit_cache_misses", ctypes.c_longlong),
+        ("render_seconds", LatencyHistogram),
+        ("orbit_build_seconds", LatencyHistogram),
+    ]
+
+lib.render_metrics_snapshot.argtypes = [ctypes.POINTER(EngineMetrics)]
+lib.render_metrics_snapshot.restype = None
+lib.render_metrics_format.argtypes = [ctypes.c_char_p, ctypes.c_longlong]
+lib.render_metrics_format.restype = ctypes.c_longlong
+
+STRATEGY_AUTO = 1
+
+class FramePlan(ctypes.Structure):
+    _fields_ = [
+        ("mode", ctypes.c_int),
+        ("fixed_mode", ctypes.c_int),
+        ("tile_size", ctypes.c_int),
+        ("probe_scale", ctypes.c_int),
+        ("probe_samples", ctypes.c_longlong),
+        ("interior_fraction", ctypes.c_double),
+        ("mean_iterations", ctypes.c_double),
+        ("iteration_cv", ctypes.c_double),
+        ("escape_p50", ctypes.c_double),
+        ("escape_p90", ctypes.c_double),
+        ("probe_ms", ctypes.c_double),
+        ("predicted_ms", ctypes.c_double),
+        ("alternative_ms", ctypes.c_double),
+        ("actual_ms", ctypes.c_double),
+    ]
+
 print("Testing optimized Mandelbrot computation...")
 
 # Test 1: Simple double precision
@@ -53,6 +266,23 @@ non_escaped = np.sum(output < 0)
 escaped = np.sum(output >= 0)
 print(f"   Escaped pixels: {escaped}/{width*height} ({100*escaped/(width*height):.1f}%)")
 print(f"   Non-escaped pixels: {non_escaped}/{width*height} ({100*non_escaped/(width*height):.1f}%)")
+
+# Pixels evaluated in an eight-lane block and in the scalar remainder agree
+# bit for bit: shift the region by 3 so every block boundary moves
+lanes_view = ("-2.0", "0.5", "-1.25", "1.25")
+lanes_whole = np.zeros((40, 67), dtype=np.float64)
+lanes_shifted = np.zeros((40, 64), dtype=np.float64)
+for out, options in [(lanes_whole, None), (lanes_shifted, RenderOptions(-1, -1, 0, None, None, 3, 0, 64, 40))]:
+    lib.compute_mandelbrot_str_ex(
+        lanes_view[0].encode(), lanes_view[1].encode(), 67,
+        lanes_view[2].encode(), lanes_view[3].encode(), 40,
+        max_iter,
+        out.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+        ctypes.byref(options) if options else None
+    )
+if not np.array_equal(lanes_whole[:, 3:], lanes_shifted):
+    print(f"   ✗ {np.sum(lanes_whole[:, 3:] != lanes_shifted)} pixels differ between the block and scalar paths")
+    sys.exit(1)
 print(f"   ✓ Double precision mode works")
 
 # Test 2: Deep zoom with perturbation (uses optimized path)
@@ -80,6 +310,68 @@ non_escaped = np.sum(output < 0)
 escaped = np.sum(output >= 0)
 print(f"   Escaped pixels: {escaped}/{width*height} ({100*escaped/(width*height):.1f}%)")
 print(f"   Non-escaped pixels: {non_escaped}/{width*height} ({100*non_escaped/(width*height):.1f}%)")
+
+# A view inside a minibrot: every AVX2 lane stays bounded to the end
+bounded_view = ("-0.743643887037158704752191506114774", "-0.743643887037158704752191506114764",
+                "0.131825904205311970493132056385139", "0.131825904205311970493132056385149")
+bounded = np.zeros(64 * 48, dtype=np.float64)
+lib.compute_mandelbrot_str(
+    bounded_view[0].encode(), bounded_view[1].encode(), 64,
+    bounded_view[2].encode(), bounded_view[3].encode(), 48,
+    20000,
+    bounded.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+)
+if np.any(bounded != -20000):
+    print(f"   ✗ {np.sum(bounded != -20000)} bounded pixels not reported as interior "
+          f"({np.sum(np.isnan(bounded))} NaN)")
+    sys.exit(1)
+
+# A view across the minibrot's edge, sampled against Decimal iteration
+from decimal import Decimal, getcontext
+getcontext().prec = 60
+edge_view = ("-0.743643887037158704762191506114774", "-0.743643887037158704742191506114774",
+             "0.131825904205311970483132056385139", "0.131825904205311970503132056385139")
+edge_iter = 10000
+edge = np.zeros((32, 32), dtype=np.float64)
+lib.compute_mandelbrot_str(
+    edge_view[0].encode(), edge_view[1].encode(), 32,
+    edge_view[2].encode(), edge_view[3].encode(), 32,
+    edge_iter,
+    edge.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+)
+edge_errors = []
+for py in range(0, 32, 5):
+    for px in range(0, 32, 7):
+        cr = Decimal(edge_view[0]) + (Decimal(edge_view[1]) - Decimal(edge_view[0])) / 32 * px
+        ci = Decimal(edge_view[2]) + (Decimal(edge_view[3]) - Decimal(edge_view[2])) / 32 * py
+        x = y = Decimal(0)
+        value = -edge_iter
+        for i in range(edge_iter):
+            modulus = x * x + y * y
+            if modulus > 4:
+                value = i + 1.0 - np.log(np.log(float(modulus)) / np.log(2)) / np.log(2)
+                break
+            x, y = x * x - y * y + cr, 2 * x * y + ci
+        edge_errors.append(abs(edge[py, px] - value))
+print(f"   Minibrot edge: median error {np.median(edge_errors):.3f} over {len(edge_errors)} Decimal pixels")
+if np.median(edge_errors) > 1:
+    print(f"   ✗ Deep render differs from the Decimal reference")
+    sys.exit(1)
+
+# Real-axis pixels of a chaotic view stay bounded. Their offsets from the
+# reference grow large, so the last 4-iteration block must test them against
+# the reference at the same step; every alignment of max_iter is covered
+for axis_iter in range(200, 204):
+    axis = np.zeros((64, 64), dtype=np.float64)
+    lib.compute_mandelbrot_str(
+        b"-1.9000000000000000000000001", b"-1.8999999999999999999999999", 64,
+        b"-0.0000000000000000000000001", b"0.0000000000000000000000001", 64,
+        axis_iter,
+        axis.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+    )
+    if np.any(axis[32] != -axis_iter):
+        print(f"   ✗ {np.sum(axis[32] != -axis_iter)} real-axis pixels escaped at max_iter {axis_iter}")
+        sys.exit(1)
 print(f"   ✓ Perturbation mode works")
 
 # Test 3: Check smoothing is working
@@ -94,4 +386,1454 @@ if escaped > 0:
     else:
         print(f"   ⚠ Warning: No fractional iterations found")
 
+# Test 4: Focus-ordered tile rendering must match the plain render
+print("\n4. Testing focus-ordered progressive rendering...")
+tile_size = 64
+tiles_x = (width + tile_size - 1) // tile_size
+tiles_y = (height + tile_size - 1) // tile_size
+tile_done = np.zeros(tiles_x * tiles_y, dtype=np.uint8)
+focused = np.zeros(width * height, dtype=np.float64)
+
+lib.compute_mandelbrot_str_focus(
+    xmin.encode(), xmax.encode(), width,
+    ymin.encode(), ymax.encode(), height,
+    max_iter,
+    width - 1, 0, tile_size,
+    focused.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    tile_done.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte))
+)
+
+if not np.all(tile_done == 1):
+    print(f"   ✗ Only {np.sum(tile_done)}/{tile_done.size} tiles flagged done")
+    sys.exit(1)
+if not np.array_equal(focused, output):
+    print(f"   ✗ Focus render differs from plain render in {np.sum(focused != output)} pixels")
+    sys.exit(1)
+
+# Tiles finish nearest-first: watch the flags of a second render as they are set
+order_done = np.zeros_like(tile_done)
+order_output = np.zeros_like(focused)
+finished_at = np.full(tile_done.size, -1)
+render = threading.Thread(target=lambda: lib.compute_mandelbrot_str_focus(
+    xmin.encode(), xmax.encode(), width,
+    ymin.encode(), ymax.encode(), height,
+    max_iter,
+    width - 1, 0, tile_size,
+    order_output.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    order_done.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte))
+))
+render.start()
+polls = 0
+while True:
+    running = render.is_alive()
+    finished_at[(order_done == 1) & (finished_at < 0)] = polls
+    polls += 1
+    if not running:
+        break
+    time.sleep(0.001)
+render.join()
+tile_x, tile_y = np.arange(tile_done.size) % tiles_x, np.arange(tile_done.size) // tiles_x
+centre_x = (tile_x * tile_size + np.minimum((tile_x + 1) * tile_size, width)) / 2
+centre_y = (tile_y * tile_size + np.minimum((tile_y + 1) * tile_size, height)) / 2
+focus_distance = np.hypot(centre_x - (width - 1), centre_y)
+# Rank correlation of finishing order and distance; tiles seen in the same poll tie
+order_rank = np.argsort(np.argsort(finished_at + focus_distance / (2 * focus_distance.max())))
+distance_rank = np.argsort(np.argsort(focus_distance))
+order_correlation = np.corrcoef(order_rank, distance_rank)[0, 1]
+
+print(f"   All {tile_done.size} tiles flagged done, output identical")
+print(f"   Tiles finished over {len(np.unique(finished_at))} polls, "
+      f"order-distance rank correlation {order_correlation:.3f}")
+if order_correlation < 0.9:
+    print(f"   ✗ Tiles did not finish nearest the focus first")
+    sys.exit(1)
+print(f"   ✓ Progressive rendering works")
+
+# Test 5: Budgeted render degrades, then background refinement completes it
+print("\n5. Testing deadline-bounded rendering...")
+deep = ("-0.7436438870371", "-0.7436438870370", "0.131825904205", "0.131825904206")
+deep_iter = 20000
+reference = np.zeros(width * height, dtype=np.float64)
+lib.compute_mandelbrot_str(
+    deep[0].encode(), deep[1].encode(), width,
+    deep[2].encode(), deep[3].encode(), height,
+    deep_iter,
+    reference.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+)
+
+budgeted = np.zeros(width * height, dtype=np.float64)
+tile_done[:] = 0
+quality = RenderQuality()
+job = lib.compute_mandelbrot_str_budget(
+    deep[0].encode(), deep[1].encode(), width,
+    deep[2].encode(), deep[3].encode(), height,
+    deep_iter,
+    5.0, 1,
+    budgeted.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ctypes.byref(RenderOptions(width // 2, height // 2, tile_size,
+                               tile_done.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)))),
+    ctypes.byref(quality)
+)
+print(f"   Returned after {quality.elapsed_ms:.1f} ms (predicted full frame {quality.predicted_ms:.1f} ms)")
+print(f"   Preview scale {quality.preview_scale}, iteration cap {quality.preview_max_iter}, "
+      f"{quality.tiles_full}/{quality.tiles_total} tiles at full quality")
+if job:
+    lib.render_job_wait(job)
+if not np.all(tile_done == 1) or not np.array_equal(budgeted, reference):
+    print(f"   ✗ Refined frame differs from plain render in {np.sum(budgeted != reference)} pixels")
+    sys.exit(1)
+
+# A perturbation preview of an odd-sized frame, left unrefined: coarse pixel k is
+# fine pixel k * scale, wherever the rounded-up coarse size puts its centre
+odd = ("-0.74364388703715920", "-0.74364388703714920", "0.13182590420530825", "0.13182590420531575")
+odd_w, odd_h = 403, 301
+odd_ref = np.zeros((odd_h, odd_w), dtype=np.float64)
+lib.compute_mandelbrot_str(odd[0].encode(), odd[1].encode(), odd_w, odd[2].encode(), odd[3].encode(), odd_h,
+                           5000, odd_ref.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+odd_out = np.zeros((odd_h, odd_w), dtype=np.float64)
+odd_done = np.zeros(((odd_w + 63) // 64) * ((odd_h + 63) // 64), dtype=np.uint8)
+quality = RenderQuality()
+lib.compute_mandelbrot_str_budget(
+    odd[0].encode(), odd[1].encode(), odd_w, odd[2].encode(), odd[3].encode(), odd_h, 5000, 0.5, 0,
+    odd_out.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ctypes.byref(RenderOptions(-1, -1, 64, odd_done.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)))),
+    ctypes.byref(quality)
+)
+scale = quality.preview_scale
+if quality.tiles_full < quality.tiles_total and scale > 1:
+    preview, truth = odd_out[::scale, ::scale], odd_ref[::scale, ::scale]
+    open_tiles = np.repeat(np.repeat(odd_done.reshape((odd_h + 63) // 64, -1) == 0, 64, 0), 64, 1)
+    sampled = open_tiles[:odd_h:scale, :odd_w:scale] & (truth >= 0) & (preview >= 0) & \
+        (preview < quality.preview_max_iter - 8)
+    aligned = np.mean(np.abs(preview - truth)[sampled] < 1e-6)
+    print(f"   Odd-sized perturbation preview at 1/{scale}: {aligned:.0%} of samples match the full frame")
+    if aligned < 0.8:
+        print(f"   ✗ Coarse preview is shifted against the full frame")
+        sys.exit(1)
+print(f"   ✓ Deadline-bounded rendering works")
+
+# Test 6: Progress counters can be read while the render runs
+print("\n6. Testing progress reporting...")
+progress = lib.render_progress_create()
+options = RenderOptions(-1, -1, 0, None, progress)
+watched = np.zeros(width * height, dtype=np.float64)
+render = threading.Thread(target=lambda: lib.compute_mandelbrot_str_ex(
+    deep[0].encode(), deep[1].encode(), width,
+    deep[2].encode(), deep[3].encode(), height,
+    deep_iter,
+    watched.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ctypes.byref(options)
+))
+snapshot = ProgressSnapshot()
+render.start()
+samples = 0
+while render.is_alive():
+    lib.render_progress_snapshot(progress, ctypes.byref(snapshot), None, None, 0)
+    samples += 1
+render.join()
+
+thread_pixels = (ctypes.c_longlong * 256)()
+phase = lib.render_progress_snapshot(progress, ctypes.byref(snapshot), thread_pixels, None, 256)
+lib.render_progress_free(progress)
+print(f"   {samples} snapshots taken during the render")
+print(f"   Final: phase {phase}, {snapshot.pixels_done}/{snapshot.pixels_total} pixels, "
+      f"{snapshot.iterations_done:,} iterations on {snapshot.threads} threads")
+if phase != 4 or snapshot.pixels_done != width * height or sum(thread_pixels) != width * height:
+    print(f"   ✗ Progress counters do not add up")
+    sys.exit(1)
+
+# Iterations are the ones the kernels ran: none inside the main cardioid,
+# which its test settles without iterating
+cardioid_progress = lib.render_progress_create()
+cardioid_before, cardioid_after = EngineMetrics(), EngineMetrics()
+lib.render_metrics_snapshot(ctypes.byref(cardioid_before))
+cardioid = np.zeros(200 * 200, dtype=np.float64)
+lib.compute_mandelbrot_str_ex(b"-0.3", b"0.1", 200, b"-0.2", b"0.2", 200, 100000,
+                              cardioid.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                              ctypes.byref(RenderOptions(-1, -1, 0, None, cardioid_progress)))
+lib.render_metrics_snapshot(ctypes.byref(cardioid_after))
+lib.render_progress_snapshot(cardioid_progress, ctypes.byref(snapshot), None, None, 0)
+lib.render_progress_free(cardioid_progress)
+cardioid_iterations = cardioid_after.iterations - cardioid_before.iterations
+print(f"   Main cardioid frame: {snapshot.iterations_done:,} iterations reported, {cardioid_iterations:,} in the metrics")
+if np.any(cardioid >= 0) or snapshot.iterations_done != 0 or cardioid_iterations != 0:
+    print(f"   ✗ Iterations the cardioid test skipped are counted")
+    sys.exit(1)
+print(f"   ✓ Progress reporting works")
+
+# Test 7: Native module renders in place, synchronously and through futures
+print("\n7. Testing native Python module...")
+sys.path.insert(0, os.path.join(os.path.dirname(script_dir), 'lib'))
+try:
+    import mandelbrot_native
+except ImportError:
+    mandelbrot_native = None
+    print("   ⚠ mandelbrot_native not built, skipping")
+
+if mandelbrot_native is not None:
+    from concurrent.futures import Future
+    from decimal import Decimal
+
+    renderer = mandelbrot_native.Renderer()
+    in_place = np.zeros((height, width), dtype=np.float64)
+    before, after = EngineMetrics(), EngineMetrics()
+    lib.render_metrics_snapshot(ctypes.byref(before))
+    result = renderer.render(in_place, Decimal(deep[0]), deep[1], deep[2], deep[3], deep_iter)
+    lib.render_metrics_snapshot(ctypes.byref(after))
+    if result is not in_place or not np.array_equal(in_place.ravel(), reference):
+        print(f"   ✗ In-place render differs from plain render")
+        sys.exit(1)
+    # One engine per process: the module's renders show in the library's metrics
+    if after.pixels - before.pixels != width * height:
+        print(f"   ✗ Native module renders on its own copy of the engine")
+        sys.exit(1)
+
+    flat = memoryview(bytearray(width * height * 8)).cast('d')
+    future = renderer.render_async(flat, deep[0], deep[1], deep[2], deep[3], deep_iter,
+                                   width=width, height=height)
+    if not isinstance(future, Future):
+        print(f"   ✗ render_async did not return a concurrent.futures.Future")
+        sys.exit(1)
+    if not np.array_equal(np.frombuffer(future.result(), dtype=np.float64), reference):
+        print(f"   ✗ Async render into a memoryview differs from plain render")
+        sys.exit(1)
+    print(f"   Renderer progress: {renderer.progress()['pixels_done']} pixels")
+    print(f"   ✓ Native module works")
+
+# Test 8: Sparse and masked evaluation agree with the dense render
+print("\n8. Testing sparse and masked evaluation...")
+sparse_view = ("0.36024044343761436323612524444", "0.36024044343761436323612524445",
+               "-0.64131306106480317486037501518", "-0.64131306106480317486037501517")
+sparse_iter = 5000
+dense = np.zeros(width * height, dtype=np.float64)
+lib.compute_mandelbrot_str(
+    sparse_view[0].encode(), sparse_view[1].encode(), width,
+    sparse_view[2].encode(), sparse_view[3].encode(), height,
+    sparse_iter,
+    dense.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+)
+view = lib.render_view_create(
+    sparse_view[0].encode(), sparse_view[1].encode(), width,
+    sparse_view[2].encode(), sparse_view[3].encode(), height,
+    sparse_iter
+)
+
+rng = np.random.default_rng(0)
+mask = (rng.random(width * height) < 0.05).astype(np.uint8)
+masked = np.full(width * height, 123.0)
+evaluated = lib.render_view_masked(
+    view, mask.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)),
+    masked.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    None
+)
+
+picked = rng.choice(width * height, 1001, replace=False)
+xs = (picked % width).astype(np.float64)
+ys = (picked // width).astype(np.float64)
+values = np.zeros(picked.size, dtype=np.float64)
+lib.render_view_points(
+    view, xs.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ys.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    picked.size, values.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    None
+)
+lib.render_view_free(view)
+
+selected = mask == 1
+print(f"   Masked: {evaluated} of {width * height} pixels evaluated")
+if evaluated != np.sum(selected) or np.any(masked[~selected] != 123.0):
+    print(f"   ✗ Masked evaluation touched unselected pixels")
+    sys.exit(1)
+# Lanes are packed differently from the dense render, so allow rounding noise
+for name, got, want in (("Masked", masked[selected], dense[selected]), ("Sparse", values, dense[picked])):
+    if not np.allclose(got, want, rtol=1e-9, atol=0.0, equal_nan=True):
+        print(f"   ✗ {name} values differ from the dense render")
+        sys.exit(1)
+print(f"   ✓ Sparse and masked evaluation works")
+
+# Test 9: Regions rendered straight into a padded, interleaved mosaic
+print("\n9. Testing strided region-of-interest output...")
+margin_y, margin_x = 5, 7
+poster = np.full((height + 2 * margin_y, width + 2 * margin_x, 2), -1.0)
+pitch = poster.strides[0] // 8
+stride = poster.strides[1] // 8
+# Regions split on multiples of 4 keep every pixel in the same AVX2 lane group
+regions = [(0, 0, 200, 140), (200, 0, width - 200, 140), (0, 140, width, height - 140)]
+for x, y, w, h in regions:
+    corner = poster[margin_y + y:, margin_x + x:, 0]
+    options = RenderOptions(-1, -1, 0, None, None, x, y, w, h, pitch, stride)
+    lib.compute_mandelbrot_str_ex(
+        deep[0].encode(), deep[1].encode(), width,
+        deep[2].encode(), deep[3].encode(), height,
+        deep_iter,
+        ctypes.cast(corner.ctypes.data, ctypes.POINTER(ctypes.c_double)),
+        ctypes.byref(options)
+    )
+window = poster[margin_y:margin_y + height, margin_x:margin_x + width, 0]
+outside = poster.copy()
+outside[margin_y:margin_y + height, margin_x:margin_x + width, 0] = -1.0
+if not np.array_equal(window.ravel(), reference, equal_nan=True) or np.any(outside != -1.0):
+    print(f"   ✗ Mosaic differs from plain render or was written outside its regions")
+    sys.exit(1)
+
+if mandelbrot_native is not None:
+    # Second channel through the native module, from a strided numpy view
+    for x, y, w, h in regions:
+        corner = poster[margin_y + y:margin_y + y + h, margin_x + x:margin_x + x + w, 1]
+        renderer.render(corner, deep[0], deep[1], deep[2], deep[3], deep_iter,
+                        width=width, height=height, roi=(x, y, w, h))
+    if not np.array_equal(poster[..., 1], poster[..., 0], equal_nan=True):
+        print(f"   ✗ Native strided render differs from the ctypes one")
+        sys.exit(1)
+print(f"   ✓ Strided region-of-interest output works")
+
+# Test 10: Iteration budgets and tile grids beyond 32 bits
+print("\n10. Testing 64-bit iteration counts and indices...")
+huge_iter = 2**32 + 5
+# Every pixel lies in the main cardioid, which is detected without iterating
+cardioid = np.zeros(16 * 16, dtype=np.float64)
+lib.compute_mandelbrot_str(b"-0.1", b"0.1", 16, b"-0.1", b"0.1", 16, huge_iter,
+                           cardioid.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+lib.render_tile_count.restype = ctypes.c_longlong
+grid = lib.render_tile_count(2_000_000_000, 2_000_000_000, 4)
+print(f"   Interior value {cardioid[0]:.0f}, {grid:,} tiles in a 2e9 x 2e9 frame")
+if np.any(cardioid != -huge_iter) or grid != 500_000_000 ** 2:
+    print(f"   ✗ Iteration count or tile count truncated to 32 bits")
+    sys.exit(1)
+print(f"   ✓ 64-bit counts work")
+
+# Test 11: Deterministic mode gives the same bits whatever the path to a pixel
+print("\n11. Testing deterministic rendering...")
+det_w, det_h = 203, 150  # Rows end in a partial AVX2 group
+det_args = (sparse_view[0].encode(), sparse_view[1].encode(), det_w,
+            sparse_view[2].encode(), sparse_view[3].encode(), det_h, sparse_iter)
+whole = np.zeros(det_w * det_h, dtype=np.float64)
+lib.compute_mandelbrot_str_ex(*det_args, whole.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                              ctypes.byref(RenderOptions(-1, -1, 0, deterministic=1)))
+
+# Odd region corners and a small tile size shift every pixel to another lane
+pieces = np.full((det_h, det_w), -1.0)
+for x, y, w, h in [(0, 0, 101, 77), (101, 0, det_w - 101, 77), (0, 77, det_w, det_h - 77)]:
+    corner = pieces[y:, x:]
+    options = RenderOptions(-1, -1, 12, None, None, x, y, w, h, det_w, 1, 1)
+    lib.compute_mandelbrot_str_ex(*det_args, ctypes.cast(corner.ctypes.data, ctypes.POINTER(ctypes.c_double)),
+                                  ctypes.byref(options))
+
+view = lib.render_view_create(*det_args)
+order = rng.permutation(det_w * det_h)
+xs = (order % det_w).astype(np.float64)
+ys = (order // det_w).astype(np.float64)
+scattered = np.zeros(order.size, dtype=np.float64)
+lib.render_view_points(
+    view, xs.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ys.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    order.size, scattered.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ctypes.byref(RenderOptions(deterministic=1))
+)
+lib.render_view_free(view)
+gathered = np.zeros_like(whole)
+gathered[order] = scattered
+
+interior = np.sum(whole == -sparse_iter)
+print(f"   {interior} interior pixels, {np.sum(np.isnan(whole))} NaN")
+if np.any(np.isnan(whole)) or not np.array_equal(pieces.ravel(), whole):
+    print(f"   ✗ Regions rendered separately differ from the whole frame")
+    sys.exit(1)
+if not np.array_equal(gathered, whole):
+    print(f"   ✗ Shuffled sparse evaluation differs from the dense render")
+    sys.exit(1)
+print(f"   ✓ Deterministic rendering works")
+
+# Test 12: Worker processes render the frame, and one dies part-way through
+print("\n12. Testing distributed rendering...")
+import distributed_render
+steady, addresses = distributed_render.spawn_local_workers(1)
+flaky, flaky_addresses = distributed_render.spawn_local_workers(1, max_tiles=3)
+try:
+    frame, stats = distributed_render.render_distributed(
+        sparse_view, det_w, det_h, sparse_iter, addresses + flaky_addresses,
+        tile_size=32, engine=Engine(lib_path))
+    flaky_exit = flaky[0].wait(timeout=10)
+
+    # Damaged view blobs are refused, and so are tiles outside the view, with
+    # the connection kept for the next request
+    blob_engine = Engine(lib_path)
+    blob_view = blob_engine.create_view(("-5e-21", "5e-21", "0.999999999999999999995", "1.000000000000000000005"),
+                                        24, 24, 3000)
+    good_blob = blob_engine.export_view(blob_view)
+    blob_engine.free_view(blob_view)
+    damaged = []
+    for fields in ({12: ("i", 2)}, {16: ("i", 0)}, {20: ("i", -24)}, {232: ("q", 0), 240: ("q", 0)},
+                   {24: ("q", 1 << 62), 232: ("q", 1 << 61)}):  # mode, width, height, orbit, size overflow
+        blob = bytearray(good_blob)
+        for offset, (code, value) in fields.items():
+            struct.pack_into(code, blob, offset, value)
+        damaged.append(bytes(blob))
+    with socket.create_connection(addresses[0], timeout=30) as sock:
+        replies = []
+        for blob in damaged:
+            distributed_render.send_message(sock, distributed_render.MSG_VIEW, blob)
+            replies.append(distributed_render.recv_message(sock)[0])
+        distributed_render.send_message(sock, distributed_render.MSG_VIEW, good_blob)
+        replies.append(distributed_render.recv_message(sock)[0])
+        for tile in ((0, 20, 0, 8, 8), (1, -1, 0, 4, 4), (2, 0, 0, 0, 4), (3, 0, 16, 4, 9)):
+            distributed_render.send_message(sock, distributed_render.MSG_TILE, distributed_render.TILE.pack(*tile))
+            replies.append(distributed_render.recv_message(sock)[0])
+        distributed_render.send_message(sock, distributed_render.MSG_TILE, b"short")
+        replies.append(distributed_render.recv_message(sock)[0])
+        distributed_render.send_message(sock, distributed_render.MSG_TILE, distributed_render.TILE.pack(4, 16, 16, 8, 8))
+        replies.append(distributed_render.recv_message(sock)[0])
+
+    # Workers answering with results for tiles they were not sent, or of the
+    # wrong size, are dropped like dead ones and their tiles go elsewhere
+    def serve_garbage(listener, bad_result):
+        conn, _ = listener.accept()
+        with conn:
+            distributed_render.recv_message(conn)
+            distributed_render.send_message(conn, distributed_render.MSG_ACK)
+            tile_id, x, y, w, h = distributed_render.TILE.unpack(distributed_render.recv_message(conn)[1])
+            try:
+                distributed_render.send_message(conn, distributed_render.MSG_RESULT, bad_result(tile_id, w, h))
+                conn.recv(1)  # Until the coordinator hangs up
+            except OSError:
+                pass
+    garbage = [lambda tile_id, w, h: distributed_render.TILE_ID.pack(tile_id + 1000) + bytes(w * h * 8),
+               lambda tile_id, w, h: distributed_render.TILE_ID.pack(tile_id) + bytes(8),
+               lambda tile_id, w, h: b"\0"]
+    listeners = [socket.create_server(("127.0.0.1", 0)) for _ in garbage]
+    for listener, bad_result in zip(listeners, garbage):
+        threading.Thread(target=serve_garbage, args=(listener, bad_result), daemon=True).start()
+    garbage_frame, garbage_stats = distributed_render.render_distributed(
+        sparse_view, det_w, det_h, sparse_iter, [l.getsockname()[:2] for l in listeners] + addresses,
+        tile_size=32, depth=1, engine=Engine(lib_path))
+    for listener in listeners:
+        listener.close()
+finally:
+    for proc in steady + flaky:
+        proc.kill()
+print(f"   Tiles per worker: {stats}")
+print(f"   Replies to damaged views and tiles: {b''.join(replies).decode()}")
+print(f"   Tiles with malformed results from three workers: {garbage_stats}")
+if flaky_exit != 0 or not np.array_equal(frame.ravel(), whole):
+    print(f"   ✗ Distributed frame differs from the single-process render")
+    sys.exit(1)
+if not np.array_equal(garbage_frame.ravel(), whole) or set(garbage_stats) != {tuple(addresses[0])}:
+    print(f"   ✗ Workers sending malformed results were not dropped: {garbage_stats}")
+    sys.exit(1)
+if replies != [b"E"] * 5 + [b"K"] + [b"E"] * 5 + [b"R"]:
+    print(f"   ✗ Worker accepted a damaged view or a tile outside it")
+    sys.exit(1)
+print(f"   ✓ Distributed rendering works")
+
+# Test 13: Reference orbits are shared through mappable files
+print("\n13. Testing the on-disk orbit cache...")
+engine = Engine(lib_path)
+with tempfile.TemporaryDirectory() as cache_dir:
+    engine.set_orbit_cache(cache_dir)
+    try:
+        renders = []
+        for attempt in range(3):
+            view = engine.create_view(sparse_view, det_w, det_h, sparse_iter)
+            renders.append(engine.render_region(view, 0, 0, det_w, det_h))
+            engine.free_view(view)
+            files = [os.path.join(cache_dir, f) for f in os.listdir(cache_dir)]
+            if attempt == 1 and len(files) == 1:
+                with open(files[0], 'r+b') as f:
+                    f.truncate(100)  # A damaged file is rebuilt, not trusted
+        file_size = os.path.getsize(files[0])
+        view = engine.open_view(files[0])
+        mapped = engine.render_region(view, 0, 0, det_w, det_h)
+        engine.free_view(view)
+    finally:
+        engine.set_orbit_cache(None)
+
+# A Julia view whose reference z0 escapes at once has an empty orbit, and
+# still round-trips through a blob
+escaping_view = engine.create_view(("2.9999999999999999999", "3.0000000000000000001", "-1e-19", "1e-19"),
+                                   16, 16, 500, julia=("-0.8", "0.156"))
+escaping_blob = engine.export_view(escaping_view)
+escaping_frame = engine.render_region(escaping_view, 0, 0, 16, 16)
+engine.free_view(escaping_view)
+escaping_orbit = struct.unpack_from("q", escaping_blob, 232)[0]  # ViewBlobHeader.ref_iter
+escaping_mode = struct.unpack_from("i", escaping_blob, 12)[0]
+try:
+    escaping_view = engine.import_view(escaping_blob)
+    escaping_back = engine.render_region(escaping_view, 0, 0, 16, 16)
+    escaping_round_trip = engine.export_view(escaping_view) == escaping_blob and \
+        np.array_equal(escaping_back, escaping_frame)
+    engine.free_view(escaping_view)
+except ValueError:
+    escaping_round_trip = False
+print(f"   {len(files)} cached orbit file of {file_size:,} bytes")
+print(f"   Julia view with an escaping reference (mode {escaping_mode}, orbit of {escaping_orbit}) "
+      f"round-trips: {escaping_round_trip}")
+if len(files) != 1 or any(not np.array_equal(r.ravel(), whole) for r in renders + [mapped]):
+    print(f"   ✗ Cached or mapped orbit gives a different frame")
+    sys.exit(1)
+if escaping_mode != 3 or escaping_orbit != 0 or not escaping_round_trip:
+    print(f"   ✗ A view with an empty reference orbit does not round-trip")
+    sys.exit(1)
+print(f"   ✓ Orbit cache works")
+
+# Test 14: Spooled jobs run by priority and resume from their checkpoint
+print("\n14. Testing the job spooler...")
+import json
+import render_spool
+with tempfile.TemporaryDirectory() as spool_dir:
+    os.makedirs(os.path.join(spool_dir, 'incoming'))
+    for name, priority in (('background', 0), ('urgent', 5)):
+        with open(os.path.join(spool_dir, 'incoming', name + '.json'), 'w') as f:
+            json.dump({'view': sparse_view, 'width': det_w, 'height': det_h,
+                       'max_iter': sparse_iter, 'priority': priority, 'tile_size': 32}, f)
+
+    # Preempted after a few tiles, which must all belong to the urgent job
+    spooler = render_spool.Spooler(spool_dir, engine=engine, poll=0.05)
+    first = spooler.run(max_tiles=5)
+    spooler.close()
+    logged = {name: os.path.getsize(os.path.join(spool_dir, 'state', name, 'tiles.log')) // 8
+              for name in ('background', 'urgent')}
+
+    spooler = render_spool.Spooler(spool_dir, engine=engine, poll=0.05)
+    second = spooler.run(until_idle=True)
+    spooler.close()
+    frames = [np.load(os.path.join(spool_dir, 'done', name + '.npy')) for name in ('background', 'urgent')]
+print(f"   {first} tiles before preemption {logged}, {second} after resuming")
+if logged != {'background': 0, 'urgent': 5} or first + second != 2 * 35:
+    print(f"   ✗ Jobs ran out of priority order or finished tiles were rendered again")
+    sys.exit(1)
+if any(not np.array_equal(frame.ravel(), whole) for frame in frames):
+    print(f"   ✗ Resumed job differs from an uninterrupted render")
+    sys.exit(1)
+print(f"   ✓ Job spooler works")
+
+# Test 15: Tile front end coalesces duplicates, shares orbits and sheds overload
+print("\n15. Testing the tile server...")
+import urllib.error
+import urllib.request
+import tile_server
+service = tile_server.TileService(engine, max_iter=2000, max_queue=2, max_wait=60, iter_limit=3000)
+try:
+    # Eight clients ask for the same tile at once. The render waits until all
+    # of them have asked, so none can arrive after it finished
+    results = [None] * 8
+    asked = threading.Event()
+    render_tile = service._render
+    service._render = lambda *key: (asked.wait(), render_tile(*key))[1]
+    clients = [threading.Thread(target=lambda i=i: results.__setitem__(i, service.tile(12, 1395, 1705)))
+               for i in range(8)]
+    for t in clients:
+        t.start()
+    while service.stats['requests'] < 8:
+        time.sleep(0.01)
+    asked.set()
+    for t in clients:
+        t.join()
+    service._render = render_tile
+    neighbour = service.tile(12, 1394, 1705)  # Same block: reuses the orbit
+    coalesced = dict(service.stats)
+
+    # The top-left tile of level 1 is the top half of a plain render of its block
+    block = np.zeros(512 * 512, dtype=np.float64)
+    lib.compute_mandelbrot_str_ex(b"-2.5", b"1.5", 512, b"-2", b"2", 512, 2000,
+                                  block.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                                  ctypes.byref(RenderOptions(-1, -1, 0, deterministic=1)))
+    corner = service.tile(1, 0, 0)
+
+    # A burst of distinct deep tiles overflows the two-slot queue
+    def fetch(x):
+        try:
+            service.tile(30, x, 500_000_000)  # Seahorse valley, one block each
+            return 'ok'
+        except tile_server.Overloaded:
+            return 'shed'
+    with concurrent.futures.ThreadPoolExecutor(12) as pool:
+        outcomes = collections.Counter(pool.map(fetch, range(471_000_000, 471_000_096, 8)))
+
+    server = tile_server.make_server(service, port=0)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    base = f"http://127.0.0.1:{server.server_address[1]}"
+    png = urllib.request.urlopen(f"{base}/12/1395/1705.png").read()
+    metrics_page = urllib.request.urlopen(f"{base}/metrics").read().decode()
+    def status(path):
+        try:
+            return urllib.request.urlopen(f"{base}{path}").status
+        except urllib.error.HTTPError as e:
+            return e.code
+    missing = status("/3/9/0.png")
+    bad_iter = [status(f"/12/1395/1705.png?iter={n}") for n in ("0", "-5", "many")]
+    clamped = status("/12/1395/1705.npy?iter=1000000000") == 200 and (12, 1395, 1705, 3000) in service.tiles
+    server.shutdown()
+    server.server_close()
+finally:
+    service.close()
+print(f"   Duplicates: {coalesced}")
+print(f"   Burst of 12: {dict(outcomes)}")
+if coalesced['rendered'] != 2 or coalesced['coalesced'] != 7 or coalesced['views_built'] != 1:
+    print(f"   ✗ Duplicate requests were rendered again or neighbours rebuilt the orbit")
+    sys.exit(1)
+if any(not np.array_equal(r, results[0]) for r in results) or np.array_equal(neighbour, results[0]):
+    print(f"   ✗ Coalesced requests got different tiles")
+    sys.exit(1)
+if not np.array_equal(corner, block.reshape(512, 512)[256:, :256][::-1]):
+    print(f"   ✗ Tile differs from the plain render of its area")
+    sys.exit(1)
+if outcomes['shed'] == 0 or outcomes['ok'] == 0:
+    print(f"   ✗ Overload was not shed, or nothing got through")
+    sys.exit(1)
+if (not png.startswith(b"\x89PNG") or missing != 404 or "mandelbrot_tile_requests_total" not in metrics_page or
+        "mandelbrot_renders_total{" not in metrics_page or bad_iter != [400] * 3 or not clamped):
+    print(f"   ✗ HTTP front end returned bad responses")
+    sys.exit(1)
+print(f"   ✓ Tile server works")
+
+# Test 16: Julia sets on the direct and perturbation kernels
+print("\n16. Testing Julia set mode...")
+from decimal import Decimal, getcontext
+getcontext().prec = 60
+julia_c = ("-0.8", "0.156")
+
+def render_julia(bounds, size, max_iter, options=None, out=None):
+    if out is None:
+        out = np.zeros((size, size), dtype=np.float64)
+    lib.compute_julia_str(bounds[0].encode(), bounds[1].encode(), size,
+                          bounds[2].encode(), bounds[3].encode(), size,
+                          julia_c[0].encode(), julia_c[1].encode(), max_iter,
+                          ctypes.cast(out.ctypes.data, ctypes.POINTER(ctypes.c_double)),
+                          ctypes.byref(options) if options else None)
+    return out
+
+# Shallow view against a plain numpy iteration of the same pixel grid
+shallow = render_julia(("-1.6", "1.6", "-1.6", "1.6"), 96, 300)
+step = 3.2 / 96
+zr, zi = np.meshgrid(-1.6 + np.arange(96) * step, -1.6 + np.arange(96) * step)
+expected = np.full(zr.shape, -300.0)
+alive = np.ones(zr.shape, dtype=bool)
+for i in range(300):
+    modulus = zr * zr + zi * zi
+    escaped = alive & (modulus > 256)
+    expected[escaped] = i + 1.0 - np.log(np.log(modulus[escaped]) / np.log(2)) / np.log(2)
+    alive &= ~escaped
+    zr, zi = np.where(alive, zr * zr - zi * zi + float(julia_c[0]), zr), np.where(alive, 2 * zr * zi + float(julia_c[1]), zi)
+shallow_match = np.mean(np.abs(shallow - expected) < 1e-6)
+
+# Deep view around a point of the Julia set, found by inverse iteration, against Decimal
+jr, ji = Decimal(julia_c[0]), Decimal(julia_c[1])
+pr, pi = Decimal(1), Decimal(0)
+for k in range(300):
+    ar, ai = pr - jr, pi - ji
+    m = (ar * ar + ai * ai).sqrt()
+    pr, pi = ((m + ar) / 2).sqrt(), ((m - ar) / 2).sqrt() * (-1 if ai < 0 else 1)
+    if k % 3 == 0:
+        pr, pi = -pr, -pi
+half = Decimal("5e-21")
+deep_bounds = tuple(str(v) for v in (pr - half, pr + half, pi - half, pi + half))
+deep_iter = 4000
+deep = render_julia(deep_bounds, 32, deep_iter)
+deep_errors = []
+for py in range(0, 32, 5):
+    for px in range(0, 32, 7):
+        x = Decimal(deep_bounds[0]) + (Decimal(deep_bounds[1]) - Decimal(deep_bounds[0])) / 32 * px
+        y = Decimal(deep_bounds[2]) + (Decimal(deep_bounds[3]) - Decimal(deep_bounds[2])) / 32 * py
+        value = -deep_iter
+        for i in range(deep_iter):
+            modulus = x * x + y * y
+            if modulus > 256:
+                value = i + 1.0 - np.log(np.log(float(modulus)) / np.log(2)) / np.log(2)
+                break
+            x, y = x * x - y * y + jr, 2 * x * y + ji
+        deep_errors.append(abs(deep[py, px] - value))
+
+# Regions rendered separately in deterministic mode match the whole frame
+julia_whole = render_julia(deep_bounds, 32, deep_iter, RenderOptions(-1, -1, 0, deterministic=1))
+julia_pieces = np.full((32, 32), -1.0)
+for x, y, w, h in [(0, 0, 13, 19), (13, 0, 19, 19), (0, 19, 32, 13)]:
+    render_julia(deep_bounds, 32, deep_iter,
+                 RenderOptions(-1, -1, 8, None, None, x, y, w, h, 32, 1, 1),
+                 julia_pieces[y:, x:])
+print(f"   Shallow pixels matching numpy: {shallow_match:.4f}")
+print(f"   Deep view mode {lib.get_precision_mode(deep_bounds[0].encode(), deep_bounds[1].encode(), 32)}, "
+      f"median error {np.median(deep_errors):.2e} over {len(deep_errors)} Decimal pixels")
+if shallow_match < 0.99:
+    print(f"   ✗ Shallow Julia render differs from the reference iteration")
+    sys.exit(1)
+if np.median(deep_errors) > 0.01 or np.any(np.isnan(deep)):
+    print(f"   ✗ Deep Julia render differs from the Decimal reference")
+    sys.exit(1)
+if not np.array_equal(julia_pieces, julia_whole):
+    print(f"   ✗ Julia regions rendered separately differ from the whole frame")
+    sys.exit(1)
+print(f"   ✓ Julia set mode works")
+
+# Test 17: Multibrot z^3 + c and Burning Ship on the direct and perturbation kernels
+print("\n17. Testing alternative formulas...")
+
+def formula_step(formula, x, y, cr, ci):
+    if formula == 1:
+        return x * (x * x - 3 * y * y) + cr, y * (3 * x * x - y * y) + ci
+    return x * x - y * y + cr, abs(2 * x * y) + ci
+
+def render_formula(bounds, size, max_iter, formula, options=None, out=None):
+    if out is None:
+        out = np.zeros((size, size), dtype=np.float64)
+    options = options or RenderOptions(-1, -1, 0)
+    options.formula = formula
+    lib.compute_mandelbrot_str_ex(bounds[0].encode(), bounds[1].encode(), size,
+                                  bounds[2].encode(), bounds[3].encode(), size, max_iter,
+                                  ctypes.cast(out.ctypes.data, ctypes.POINTER(ctypes.c_double)),
+                                  ctypes.byref(options))
+    return out
+
+# c = sqrt(omega - 1), omega a primitive cube root of unity, is a Misiurewicz point of z^3 + c
+wr, wi = Decimal("-1.5"), Decimal(3).sqrt() / 2
+m3r, m3i = Decimal("0.5"), Decimal("0.9")
+for _ in range(10):
+    d = m3r * m3r + m3i * m3i
+    m3r, m3i = (m3r + (wr * m3r + wi * m3i) / d) / 2, (m3i + (wi * m3r - wr * m3i) / d) / 2
+
+formula_shallow = {}
+formula_deep = {}
+for formula, (cx, cy) in ((1, (m3r, m3i)), (2, (Decimal(-1), Decimal(-1)))):
+    # Shallow view against a plain numpy iteration of the same pixel grid
+    image = render_formula(("-2", "2", "-2", "2"), 96, 200, formula)
+    cr, ci = np.meshgrid(-2 + np.arange(96) * (4 / 96), -2 + np.arange(96) * (4 / 96))
+    zr, zi = np.zeros_like(cr), np.zeros_like(ci)
+    expected = np.full(cr.shape, -200.0)
+    alive = np.ones(cr.shape, dtype=bool)
+    for i in range(200):
+        modulus = zr * zr + zi * zi
+        escaped = alive & (modulus > 256)
+        expected[escaped] = i + 1.0 - np.log(np.log(modulus[escaped]) / np.log(2)) / np.log(3 if formula == 1 else 2)
+        alive &= ~escaped
+        nr, ni = formula_step(formula, zr, zi, cr, ci)
+        zr, zi = np.where(alive, nr, zr), np.where(alive, ni, zi)
+    formula_shallow[formula] = np.mean(np.abs(image - expected) < 1e-6)
+
+    # Deep view on a Misiurewicz point against Decimal
+    half = Decimal("5e-20")
+    bounds = tuple(str(v) for v in (cx - half, cx + half, cy - half, cy + half))
+    deep_iter = 3000
+    deep = render_formula(bounds, 32, deep_iter, formula)
+    errors = []
+    for py in range(0, 32, 5):
+        for px in range(0, 32, 7):
+            pr = Decimal(bounds[0]) + (Decimal(bounds[1]) - Decimal(bounds[0])) / 32 * px
+            pi = Decimal(bounds[2]) + (Decimal(bounds[3]) - Decimal(bounds[2])) / 32 * py
+            x = y = Decimal(0)
+            value = -deep_iter
+            for i in range(deep_iter):
+                modulus = x * x + y * y
+                if modulus > 256:
+                    value = i + 1.0 - np.log(np.log(float(modulus)) / np.log(2)) / np.log(3 if formula == 1 else 2)
+                    break
+                x, y = formula_step(formula, x, y, pr, pi)
+            errors.append(abs(deep[py, px] - value))
+    formula_deep[formula] = (bounds, deep, np.median(errors))
+    print(f"   Formula {formula}: {formula_shallow[formula]:.4f} shallow pixels matching numpy, "
+          f"deep mode {lib.get_precision_mode(bounds[0].encode(), bounds[1].encode(), 32)} "
+          f"median error {np.median(errors):.2e} over {len(errors)} Decimal pixels")
+
+# Burning Ship regions rendered separately in deterministic mode match the whole frame
+ship_bounds = formula_deep[2][0]
+ship_whole = render_formula(ship_bounds, 32, 3000, 2, RenderOptions(-1, -1, 0, deterministic=1))
+ship_pieces = np.full((32, 32), -1.0)
+for x, y, w, h in [(0, 0, 13, 19), (13, 0, 19, 19), (0, 19, 32, 13)]:
+    render_formula(ship_bounds, 32, 3000, 2,
+                   RenderOptions(-1, -1, 8, None, None, x, y, w, h, 32, 1, 1),
+                   ship_pieces[y:, x:])
+if min(formula_shallow.values()) < 0.99:
+    print(f"   ✗ Shallow formula render differs from the reference iteration")
+    sys.exit(1)
+if any(d[2] > 0.01 or np.any(np.isnan(d[1])) for d in formula_deep.values()):
+    print(f"   ✗ Deep formula render differs from the Decimal reference")
+    sys.exit(1)
+if not np.array_equal(ship_pieces, ship_whole):
+    print(f"   ✗ Burning Ship regions rendered separately differ from the whole frame")
+    sys.exit(1)
+print(f"   ✓ Alternative formulas work")
+
+# Test 18: Orbit density, importance-sampled and in tiles
+print("\n18. Testing the Buddhabrot mode...")
+buddha_bounds = (b"-2", b"1", b"-1.5", b"1.5")
+
+def render_buddhabrot(size, max_iter, settings, options=None, out=None):
+    if out is None:
+        out = np.zeros((size, size), dtype=np.float64)
+    recorded = lib.compute_buddhabrot_str(buddha_bounds[0], buddha_bounds[1], size,
+                                          buddha_bounds[2], buddha_bounds[3], size, max_iter,
+                                          ctypes.byref(settings),
+                                          ctypes.cast(out.ctypes.data, ctypes.POINTER(ctypes.c_double)),
+                                          ctypes.byref(options) if options else None)
+    return out, recorded
+
+# Importance sampling estimates the density of uniform samples with far fewer wasted orbits
+start = time.perf_counter()
+uniform, uniform_recorded = render_buddhabrot(120, 1000, BuddhabrotOptions(2000000, 20, 1, 0, 1))
+uniform_time = time.perf_counter() - start
+start = time.perf_counter()
+guided, guided_recorded = render_buddhabrot(120, 1000, BuddhabrotOptions(400000, 20, 2))
+guided_time = time.perf_counter() - start
+blocks_uniform = uniform.reshape(12, 10, 12, 10).sum(axis=(1, 3))
+blocks_guided = 5 * guided.reshape(12, 10, 12, 10).sum(axis=(1, 3))
+dense = blocks_uniform > np.percentile(blocks_uniform, 50)
+block_error = np.median(np.abs(blocks_guided[dense] - blocks_uniform[dense]) / blocks_uniform[dense])
+mass_error = abs(5 * guided.sum() / uniform.sum() - 1)
+
+# Regions rendered separately add up to the whole frame
+settings = BuddhabrotOptions(200000, 0, 5)
+buddha_whole, _ = render_buddhabrot(64, 300, settings)
+buddha_pieces = np.full((64, 64), -1.0)
+for x, y, w, h in [(0, 0, 20, 30), (20, 0, 44, 30), (0, 30, 64, 34)]:
+    render_buddhabrot(64, 300, settings, RenderOptions(-1, -1, 0, None, None, x, y, w, h, 64, 1, 0),
+                      buddha_pieces[y:, x:])
+
+# The same seed gives the same image bit for bit on any thread count
+buddha_tuning = engine.tuning()
+buddha_threads = []
+for threads in (1, 3, 4, 4):
+    profile = engine.tuning()
+    profile.threads = threads
+    engine.set_tuning(profile)
+    buddha_threads.append(render_buddhabrot(64, 300, settings)[0])
+engine.set_tuning(buddha_tuning)
+buddha_same = all(np.array_equal(image, buddha_threads[0]) for image in buddha_threads)
+print(f"   Uniform: {uniform_recorded / 2e6:.1%} of orbits recorded in {uniform_time:.2f}s")
+print(f"   Importance-sampled: {guided_recorded / 4e5:.1%} of orbits recorded in {guided_time:.2f}s")
+print(f"   Density mass error {mass_error:.3f}, median block error {block_error:.3f}")
+print(f"   Same seed on 1, 3 and 4 threads, bit-identical: {buddha_same}")
+if guided_recorded / 4e5 < 10 * uniform_recorded / 2e6:
+    print(f"   ✗ Importance sampling does not favour contributing orbits")
+    sys.exit(1)
+if mass_error > 0.03 or block_error > 0.1:
+    print(f"   ✗ Importance-sampled density differs from the uniform estimate")
+    sys.exit(1)
+if not np.allclose(buddha_pieces, buddha_whole, rtol=1e-12, atol=0):
+    print(f"   ✗ Buddhabrot regions rendered separately differ from the whole frame")
+    sys.exit(1)
+if not buddha_same:
+    print(f"   ✗ Buddhabrot image depends on the thread count")
+    sys.exit(1)
+print(f"   ✓ Buddhabrot mode works")
+
+# Test 19: Auxiliary planes from the same iteration pass
+print("\n19. Testing auxiliary output planes...")
+AUX_PLANES = 4
+
+def render_aux(bounds, width, height, max_iter, aux=True):
+    out = np.zeros((height, width), dtype=np.float64)
+    planes = [np.full((height, width), np.nan) for _ in range(AUX_PLANES)]
+    options = RenderOptions(-1, -1, 0)
+    if aux:
+        for p in range(AUX_PLANES):
+            options.aux[p] = planes[p].ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+    lib.compute_mandelbrot_str_ex(bounds[0].encode(), bounds[1].encode(), width,
+                                  bounds[2].encode(), bounds[3].encode(), height, max_iter,
+                                  out.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), ctypes.byref(options))
+    return out, planes
+
+# Shallow frame against a numpy iteration tracking the same quantities
+aux_values, aux_planes = render_aux(("-2.2", "1.2", "-1.3", "1.3"), 68, 52, 200)
+cr, ci = np.meshgrid(-2.2 + np.arange(68) * (3.4 / 68), -1.3 + np.arange(52) * (2.6 / 52))
+zr, zi, dr, di = (np.zeros_like(cr) for _ in range(4))
+trap, stripe, last = np.full(cr.shape, np.inf), np.zeros_like(cr), np.zeros_like(cr)
+expected = [np.full(cr.shape, np.nan) for _ in range(AUX_PLANES)]
+alive = np.ones(cr.shape, dtype=bool)
+np.seterr(all='ignore')
+for i in range(200):
+    modulus = zr * zr + zi * zi
+    if i > 0:
+        term = 0.5 + 0.5 * np.sin(5 * np.arctan2(zi, zr))
+        trap = np.where(alive, np.minimum(trap, modulus), trap)
+        stripe = np.where(alive, stripe + term, stripe)
+        last = np.where(alive, term, last)
+    escaped = alive & (modulus > 256)
+    smooth = i + 1.0 - np.log(np.log(modulus) / np.log(2)) / np.log(2)
+    mean = stripe / max(i, 1)
+    previous = (stripe - last) / max(i - 1, 1)
+    expected[0][escaped] = np.arctan2(zi, zr)[escaped]
+    expected[1][escaped] = (previous + (mean - previous) * (smooth - np.floor(smooth)))[escaped]
+    expected[2][escaped] = np.sqrt(trap)[escaped]
+    expected[3][escaped] = np.hypot(dr, di)[escaped]
+    alive &= ~escaped
+    dr, di = np.where(alive, 2 * (zr * dr - zi * di) + 1, dr), np.where(alive, 2 * (zr * di + zi * dr), di)
+    zr, zi = np.where(alive, zr * zr - zi * zi + cr, zr), np.where(alive, 2 * zr * zi + ci, zi)
+np.seterr(all='warn')
+escaped = aux_values >= 0
+plane_match = min(np.mean(np.isclose(aux_planes[p][escaped], expected[p][escaped], rtol=1e-9, atol=1e-12))
+                  for p in range(AUX_PLANES))
+bounded_trap = np.all(aux_planes[2][~escaped] <= 2)
+
+# Deep view around c = i against Decimal; the escape iteration is the one
+# whose smooth count the render reports
+half = Decimal("5e-21")
+deep_aux_bounds = tuple(str(v) for v in (-half, half, 1 - half, 1 + half))
+deep_values, deep_planes = render_aux(deep_aux_bounds, 24, 24, 3000)
+deep_aux_errors = []
+for py, px in [(2, 3), (5, 17), (11, 7), (19, 20), (22, 1)]:
+    x = y = dr = di = Decimal(0)
+    trap = None
+    for i in range(3010):
+        modulus = x * x + y * y
+        if i > 0:
+            trap = modulus if trap is None else min(trap, modulus)
+        if modulus > 4 and abs(i + 1.0 - np.log2(np.log2(float(modulus))) - deep_values[py, px]) < 1e-6:
+            deep_aux_errors.append(max(abs(deep_planes[2][py, px] / np.sqrt(float(trap)) - 1),
+                                       abs(deep_planes[3][py, px] / float((dr * dr + di * di).sqrt()) - 1)))
+            break
+        dr, di = 2 * (x * dr - y * di) + 1, 2 * (x * di + y * dr)
+        x, y = x * x - y * y + Decimal(px) / 24 * 2 * half - half, 2 * x * y + 1 + Decimal(py) / 24 * 2 * half - half
+unchanged = (np.array_equal(aux_values, render_aux(("-2.2", "1.2", "-1.3", "1.3"), 68, 52, 200, False)[0]) and
+             np.array_equal(deep_values, render_aux(deep_aux_bounds, 24, 24, 3000, False)[0]))
+print(f"   Shallow planes matching numpy: {plane_match:.4f}")
+deep_aux_mode = lib.get_precision_mode_ex(deep_aux_bounds[0].encode(), deep_aux_bounds[1].encode(), 24,
+                                          deep_aux_bounds[2].encode(), deep_aux_bounds[3].encode(), 24, None)
+print(f"   Deep view mode {deep_aux_mode}, "
+      f"{len(deep_aux_errors)} Decimal pixels, worst trap/derivative error {max(deep_aux_errors, default=1):.1e}")
+if plane_match < 0.99 or not bounded_trap:
+    print(f"   ✗ Auxiliary planes differ from the reference iteration")
+    sys.exit(1)
+if not unchanged:
+    print(f"   ✗ Escape values change when auxiliary planes are requested")
+    sys.exit(1)
+if len(deep_aux_errors) < 5 or max(deep_aux_errors) > 1e-6:
+    print(f"   ✗ Deep auxiliary planes differ from the Decimal reference")
+    sys.exit(1)
+print(f"   ✓ Auxiliary planes work")
+
+# Test 20: Sampled accuracy audit against brute-force quad iteration
+print("\n20. Testing accuracy audits...")
+
+def run_audit(bounds, width, height, max_iter, samples, budget_ms=0.0, cancel_after=None):
+    view = lib.render_view_create(bounds[0].encode(), bounds[1].encode(), width,
+                                  bounds[2].encode(), bounds[3].encode(), height, max_iter)
+    report = AuditReport()
+    job = lib.render_audit_start(view, samples, budget_ms, 1, ctypes.byref(report))
+    if cancel_after is not None:
+        time.sleep(cancel_after)
+        lib.render_audit_cancel(job)
+    else:
+        lib.render_audit_wait(job)
+    lib.render_view_free(view)
+    return report
+
+shallow_audit = run_audit(("-2.2", "1.2", "-1.3", "1.3"), 80, 60, 500, 256)
+# Deep view around c = i, audited as rendered at both escape intervals: the
+# reference sees each escape where the kernel does, so only rounding is left
+deep_bounds = ("-5e-21", "5e-21", "0.999999999999999999995", "1.000000000000000000005")
+audit_tuning = engine.tuning()
+deep_audits = []
+for interval in (4, 8):
+    profile = engine.tuning()
+    profile.escape_interval = interval
+    engine.set_tuning(profile)
+    deep_audits.append(run_audit(deep_bounds, 24, 24, 3000, 64))
+engine.set_tuning(audit_tuning)
+deep_audit = max(deep_audits, key=lambda r: r.max_error)
+
+# The same view with its series approximation skipping 20 iterations too many:
+# the audit has to see the error a render of it shows
+deep_view = engine.create_view(deep_bounds, 24, 24, 3000)
+blob = bytearray(engine.export_view(deep_view))
+engine.free_view(deep_view)
+skip_at = 240  # Offset of ViewBlobHeader.skip_iter
+struct.pack_into("q", blob, skip_at, struct.unpack_from("q", blob, skip_at)[0] + 20)
+skipped_view = engine.import_view(bytes(blob))
+skipped_audit = AuditReport()
+lib.render_audit_wait(lib.render_audit_start(skipped_view, 64, 0.0, 1, ctypes.byref(skipped_audit)))
+skipped_frame = engine.render_region(skipped_view, 0, 0, 24, 24, deterministic=False)
+engine.free_view(skipped_view)
+deep_frame = np.zeros((24, 24), dtype=np.float64)
+lib.compute_mandelbrot_str(*[b.encode() for b in deep_bounds[:2]], 24, *[b.encode() for b in deep_bounds[2:]], 24,
+                           3000, deep_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+skipped_shift = abs(skipped_frame[skipped_audit.worst_y, skipped_audit.worst_x] -
+                    deep_frame[skipped_audit.worst_y, skipped_audit.worst_x])
+budget_audit = run_audit(("-2.2", "1.2", "-1.3", "1.3"), 400, 300, 100000, 1 << 30, budget_ms=50.0)
+cancelled_audit = run_audit(("-2.2", "1.2", "-1.3", "1.3"), 400, 300, 100000, 1 << 30, cancel_after=0.05)
+print(f"   Shallow: {shallow_audit.pixels_checked} pixels, {shallow_audit.class_mismatches} mismatches, "
+      f"max error {shallow_audit.max_error:.1e}")
+print(f"   Deep at escape intervals 4 and 8: {deep_audit.pixels_checked} pixels, "
+      f"{deep_audit.class_mismatches} mismatches, max error {deep_audit.max_error:.1e}")
+print(f"   Series skip 20 too far: max error {skipped_audit.max_error:.3f} "
+      f"(render moved by {skipped_shift:.3f})")
+print(f"   Budget 50 ms: stopped after {budget_audit.elapsed_ms:.0f} ms, "
+      f"cancelled after {cancelled_audit.pixels_checked} pixels")
+if shallow_audit.pixels_checked != 256 or shallow_audit.class_mismatches > 0 or shallow_audit.max_error > 1e-9:
+    print(f"   ✗ Shallow audit reports errors")
+    sys.exit(1)
+if deep_audit.class_mismatches > 0 or deep_audit.escaped_both == 0 or deep_audit.max_error > 1e-6:
+    print(f"   ✗ Deep audit reports errors in an accurate render")
+    sys.exit(1)
+if skipped_audit.max_error < 1.0 or abs(skipped_audit.max_error - skipped_shift) > 1e-6:
+    print(f"   ✗ Audit misses the error of a series approximation that skips too far")
+    sys.exit(1)
+if not (budget_audit.done and cancelled_audit.done and budget_audit.elapsed_ms < 1000 and
+        cancelled_audit.pixels_checked < 1 << 30):
+    print(f"   ✗ Audit did not stop on budget or cancel")
+    sys.exit(1)
+print(f"   ✓ Accuracy audits work")
+
+# Test 21: Precision mode from the pixel spacing relative to the coordinates
+print("\n21. Testing relative precision mode selection...")
+
+def precision_of(bounds, width, height):
+    choice = PrecisionChoice()
+    mode = lib.get_precision_mode_ex(bounds[0].encode(), bounds[1].encode(), width,
+                                     bounds[2].encode(), bounds[3].encode(), height, ctypes.byref(choice))
+    return mode, choice
+
+# Widths that used to mean double: fine near the origin, glitching at distance 1,
+# and near -2 a pixel 1e-14 / 800 wide is below a double ulp
+near_i = ("-5e-13", "5e-13", "0.0000001", "0.0000001000001")
+far = ("-0.10109636384612", "-0.10109636384512", "0.95628651080864", "0.95628651080964")
+edge = ("-1.999999999999995", "-1.999999999999985", "-5e-15", "5e-15")
+precision_cases = {name: precision_of(bounds, 800, 800) for name, bounds in
+                   (("near i", near_i), ("far", far), ("edge", edge))}
+# A 1e-17 wide view near 1e-6 stays out of perturbation
+near_origin = precision_of(("1e-6", "1.00000000001e-6", "-5e-18", "5e-18"), 800, 600)
+far_audit = run_audit(far, 64, 64, 5000, 128)
+julia_view = lib.render_view_create_julia(b"-1e-9", b"1e-9", 64, b"-1e-9", b"1e-9", 64,
+                                          b"-0.8", b"0.156", 1000)
+julia_choice = PrecisionChoice()
+lib.render_view_precision(julia_view, ctypes.byref(julia_choice))
+lib.render_view_free(julia_view)
+for name, (mode, choice) in precision_cases.items():
+    print(f"   {name}: mode {mode}, reason {choice.reason}, {choice.bits_needed:.1f} bits needed")
+print(f"   1e-17 wide view near 1e-6: mode {near_origin[0]}; Julia set view scaled by |c| = {julia_choice.magnitude:.3f}")
+print(f"   Long double at 1e-12 off the origin: mean audit error {far_audit.mean_error:.1e}")
+if [mode for mode, _ in precision_cases.values()] != [0, 1, 3] or near_origin[0] != 1:
+    print(f"   ✗ Precision modes ignore where the view is")
+    sys.exit(1)
+if ([choice.reason for _, choice in precision_cases.values()] != [0, 1, 2] or
+        abs(julia_choice.magnitude - np.hypot(0.8, 0.156)) > 1e-12 or julia_choice.mode != 0):
+    print(f"   ✗ Precision choice reported wrongly")
+    sys.exit(1)
+if far_audit.class_mismatches > 0 or far_audit.mean_error > 1e-3:
+    print(f"   ✗ Chosen mode is not accurate enough")
+    sys.exit(1)
+print(f"   ✓ Relative precision selection works")
+
+# Test 22: Chrome trace-event timelines
+print("\n22. Testing render timelines...")
+trace_bounds = [b.encode() for b in ("-0.743643887037158704752191506114774", "-0.743643887037158704752191506114764",
+                                      "0.131825904205311970493132056385139", "0.131825904205311970493132056385149")]
+trace = lib.render_trace_create(0)
+trace_frame = np.zeros(200 * 150, dtype=np.float64)
+lib.compute_mandelbrot_str_ex(trace_bounds[0], trace_bounds[1], 200, trace_bounds[2], trace_bounds[3], 150, 3000,
+                              trace_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                              ctypes.byref(RenderOptions(-1, -1, 32, trace=trace)))
+with tempfile.TemporaryDirectory() as trace_dir:
+    trace_path = f"{trace_dir}/render.json"
+    spans_written = lib.render_trace_write(trace, trace_path.encode())
+    with open(trace_path) as f:
+        timeline = json.load(f)["traceEvents"]
+trace_dropped = lib.render_trace_dropped(trace)
+lib.render_trace_free(trace)
+
+# A buffer of two spans per thread keeps the first two of each and counts the rest
+small_trace = lib.render_trace_create(2)
+lib.compute_mandelbrot_str_ex(trace_bounds[0], trace_bounds[1], 200, trace_bounds[2], trace_bounds[3], 150, 3000,
+                              trace_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                              ctypes.byref(RenderOptions(-1, -1, 32, trace=small_trace)))
+small_dropped = lib.render_trace_dropped(small_trace)
+lib.render_trace_free(small_trace)
+
+# A background refine job and a foreground render into one timeline, with more
+# threads than when it was created: one track per OS thread, so no track has
+# overlapping tiles, and every span is kept
+trace_tuning = engine.tuning()
+profile = engine.tuning()
+profile.threads = 1
+engine.set_tuning(profile)
+shared_trace = lib.render_trace_create(0)
+profile.threads = 4
+engine.set_tuning(profile)
+refined_frame = np.zeros(200 * 150, dtype=np.float64)
+shared_job = lib.compute_mandelbrot_str_budget(
+    trace_bounds[0], trace_bounds[1], 200, trace_bounds[2], trace_bounds[3], 150, 3000, 1.0, 1,
+    refined_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+    ctypes.byref(RenderOptions(-1, -1, 32, trace=shared_trace)), None)
+lib.compute_mandelbrot_str_ex(trace_bounds[0], trace_bounds[1], 200, trace_bounds[2], trace_bounds[3], 150, 3000,
+                              trace_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                              ctypes.byref(RenderOptions(-1, -1, 32, trace=shared_trace)))
+if shared_job:
+    lib.render_job_wait(shared_job)
+engine.set_tuning(trace_tuning)
+with tempfile.TemporaryDirectory() as trace_dir:
+    lib.render_trace_write(shared_trace, f"{trace_dir}/shared.json".encode())
+    with open(f"{trace_dir}/shared.json") as f:
+        shared_tiles = [e for e in json.load(f)["traceEvents"] if e["ph"] == "X" and e["name"] == "tile"]
+shared_dropped = lib.render_trace_dropped(shared_trace)
+lib.render_trace_free(shared_trace)
+tracks = collections.defaultdict(list)
+for e in shared_tiles:
+    tracks[e["tid"]].append((e["ts"], e["ts"] + e["dur"]))
+overlapping = sum(b[0] < a[1] - 1e-3 for t in tracks.values() for a, b in zip(sorted(t), sorted(t)[1:]))
+
+spans = [e for e in timeline if e["ph"] == "X"]
+by_name = collections.Counter(e["name"] for e in spans)
+render_span = next(e for e in spans if e["name"] == "render")
+tiles = [e for e in spans if e["name"] == "tile"]
+inside = all(render_span["ts"] <= e["ts"] and e["ts"] + e["dur"] <= render_span["ts"] + render_span["dur"] + 1e-3
+             for e in spans)
+print(f"   {spans_written} spans: {dict(by_name)}")
+print(f"   Reference orbit {next(e for e in spans if e['name'] == 'reference orbit')['args']['iterations']} "
+      f"iterations, {sum(e['dur'] for e in tiles) / render_span['dur']:.0%} of the render in tiles")
+print(f"   Refine job and caller: {len(shared_tiles)} tiles on {len(tracks)} threads, "
+      f"{overlapping} overlapping, {shared_dropped} dropped")
+if (spans_written != len(spans) or trace_dropped or
+        any(by_name[n] != 1 for n in ("render", "setup", "reference orbit", "series approximation"))):
+    print(f"   ✗ Timeline is missing spans")
+    sys.exit(1)
+if sum(e["args"]["width"] * e["args"]["height"] for e in tiles) != 200 * 150 or not inside:
+    print(f"   ✗ Tile spans do not cover the frame inside the render span")
+    sys.exit(1)
+if not 0 < small_dropped <= spans_written - 2:
+    print(f"   ✗ Full trace buffers are not counted")
+    sys.exit(1)
+if shared_dropped or overlapping or len(shared_tiles) < 2 * len(tiles):
+    print(f"   ✗ Threads of a refine job and its caller share trace tracks")
+    sys.exit(1)
+print(f"   ✓ Render timelines work")
+
+# Test 23: USDT probes, present when the build found <sys/sdt.h>
+print("\n23. Testing USDT probes...")
+import shutil
+import subprocess
+expected_probes = {"render__start", "render__done", "precision__mode", "orbit__done", "series__skip", "tile__done",
+                   "frame__plan"}
+if shutil.which("readelf") is None:
+    print(f"   readelf not found, skipped")
+else:
+    notes = subprocess.run(["readelf", "-n", lib._name], capture_output=True, text=True).stdout
+    probes = {line.split(":", 1)[1].strip() for line in notes.splitlines() if line.strip().startswith("Name:")}
+    provider = {line.split(":", 1)[1].strip() for line in notes.splitlines() if line.strip().startswith("Provider:")}
+    if not probes:
+        print(f"   Built without <sys/sdt.h>: probes compiled out")
+    elif provider != {"mandelbrot"} or probes != expected_probes:
+        print(f"   ✗ Unexpected probes {sorted(probes)} of {sorted(provider)}")
+        sys.exit(1)
+    else:
+        print(f"   {len(probes)} probes: {', '.join(sorted(probes))}")
+print(f"   ✓ USDT probes work")
+
+# Test 24: Process-wide metrics and their Prometheus exposition
+print("\n24. Testing engine metrics...")
+
+def metrics_now():
+    m = EngineMetrics()
+    lib.render_metrics_snapshot(ctypes.byref(m))
+    return m
+
+before = metrics_now()
+shallow_frame = np.zeros(160 * 120, dtype=np.float64)
+lib.compute_mandelbrot_str(b"-2.2", b"1.2", 160, b"-1.3", b"1.3", 120, 500,
+                           shallow_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)))
+with tempfile.TemporaryDirectory() as metrics_cache:
+    lib.render_set_orbit_cache(metrics_cache.encode())
+    for _ in range(2):  # Miss, then hit
+        lib.compute_mandelbrot_str_ex(trace_bounds[0], trace_bounds[1], 200, trace_bounds[2], trace_bounds[3], 150,
+                                      3000, trace_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), None)
+    lib.render_set_orbit_cache(None)
+after = metrics_now()
+
+size = lib.render_metrics_format(None, 0)
+text_buffer = ctypes.create_string_buffer(size)
+exposition = text_buffer.value.decode() if lib.render_metrics_format(text_buffer, size) == size else ""
+samples = {}
+for line in exposition.splitlines():
+    if line and not line.startswith("#"):
+        name, value = line.rsplit(" ", 1)
+        samples[name] = float(value)
+# Iterations the kernels ran: the escape count less the series approximation's
+# share, the reference orbit's length less that share for bounded perturbation
+# pixels, and none for those the cardioid test settles
+def iterations_run(frame, bounded, skipped=0, cardioid=None):
+    escaped = frame >= 0
+    counts = np.where(escaped, np.maximum(frame.astype(np.int64) - skipped, 0), bounded - skipped)
+    if cardioid is not None:
+        counts[~escaped & cardioid] = 0
+    return int(np.sum(counts))
+
+shallow_re, shallow_im = np.meshgrid(-2.2 + 3.4 / 160 * np.arange(160), -1.3 + 2.6 / 120 * np.arange(120))
+shallow_q = (shallow_re - 0.25) ** 2 + shallow_im ** 2
+shallow_cardioid = (shallow_q * (shallow_q + (shallow_re - 0.25)) < 0.25 * shallow_im ** 2).ravel()
+trace_ref = (after.reference_iterations - before.reference_iterations) // 2
+trace_skip = (after.series_skipped_iterations - before.series_skipped_iterations) // 2
+expected_iterations = (iterations_run(shallow_frame, 500, cardioid=shallow_cardioid) +
+                       2 * iterations_run(trace_frame, trace_ref, trace_skip))
+print(f"   Renders by mode {[after.renders[m] - before.renders[m] for m in range(4)]}, "
+      f"{after.iterations - before.iterations:,} iterations, "
+      f"cache {after.orbit_cache_hits - before.orbit_cache_hits} hit / "
+      f"{after.orbit_cache_misses - before.orbit_cache_misses} miss")
+print(f"   Series approximation skipped {after.series_skipped_iterations - before.series_skipped_iterations} "
+      f"of {after.reference_iterations - before.reference_iterations} reference iterations; "
+      f"{len(samples)} exposition samples")
+if ([after.renders[m] - before.renders[m] for m in range(4)] != [1, 0, 0, 2] or
+        after.pixels - before.pixels != 160 * 120 + 2 * 200 * 150 or
+        after.iterations - before.iterations != expected_iterations):
+    print(f"   ✗ Render counters are off")
+    sys.exit(1)
+if (after.orbit_cache_hits - before.orbit_cache_hits != 1 or after.orbit_cache_misses - before.orbit_cache_misses != 1 or
+        after.orbit_build_seconds.count - before.orbit_build_seconds.count != 1 or
+        after.render_seconds.count - before.render_seconds.count != 3 or
+        sum(after.render_seconds.buckets) != after.render_seconds.count):
+    print(f"   ✗ Cache or latency counters are off")
+    sys.exit(1)
+if (samples.get('mandelbrot_renders_total{mode="perturbation"}') != after.renders[3] or
+        samples.get('mandelbrot_render_duration_seconds_bucket{le="+Inf"}') !=
+        samples.get("mandelbrot_render_duration_seconds_count") or "mandelbrot_iterations_total" not in samples):
+    print(f"   ✗ Prometheus exposition is malformed")
+    sys.exit(1)
+print(f"   ✓ Engine metrics work")
+
+# Test 25: Per-frame strategy from a probe render and a cost model
+print("\n25. Testing cost-model strategy selection...")
+
+def render_planned(bounds, width, height, max_iter, **fields):
+    frame = np.zeros(width * height, dtype=np.float64)
+    plan = FramePlan()
+    options = RenderOptions(-1, -1, plan=ctypes.cast(ctypes.pointer(plan), ctypes.c_void_p), **fields)
+    start = time.perf_counter()
+    lib.compute_mandelbrot_str_ex(bounds[0], bounds[1], width, bounds[2], bounds[3], height, max_iter,
+                                  frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), ctypes.byref(options))
+    return frame, plan, time.perf_counter() - start
+
+# A 1e-12 wide view near -2: long double by pixel spacing, bounded at the centre
+needle = (b"-1.9999991175878805", b"-1.9999991175868805", b"-0.000000000000375", b"0.000000000000375")
+fixed_frame, _, fixed_time = render_planned(needle, 400, 300, 3000)
+auto_frame, plan, auto_time = render_planned(needle, 400, 300, 3000, strategy=STRATEGY_AUTO)
+_, kept_plan, _ = render_planned(needle, 400, 300, 3000, strategy=STRATEGY_AUTO, deterministic=1)
+_, sized_plan, _ = render_planned(needle, 400, 300, 3000, strategy=STRATEGY_AUTO, tile_size=32)
+shallow_fixed, _, _ = render_planned((b"-2.2", b"1.2", b"-1.3", b"1.3"), 320, 240, 500)
+shallow_auto, shallow_plan, _ = render_planned((b"-2.2", b"1.2", b"-1.3", b"1.3"), 320, 240, 500,
+                                               strategy=STRATEGY_AUTO)
+class_changes = np.mean((fixed_frame < 0) != (auto_frame < 0))
+print(f"   Probe of {plan.probe_samples} samples every {plan.probe_scale} px in {plan.probe_ms:.1f} ms: "
+      f"interior {plan.interior_fraction:.2f}, mean {plan.mean_iterations:.0f} iterations, cv {plan.iteration_cv:.2f}, "
+      f"escapes p50 {plan.escape_p50:.0f} / p90 {plan.escape_p90:.0f}")
+print(f"   Mode {plan.fixed_mode} -> {plan.mode}, tile {plan.tile_size}: predicted {plan.predicted_ms:.0f} ms "
+      f"(other mode {plan.alternative_ms:.0f} ms), actual {plan.actual_ms:.0f} ms; "
+      f"frame {fixed_time * 1000:.0f} -> {auto_time * 1000:.0f} ms")
+if plan.fixed_mode != 1 or plan.mode != 3 or not 0 < plan.predicted_ms < plan.alternative_ms:
+    print(f"   ✗ The cost model kept the slower mode")
+    sys.exit(1)
+if plan.actual_ms <= 0 or plan.tile_size % 16 or not 0 < plan.mean_iterations <= 3000 or class_changes > 0.001:
+    print(f"   ✗ Plan figures or the planned frame are off ({class_changes:.4f} class changes)")
+    sys.exit(1)
+if kept_plan.mode != 1 or sized_plan.tile_size != 32:
+    print(f"   ✗ Deterministic renders or fixed tile sizes were overridden")
+    sys.exit(1)
+if shallow_plan.mode != 0 or shallow_plan.alternative_ms != 0 or not np.array_equal(shallow_fixed, shallow_auto):
+    print(f"   ✗ Double precision frames changed under the planner")
+    sys.exit(1)
+print(f"   ✓ Cost-model strategy selection works")
+
+# Test 26: Host tuning profiles, loaded at startup and written by the autotuner
+print("\n26. Testing tuning profiles...")
+import autotune
+lib.render_tuning_load.argtypes = [ctypes.c_char_p]
+lib.render_tuning_load.restype = ctypes.c_int
+lib.render_tuning_save.argtypes = [ctypes.c_char_p]
+lib.render_tuning_save.restype = ctypes.c_int
+
+host_tuning = engine.tuning()  # Restored at the end
+deep_spiral = (b"-0.74364388703715920", b"-0.74364388703714920", b"0.13182590420530825", b"0.13182590420531575")
+
+def render_tuned(bounds, max_iter, deterministic=0, **settings):
+    profile = engine.tuning()
+    for name, value in settings.items():
+        setattr(profile, name, value)
+    engine.set_tuning(profile)
+    frame = np.zeros(240 * 180, dtype=np.float64)
+    lib.compute_mandelbrot_str_ex(bounds[0], bounds[1], 240, bounds[2], bounds[3], 180, max_iter,
+                                  frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                                  ctypes.byref(RenderOptions(-1, -1, 0, deterministic=deterministic)))
+    return frame
+
+shallow = (b"-0.75", b"-0.74", b"0.10", b"0.11")
+groups_match = np.array_equal(render_tuned(shallow, 1000, direct_groups=2, threads=0),
+                              render_tuned(shallow, 1000, direct_groups=1, threads=1))
+interval_4 = render_tuned(deep_spiral, 3000, escape_interval=4)
+interval_8 = render_tuned(deep_spiral, 3000, escape_interval=8)
+interval_shift = np.max(np.abs(interval_4 - interval_8))
+# Sparse and masked evaluation take the tuned interval too, so a masked
+# refinement does not mix values of both intervals in one image
+perturbed = tuple(bound.encode() for bound in sparse_view)
+perturbed_4 = render_tuned(perturbed, sparse_iter, escape_interval=4)
+perturbed_8 = render_tuned(perturbed, sparse_iter, escape_interval=8)
+perturbed_view = lib.render_view_create(perturbed[0], perturbed[1], 240, perturbed[2], perturbed[3], 180, sparse_iter)
+perturbed_picked = np.random.default_rng(8).choice(240 * 180, 500, replace=False)
+perturbed_xs = (perturbed_picked % 240).astype(np.float64)
+perturbed_ys = (perturbed_picked // 240).astype(np.float64)
+perturbed_points = np.zeros(perturbed_picked.size, dtype=np.float64)
+lib.render_view_points(perturbed_view, perturbed_xs.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                       perturbed_ys.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), perturbed_picked.size,
+                       perturbed_points.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), None)
+perturbed_mask = np.zeros(240 * 180, dtype=np.uint8)
+perturbed_mask[perturbed_picked] = 1
+perturbed_masked = np.zeros(240 * 180, dtype=np.float64)
+lib.render_view_masked(perturbed_view, perturbed_mask.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)),
+                       perturbed_masked.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), None)
+lib.render_view_free(perturbed_view)
+points_match = (np.allclose(perturbed_points, perturbed_8[perturbed_picked], rtol=1e-9, atol=0.0) and
+                np.allclose(perturbed_masked[perturbed_picked], perturbed_8[perturbed_picked], rtol=1e-9, atol=0.0))
+deterministic_match = np.array_equal(render_tuned(deep_spiral, 3000, 1, escape_interval=4),
+                                     render_tuned(deep_spiral, 3000, 1, escape_interval=8))
+
+bad = engine.tuning()
+bad.direct_groups, bad.escape_interval, bad.tile_size = 3, 5, 96
+accepted_bad = engine.set_tuning(bad)
+cleaned = engine.tuning()
+with tempfile.TemporaryDirectory() as tuning_dir:
+    profile_path = os.path.join(tuning_dir, "tuning-test.conf")
+    wanted = engine.tuning()
+    wanted.tile_size, wanted.threads, wanted.direct_groups, wanted.escape_interval = 32, 1, 1, 8
+    wanted.iteration_ns[3] = 1.75
+    engine.set_tuning(wanted)
+    engine.save_tuning(profile_path)
+    tiles_at_32 = lib.render_tile_count(256, 256, 0)
+    engine.set_tuning(host_tuning)
+    loaded = lib.render_tuning_load(profile_path.encode())
+    reloaded = engine.tuning()
+    missing = lib.render_tuning_load(os.path.join(tuning_dir, "absent.conf").encode())
+    # A fresh process picks the profile up as the library loads
+    child = subprocess.run([sys.executable, "-c",
+                            "import ctypes, sys; lib = ctypes.CDLL(sys.argv[1]); "
+                            "print(lib.render_tile_count(256, 256, 0))", lib_path],
+                           capture_output=True, text=True, env=dict(os.environ, MANDELBROT_TUNING=profile_path))
+    startup_tiles = int(child.stdout.strip() or 0)
+    engine.set_tuning(host_tuning)
+    tuned = autotune.autotune(engine, repeat=1, scale=0.25, log=lambda line: None)
+    engine.set_tuning(host_tuning)
+
+print(f"   Interleave and threads bit-identical: {groups_match}; escape interval 8 moves smooth values "
+      f"by up to {interval_shift:.3f}, deterministic renders unchanged: {deterministic_match}")
+print(f"   Perturbation at interval 8 moves smooth values by up to "
+      f"{np.max(np.abs(perturbed_4 - perturbed_8)):.3f}; sparse and masked values match the dense render: {points_match}")
+print(f"   Profile round trip: tile {reloaded.tile_size}, threads {reloaded.threads}, groups {reloaded.direct_groups}, "
+      f"interval {reloaded.escape_interval}, perturbation {reloaded.iteration_ns[3]} ns; "
+      f"startup load {startup_tiles} tiles of 32")
+print(f"   Quick autotune: {autotune.describe(tuned)}")
+if not groups_match or not deterministic_match or interval_shift >= 1.0:
+    print(f"   ✗ Kernel variants changed results they must not")
+    sys.exit(1)
+if not points_match:
+    print(f"   ✗ Sparse or masked evaluation ignores the tuned escape interval")
+    sys.exit(1)
+if accepted_bad or (cleaned.direct_groups, cleaned.escape_interval, cleaned.tile_size) != (2, 4, 96):
+    print(f"   ✗ Out-of-range settings were not defaulted")
+    sys.exit(1)
+if (not loaded or missing or tiles_at_32 != 64 or startup_tiles != 64 or
+        (reloaded.tile_size, reloaded.threads, reloaded.direct_groups, reloaded.escape_interval) != (32, 1, 1, 8) or
+        abs(reloaded.iteration_ns[3] - 1.75) > 1e-9):
+    print(f"   ✗ Profiles do not round-trip")
+    sys.exit(1)
+if tuned.direct_groups not in (1, 2) or tuned.escape_interval not in (4, 8) or tuned.tile_size not in autotune.TILE_SIZES:
+    print(f"   ✗ Autotuner chose settings outside its candidates")
+    sys.exit(1)
+print(f"   ✓ Tuning profiles work")
+
+# Test 27: Memory accounting by subsystem, and a hard budget
+print("\n27. Testing memory accounting...")
+from engine import MEMORY_CACHE, MEMORY_ORBIT, MEMORY_SCRATCH, MEMORY_STAGING
+lib.render_memory_reset_peak.argtypes = []
+lib.render_memory_reset_peak.restype = None
+
+def orbit_blob_points(blob):
+    return (len(blob) - 272) // 16  # ViewBlobHeader, then the double orbit
+
+# Orbits keep only their double rounding, trimmed when the reference escapes early
+early_view = ("0.36024044343761436323612524444", "0.36024044343761436323612524445",
+              "-0.64131306106480317486037501518", "-0.64131306106480317486037501517")
+full_view = ("0.2500000000000100", "0.2500000000000101", "0.0000000000000000", "0.0000000000000001")
+lib.render_memory_reset_peak()
+before = engine.memory_usage()
+early = engine.create_view(early_view, 200, 150, 200000)
+early_bytes = engine.memory_usage().bytes[MEMORY_ORBIT] - before.bytes[MEMORY_ORBIT]
+early_blob = engine.export_view(early)
+full = engine.create_view(full_view, 200, 150, 200000)
+full_bytes = engine.memory_usage().bytes[MEMORY_ORBIT] - before.bytes[MEMORY_ORBIT] - early_bytes
+engine.free_view(full)
+engine.free_view(early)
+after = engine.memory_usage()
+early_points = orbit_blob_points(early_blob)
+
+# Over the budget: an orbit that does not fit up front is grown as it goes,
+# and one that never fits is refused
+engine.set_memory_budget(after.total + 2 * 1024 * 1024)
+budget_early = engine.create_view(early_view, 200, 150, 200000)
+streamed_blob = engine.export_view(budget_early)
+engine.free_view(budget_early)
+try:
+    engine.free_view(engine.create_view(full_view, 200, 150, 2000000))
+    refused_view = False
+except MemoryError:
+    refused_view = True
+orbit_budget = engine.memory_usage()
+
+# Buddhabrot within a budget: narrower bands and retraced orbits, same image,
+# also when the two renders run on different thread counts
+buddha_settings = BuddhabrotOptions(50000, 0, 3, 128)
+buddha_tuning = engine.tuning()
+profile = engine.tuning()
+profile.threads = 4
+engine.set_tuning(profile)
+engine.set_memory_budget(0)
+buddha_free, buddha_free_recorded = render_buddhabrot(150, 5000, buddha_settings)
+profile.threads = 3
+engine.set_tuning(profile)
+engine.set_memory_budget(engine.memory_usage().total + 100000)
+buddha_tight, buddha_tight_recorded = render_buddhabrot(150, 5000, buddha_settings)
+buddha_budget = engine.memory_usage()
+engine.set_tuning(buddha_tuning)
+
+# Callers charge what they keep on the engine's behalf to the same budget
+fits = engine.reserve_memory(MEMORY_CACHE, 50000)
+too_big = engine.reserve_memory(MEMORY_CACHE, 10 ** 9)
+charged = engine.memory_usage().bytes[MEMORY_CACHE]
+engine.release_memory(MEMORY_CACHE, 50000)
+engine.set_memory_budget(0)
+
+# Trace event buffers are charged as threads claim their tracks, until the trace is freed
+trace_event_bytes = 1000 * 56 + 64  # 1000 TraceEvents and the block header
+scratch_before = engine.memory_usage().bytes[MEMORY_SCRATCH]
+memory_trace = lib.render_trace_create(1000)
+lib.compute_mandelbrot_str_ex(trace_bounds[0], trace_bounds[1], 200, trace_bounds[2], trace_bounds[3], 150, 3000,
+                              trace_frame.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                              ctypes.byref(RenderOptions(-1, -1, 32, trace=memory_trace)))
+trace_held = engine.memory_usage().bytes[MEMORY_SCRATCH] - scratch_before
+lib.render_trace_free(memory_trace)
+trace_released = engine.memory_usage().bytes[MEMORY_SCRATCH] == scratch_before
+exposition = engine.metrics_text()
+final = engine.memory_usage()
+
+print(f"   Orbits: {early_points} of 200000 points held in {early_bytes:,} bytes, full orbit {full_bytes:,} bytes; "
+      f"peak {after.peak[MEMORY_ORBIT]:,}")
+print(f"   Budget: {orbit_budget.streamed - after.streamed} orbit streamed, refused 2M-point orbit: {refused_view}; "
+      f"Buddhabrot streamed {buddha_budget.streamed - orbit_budget.streamed}, same image: "
+      f"{np.array_equal(buddha_free, buddha_tight)}")
+print(f"   Trace buffers: {trace_held:,} scratch bytes while the trace lives, released: {trace_released}")
+print(f"   Held now: {[final.bytes[s] for s in range(4)]}, peaks {[final.peak[s] for s in range(4)]}")
+if (early_bytes != 2 * (8 * (early_points + 1) + 64) or full_bytes != 2 * (8 * 200001 + 64) or
+        after.bytes[MEMORY_ORBIT] != before.bytes[MEMORY_ORBIT] or after.peak[MEMORY_ORBIT] < early_bytes + full_bytes):
+    print(f"   ✗ Orbit memory is not accounted as held")
+    sys.exit(1)
+if (streamed_blob != early_blob or not refused_view or orbit_budget.streamed - after.streamed != 1 or
+        orbit_budget.refused <= after.refused or orbit_budget.total > orbit_budget.budget):
+    print(f"   ✗ Orbits do not respect the memory budget")
+    sys.exit(1)
+if (not np.array_equal(buddha_free, buddha_tight) or buddha_free_recorded != buddha_tight_recorded or
+        buddha_budget.streamed - orbit_budget.streamed != 1 or buddha_budget.peak[MEMORY_STAGING] <= 0 or
+        buddha_budget.peak[MEMORY_SCRATCH] <= 0):
+    print(f"   ✗ Buddhabrot does not fall back to streaming within the budget")
+    sys.exit(1)
+if (not fits or too_big or charged < 50000 or final.budget != 0 or
+        final.bytes[MEMORY_ORBIT] != before.bytes[MEMORY_ORBIT] or final.bytes[MEMORY_SCRATCH] != 0 or
+        final.bytes[MEMORY_STAGING] != 0 or 'mandelbrot_memory_bytes{subsystem="orbit"}' not in exposition):
+    print(f"   ✗ Memory is not released or reported")
+    sys.exit(1)
+if trace_held <= 0 or trace_held % trace_event_bytes or not trace_released:
+    print(f"   ✗ Trace buffers are not charged to the scratch subsystem")
+    sys.exit(1)
+print(f"   ✓ Memory accounting works")
+
 print("\n✅ All tests passed! Optimizations are working correctly.")